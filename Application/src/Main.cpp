@@ -12,7 +12,8 @@ int main()
 		2) LearnOGL()\n\
 		3) LightCasters5_4 (learnopengl.com)\n\
 		4) Depth testing (learnopengl.com)\n\
-		5) Stencil testing (learnopengl.com)" << std::endl;
+		5) Stencil testing (learnopengl.com)\n\
+		6) Build asset pack" << std::endl;
 	std::cin >> choice;
 
 	if (choice == 1)
@@ -25,6 +26,8 @@ int main()
     Depth_testing_main();
   else if (choice == 5)
    Stencil_testing_main();
+  else if (choice == 6)
+    BuildAssetPack();
 
 	NullEngine::ReleaseEngine(e);
 	//std::cin.get();
@@ -0,0 +1,7 @@
+#include "IEngine.h"
+
+// nullengine-cook: see AssetCooker.h, run from the engine's working directory (Application/)
+int main(int argc, char** argv)
+{
+  return CookAssets(argc, argv);
+}
@@ -1,15 +1,20 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
+// instanced meshes: model space translation per instance
+layout (location = 3) in vec3 aInstanceOffset;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// quantized meshes: AABB relative unorm16 positions
+uniform vec3 posOffset = vec3(0.0);
+uniform vec3 posScale = vec3(1.0);
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
+    gl_Position = projection * view * model * vec4(posOffset + aPos * posScale + aInstanceOffset, 1.0f);
 }
\ No newline at end of file
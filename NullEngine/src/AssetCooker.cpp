@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include "AssetCooker.h"
+#include "Hash.h"
+#include "IEngine.h"
+#include "MappedFile.h"
+#include "Model.h"
+#include "Texture.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+using Clock = std::chrono::high_resolution_clock;
+
+double MsSince(Clock::time_point t)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// what Model loads through the mesh cache (glTF is drawn in place) and what stb decodes
+const char* const ModelExtensions[] = {"obj", "fbx", "dae", "3ds", "ply", "stl"};
+const char* const ImageExtensions[] = {"png", "jpg", "jpeg", "tga", "bmp", "psd", "gif"};
+
+template<size_t N>
+bool HasExtension(const std::string& path, const char* const (&extensions)[N])
+{
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos)
+    return false;
+  std::string lower = path.substr(dot + 1);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return std::find_if(std::begin(extensions), std::end(extensions), [&](const char* e) { return lower == e; }) != std::end(extensions);
+}
+
+std::string Normalize(const std::string& path)
+{
+  return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+std::string Relative(const std::string& path, const std::string& root)
+{
+  return std::filesystem::path(path).lexically_relative(root).generic_string();
+}
+
+// a material texture as Model::LoadMaterialTextures resolves it: relative to the model's directory
+std::string TexturePath(const std::string& model, const std::string& reference)
+{
+  return Normalize(model.substr(0, model.find_last_of('/')) + "/" + reference);
+}
+
+std::vector<std::string> Split(const std::string& line)
+{
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (size_t tab; (tab = line.find('\t', start)) != std::string::npos; start = tab + 1)
+    fields.push_back(line.substr(start, tab - start));
+  fields.push_back(line.substr(start));
+  return fields;
+}
+
+} // namespace
+
+// Manifest, one tab separated record per line (paths may contain spaces):
+//   NECOOK <version>
+//   file <path> <size> <mtime> <content hash>
+//   model <path> <process flags> <flip>
+//   dep <path>            - file the importer read for the model above
+//   tex <type> <path>     - texture reference of the model above, relative to its directory
+//   image <path> <flip> <usage>
+//   flip <path>           - relative to root
+bool AssetCooker::ReadManifest(const std::string& path, Manifest& manifest)
+{
+  std::ifstream in(path);
+  std::string line;
+  if (!in || !std::getline(in, line) || line != "NECOOK\t" + std::to_string(ManifestVersion))
+    return false;
+
+  ModelRecord* model = nullptr;
+  try
+  {
+    while (std::getline(in, line))
+    {
+      std::vector<std::string> f = Split(line);
+      if (f[0] == "file" && f.size() == 5)
+      {
+        FileRecord& record = manifest.files[f[1]];
+        record.size = std::stoull(f[2]);
+        record.mtime = std::stoll(f[3]);
+        record.hash = std::stoull(f[4], nullptr, 16);
+      }
+      else if (f[0] == "model" && f.size() == 4)
+      {
+        model = &manifest.models[f[1]];
+        model->processFlags = (unsigned)std::stoul(f[2]);
+        model->flip = f[3] == "1";
+      }
+      else if (f[0] == "dep" && f.size() == 2 && model)
+        model->dependencies.push_back(f[1]);
+      else if (f[0] == "tex" && f.size() == 3 && model)
+        model->textures.push_back({f[1], f[2]});
+      else if (f[0] == "image" && f.size() == 4)
+        manifest.images[f[1]] = {f[2] == "1", (TextureUsage)std::stoi(f[3])};
+      else if (f[0] == "flip" && f.size() == 2)
+        manifest.flip.insert(f[1]);
+    }
+  }
+  catch (const std::exception&)
+  {
+    // a damaged manifest only costs a full rebuild
+    std::cout << "ERROR::COOK::Bad manifest line in " << path << ": " << line << std::endl;
+    manifest = Manifest();
+    return false;
+  }
+  return true;
+}
+
+bool AssetCooker::WriteManifest(const std::string& path, const Manifest& manifest)
+{
+  // written next to it and renamed, an interrupted run keeps the previous graph
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::trunc);
+    if (!out)
+    {
+      std::cout << "ERROR::COOK::Cannot write " << tmpPath << std::endl;
+      return false;
+    }
+    out << "NECOOK\t" << ManifestVersion << '\n';
+    for (const auto& [file, record] : manifest.files)
+      out << "file\t" << file << '\t' << record.size << '\t' << record.mtime << '\t' << std::hex << record.hash << std::dec << '\n';
+    for (const auto& [model, record] : manifest.models)
+    {
+      out << "model\t" << model << '\t' << record.processFlags << '\t' << (record.flip ? 1 : 0) << '\n';
+      for (const auto& dependency : record.dependencies)
+        out << "dep\t" << dependency << '\n';
+      for (const auto& texture : record.textures)
+        out << "tex\t" << texture.type << '\t' << texture.path << '\n';
+    }
+    for (const auto& [image, record] : manifest.images)
+      out << "image\t" << image << '\t' << (record.flip ? 1 : 0) << '\t' << (int)record.usage << '\n';
+    for (const auto& flip : manifest.flip)
+      out << "flip\t" << flip << '\n';
+    if (!out)
+      return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    std::cout << "ERROR::COOK::Cannot replace " << path << ": " << ec.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+CookReport AssetCooker::Cook(const CookOptions& options)
+{
+  auto t = Clock::now();
+  CookReport report;
+  ThreadPool& pool = ThreadPool::Instance();
+  const std::string root = Normalize(options.root);
+  const std::string manifestPath = options.manifest.empty() ? root + "/cook.manifest" : options.manifest;
+
+  Manifest previous;
+  ReadManifest(manifestPath, previous);
+  Manifest next;
+  next.flip = previous.flip;
+  for (const auto& path : options.flip)
+    next.flip.insert(Normalize(path));
+  for (const auto& path : options.unflip)
+    next.flip.erase(Normalize(path));
+
+  std::vector<std::string> models, images;
+  std::error_code ec;
+  for (std::filesystem::recursive_directory_iterator it(root, ec), end; it != end; it.increment(ec))
+  {
+    if (ec)
+      break;
+    if (!it->is_regular_file(ec))
+      continue;
+    const std::string path = it->path().generic_string();
+    if (HasExtension(path, ModelExtensions))
+      models.push_back(path);
+    else if (HasExtension(path, ImageExtensions))
+      images.push_back(path);
+  }
+  std::sort(models.begin(), models.end());
+  std::sort(images.begin(), images.end());
+  if (ec)
+    std::cout << "ERROR::COOK::Cannot walk " << root << ": " << ec.message() << std::endl;
+
+  // content hashes: reused from the manifest while size and mtime match, read otherwise
+  auto hashFiles = [&](const std::vector<std::string>& paths)
+  {
+    std::set<std::string> unique;
+    std::vector<std::string> todo;
+    for (const auto& path : paths)
+      if (!next.files.count(path) && unique.insert(path).second)
+        todo.push_back(path);
+    std::vector<FileRecord> records(todo.size());
+    std::vector<char> found(todo.size(), 0), hashed(todo.size(), 0);
+    pool.ParallelFor(todo.size(), [&](size_t i)
+    {
+      FileStamp stamp;
+      if (!MeshCache::Stamp(todo[i], stamp))
+        return;
+      FileRecord& record = records[i];
+      record.size = stamp.size;
+      record.mtime = stamp.mtime;
+      auto known = previous.files.find(todo[i]);
+      if (!options.force && known != previous.files.end() && known->second.size == record.size && known->second.mtime == record.mtime)
+        record.hash = known->second.hash;
+      else
+      {
+        MappedFile file(todo[i]);
+        if (record.size && !file.IsOpen())
+          return;
+        record.hash = HashBytes(file.Data(), file.Size());
+        hashed[i] = 1;
+      }
+      found[i] = 1;
+    });
+    for (size_t i = 0; i < todo.size(); ++i)
+    {
+      if (found[i])
+        next.files[todo[i]] = records[i];
+      report.hashed += hashed[i];
+    }
+  };
+  // missing now, new, or different content than last run
+  auto changed = [&](const std::string& path)
+  {
+    auto now = next.files.find(path);
+    auto before = previous.files.find(path);
+    return now == next.files.end() || before == previous.files.end() || now->second.hash != before->second.hash;
+  };
+  std::mutex printMutex;
+  auto print = [&](const std::string& message)
+  {
+    std::lock_guard<std::mutex> lock(printMutex);
+    std::cout << message << std::endl;
+  };
+
+  // models - the mesh cache is keyed on what LoadModel uses by default
+  const unsigned flags = ModelLoad_Default;
+  const unsigned processFlags = flags & Model::ProcessFlags;
+  hashFiles(models);
+  std::vector<std::string> recordedDependencies;
+  for (const auto& path : models)
+  {
+    auto known = previous.models.find(path);
+    if (known != previous.models.end())
+      recordedDependencies.insert(recordedDependencies.end(), known->second.dependencies.begin(), known->second.dependencies.end());
+  }
+  hashFiles(recordedDependencies);
+
+  std::vector<std::string> dirtyModels;
+  for (const auto& path : models)
+  {
+    const bool flip = next.flip.count(Relative(path, root)) != 0;
+    auto known = previous.models.find(path);
+    bool clean = !options.force && known != previous.models.end() && known->second.processFlags == processFlags && !changed(path)
+      && std::none_of(known->second.dependencies.begin(), known->second.dependencies.end(), changed);
+    if (clean)
+    {
+      const FileRecord& file = next.files[path];
+      FileStamp source;
+      source.path = path;
+      source.size = file.size;
+      source.mtime = file.mtime;
+      MeshCache cache;
+      const std::string cachePath = MeshCache::CachePath(path);
+      if (cache.Open(cachePath, source, file.hash, Model::ImportFlags, processFlags))
+        ++report.upToDate;
+      else if (!options.dryRun && MeshCache::Restamp(cachePath, source, file.hash) && cache.Open(cachePath, source, file.hash, Model::ImportFlags, processFlags))
+        ++report.restamped;
+      else
+        clean = false;
+    }
+
+    if (clean)
+    {
+      ModelRecord& record = next.models[path];
+      record = known->second;
+      record.flip = flip;
+    }
+    else
+      dirtyModels.push_back(path);
+  }
+
+  std::vector<ModelRecord> cookedModels(dirtyModels.size());
+  std::vector<char> modelCooked(dirtyModels.size(), 0);
+  if (!options.dryRun)
+  {
+    pool.ParallelFor(dirtyModels.size(), [&](size_t i)
+    {
+      auto start = Clock::now();
+      const std::string& path = dirtyModels[i];
+      ModelRecord& record = cookedModels[i];
+      std::vector<std::string> files;
+      modelCooked[i] = Model::Cook(path, flags, files, record.textures);
+      for (const auto& file : files)
+        if (file != path && std::find(record.dependencies.begin(), record.dependencies.end(), file) == record.dependencies.end())
+          record.dependencies.push_back(file);
+      record.processFlags = processFlags;
+      record.flip = next.flip.count(Relative(path, root)) != 0;
+      std::ostringstream message;
+      message << "COOK::MODEL::" << path << (modelCooked[i] ? "" : " FAILED") << " (" << MsSince(start) << " ms)";
+      print(message.str());
+    });
+  }
+  for (size_t i = 0; i < dirtyModels.size(); ++i)
+  {
+    if (options.dryRun)
+    {
+      print("COOK::MODEL::" + dirtyModels[i] + " out of date");
+      ++report.cookedModels;
+    }
+    else if (modelCooked[i])
+    {
+      hashFiles(cookedModels[i].dependencies);
+      next.models[dirtyModels[i]] = std::move(cookedModels[i]);
+      ++report.cookedModels;
+    }
+    else
+      ++report.failed;
+  }
+  report.models = models.size();
+
+  // textures: every material texture of the models with the model's flip and the usage its type implies,
+  // then the loose images nothing references
+  std::map<std::string, ImageRecord> wanted;
+  for (const auto& [model, record] : next.models)
+  {
+    for (const auto& reference : record.textures)
+    {
+      const std::string path = TexturePath(model, reference.path);
+      ImageRecord want{record.flip || next.flip.count(Relative(path, root)) != 0, TextureCooker::UsageFromName(reference.type)};
+      auto [it, inserted] = wanted.emplace(path, want);
+      if (!inserted && (it->second.flip != want.flip || it->second.usage != want.usage))
+        print("COOK::TEXTURE::" + path + " is used with different flip/usage, cooked for the first use only");
+    }
+  }
+  for (const auto& path : images)
+    wanted.emplace(path, ImageRecord{next.flip.count(Relative(path, root)) != 0, TextureUsage::Color});
+
+  std::vector<std::string> texturePaths;
+  for (const auto& entry : wanted)
+    texturePaths.push_back(entry.first);
+  hashFiles(texturePaths);
+
+  std::vector<std::string> dirtyTextures;
+  for (const auto& [path, want] : wanted)
+  {
+    if (!next.files.count(path))
+    {
+      print("ERROR::COOK::Missing texture " + path);
+      ++report.failed;
+      continue;
+    }
+    auto known = previous.images.find(path);
+    bool clean = !options.force && known != previous.images.end() && known->second.flip == want.flip && known->second.usage == want.usage
+      && !changed(path);
+    if (clean)
+    {
+      if (Texture::IsCooked(path, want.flip, want.usage))
+        ++report.upToDate;
+      else if (!options.dryRun && Texture::Restamp(path, want.flip, want.usage) && Texture::IsCooked(path, want.flip, want.usage))
+        ++report.restamped;
+      else
+        clean = false;
+    }
+
+    if (clean)
+      next.images[path] = want;
+    else
+      dirtyTextures.push_back(path);
+  }
+
+  std::vector<char> textureCooked(dirtyTextures.size(), 0);
+  if (!options.dryRun)
+  {
+    pool.ParallelFor(dirtyTextures.size(), [&](size_t i)
+    {
+      auto start = Clock::now();
+      const ImageRecord& want = wanted.at(dirtyTextures[i]);
+      textureCooked[i] = Texture::Cook(dirtyTextures[i], want.flip, want.usage);
+      std::ostringstream message;
+      message << "COOK::TEXTURE::" << dirtyTextures[i] << ' ' << (want.flip ? "flipped " : "") << (textureCooked[i] ? "" : "FAILED ")
+        << "(" << MsSince(start) << " ms)";
+      print(message.str());
+    });
+  }
+  for (size_t i = 0; i < dirtyTextures.size(); ++i)
+  {
+    if (options.dryRun)
+    {
+      print("COOK::TEXTURE::" + dirtyTextures[i] + " out of date");
+      ++report.cookedTextures;
+    }
+    else if (textureCooked[i])
+    {
+      next.images[dirtyTextures[i]] = wanted.at(dirtyTextures[i]);
+      ++report.cookedTextures;
+    }
+    else
+      ++report.failed;
+  }
+  report.textures = wanted.size();
+
+  if (!options.dryRun)
+    WriteManifest(manifestPath, next);
+  report.ms = MsSince(t);
+
+  std::cout << "COOK::" << root << (options.dryRun ? " (dry run)" : "") << ": " << report.models << " models, " << report.textures
+    << " textures; cooked " << report.cookedModels << " models, " << report.cookedTextures << " textures; " << report.restamped
+    << " restamped, " << report.upToDate << " up to date, " << report.failed << " failed; " << report.hashed << " files hashed in "
+    << report.ms << " ms on " << pool.Size() + 1 << " threads" << std::endl;
+  return report;
+}
+
+void AssetCooker::Usage()
+{
+  std::cout << "usage: nullengine-cook [options]\n"
+    << "  Cooks the models (.nemesh) and textures (.ktx2) under the root ahead of time. Paths are used as\n"
+    << "  given, so run it from the engine's working directory. Only outputs whose inputs changed are rebuilt.\n"
+    << "  -r, --root <dir>       asset directory (default ../Resources)\n"
+    << "  -m, --manifest <file>  dependency manifest (default <root>/cook.manifest)\n"
+    << "  --flip <path>          cook this model's textures / this image flipped, path relative to the root;\n"
+    << "                         remembered in the manifest (e.g. --flip backpack/backpack.obj)\n"
+    << "  --unflip <path>        forget a --flip\n"
+    << "  -f, --force            rebuild everything\n"
+    << "  -n, --dry-run          list what is out of date, write nothing\n"
+    << "  -h, --help" << std::endl;
+}
+
+int AssetCooker::Main(int argc, char** argv)
+{
+  CookOptions options;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    auto value = [&](std::string& out)
+    {
+      if (i + 1 >= argc)
+        return false;
+      out = argv[++i];
+      return true;
+    };
+    std::string path;
+    bool ok = true;
+    if (arg == "-r" || arg == "--root")
+      ok = value(options.root);
+    else if (arg == "-m" || arg == "--manifest")
+      ok = value(options.manifest);
+    else if (arg == "--flip")
+      ok = value(path) && (options.flip.push_back(path), true);
+    else if (arg == "--unflip")
+      ok = value(path) && (options.unflip.push_back(path), true);
+    else if (arg == "-f" || arg == "--force")
+      options.force = true;
+    else if (arg == "-n" || arg == "--dry-run")
+      options.dryRun = true;
+    else if (arg == "-h" || arg == "--help")
+    {
+      Usage();
+      return 0;
+    }
+    else
+      ok = false;
+
+    if (!ok)
+    {
+      std::cout << "ERROR::COOK::Bad argument " << arg << std::endl;
+      Usage();
+      return 2;
+    }
+  }
+  return Cook(options).failed ? 1 : 0;
+}
+
+}
+
+NULLENGINE_API int CookAssets(int argc, char** argv)
+{
+  return NullEngine::AssetCooker::Main(argc, argv);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "MeshCache.h"
+#include "TextureCooker.h"
+
+namespace NullEngine
+{
+
+struct CookOptions
+{
+  // paths are used as given, so run from the engine's working directory
+  std::string root = "../Resources";
+  // empty: <root>/cook.manifest
+  std::string manifest;
+  // models (their material textures) and images to cook flipped, relative to root; remembered in the manifest
+  std::vector<std::string> flip;
+  std::vector<std::string> unflip;
+  // rebuild everything
+  bool force = false;
+  // report what would be rebuilt, write nothing
+  bool dryRun = false;
+};
+
+struct CookReport
+{
+  size_t models = 0;
+  size_t textures = 0;
+  // inputs whose size/mtime changed since the last run (or new ones), read to get their content hash
+  size_t hashed = 0;
+  size_t cookedModels = 0;
+  size_t cookedTextures = 0;
+  // outputs re-keyed because only the stamps of their inputs changed (checkout, copy)
+  size_t restamped = 0;
+  size_t upToDate = 0;
+  size_t failed = 0;
+  double ms = 0.0;
+};
+
+// Offline cooker behind nullengine-cook: walks root, writes the same .nemesh (Model::Cook) and .ktx2
+// (Texture::Cook) the runtime would cook on first load, so Model and Texture::Prepare find them up to date.
+//
+// The manifest is the dependency graph of the last run: every input file with its size, mtime and
+// content hash, every model with the files its importer read (.mtl, ...) and the textures its
+// materials reference, every image with the flip/usage it was cooked with. An output is rebuilt only
+// if the content of one of its inputs or its settings changed; models are cooked in parallel, then
+// all textures they reference (plus loose images) in parallel.
+class AssetCooker
+{
+public:
+  static CookReport Cook(const CookOptions& options);
+  // command line, see Usage(); returns 0 if nothing failed
+  static int Main(int argc, char** argv);
+
+  static constexpr unsigned ManifestVersion = 1;
+
+private:
+  struct FileRecord
+  {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+  };
+
+  struct ModelRecord
+  {
+    unsigned processFlags = 0;
+    bool flip = false;
+    // files the importer read besides the model, and the texture references of its materials
+    std::vector<std::string> dependencies;
+    std::vector<MaterialTextureRef> textures;
+  };
+
+  struct ImageRecord
+  {
+    bool flip = false;
+    TextureUsage usage = TextureUsage::Color;
+  };
+
+  struct Manifest
+  {
+    std::map<std::string, FileRecord> files;
+    std::map<std::string, ModelRecord> models;
+    std::map<std::string, ImageRecord> images;
+    // relative to root
+    std::set<std::string> flip;
+  };
+
+  static bool ReadManifest(const std::string& path, Manifest& manifest);
+  static bool WriteManifest(const std::string& path, const Manifest& manifest);
+  static void Usage();
+};
+
+}
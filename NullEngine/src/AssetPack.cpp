@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "AssetPack.h"
+#include "Hash.h"
+#include "IEngine.h"
+#include "FileStamp.h"
+#include "Lz4.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+constexpr char Magic[4] = {'N', 'E', 'P', 'K'};
+constexpr uint32_t Version = 2;
+// files read per compression batch while packing, bounds the packer's memory
+constexpr size_t BatchBytes = 64 * 1024 * 1024;
+
+using Clock = std::chrono::high_resolution_clock;
+
+// generated next to their sources per machine, see MeshCache and Ktx2
+bool IsCacheFile(const std::filesystem::path& path)
+{
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return extension == ".nemesh" || extension == ".ktx2" || extension == ".nepack";
+}
+
+bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& out)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return false;
+  out.resize((size_t)file.tellg());
+  file.seekg(0);
+  return file.read(reinterpret_cast<char*>(out.data()), (std::streamsize)out.size()) || out.empty();
+}
+
+} // namespace
+
+AssetPack& AssetPack::Instance()
+{
+  static AssetPack pack;
+  return pack;
+}
+
+std::string AssetPack::NormalizePath(const std::string& path)
+{
+  std::vector<std::string> parts;
+  const bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+  size_t start = 0;
+  while (start <= path.size())
+  {
+    size_t end = path.find_first_of("/\\", start);
+    if (end == std::string::npos)
+      end = path.size();
+    std::string part = path.substr(start, end - start);
+    start = end + 1;
+
+    if (part.empty() || part == ".")
+      continue;
+    if (part == ".." && !parts.empty() && parts.back() != "..")
+      parts.pop_back();
+    else
+      parts.push_back(std::move(part));
+  }
+
+  std::string out = absolute ? "/" : "";
+  for (size_t i = 0; i < parts.size(); ++i)
+  {
+    if (i)
+      out += '/';
+    out += parts[i];
+  }
+  std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return out;
+}
+
+bool AssetPack::Mount(const std::string& packPath, const std::string& baseDirectory)
+{
+  Unmount();
+  if (!_file.Open(packPath))
+    return false;
+
+  auto fail = [this, &packPath](const char* reason)
+  {
+    std::cout << "ERROR::ASSET_PACK::" << packPath << ": " << reason << std::endl;
+    Unmount();
+    return false;
+  };
+
+  const uint8_t* data = _file.Data();
+  const size_t size = _file.Size();
+  if (size < sizeof(AssetPackHeader))
+    return fail("too small");
+  const AssetPackHeader* header = reinterpret_cast<const AssetPackHeader*>(data);
+  if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version || header->chunkSize != ChunkSize)
+    return fail("not a pack of this version");
+
+  auto inside = [size](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+  if (!inside(header->chunkTableOffset, (uint64_t)header->chunkCount * sizeof(AssetPackChunk))
+    || !inside(header->entryTableOffset, (uint64_t)header->fileCount * sizeof(AssetPackEntry))
+    || !inside(header->stringsOffset, header->stringsSize))
+    return fail("truncated");
+
+  const AssetPackChunk* chunks = reinterpret_cast<const AssetPackChunk*>(data + header->chunkTableOffset);
+  const AssetPackEntry* entries = reinterpret_cast<const AssetPackEntry*>(data + header->entryTableOffset);
+  // checked once here, so reads can trust the tables
+  for (uint32_t i = 0; i < header->chunkCount; ++i)
+  {
+    if (!inside(chunks[i].offset, chunks[i].compressedSize) || chunks[i].rawSize > ChunkSize)
+      return fail("chunk out of range");
+  }
+  for (uint32_t i = 0; i < header->fileCount; ++i)
+  {
+    const AssetPackEntry& entry = entries[i];
+    if ((uint64_t)entry.firstChunk + entry.chunkCount > header->chunkCount || (uint64_t)entry.pathOffset + entry.pathLength > header->stringsSize)
+      return fail("entry out of range");
+    // full chunks and a last one with the rest, so chunk i decodes at i * ChunkSize inside the file
+    for (uint32_t c = 0; c + 1 < entry.chunkCount; ++c)
+      if (chunks[entry.firstChunk + c].rawSize != ChunkSize)
+        return fail("short chunk inside a file");
+    uint64_t fileSize = entry.chunkCount ? (uint64_t)(entry.chunkCount - 1) * ChunkSize + chunks[entry.firstChunk + entry.chunkCount - 1].rawSize : 0;
+    if (fileSize != entry.size)
+      return fail("chunk sizes don't add up");
+  }
+
+  _header = header;
+  _chunks = chunks;
+  _entries = entries;
+  _strings = reinterpret_cast<const char*>(data + header->stringsOffset);
+  _freshness.reset(new std::atomic<uint8_t>[header->fileCount]);
+  for (uint32_t i = 0; i < header->fileCount; ++i)
+    _freshness[i] = Unchecked;
+  _prefix = NormalizePath(baseDirectory);
+  if (!_prefix.empty() && _prefix != "/")
+    _prefix += '/';
+  _reads = 0;
+  _bytesRead = 0;
+  _chunksDecompressed = 0;
+  _readMicroseconds = 0;
+
+  std::cout << "ASSET_PACK::mounted " << packPath << ": " << header->fileCount << " files, " << size / (1024.0 * 1024.0) << " MB" << std::endl;
+  return true;
+}
+
+void AssetPack::Unmount()
+{
+  _header = nullptr;
+  _chunks = nullptr;
+  _entries = nullptr;
+  _strings = nullptr;
+  _prefix.clear();
+  _file.Close();
+  _freshness.reset();
+}
+
+const AssetPackEntry* AssetPack::Find(const std::string& path) const
+{
+  if (!_header)
+    return nullptr;
+
+  std::string normalized = NormalizePath(path);
+  if (normalized.compare(0, _prefix.size(), _prefix) != 0)
+    return nullptr;
+  const char* relative = normalized.c_str() + _prefix.size();
+  const size_t length = normalized.size() - _prefix.size();
+  const uint64_t hash = HashBytes(relative, length);
+
+  const AssetPackEntry* end = _entries + _header->fileCount;
+  const AssetPackEntry* it = std::lower_bound(_entries, end, hash, [](const AssetPackEntry& entry, uint64_t h) { return entry.pathHash < h; });
+  for (; it != end && it->pathHash == hash; ++it)
+  {
+    if (it->pathLength == length && std::memcmp(_strings + it->pathOffset, relative, length) == 0)
+      return IsCurrent(*it, path) ? it : nullptr;
+  }
+  return nullptr;
+}
+
+bool AssetPack::IsCurrent(const AssetPackEntry& entry, const std::string& path) const
+{
+  std::atomic<uint8_t>& freshness = _freshness[&entry - _entries];
+  uint8_t state = freshness.load(std::memory_order_relaxed);
+  if (state != Unchecked)
+    return state == Current;
+
+  // no loose file (a shipped build): the pack is all there is
+  FileStamp stamp;
+  const bool current = !StampFile(path, stamp) || (stamp.size == entry.size && stamp.mtime == entry.sourceMtime);
+  // threads racing on the first lookup agree, only the one that stores the answer reports it
+  state = Unchecked;
+  if (freshness.compare_exchange_strong(state, current ? Current : Stale, std::memory_order_relaxed) && !current)
+    std::cout << "ASSET_PACK::STALE::" << path << " changed since the pack was built, reading the loose file (rerun BuildAssetPack)" << std::endl;
+  return current;
+}
+
+bool AssetPack::ReadEntry(const AssetPackEntry& entry, uint8_t* out)
+{
+  const uint8_t* data = _file.Data();
+  std::atomic<bool> ok{true};
+  auto decompress = [&](size_t i)
+  {
+    const AssetPackChunk& chunk = _chunks[entry.firstChunk + i];
+    uint8_t* dst = out + i * ChunkSize;
+    if (chunk.compressedSize == chunk.rawSize)
+      std::memcpy(dst, data + chunk.offset, chunk.rawSize);
+    else if (!Lz4::Decompress(data + chunk.offset, chunk.compressedSize, dst, chunk.rawSize))
+      ok = false;
+  };
+
+  // a single chunk is not worth waking the workers for
+  if (entry.chunkCount > 1)
+    ThreadPool::Instance().ParallelFor(entry.chunkCount, decompress);
+  else if (entry.chunkCount == 1)
+    decompress(0);
+
+  _chunksDecompressed += entry.chunkCount;
+  return ok;
+}
+
+bool AssetPack::Read(const std::string& path, std::vector<uint8_t>& out)
+{
+  const AssetPackEntry* entry = Find(path);
+  return entry && Read(*entry, out);
+}
+
+bool AssetPack::Read(const AssetPackEntry& entry, std::vector<uint8_t>& out)
+{
+  auto t = Clock::now();
+  out.resize((size_t)entry.size);
+  bool ok = ReadEntry(entry, out.data());
+
+  ++_reads;
+  _bytesRead += (size_t)entry.size;
+  _readMicroseconds += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count();
+  if (!ok)
+    std::cout << "ERROR::ASSET_PACK::corrupt data for " << std::string(_strings + entry.pathOffset, entry.pathLength) << std::endl;
+  return ok;
+}
+
+bool AssetPack::ReadText(const std::string& path, std::string& out)
+{
+  std::vector<uint8_t> bytes;
+  if (!Read(path, bytes))
+    return false;
+  out.assign(bytes.begin(), bytes.end());
+  return true;
+}
+
+bool AssetPack::Verify()
+{
+  if (!_header)
+    return false;
+
+  std::atomic<size_t> bad{0};
+  ThreadPool::Instance().ParallelFor(_header->fileCount, [&](size_t i)
+  {
+    const AssetPackEntry& entry = _entries[i];
+    std::vector<uint8_t> bytes((size_t)entry.size);
+    if (!ReadEntry(entry, bytes.data()) || HashBytes(bytes.data(), (size_t)entry.size) != entry.contentHash)
+    {
+      std::cout << "ERROR::ASSET_PACK::content hash mismatch: " << std::string(_strings + entry.pathOffset, entry.pathLength) << std::endl;
+      ++bad;
+    }
+  });
+  return bad == 0;
+}
+
+AssetPackStats AssetPack::Stats() const
+{
+  AssetPackStats stats;
+  if (_header)
+  {
+    stats.files = _header->fileCount;
+    stats.packBytes = _file.Size();
+  }
+  stats.reads = _reads;
+  stats.bytesRead = _bytesRead;
+  stats.chunksDecompressed = _chunksDecompressed;
+  stats.readMs = _readMicroseconds / 1000.0;
+  return stats;
+}
+
+bool AssetPack::Build(const std::string& packPath, const std::string& baseDirectory, const std::vector<std::string>& directories)
+{
+  namespace fs = std::filesystem;
+  auto t = Clock::now();
+
+  // relative path -> file, sorted so equal inputs give an identical pack
+  std::vector<std::pair<std::string, fs::path>> files;
+  for (const auto& directory : directories)
+  {
+    fs::path root = fs::path(baseDirectory) / directory;
+    std::error_code error;
+    if (!fs::is_directory(root, error))
+    {
+      std::cout << "ERROR::ASSET_PACK::no directory " << root.string() << std::endl;
+      continue;
+    }
+    for (fs::recursive_directory_iterator it(root, error), end; it != end; it.increment(error))
+    {
+      if (error)
+        break;
+      if (!it->is_regular_file(error) || IsCacheFile(it->path()))
+        continue;
+      files.emplace_back(NormalizePath(it->path().lexically_relative(baseDirectory).generic_string()), it->path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), files.end());
+
+  std::ofstream out(packPath, std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    std::cout << "ERROR::ASSET_PACK::can't write " << packPath << std::endl;
+    return false;
+  }
+  AssetPackHeader header = {};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t offset = sizeof(header);
+
+  std::vector<AssetPackChunk> chunks;
+  std::vector<AssetPackEntry> entries;
+  std::string strings;
+  size_t rawBytes = 0;
+
+  // read a batch of files, compress all their chunks in parallel, append them in order
+  for (size_t first = 0; first < files.size();)
+  {
+    std::vector<std::vector<uint8_t>> contents;
+    size_t batchBytes = 0;
+    size_t last = first;
+    for (; last < files.size() && (last == first || batchBytes < BatchBytes); ++last)
+    {
+      contents.emplace_back();
+      if (!ReadFile(files[last].second, contents.back()))
+        std::cout << "ERROR::ASSET_PACK::can't read " << files[last].second.string() << std::endl;
+      batchBytes += contents.back().size();
+    }
+
+    struct Job
+    {
+      const uint8_t* data;
+      uint32_t size;
+      std::vector<uint8_t> packed;
+    };
+    std::vector<Job> jobs;
+    for (size_t f = first; f < last; ++f)
+    {
+      const std::vector<uint8_t>& content = contents[f - first];
+      AssetPackEntry entry = {};
+      entry.pathHash = HashString(files[f].first);
+      entry.contentHash = HashBytes(content.data(), content.size());
+      entry.size = content.size();
+      FileStamp stamp;
+      entry.sourceMtime = StampFile(files[f].second.string(), stamp) ? stamp.mtime : 0;
+      entry.firstChunk = (uint32_t)(chunks.size() + jobs.size());
+      entry.chunkCount = (uint32_t)((content.size() + ChunkSize - 1) / ChunkSize);
+      entry.pathOffset = (uint32_t)strings.size();
+      entry.pathLength = (uint32_t)files[f].first.size();
+      strings += files[f].first;
+      entries.push_back(entry);
+      for (size_t at = 0; at < content.size(); at += ChunkSize)
+        jobs.push_back({content.data() + at, (uint32_t)std::min<size_t>(ChunkSize, content.size() - at), {}});
+      rawBytes += content.size();
+    }
+
+    ThreadPool::Instance().ParallelFor(jobs.size(), [&jobs](size_t i)
+    {
+      Job& job = jobs[i];
+      job.packed.resize(Lz4::CompressBound(job.size));
+      size_t size = Lz4::Compress(job.data, job.size, job.packed.data(), job.packed.size());
+      // incompressible (jpg, png, ...) is stored as is
+      if (size == 0 || size >= job.size)
+        job.packed.assign(job.data, job.data + job.size);
+      else
+        job.packed.resize(size);
+    });
+
+    for (const Job& job : jobs)
+    {
+      chunks.push_back({offset, (uint32_t)job.packed.size(), job.size});
+      out.write(reinterpret_cast<const char*>(job.packed.data()), (std::streamsize)job.packed.size());
+      offset += job.packed.size();
+    }
+    first = last;
+  }
+
+  // tables 8 byte aligned
+  const char zeros[8] = {};
+  out.write(zeros, (std::streamsize)((8 - offset % 8) % 8));
+  offset += (8 - offset % 8) % 8;
+
+  std::stable_sort(entries.begin(), entries.end(), [](const AssetPackEntry& a, const AssetPackEntry& b) { return a.pathHash < b.pathHash; });
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.chunkSize = ChunkSize;
+  header.fileCount = (uint32_t)entries.size();
+  header.chunkCount = (uint32_t)chunks.size();
+  header.chunkTableOffset = offset;
+  header.entryTableOffset = header.chunkTableOffset + chunks.size() * sizeof(AssetPackChunk);
+  header.stringsOffset = header.entryTableOffset + entries.size() * sizeof(AssetPackEntry);
+  header.stringsSize = strings.size();
+
+  out.write(reinterpret_cast<const char*>(chunks.data()), (std::streamsize)(chunks.size() * sizeof(AssetPackChunk)));
+  out.write(reinterpret_cast<const char*>(entries.data()), (std::streamsize)(entries.size() * sizeof(AssetPackEntry)));
+  out.write(strings.data(), (std::streamsize)strings.size());
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!out)
+  {
+    std::cout << "ERROR::ASSET_PACK::write failed " << packPath << std::endl;
+    return false;
+  }
+  const uint64_t packBytes = header.stringsOffset + header.stringsSize;
+
+  std::cout << "ASSET_PACK::BUILD::" << packPath << ": " << entries.size() << " files, " << chunks.size() << " chunks, "
+    << rawBytes / (1024.0 * 1024.0) << " MB -> " << packBytes / (1024.0 * 1024.0) << " MB in "
+    << std::chrono::duration<double, std::milli>(Clock::now() - t).count() << " ms" << std::endl;
+  return true;
+}
+
+}
+
+// packs the asset directories next to the executable's working directory into ../Assets.nepack
+NULLENGINE_API int BuildAssetPack()
+{
+  return NullEngine::AssetPack::Build("../Assets.nepack", "..", {"Resources", "LearnOpenGL_guide/shaders", "NullEngine/src/Shaders"}) ? 0 : 1;
+}
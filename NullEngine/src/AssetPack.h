@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+namespace NullEngine
+{
+
+// Asset pack (.nepack): the loose files of the asset directories in one memory mapped archive.
+//
+// Layout (little endian):
+//   AssetPackHeader
+//   chunk data - every file cut into ChunkSize pieces, each LZ4 block compressed or stored raw
+//   AssetPackChunk[chunkCount]
+//   AssetPackEntry[fileCount] - sorted by pathHash
+//   string table - relative paths, '/' separated, lower case
+//
+// A file starts on a new chunk, so its chunks decompress independently straight into the
+// output buffer, in parallel on the ThreadPool.
+
+struct AssetPackHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t chunkSize;
+  uint32_t fileCount;
+  uint32_t chunkCount;
+  uint32_t pad;
+
+  uint64_t chunkTableOffset;
+  uint64_t entryTableOffset;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+};
+
+struct AssetPackChunk
+{
+  uint64_t offset;
+  uint32_t compressedSize;  // == rawSize: stored uncompressed
+  uint32_t rawSize;
+};
+
+struct AssetPackEntry
+{
+  uint64_t pathHash;
+  uint64_t contentHash;  // HashBytes of the uncompressed file
+  uint64_t size;
+  // last write time of the loose file it was packed from, see StampFile
+  int64_t sourceMtime;
+  uint32_t firstChunk;
+  uint32_t chunkCount;
+  uint32_t pathOffset;
+  uint32_t pathLength;
+};
+
+struct AssetPackStats
+{
+  size_t files = 0;
+  size_t packBytes = 0;
+  // totals since the pack was mounted
+  size_t reads = 0;
+  size_t bytesRead = 0;
+  size_t chunksDecompressed = 0;
+  double readMs = 0.0;
+};
+
+// The engine's mounted pack. While one is mounted, Texture, CubeMap, Shader (file constructor)
+// and Model (Assimp and ObjLoader) look every path up here first and read the loose file only
+// if the pack does not have it. A loose file that still exists but differs in size or mtime from
+// what was packed wins over the stale copy (with a warning), so edits show up without rebuilding
+// the pack; each file is checked on its first lookup only. Mount/Unmount before/after loading,
+// Find/Read from any thread.
+class AssetPack
+{
+public:
+  static constexpr uint32_t ChunkSize = 64 * 1024;
+
+  static AssetPack& Instance();
+
+  // paths passed to Find/Read are resolved against baseDirectory the way the loose files would
+  // be (relative to the working directory); false if there is no valid pack at packPath
+  bool Mount(const std::string& packPath, const std::string& baseDirectory);
+  void Unmount();
+  bool IsMounted() const { return _header != nullptr; }
+
+  const AssetPackEntry* Find(const std::string& path) const;
+  bool Contains(const std::string& path) const { return Find(path) != nullptr; }
+  // false if the path is not in the pack or its data is corrupt
+  bool Read(const std::string& path, std::vector<uint8_t>& out);
+  // an entry returned by Find, for callers that already looked the path up; valid until Unmount
+  bool Read(const AssetPackEntry& entry, std::vector<uint8_t>& out);
+  bool ReadText(const std::string& path, std::string& out);
+
+  // decompresses every file and checks its content hash
+  bool Verify();
+  AssetPackStats Stats() const;
+
+  // Packer: every file under directories (relative to baseDirectory, recursively) except mesh and
+  // texture caches; chunks are compressed in parallel. Prints the result.
+  static bool Build(const std::string& packPath, const std::string& baseDirectory, const std::vector<std::string>& directories);
+
+  // lexically normalized, lower case, '/' separated; ".." stays only at the front
+  static std::string NormalizePath(const std::string& path);
+
+private:
+  AssetPack() = default;
+
+  bool ReadEntry(const AssetPackEntry& entry, uint8_t* out);
+  // false if the loose file at path was changed since the pack was built; stats it on the first
+  // call per entry, later calls read the cached answer
+  bool IsCurrent(const AssetPackEntry& entry, const std::string& path) const;
+
+  enum Freshness : uint8_t
+  {
+    Unchecked,
+    Current,
+    Stale
+  };
+
+  MappedFile _file;
+  const AssetPackHeader* _header = nullptr;
+  const AssetPackChunk* _chunks = nullptr;
+  const AssetPackEntry* _entries = nullptr;
+  const char* _strings = nullptr;
+  // normalized baseDirectory + '/', empty for the working directory
+  std::string _prefix;
+  // Freshness of each entry, by index
+  std::unique_ptr<std::atomic<uint8_t>[]> _freshness;
+
+  std::atomic<size_t> _reads{0};
+  std::atomic<size_t> _bytesRead{0};
+  std::atomic<size_t> _chunksDecompressed{0};
+  std::atomic<uint64_t> _readMicroseconds{0};
+};
+
+}
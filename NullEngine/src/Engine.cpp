@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 #include <windows.h>
 #include <random>
@@ -13,12 +14,26 @@
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_opengl3.h>
 
+#include "AssetPack.h"
 #include "Engine.h"
+#include "GeometryCodec.h"
+#include "GeometryRegistry.h"
+#include "GLState.h"
 #include "IEngine.h"
+#include "LightSystem.h"
 #include "Shader.h"
 #include "Shaders/ShaderSources.hpp"
 #include "Texture.h"
 #include "Model.h"
+#include "MeshStreamer.h"
+#include "RenderQueue.h"
+#include "ResourceManager.h"
+#include "TextureRegistry.h"
+#include "TextureResidency.h"
+#include "TaskGraph.h"
+#include "Uniforms.h"
+#include "TextureStreamer.h"
+#include "Vfs.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
@@ -46,6 +61,29 @@ static void HelpMarker(const char* desc)
 namespace NullEngine
 {
 
+// the model behind a handle, or a status line in its place until it is loaded
+static const Model* ResidentOrStatus(const char* name, const ModelHandle& handle)
+{
+  const Model* model = handle.Resident();
+  if (!model)
+    ImGui::Text("%s: %s", name, handle.State() == ResourceState::Declared ? "not loaded" : "loading");
+  return model;
+}
+
+// uniforms drawScene sets every frame
+namespace SceneUniforms
+{
+  constexpr UniformHandle ViewPos("viewPos");
+  constexpr UniformHandle CameraPos("cameraPos");
+  constexpr UniformHandle SkyBoxView("skyBoxView");
+  constexpr UniformHandle LightColor("lightColor");
+  constexpr UniformHandle HighlightColor("highLightColor");
+  constexpr UniformHandle Shininess("material.shininess");
+  constexpr UniformHandle Time("time");
+  constexpr UniformHandle View("view");
+  constexpr UniformHandle Projection("projection");
+}
+
 /***************************Engine***************************/
 
 Engine* Engine::_engineContext = nullptr;
@@ -299,60 +337,74 @@ void Engine::InitPhongMaterials()
 
 int Engine::Main()
 {
-  InitGLFW();
-  CreateShaders();
-  InitImGui();
-
-  InitVertices();
-  InitPositions();
-  InitPhongMaterials();
+  GLState& gl = GLState::Instance();
+  // everything below reads from the pack if one was built (see BuildAssetPack), loose files otherwise
+  // and where a loose file was edited after packing
+  AssetPack::Instance().Mount("../Assets.nepack", "..");
+
+  // Startup as a task graph: the window, shaders and ImGui on this thread overlap the scene data
+  // on a worker. Assets are not part of it, they load lazily (ResourceManager). Prints a report at the end.
+  const auto startupBegin = std::chrono::steady_clock::now();
+  TaskGraph startup;
+  const auto initGlfw = startup.Add("InitGLFW", TaskThread::Main, [this]() { InitGLFW(); });
+  startup.Add("CreateShaders", TaskThread::Main, [this]() { CreateShaders(); }, {initGlfw});
+  startup.Add("InitImGui", TaskThread::Main, [this]() { InitImGui(); }, {initGlfw});
+  startup.Add("Scene data", TaskThread::Worker, [this]()
+  {
+    InitVertices();
+    InitPositions();
+    InitPhongMaterials();
+  });
 
   // obtain resources path
   std::string root = R"(../Resources/)";
 
-  // texture loading from image
-  Texture texture1("container", root + "container.jpg");
-  Texture texture2("AwesomeFace", root + "awesomeface.png", true);
-  texture1.Load();
-  texture2.Load();
-
-  Texture containerDiffuseMap("containerWood", root + "container2.png");
-  Texture containerSpecularMap("containerSteelBorder", root + "container2_specular.png");
-  Texture containerEmissionMap("containerEmission", root + "matrix_container.png");
-  containerDiffuseMap.Load();
-  containerSpecularMap.Load();
-  containerEmissionMap.Load();
-
-  std::string imgExt = ".jpg";
-  std::vector<std::string> faces
-  {
-    root + "skybox/right" + imgExt,
-    root + "skybox/left" + imgExt,
-    root + "skybox/top" + imgExt,
-    root + "skybox/bottom" + imgExt,
-    root + "skybox/front" + imgExt,
-    root + "skybox/back" + imgExt
-  };
-  CubeMap skyBox("LearnOpenGLskyBox", faces);
-  skyBox.Load();
-
-  imgExt = ".png";
-  std::vector<std::string> faces2
+  startup.Run();
+  startup.Report().Print("startup");
+
+  // assets are only declared here: each loads the first time it is bound or drawn, with a
+  // placeholder until then, or earlier from a prefetch hint in a frame with time to spare
+  ResourceManager& resources = ResourceManager::Instance();
+  TextureHandle texture1 = resources.DeclareTexture("container", root + "container.jpg", false, TextureCooker::UsageFromName("container"));
+  TextureHandle texture2 = resources.DeclareTexture("AwesomeFace", root + "awesomeface.png", true, TextureCooker::UsageFromName("AwesomeFace"));
+  TextureHandle containerDiffuseMap = resources.DeclareTexture("containerWood", root + "container2.png", false,
+    TextureCooker::UsageFromName("containerWood"));
+  TextureHandle containerSpecularMap = resources.DeclareTexture("containerSteelBorder", root + "container2_specular.png", false, TextureUsage::Linear);
+  TextureHandle containerEmissionMap = resources.DeclareTexture("containerEmission", root + "matrix_container.png", false,
+    TextureCooker::UsageFromName("containerEmission"));
+
+  auto facesOf = [&root](const std::string& directory, const std::string& imgExt)
   {
-    root + "skybox2/right" + imgExt,
-    root + "skybox2/left" + imgExt,
-    root + "skybox2/top" + imgExt,
-    root + "skybox2/bottom" + imgExt,
-    root + "skybox2/front" + imgExt,
-    root + "skybox2/back" + imgExt
+    return std::vector<std::string>
+    {
+      root + directory + "/right" + imgExt,
+      root + directory + "/left" + imgExt,
+      root + directory + "/top" + imgExt,
+      root + directory + "/bottom" + imgExt,
+      root + directory + "/front" + imgExt,
+      root + directory + "/back" + imgExt
+    };
   };
-  CubeMap skyBox2("LearnOpenGLskyBox2", faces2);
-  skyBox2.Load();
-
-  Model guitarBag("../Resources/backpack/backpack.obj", nullptr, true);
-  Model singapore("../Resources/singapore/untitled.obj");
-  //Model destructor("../Resources/destructor-pesado-imperial-isd-1/Destructor imperial ISD 1.obj");
-  //Model sponza("../Resources/sponza/source/sponza.fbx", "../Resources/sponza/textures", false);
+  CubeMapHandle skyBox = resources.DeclareCubeMap("LearnOpenGLskyBox", facesOf("skybox", ".jpg"));
+  CubeMapHandle skyBox2 = resources.DeclareCubeMap("LearnOpenGLskyBox2", facesOf("skybox2", ".png"));
+
+  ModelHandle guitarBag = resources.DeclareModel("../Resources/backpack/backpack.obj", nullptr, true, ModelLoad_Default);
+  // the big scene uploads quantized vertices, half the vertex memory and fetch bandwidth
+  ModelHandle singapore = resources.DeclareModel("../Resources/singapore/untitled.obj", nullptr, false, ModelLoad_Default | ModelLoad_Quantize);
+  // the big scenes stream in, nearest/largest on screen first, once they are resident
+  ModelHandle destructor = resources.DeclareModel("../Resources/destructor-pesado-imperial-isd-1/Destructor imperial ISD 1.obj", nullptr, false,
+    ModelLoad_Default | ModelLoad_Quantize | ModelLoad_Streaming);
+  ModelHandle sponza = resources.DeclareModel("../Resources/sponza/source/sponza.fbx", "../Resources/sponza/textures", false,
+    ModelLoad_Default | ModelLoad_Streaming);
+
+  // likely next: the container maps and the other skybox are one click away in the UI
+  resources.Prefetch(containerDiffuseMap);
+  resources.Prefetch(containerSpecularMap);
+  resources.Prefetch(containerEmissionMap);
+  resources.Prefetch(skyBox2);
+
+  const glm::mat4 destructorModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -20.0f));
+  const glm::mat4 sponzaModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -10.0f, 0.0f)), glm::vec3(0.01f));
 
   std::string shaderRoot = "../LearnOpenGL_guide/shaders/";
   Shader shaderSingleColor((shaderRoot + "2.stencil_testing.vs").c_str(), (shaderRoot + "2.stencil_single_color.fs").c_str());
@@ -360,9 +412,9 @@ int Engine::Main()
   // Set skybox Vertex buffers
   unsigned skyboxVAO, skyboxVBO;
   glGenVertexArrays(1, &skyboxVAO);
-  glBindVertexArray(skyboxVAO);
+  gl.BindVertexArray(skyboxVAO);
   glGenBuffers(1, &skyboxVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+  gl.BindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
   auto& skyboxVertices = _vertices[9];
   glBufferData(GL_ARRAY_BUFFER, skyboxVertices.size() * sizeof(float), skyboxVertices.data(), GL_STATIC_DRAW);
   glEnableVertexAttribArray(0);
@@ -379,13 +431,13 @@ int Engine::Main()
   glGenBuffers(2, EBO);
 
   // 1. bind Vertex Array Object
-  glBindVertexArray(VAOs[0]);
+  gl.BindVertexArray(VAOs[0]);
   // 2. copy our vertices array in a buffer for OpenGL to use
 
   auto& cubeLsource = _vertices[4];
   auto& cubeOb = _vertices[6];
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[0]);
+  gl.BindBuffer(GL_ARRAY_BUFFER, VBOs[0]);
   glBufferData(GL_ARRAY_BUFFER, cubeOb.size() * sizeof(float), cubeOb.data(), GL_STATIC_DRAW);
 
   // 3. then set our vertex attributes pointers
@@ -398,19 +450,19 @@ int Engine::Main()
   glEnableVertexAttribArray(2);
 
   // note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  gl.BindBuffer(GL_ARRAY_BUFFER, 0);
 
   // You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
   // VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
-  glBindVertexArray(0);
+  gl.BindVertexArray(0);
 
   // remember: do NOT unbind the EBO while a VAO is active as the bound element buffer object IS stored in the VAO; keep the EBO bound.
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
   //------------- bind vertex array object for 'light cube'
-  glBindVertexArray(VAOs[1]);
+  gl.BindVertexArray(VAOs[1]);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[1]);
+  gl.BindBuffer(GL_ARRAY_BUFFER, VBOs[1]);
   glBufferData(GL_ARRAY_BUFFER, cubeLsource.size() * sizeof(float), cubeLsource.data(), GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
@@ -419,16 +471,16 @@ int Engine::Main()
   glEnableVertexAttribArray(1);*/
 
   // note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  gl.BindBuffer(GL_ARRAY_BUFFER, 0);
 
-  glBindVertexArray(0);
+  gl.BindVertexArray(0);
 
   // Render to texture
   unsigned screenQuadVAO, screenQuadVBO;
   glGenVertexArrays(1, &screenQuadVAO);
   glGenBuffers(1, &screenQuadVBO);
-  glBindVertexArray(screenQuadVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, screenQuadVBO);
+  gl.BindVertexArray(screenQuadVAO);
+  gl.BindBuffer(GL_ARRAY_BUFFER, screenQuadVBO);
 
   auto& quadVertices = _vertices[7];
   glBufferData(GL_ARRAY_BUFFER, quadVertices.size() * sizeof(float), quadVertices.data(), GL_STATIC_DRAW);
@@ -439,18 +491,18 @@ int Engine::Main()
 
   unsigned framebuf;
   glGenFramebuffers(1, &framebuf);
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+  gl.BindFramebuffer(GL_FRAMEBUFFER, framebuf);
 
   const GLsizei Width = _width, Height = _height;
   unsigned textureColor;
   glGenTextures(1, &textureColor);
-  glBindTexture(GL_TEXTURE_2D, textureColor);
+  gl.BindTexture(GL_TEXTURE_2D, textureColor);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, Width, Height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   /*glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);*/
-  glBindTexture(GL_TEXTURE_2D, 0);
+  gl.BindTexture(GL_TEXTURE_2D, 0);
 
   // attach the color texture to the framebuffer
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColor, 0);
@@ -471,14 +523,14 @@ int Engine::Main()
     std::cout << "NULLENGINE::ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
   }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
   // Render to mirror texture
   unsigned mirrorQuadVAO, mirrorQuadVBO;
   glGenVertexArrays(1, &mirrorQuadVAO);
   glGenBuffers(1, &mirrorQuadVBO);
-  glBindVertexArray(mirrorQuadVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, mirrorQuadVBO);
+  gl.BindVertexArray(mirrorQuadVAO);
+  gl.BindBuffer(GL_ARRAY_BUFFER, mirrorQuadVBO);
 
   auto& mirrorVertices = _vertices[8];
   glBufferData(GL_ARRAY_BUFFER, mirrorVertices.size() * sizeof(float), mirrorVertices.data(), GL_STATIC_DRAW);
@@ -489,16 +541,16 @@ int Engine::Main()
 
   unsigned mirrorBuf;
   glGenFramebuffers(1, &mirrorBuf);
-  glBindFramebuffer(GL_FRAMEBUFFER, mirrorBuf);
+  gl.BindFramebuffer(GL_FRAMEBUFFER, mirrorBuf);
 
   const GLsizei mirrorWidth = _width, mirrorHeight = _height;
   unsigned texMirror;
   glGenTextures(1, &texMirror);
-  glBindTexture(GL_TEXTURE_2D, texMirror);
+  gl.BindTexture(GL_TEXTURE_2D, texMirror);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, mirrorWidth, mirrorHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  gl.BindTexture(GL_TEXTURE_2D, 0);
 
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texMirror, 0);
 
@@ -515,7 +567,7 @@ int Engine::Main()
     std::cout << "NULLENGINE::ERROR::FRAMEBUFFER:: Mirror framebuffer not complete!" << std::endl;
   }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
 
   //-------------------------------
 
@@ -536,9 +588,9 @@ int Engine::Main()
   std::vector<Shader*> activeShaders = {objectShader, lightSourceCube};// _shaders[0].get()};
 
   // this enables Z-buffer so that faces overlap correctly when projected to the screen
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_STENCIL_TEST);
-  glEnable(GL_CULL_FACE);
+  gl.Enable(GL_DEPTH_TEST);
+  gl.Enable(GL_STENCIL_TEST);
+  gl.Enable(GL_CULL_FACE);
   glFrontFace(GL_CCW);
 
   float time = 0.0f, timeLast = 0.0f, deltap = 0.0f;
@@ -566,28 +618,49 @@ int Engine::Main()
     randRadius[i] = (int)uni_rad(gen);
   }
 
+  // the scene's lights, animated in drawScene; the point lights were never attenuated (constant 1 only)
+  LightSystem& lights = LightSystem::Instance();
+  Light dirLight;
+  dirLight.type = LightType::Directional;
+  dirLight.direction = glm::vec3(0.0f, -50.0f, 0.0f);
+  dirLight.ambient = glm::vec3(0.1f);
+  dirLight.diffuse = glm::vec3(0.0f);
+  dirLight.specular = glm::vec3(0.0f);
+  lights.Add(dirLight);
+  Light sceneLight;
+  sceneLight.linear = 0.0f;
+  sceneLight.quadratic = 0.0f;
+  // the light cube orbiting the first cube position, then the four point lights
+  const LightId cubeLightId = lights.Add(sceneLight);
+  LightId pointLightIds[4];
+  for (LightId& id : pointLightIds)
+    id = lights.Add(sceneLight);
+  Light flashLight;
+  flashLight.type = LightType::Spot;
+  flashLight.cutOff = glm::cos(glm::radians(12.5f));
+  flashLight.outerCutOff = glm::cos(glm::radians(17.5f));
+  const LightId flashLightId = lights.Add(flashLight);
+  // small attenuated lights swarming the scene, count set in the Lights panel
+  std::vector<LightId> swarmIds;
+  std::vector<glm::vec4> swarmOrbits;
+  std::uniform_real_distribution<float> uni_unit(0.0f, 1.0f);
+
   objectShader->Use();
   objectShader->SetInt("material.diffuse", 0);
-
-  glActiveTexture(GL_TEXTURE0);
-  containerDiffuseMap.Use();
-
   objectShader->SetInt("material.specular", 1);
-  glActiveTexture(GL_TEXTURE1);
-  containerSpecularMap.Use();
-
   objectShader->SetInt("material.emissive", 2);
-  glActiveTexture(GL_TEXTURE2);
-  containerEmissionMap.Use();
 
   unsigned uboVP;
   glGenBuffers(1, &uboVP);
-  glBindBuffer(GL_UNIFORM_BUFFER, uboVP);
+  gl.BindBuffer(GL_UNIFORM_BUFFER, uboVP);
   // allocate memory for two float4x4 matrices
   glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
 
-  glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboVP, 0, 2 * sizeof(glm::mat4));
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  gl.BindBufferRange(GL_UNIFORM_BUFFER, 0, uboVP, 0, 2 * sizeof(glm::mat4));
+  gl.BindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  // draws of a view, sorted by state and depth and submitted at the end of drawScene
+  RenderQueue renderQueue;
 
   glm::vec4 clear_color = {0.4f, 0.55f, 0.9f, 0.75f};
   glm::vec4 highlight_color = {0.4f, 0.55f, 0.9f, 0.75f};
@@ -596,15 +669,29 @@ int Engine::Main()
   float frameBeg = (float)glfwGetTime();
   bool showMirror = false;
 
+  // the setup above left state the cache may not have seen
+  gl.Invalidate();
+
   // Main loop
   while (!glfwWindowShouldClose((GLFWwindow*)_window))
   {
     float frameEnd = (float)glfwGetTime();
+    const float frameTime = frameEnd - frameBeg;
     // process input
     //glfwPollEvents();
-    processInput(frameEnd - frameBeg);
+    processInput(frameTime);
     frameBeg = frameEnd;
 
+    // finish the lazy loads whose worker part is done, prefetch if the last frame left time
+    resources.Update(frameTime * 1000.0);
+
+    // finish background texture loads within this frame's upload budget
+    TextureStreamer::Instance().Update();
+    // free the GL textures and mesh buffers nothing references any more, then fit the textures into the VRAM budget
+    TextureRegistry::Instance().CollectGarbage();
+    GeometryRegistry::Instance().CollectGarbage();
+    TextureResidency::Instance().Update();
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -616,6 +703,29 @@ int Engine::Main()
     static bool highlight = false;
     static float highlightAmount = 0.01f;
     static int shSky_selected = 1;
+    static LodView lodView;
+    static CullView cullView;
+    // counters of the last rendered frame are shown, this frame's are collected while drawing
+    static ClusterCullStats cullStats, lastCullStats;
+    lastCullStats = cullStats;
+    cullStats = ClusterCullStats();
+    static RenderQueueStats queueStats, lastQueueStats;
+    lastQueueStats = queueStats;
+    queueStats = RenderQueueStats();
+    static UniformUploadStats lastUniformStats;
+    lastUniformStats = Shader::UploadStats();
+    Shader::ResetUploadStats();
+    static GLStateStats lastGLStats;
+    static size_t lastGLValidated = 0;
+    lastGLStats = gl.Stats();
+    gl.ResetStats();
+
+    // decode/upload the next streamed meshes, prioritized with last frame's views
+    MeshStreamer::Instance().BeginFrame();
+    if (Model* streamed = destructor.Acquire())
+      streamed->Stream(destructorModel, lodView, cullView);
+    if (Model* streamed = sponza.Acquire())
+      streamed->Stream(sponzaModel, lodView, cullView);
 
     // GUI related stuff
     {
@@ -750,18 +860,337 @@ int Engine::Main()
       const char* truestr = "true"; const char* falsestr = "false";
       ImGui::Text("Show mirror = %s", showMirror ? truestr : falsestr);*/
 
+      if (ImGui::CollapsingHeader("Resources"))
+      {
+        ResourceStats stats = resources.Stats();
+        ImGui::Text("Declared: %zu, ready %zu, loading %zu, failed %zu", stats.declared, stats.ready, stats.loading, stats.failed);
+        ImGui::Text("Loaded on first use: %zu, prefetched while idle: %zu", stats.onDemandLoads, stats.prefetchLoads);
+        if (ImGui::Button("Prefetch everything"))
+        {
+          for (const TextureHandle* handle : {&texture1, &texture2, &containerDiffuseMap, &containerSpecularMap, &containerEmissionMap})
+            resources.Prefetch(*handle);
+          resources.Prefetch(skyBox);
+          resources.Prefetch(skyBox2);
+          for (const ModelHandle* handle : {&guitarBag, &singapore, &destructor, &sponza})
+            resources.Prefetch(*handle);
+        }
+        static const char* stateNames[] = {"declared", "loading", "ready", "failed"};
+        static std::vector<std::pair<std::string, ResourceState>> declared;
+        resources.List(declared);
+        for (const auto& resource : declared)
+          ImGui::BulletText("%s: %s", resource.first.c_str(), stateNames[(int)resource.second]);
+      }
+
+      if (ImGui::CollapsingHeader("Texture streaming"))
+      {
+        TextureStreamer& streamer = TextureStreamer::Instance();
+        static int budgetMB = (int)(streamer.FrameBudget() / (1024 * 1024));
+        if (ImGui::SliderInt("Upload budget (MB/frame)", &budgetMB, 1, 64))
+          streamer.SetFrameBudget((size_t)budgetMB * 1024 * 1024);
+        ImGui::Text("Decoding: %zu  Waiting for upload: %zu", streamer.PendingDecodes(), streamer.PendingUploads());
+        ImGui::Text("Uploaded: %.2f MB this frame, %.1f MB total", streamer.UploadedLastFrame() / (1024.0 * 1024.0), streamer.TotalUploaded() / (1024.0 * 1024.0));
+
+        ImGui::Text("Block compression: %s", Texture::CompressionEnabled() ? "on" : "off");
+        auto textureMemory = [](const char* name, const ModelHandle& handle)
+        {
+          const Model* model = ResidentOrStatus(name, handle);
+          if (!model)
+            return;
+          size_t gpuBytes, uncompressedBytes;
+          model->TextureMemory(gpuBytes, uncompressedBytes);
+          ImGui::Text("%s: %.1f MB textures, %.1f MB saved", name, gpuBytes / (1024.0 * 1024.0),
+            (uncompressedBytes > gpuBytes ? uncompressedBytes - gpuBytes : 0) / (1024.0 * 1024.0));
+        };
+        textureMemory("Backpack", guitarBag);
+        textureMemory("Singapore", singapore);
+
+        TextureRegistryStats registry = TextureRegistry::Instance().Stats();
+        ImGui::Text("Registry: %zu textures, %.1f MB resident", registry.textures, registry.residentBytes / (1024.0 * 1024.0));
+        ImGui::Text("  hits %zu, misses %zu, released %zu", registry.hits, registry.misses, registry.released);
+      }
+
+      if (ImGui::CollapsingHeader("Mesh streaming"))
+      {
+        MeshStreamer& streamer = MeshStreamer::Instance();
+        static int budgetMB = (int)(streamer.FrameBudget() / (1024 * 1024));
+        if (ImGui::SliderInt("Mesh upload budget (MB/frame)", &budgetMB, 1, 64))
+          streamer.SetFrameBudget((size_t)budgetMB * 1024 * 1024);
+        ImGui::Text("Uploaded: %zu meshes, %.2f MB last frame, %.1f MB total", streamer.UploadsLastFrame(),
+          streamer.UploadedLastFrame() / (1024.0 * 1024.0), streamer.TotalUploaded() / (1024.0 * 1024.0));
+        auto streamProgress = [](const char* name, const ModelHandle& handle)
+        {
+          const Model* model = ResidentOrStatus(name, handle);
+          if (!model)
+            return;
+          ModelStreamStats stats = model->StreamStats();
+          if (stats.importing)
+          {
+            ImGui::Text("%s: importing, no cache yet", name);
+            return;
+          }
+          char overlay[96];
+          snprintf(overlay, sizeof(overlay), "%zu/%zu meshes, %.1f/%.1f MB", stats.resident, stats.meshes, stats.residentBytes / (1024.0 * 1024.0),
+            stats.totalBytes / (1024.0 * 1024.0));
+          ImGui::Text("%s", name);
+          ImGui::ProgressBar(stats.Progress(), ImVec2(-1.0f, 0.0f), overlay);
+          ImGui::Text("  %zu decoding/waiting, %zu failed", stats.pending, stats.failed);
+        };
+        streamProgress("Destructor", destructor);
+        streamProgress("Sponza", sponza);
+      }
+
+      if (ImGui::CollapsingHeader("Texture residency"))
+      {
+        TextureResidency& residency = TextureResidency::Instance();
+        static int vramBudgetMB = (int)(residency.Budget() / (1024 * 1024));
+        if (ImGui::SliderInt("VRAM budget (MB)", &vramBudgetMB, 16, 2048))
+          residency.SetBudget((size_t)vramBudgetMB * 1024 * 1024);
+        const TextureResidencyStats& stats = residency.Stats();
+        ImGui::Text("Resident: %.1f / %.1f MB, %zu textures", stats.residentBytes / (1024.0 * 1024.0), stats.budget / (1024.0 * 1024.0), stats.textures);
+        ImGui::Text("Reduced: %zu, restoring %zu", stats.reduced, stats.pendingRestores);
+        ImGui::Text("Evicted: %zu levels, %.1f MB total, %zu restores", stats.levelsDropped, stats.bytesEvicted / (1024.0 * 1024.0), stats.restores);
+      }
+
+      if (ImGui::CollapsingHeader("Cluster culling"))
+      {
+        ImGui::Checkbox("Frustum culling", &cullView.frustumCulling);
+        ImGui::Checkbox("Normal cone culling", &cullView.coneCulling);
+        ImGui::Text("Meshes: %zu, rejected %zu", lastCullStats.meshes, lastCullStats.meshesRejected);
+        size_t rejected = lastCullStats.frustumRejected + lastCullStats.backfaceRejected;
+        ImGui::Text("Meshlets: %zu tested, %zu rejected (%.1f%%)", lastCullStats.meshlets, rejected,
+          lastCullStats.meshlets ? 100.0 * rejected / lastCullStats.meshlets : 0.0);
+        ImGui::Text("  frustum %zu, back-facing %zu", lastCullStats.frustumRejected, lastCullStats.backfaceRejected);
+        static int meshletSelfTest = -1;
+        if (ImGui::Button("Meshlet builder self test"))
+          meshletSelfTest = MeshletBuilder::SelfTest() ? 1 : 0;
+        if (meshletSelfTest >= 0)
+        {
+          ImGui::SameLine();
+          ImGui::Text(meshletSelfTest ? "passed" : "failed, see the log");
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Render queue"))
+      {
+        bool sorting = renderQueue.Sorting();
+        if (ImGui::Checkbox("Sort draw items", &sorting))
+          renderQueue.SetSorting(sorting);
+        ImGui::Text("Items: %zu, draws %zu, sort %.3f ms", lastQueueStats.items, lastQueueStats.submitted.draws, lastQueueStats.sortMs);
+        auto stateChanges = [](const char* name, const RenderStateCounts& counts)
+        {
+          ImGui::Text("%s: %zu state changes", name, counts.Total());
+          ImGui::Text("  programs %zu, texture sets %zu (%zu binds), VAOs %zu, uniforms %zu", counts.programs, counts.materials,
+            counts.textureBinds, counts.vaos, counts.uniforms);
+        };
+        stateChanges("Push order", lastQueueStats.pushOrder);
+        stateChanges("Submitted", lastQueueStats.submitted);
+      }
+
+      if (ImGui::CollapsingHeader("Uniforms"))
+      {
+        ImGui::Text("Object shader: %zu active uniforms reflected", objectShader->Uniforms().size());
+        const size_t calls = lastUniformStats.issued + lastUniformStats.skipped;
+        ImGui::Text("Last frame: %zu uploads issued, %zu skipped unchanged (%.1f%%), %zu to inactive uniforms", lastUniformStats.issued,
+          lastUniformStats.skipped, calls ? 100.0 * lastUniformStats.skipped / calls : 0.0, lastUniformStats.inactive);
+        static UniformBenchmark benchmark;
+        // blocks the frame for the duration of the runs
+        if (ImGui::Button("Benchmark uniform setting"))
+          benchmark = objectShader->BenchmarkUniforms();
+        if (benchmark.frames)
+        {
+          ImGui::Text("%zu uniforms per frame, %u frames", benchmark.uniforms, benchmark.frames);
+          ImGui::Text("  string + glGetUniformLocation %.4f ms, handle %.4f ms (%.1fx)", benchmark.stringMs, benchmark.handleMs,
+            benchmark.handleMs > 0.0 ? benchmark.stringMs / benchmark.handleMs : 0.0);
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Lights"))
+      {
+        const LightSystemStats& lightStats = lights.Stats();
+        ImGui::Text("%zu lights in the buffer (room for %zu), last upload %zu bytes", lightStats.lights, lightStats.capacity,
+          lightStats.uploaded ? lightStats.bytes : 0);
+        int swarm = (int)swarmIds.size();
+        if (ImGui::SliderInt("Swarm lights", &swarm, 0, 1024))
+        {
+          while ((int)swarmIds.size() > swarm)
+          {
+            lights.Remove(swarmIds.back());
+            swarmIds.pop_back();
+            swarmOrbits.pop_back();
+          }
+          while ((int)swarmIds.size() < swarm)
+          {
+            Light light;
+            light.diffuse = glm::vec3(uni_unit(gen), uni_unit(gen), uni_unit(gen));
+            light.specular = light.diffuse;
+            // reaches ~7 units
+            light.linear = 0.7f;
+            light.quadratic = 1.8f;
+            swarmIds.push_back(lights.Add(light));
+            swarmOrbits.emplace_back(2.0f + 10.0f * uni_unit(gen), 6.0f * uni_unit(gen) - 3.0f, 6.2832f * uni_unit(gen),
+              (uni_unit(gen) < 0.5f ? -1.0f : 1.0f) * (0.5f + uni_unit(gen)));
+          }
+        }
+      }
+
+      if (ImGui::CollapsingHeader("GL state"))
+      {
+        const size_t calls = lastGLStats.issued + lastGLStats.skipped;
+        ImGui::Text("Last frame: %zu calls issued, %zu skipped redundant (%.1f%%)", lastGLStats.issued, lastGLStats.skipped,
+          calls ? 100.0 * lastGLStats.skipped / calls : 0.0);
+        bool validation = gl.Validation();
+        // glGet per skipped call and a full sweep per frame, stalls the pipeline
+        if (ImGui::Checkbox("Validate cache against GL", &validation))
+          gl.SetValidation(validation);
+        if (validation)
+          ImGui::Text("Mismatches: %zu last frame, %zu of them in the sweep", lastGLStats.mismatches, lastGLValidated);
+      }
+
+      if (ImGui::CollapsingHeader("Level of detail"))
+      {
+        ImGui::SliderInt("Force LOD (-1 = auto)", &lodView.forcedLod, -1, (int)Model::MaxLods - 1);
+        ImGui::SliderFloat("Max pixel error", &lodView.maxPixelError, 0.1f, 16.0f, "%.1f");
+        ImGui::SliderFloat("Hysteresis", &lodView.hysteresis, 0.0f, 0.5f, "%.2f");
+        auto lodTriangles = [](const char* name, const ModelHandle& handle)
+        {
+          const Model* model = ResidentOrStatus(name, handle);
+          if (!model)
+            return;
+          ImGui::Text("%s: %zu triangles drawn", name, model->SelectedTriangles());
+          for (unsigned lod = 0; lod < model->LodCount(); ++lod)
+          {
+            ImGui::SameLine();
+            ImGui::Text("| LOD%u %zu", lod, model->LodTriangles(lod));
+          }
+        };
+        lodTriangles("Backpack", guitarBag);
+        lodTriangles("Singapore", singapore);
+      }
+
+      if (ImGui::CollapsingHeader("Geometry memory"))
+      {
+        auto geometryMemory = [](const char* name, const ModelHandle& handle)
+        {
+          const Model* model = ResidentOrStatus(name, handle);
+          if (!model)
+            return;
+          const ModelLoadStats& stats = model->LoadStats();
+          ImGui::Text("%s: %.1f MB vertices + indices (float layout %.1f MB)", name, stats.gpuBytes / (1024.0 * 1024.0),
+            stats.floatBytes / (1024.0 * 1024.0));
+          ImGui::Text("  dedup: %.1f MB not uploaded, %zu draw calls saved (%zu instanced, %zu shared)", stats.dedupBytes / (1024.0 * 1024.0),
+            stats.drawsSaved, stats.instancedMeshes, stats.sharedMeshes);
+        };
+        geometryMemory("Backpack", guitarBag);
+        geometryMemory("Singapore", singapore);
+        geometryMemory("Destructor", destructor);
+        geometryMemory("Sponza", sponza);
+        GeometryRegistryStats registry = GeometryRegistry::Instance().Stats();
+        ImGui::Text("Geometry registry: %zu shared, hits %zu, misses %zu (%zu key collisions), %.1f MB not uploaded",
+          registry.geometries, registry.hits, registry.misses, registry.collisions, registry.sharedBytes / (1024.0 * 1024.0));
+        if (const Model* resident = singapore.Resident())
+        {
+          const QuantizationError& error = resident->LoadStats().quantError;
+          ImGui::Text("Singapore quantization error: position %.2e, normal %.4f deg, uv %.2e (%s)", error.position, error.normalDegrees,
+            error.texCoord, error.WithinTolerance() ? "ok" : "over tolerance");
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Asset pack"))
+      {
+        AssetPack& pack = AssetPack::Instance();
+        AssetPackStats stats = pack.Stats();
+        if (pack.IsMounted())
+        {
+          ImGui::Text("%zu files, %.1f MB", stats.files, stats.packBytes / (1024.0 * 1024.0));
+          ImGui::Text("Read %zu files, %.1f MB in %.1f ms, %zu chunks", stats.reads, stats.bytesRead / (1024.0 * 1024.0), stats.readMs,
+            stats.chunksDecompressed);
+          static int verified = -1;
+          if (ImGui::Button("Verify content hashes"))
+            verified = pack.Verify() ? 1 : 0;
+          if (verified >= 0)
+          {
+            ImGui::SameLine();
+            ImGui::Text(verified ? "ok" : "mismatch, see the log");
+          }
+        }
+        else
+          ImGui::Text("No pack mounted, reading loose files");
+      }
+
+      if (ImGui::CollapsingHeader("File IO"))
+      {
+        VfsStats io = Vfs::Instance().Stats();
+        ImGui::Text("Backend: %s, queue depth %u", io.backend, Vfs::QueueDepth);
+        ImGui::Text("Queued %zu, in flight %zu (max %zu)", io.queued, io.inFlight, io.maxInFlight);
+        ImGui::Text("%zu requests, %zu failed, %zu from the pack", io.requests, io.failed, io.packReads);
+        ImGui::Text("%.1f MB in %.1f ms busy, %.1f MB/s, %zu submits", io.bytesRead / (1024.0 * 1024.0), io.busyMs, io.ThroughputMBs(),
+          io.submitCalls);
+        static VfsBenchmark benchmark;
+        // blocks the frame for the duration of the runs
+        if (ImGui::Button("Benchmark ../Resources"))
+          benchmark = Vfs::Benchmark("../Resources");
+        if (benchmark.files)
+          ImGui::Text("%zu files (%s cache): blocking %.1f ms, %s %.1f ms, %.2fx", benchmark.files, benchmark.coldCache ? "cold" : "warm",
+            benchmark.blockingMs, benchmark.backend, benchmark.vfsMs, benchmark.Speedup());
+      }
+
+      if (ImGui::CollapsingHeader("Geometry codec"))
+      {
+        ImGui::Text("Decoder: %s", GeometryCodec::DecoderName());
+        static int selfTest = -1;
+        if (ImGui::Button("Self test"))
+          selfTest = GeometryCodec::SelfTest() ? 1 : 0;
+        if (selfTest >= 0)
+        {
+          ImGui::SameLine();
+          ImGui::Text(selfTest ? "passed" : "failed, see the log");
+        }
+        static GeometryCodecBenchmark benchmark;
+        // blocks the frame for the duration of the runs
+        if (ImGui::Button("Benchmark"))
+          benchmark = GeometryCodec::Benchmark();
+        if (benchmark.vertices)
+        {
+          ImGui::Text("%zu vertices: %.1f%% of raw, encode %.2f GB/s, decode %.2f GB/s", benchmark.vertices, benchmark.VertexRatio() * 100.0,
+            benchmark.vertexEncodeGBs, benchmark.vertexDecodeGBs);
+          ImGui::Text("%zu indices: %.1f%% of raw, encode %.2f GB/s, decode %.2f GB/s", benchmark.indices, benchmark.IndexRatio() * 100.0,
+            benchmark.indexEncodeGBs, benchmark.indexDecodeGBs);
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Import benchmark"))
+      {
+        static std::vector<ImportBenchmark> benchmarks;
+        // blocks the frame for the duration of the runs
+        if (ImGui::Button("Assimp vs native OBJ"))
+        {
+          benchmarks.clear();
+          benchmarks.push_back(Model::BenchmarkImport("../Resources/backpack/backpack.obj"));
+          benchmarks.push_back(Model::BenchmarkImport("../Resources/singapore/untitled.obj"));
+        }
+        for (const ImportBenchmark& benchmark : benchmarks)
+        {
+          ImGui::Text("%s", benchmark.path.c_str());
+          ImGui::Text("  assimp %.1f ms, native %.1f ms (%.2fx), %zu triangles", benchmark.assimpMs, benchmark.nativeMs, benchmark.Speedup(),
+            benchmark.triangles);
+          ImGui::Text("  vertices: assimp %zu, native %zu", benchmark.assimpVertices, benchmark.nativeVertices);
+        }
+      }
+
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+      ImGui::Text("Uniform uploads %zu, skipped %zu", lastUniformStats.issued, lastUniformStats.skipped);
+      ImGui::Text("GL state calls %zu, skipped %zu", lastGLStats.issued, lastGLStats.skipped);
       ImGui::End();
     }
 
     // Rendering
     // 1. pass
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, framebuf);
     //glClearColor(0.1f, 0.15f, 0.3f, 0.75f);
     //glClearColor(0.01f, 0.01f, 0.01f, 0.75f);
     glClearColor(clear_color.x* clear_color.w, clear_color.y* clear_color.w, clear_color.z* clear_color.w, clear_color.w);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
+    gl.Enable(GL_DEPTH_TEST);
 
     if (!_pause)
     {
@@ -778,36 +1207,44 @@ int Engine::Main()
       glm::mat4 view = cam.GetViewMatrix();
 
       glm::mat4 projection = glm::perspective(glm::radians(cam._fov), texWidth / texHeight, 0.1f, 100.0f);
+      lodView.cameraPosition = cam._pos;
+      lodView.projScale = texHeight / (2.0f * glm::tan(glm::radians(cam._fov) * 0.5f));
+      cullView.Set(projection * view, cam._pos);
       //projection = glm::ortho(-(float)_width / 256, (float)_width / 256, -(float)_height / 256, (float)_height / 256, -100.1f, 100.0f);
 
-      glBindBuffer(GL_UNIFORM_BUFFER, uboVP);
+      gl.BindBuffer(GL_UNIFORM_BUFFER, uboVP);
       glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(view));
       glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(projection));
-      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      gl.BindBuffer(GL_UNIFORM_BUFFER, 0);
+
+      // everything below is queued and submitted sorted at the end, per-program uniforms are set right away
+      renderQueue.Begin(cam._pos, cam._front, 0.1f, 100.0f);
+      // the 36 vertex cubes of the skybox, light sources and containers
+      DrawItem cube;
+      cube.count = 36;
 
-      // draw skybox first
-      glDepthMask(GL_FALSE);
-      glStencilMask(0);
+      // skybox in the background pass, drawn first without depth writes
       skyBoxShader->Use();
       // ... set view and projection matrix
-      skyBoxShader->SetMat4("skyBoxView", glm::mat4(glm::mat3(view)));
+      skyBoxShader->SetMat4(SceneUniforms::SkyBoxView, glm::mat4(glm::mat3(view)));
       // skyBoxShader->SetMat4("projection", projection);
-      glBindVertexArray(skyboxVAO);
+      unsigned skyCubeMap = 0;
       if (shSky_selected == 1)
-        skyBox.Use();
+        skyCubeMap = skyBox.Id();
       else if (shSky_selected == 2)
-        skyBox2.Use();
-      else
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-
-      glDrawArrays(GL_TRIANGLES, 0, 36);
-      glDepthMask(GL_TRUE);
-      glStencilMask(0xFF);
+        skyCubeMap = skyBox2.Id();
+
+      DrawItem sky = cube;
+      sky.shader = skyBoxShader;
+      sky.vao = skyboxVAO;
+      sky.cubeMap = skyCubeMap;
+      sky.hasModel = false;
+      renderQueue.Push(RenderPass::Background, sky, cam._pos);
       // ... draw rest of the scene
 
       // set lighting properties
       lightSourceCube->Use();
-      lightSourceCube->SetVec3("lightColor", glm::vec3(1.0f) * (float)_lightColorIntensity / 100.0f);
+      lightSourceCube->SetVec3(SceneUniforms::LightColor, glm::vec3(1.0f) * (float)_lightColorIntensity / 100.0f);
 
       // draw light source
       // lightSourceCube->SetMat4("view", view);
@@ -826,10 +1263,12 @@ int Engine::Main()
 
       model = glm::rotate(model, glm::radians(rotTime * angle), glm::vec3(1.0f, 0.3f * sin(time), 0.5f));
       model = glm::scale(model, glm::vec3(1.0f) * 0.2f);
-      lightSourceCube->SetMat4("model", model);
 
-      glBindVertexArray(VAOs[1]);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+      DrawItem lightCube = cube;
+      lightCube.shader = lightSourceCube;
+      lightCube.vao = VAOs[1];
+      lightCube.model = model;
+      renderQueue.Push(RenderPass::Opaque, lightCube, _positions.lightPos);
 
       // draw material cube(s)
       objectShader->Use();
@@ -837,80 +1276,67 @@ int Engine::Main()
       // objectShader->SetMat4("projection", projection);
 
       shaderSingleColor.Use();
-      shaderSingleColor.SetMat4("view", view);
-      shaderSingleColor.SetMat4("projection", projection);
+      shaderSingleColor.SetMat4(SceneUniforms::View, view);
+      shaderSingleColor.SetMat4(SceneUniforms::Projection, projection);
       objectShader->Use();
 
-      glActiveTexture(GL_TEXTURE0);
-      containerDiffuseMap.Use();
-
-      glActiveTexture(GL_TEXTURE1);
-      containerSpecularMap.Use();
-
-      glActiveTexture(GL_TEXTURE2);
-      containerEmissionMap.Use();
-
-      objectShader->SetVec3("viewPos", cam._pos);
-
-      objectShader->SetVec3("dirLight.ambient", glm::vec3(0.1f)/* * (float)(_lightAmbIntensity  * _lightColorIntensity) / 100.0f / 100.0f*/);
-      objectShader->SetVec3("dirLight.diffuse", glm::vec3(0.0f)/* * (float)(_lightDiffIntensity * _lightColorIntensity) / 100.0f / 100.0f*/);
-      objectShader->SetVec3("dirLight.specular", glm::vec3(0.0f)/* * (float)(_lightSpecIntensity * _lightColorIntensity) / 100.0f / 100.0f*/);
-      objectShader->SetVec3("dirLight.direction", glm::vec3(0.0f, -50.0f, 0.0f));
+      // only the containers use these, hidden ones never load them
+      if (showContainers)
+      {
+        gl.ActiveTexture(GL_TEXTURE0);
+        containerDiffuseMap.Use();
 
-      //lightShader->SetVec3("pointLight.direction", newLightPos);
-      objectShader->SetVec3("pointLight.position", _positions.lightPos);
-      // ambient part should not be there
-      objectShader->SetVec3("pointLight.ambient", glm::vec3(0.0f) * (float)(_lightAmbIntensity * _lightColorIntensity) / 100.0f / 100.0f);
-      objectShader->SetVec3("pointLight.diffuse", glm::vec3(1.0f) * (float)(_lightDiffIntensity * _lightColorIntensity) / 100.0f / 100.0f);
-      objectShader->SetVec3("pointLight.specular", glm::vec3(1.0f) * (float)(_lightSpecIntensity * _lightColorIntensity) / 100.0f / 100.0f);
+        gl.ActiveTexture(GL_TEXTURE1);
+        containerSpecularMap.Use();
 
+        gl.ActiveTexture(GL_TEXTURE2);
+        containerEmissionMap.Use();
+      }
 
-      objectShader->SetFloat("pointLight.constant", 1.0f);
-      objectShader->SetFloat("pointLight.linear", 0.09f);
-      objectShader->SetFloat("pointLight.quadratic", 0.032f);
+      objectShader->SetVec3(SceneUniforms::ViewPos, cam._pos);
 
-      std::stringstream s;
-      s << "pointLights[";
-      std::streampos cur = s.tellp();
+      const float diffuseIntensity = (float)(_lightDiffIntensity * _lightColorIntensity) / 100.0f / 100.0f;
+      const float specularIntensity = (float)(_lightSpecIntensity * _lightColorIntensity) / 100.0f / 100.0f;
+      if (Light* light = lights.Get(cubeLightId))
+      {
+        light->position = _positions.lightPos;
+        light->diffuse = glm::vec3(1.0f) * diffuseIntensity;
+        light->specular = glm::vec3(1.0f) * specularIntensity;
+      }
 
       glm::vec3 movedPosisitons[4];
-
       for (int i = 0; i < 4; ++i)
       {
         movedPosisitons[i] = _positions.pointLightPositions[i] + glm::vec3(randRadius[i] * cos(randsgn[i] * posTime), randRadius[i] * cos(posTime), randRadius[i] * sin(randsgn[3 - i] * posTime));
-        s.seekp(cur);
-        s << i << "].position";
-        s.put('\0');
-        objectShader->SetVec3(s.str(), movedPosisitons[i]);
-
-        s.seekp(cur + std::streampos(3));
-        s << "diffuse";
-        s.put('\0');
-        objectShader->SetVec3(s.str(), glm::vec3(1.0f) * (float)(_lightDiffIntensity * _lightColorIntensity) / 100.0f / 100.0f);
-
-        s.seekp(cur + std::streampos(3));
-        s << "specular";
-        s.put('\0');
-        objectShader->SetVec3(s.str(), glm::vec3(1.0f) * (float)(_lightSpecIntensity * _lightColorIntensity) / 100.0f / 100.0f);
-
-        s.seekp(cur + std::streampos(3));
-        s << "constant";
-        s.put('\0');
-        objectShader->SetFloat(s.str(), 1.0f);
-
-        s.seekp(cur + std::streampos(3));
-        s << "linear";
-        s.put('\0');
-        objectShader->SetFloat(s.str(), 0.09f);
-
-        s.seekp(cur + std::streampos(3));
-        s << "quadratic";
-        s.put('\0');
-        objectShader->SetFloat(s.str(), 0.032f);
+        if (Light* light = lights.Get(pointLightIds[i]))
+        {
+          light->position = movedPosisitons[i];
+          light->diffuse = glm::vec3(1.0f) * diffuseIntensity;
+          light->specular = glm::vec3(1.0f) * specularIntensity;
+        }
+      }
+
+      if (Light* light = lights.Get(flashLightId))
+      {
+        light->position = cam._pos;
+        light->direction = cam._front;
+        light->ambient = glm::vec3(0.1f) * (float)(_spotLightColorIntensity) / 100.0f;
+        light->diffuse = glm::vec3(1.0f) * (float)(_spotLightColorIntensity) / 100.0f;
+        light->specular = glm::vec3(1.0f) * (float)(_spotLightColorIntensity) / 100.0f;
+      }
+
+      // orbit: xyz radius/height/phase, w speed and direction
+      for (size_t i = 0; i < swarmIds.size(); ++i)
+      {
+        const glm::vec4& orbit = swarmOrbits[i];
+        if (Light* light = lights.Get(swarmIds[i]))
+          light->position = _positions.cubePositions[0] + glm::vec3(orbit.x * cos(orbit.w * posTime + orbit.z), orbit.y, orbit.x * sin(orbit.w * posTime + orbit.z));
       }
 
+      // one buffer write for all of them
+      lights.Upload();
+
       // Draw all point lights
-      lightSourceCube->Use();
       for (auto& position : movedPosisitons)
       {
         glm::mat4 model(1.0f);
@@ -921,10 +1347,9 @@ int Engine::Main()
 
         model = glm::rotate(model, glm::radians(rotTime * angle), glm::vec3(1.0f, 0.3f * sin(time), 0.5f));
         model = glm::scale(model, glm::vec3(1.0f) * 0.2f);
-        lightSourceCube->SetMat4("model", model);
 
-        glBindVertexArray(VAOs[1]);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        lightCube.model = model;
+        renderQueue.Push(RenderPass::Opaque, lightCube, position);
       }
 
       auto setShaderVars = [&](Shader* sh)
@@ -932,30 +1357,16 @@ int Engine::Main()
         if (sh->_ID == _shaders[(int)ShadersTypes::CubeMapReflect]->_ID || sh->_ID == _shaders[(int)ShadersTypes::CubeMapRefract]->_ID)
         {
           sh->Use();
-          sh->SetVec3("cameraPos", cam._pos);
+          sh->SetVec3(SceneUniforms::CameraPos, cam._pos);
           // sh->SetMat4("view", view);
           // sh->SetMat4("projection", projection);
         }
         else if (sh->_ID == _shaders[(int)ShadersTypes::LightingCube]->_ID || sh->_ID == _shaders[(int)ShadersTypes::LightingCubeExplosion]->_ID)
         {
           sh->Use();
-
-          sh->SetVec3("spotLight.ambient", glm::vec3(0.1f) * (float)(_spotLightColorIntensity) / 100.0f);
-          sh->SetVec3("spotLight.diffuse", glm::vec3(1.0f) * (float)(_spotLightColorIntensity) / 100.0f);
-          sh->SetVec3("spotLight.specular", glm::vec3(1.0f) * (float)(_spotLightColorIntensity) / 100.0f);
-
-          sh->SetVec3("spotLight.position", cam._pos);
-          sh->SetVec3("spotLight.direction", cam._front);
-          sh->SetFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-          sh->SetFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-
-          sh->SetFloat("spotLight.constant", 1.0f);
-          sh->SetFloat("spotLight.linear", 0.09f);
-          sh->SetFloat("spotLight.quadratic", 0.032f);
-
           if (sh->_ID == _shaders[(int)ShadersTypes::LightingCubeExplosion]->_ID)
           {
-            sh->SetFloat("time", frameEnd);
+            sh->SetFloat(SceneUniforms::Time, frameEnd);
           }
         }
       };
@@ -965,8 +1376,11 @@ int Engine::Main()
 
       auto drawContainers = [&]()
       {
-        cmReflectRefract->Use();
-        glBindVertexArray(VAOs[0]);
+        // they reflect the skybox
+        DrawItem container = cube;
+        container.shader = cmReflectRefract;
+        container.vao = VAOs[0];
+        container.cubeMap = skyCubeMap;
         for (int i = 0; i < _materials.size(); ++i)
         {
           auto& material = _materials[i];
@@ -985,9 +1399,9 @@ int Engine::Main()
 
           angle = rotTime * (-20.0f);
           model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f * sin(time), 0.5f));
-          cmReflectRefract->SetMat4("model", model);
 
-          glDrawArrays(GL_TRIANGLES, 0, 36);
+          container.model = model;
+          renderQueue.Push(RenderPass::Opaque, container, glm::vec3(model[3]));
         }
       };
 
@@ -998,28 +1412,34 @@ int Engine::Main()
 
       auto drawGuitarBag = [&]()
       {
+        Model* guitarBagModel = guitarBag.Acquire();
+        if (!guitarBagModel)
+          return;
         model = glm::mat4(1.0);
         glm::vec3 bagPos(0.0f, 5.0f, 1.0f);
         model = glm::translate(model, bagPos);
         //model = glm::rotate(model, glm::degrees(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
-        objectShader->SetMat4("model", model);
-        objectShader->SetFloat("material.shininess", 64.0f);
-        guitarBag.Draw(*objectShader);
+        objectShader->SetFloat(SceneUniforms::Shininess, 64.0f);
+        guitarBagModel->SelectLod(model, lodView);
+        guitarBagModel->Cull(model, cullView, cullStats);
+        guitarBagModel->Submit(renderQueue, RenderPass::Opaque, *objectShader, model);
 
         if (highlight)
         {
           model = glm::scale(model, glm::vec3(1.0f) + glm::vec3(highlightAmount));
           shaderSingleColor.Use();
-          shaderSingleColor.SetVec4("highLightColor", highlight_color);
-          shaderSingleColor.SetMat4("model", model);
-          guitarBag.Highlight(shaderSingleColor);
+          shaderSingleColor.SetVec4(SceneUniforms::HighlightColor, highlight_color);
+          guitarBagModel->Submit(renderQueue, RenderPass::Highlight, shaderSingleColor, model);
         }
 
       };
 
       auto drawSingapore = [&]()
       {
+        Model* singaporeModel = singapore.Acquire();
+        if (!singaporeModel)
+          return;
         objectShader->Use();
         model = glm::mat4(1.0);
         glm::vec3 singaporePos(0.0f, -5.0f, 1.0f);
@@ -1036,27 +1456,39 @@ int Engine::Main()
         lightShader->SetFloat("dirLight.linear", 0.0f);
         lightShader->SetFloat("dirLight.quadratic", 0.0f);*/
 
-        objectShader->SetMat4("model", model);
         /*lightShader->SetVec3("material.ambient", obsidian.ambient);
         lightShader->SetVec3("material.diffuse", obsidian.diffuse);
         lightShader->SetVec3("material.specular", obsidian.specular);
         lightShader->SetFloat("material.shininess", obsidian.shininess);*/
 
-        singapore.Draw(*objectShader);
+        singaporeModel->SelectLod(model, lodView);
+        singaporeModel->Cull(model, cullView, cullStats);
+        singaporeModel->Submit(renderQueue, RenderPass::Opaque, *objectShader, model);
         if (highlight)
         {
           model = glm::scale(model, glm::vec3(1.0f) + glm::vec3(highlightAmount));
           shaderSingleColor.Use();
-          shaderSingleColor.SetVec4("highLightColor", highlight_color);
-          shaderSingleColor.SetMat4("model", model);
-          singapore.Highlight(shaderSingleColor);
+          shaderSingleColor.SetVec4(SceneUniforms::HighlightColor, highlight_color);
+          singaporeModel->Submit(renderQueue, RenderPass::Highlight, shaderSingleColor, model);
         }
       };
-      //destructor.Draw(*lightShader);
-      //sponza.Draw(*lightShader);
+      // only the resident meshes of a streaming model are drawn
+      auto drawStreamed = [&](ModelHandle& handle, const glm::mat4& streamedModel)
+      {
+        Model* streamed = handle.Acquire();
+        if (!streamed)
+          return;
+        streamed->SelectLod(streamedModel, lodView);
+        streamed->Cull(streamedModel, cullView, cullStats);
+        streamed->Submit(renderQueue, RenderPass::Opaque, *objectShader, streamedModel);
+      };
 
       drawGuitarBag();
       drawSingapore();
+      drawStreamed(destructor, destructorModel);
+      drawStreamed(sponza, sponzaModel);
+
+      renderQueue.Flush(queueStats);
     };
 
     drawScene(_camera, float(_width), float(_height));
@@ -1066,7 +1498,7 @@ int Engine::Main()
     _camera._right *= -1;*/
     if (showMirror)
     {
-      glBindFramebuffer(GL_FRAMEBUFFER, mirrorBuf);
+      gl.BindFramebuffer(GL_FRAMEBUFFER, mirrorBuf);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
       Camera mirrorCam(_camera);
@@ -1078,16 +1510,16 @@ int Engine::Main()
       _camera._right *= -1;*/
     }
     // 2.pass = draw the screen (quad)
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
     glClearColor(.2f, .2f, .6f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
     _currentEffect->Use();
     glm::mat4 rtTexTransform(1.0f);
     _currentEffect->SetMat4("transform", rtTexTransform);
-    glBindVertexArray(screenQuadVAO);
-    glDisable(GL_DEPTH_TEST);
-    glBindTexture(GL_TEXTURE_2D, textureColor);
+    gl.BindVertexArray(screenQuadVAO);
+    gl.Disable(GL_DEPTH_TEST);
+    gl.BindTexture(GL_TEXTURE_2D, textureColor);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
     // Draw mirror
@@ -1096,8 +1528,8 @@ int Engine::Main()
       //rtTexTransform = glm::translate(rtTexTransform, glm::vec3(0.5f, -0.5f, 0.0f));
       //rtTexTransform = glm::scale(rtTexTransform, glm::vec3(0.33f));
       _currentEffect->SetMat4("transform", rtTexTransform);
-      glBindVertexArray(mirrorQuadVAO);
-      glBindTexture(GL_TEXTURE_2D, texMirror);
+      gl.BindVertexArray(mirrorQuadVAO);
+      gl.BindTexture(GL_TEXTURE_2D, texMirror);
       glTexImage2D(GL_TEXTURE_2D, 2, GL_RGB, mirrorWidth, mirrorHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
 
       /*glBindRenderbuffer(GL_RENDERBUFFER, mirrorRenderBuf);
@@ -1107,6 +1539,11 @@ int Engine::Main()
       glDrawArrays(GL_TRIANGLES, 0, 6);
     }
 
+    // full sweep once the scene is drawn (before the GUI invalidates the cache), the per-call checks only see
+    // what is about to be skipped
+    if (gl.Validation())
+      lastGLValidated = gl.Validate();
+
     // Rendering GUI
     ImGui::Render();
     int width, height;
@@ -1127,20 +1564,35 @@ int Engine::Main()
       ImGui::RenderPlatformWindowsDefault();
       glfwMakeContextCurrent(backup_current_context);
     }
+    // the ImGui backend sets program, VAO, textures, blending, scissor... behind the cache
+    gl.Invalidate();
 
     glfwSwapBuffers((GLFWwindow*)_window);
+    // the startup metric: Main entered -> first frame on screen
+    static bool firstFrame = true;
+    if (firstFrame)
+    {
+      firstFrame = false;
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+      std::cout << "ENGINE::STARTUP::Time to first frame " << ms << " ms (startup graph " << startup.Report().wallMs << " ms)" << std::endl;
+    }
     glfwPollEvents();
   }
 
   // optional: de-allocate all resources once they've outlived their purpose:
   // ------------------------------------------------------------------------
-  glDeleteVertexArrays(2, VAOs);
-  glDeleteBuffers(2, VBOs);
-  glDeleteBuffers(2, EBO);
-
-  glDeleteVertexArrays(1, &screenQuadVAO);
-  glDeleteBuffers(1, &screenQuadVBO);
-
+  gl.DeleteVertexArrays(2, VAOs);
+  gl.DeleteBuffers(2, VBOs);
+  gl.DeleteBuffers(2, EBO);
+
+  gl.DeleteVertexArrays(1, &screenQuadVAO);
+  gl.DeleteBuffers(1, &screenQuadVBO);
+
+  ResourceManager::Instance().Shutdown();
+  TextureStreamer::Instance().Shutdown();
+  TextureRegistry::Instance().Shutdown();
+  GeometryRegistry::Instance().Shutdown();
+  LightSystem::Instance().Shutdown();
   glfwTerminate();
   return 0;
 }
@@ -1170,6 +1622,9 @@ void Engine::InitGLFW()
     return;
   }
 
+  // cook textures to BC1/BC3/BC5/BC7 (.ktx2 next to the image) and upload them precompressed
+  Texture::EnableCompression(true);
+
   int nrAttributes;
   glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &nrAttributes);
   std::cout << "Maximum nr of vertex attributes supported: " << nrAttributes << std::endl;
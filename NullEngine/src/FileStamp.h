@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace NullEngine
+{
+
+// Identity of a source file
+struct FileStamp
+{
+  std::string path;
+  uint64_t size = 0;
+  int64_t mtime = 0;
+};
+
+// size + mtime of a file, false if it does not exist
+inline bool StampFile(const std::string& path, FileStamp& stamp)
+{
+  std::error_code ec;
+  auto size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return false;
+
+  stamp.path = path;
+  stamp.size = size;
+  stamp.mtime = (int64_t)mtime.time_since_epoch().count();
+  return true;
+}
+
+}
@@ -0,0 +1,445 @@
+#include <iostream>
+#include "GLState.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+struct BufferTarget
+{
+  GLenum target;
+  GLenum binding;
+  const char* name;
+};
+
+const BufferTarget bufferTargets[] = {
+  {GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING, "array buffer"},
+  {GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER_BINDING, "element array buffer"},
+  {GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING, "uniform buffer"},
+  {GL_SHADER_STORAGE_BUFFER, GL_SHADER_STORAGE_BUFFER_BINDING, "shader storage buffer"},
+  {GL_COPY_READ_BUFFER, GL_COPY_READ_BUFFER_BINDING, "copy read buffer"},
+  {GL_COPY_WRITE_BUFFER, GL_COPY_WRITE_BUFFER_BINDING, "copy write buffer"},
+  {GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING, "pixel unpack buffer"},
+  {GL_PIXEL_PACK_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING, "pixel pack buffer"},
+  {GL_DRAW_INDIRECT_BUFFER, GL_DRAW_INDIRECT_BUFFER_BINDING, "draw indirect buffer"},
+};
+// GL_ELEMENT_ARRAY_BUFFER's entry, part of the VAO state
+constexpr size_t ElementArraySlot = 1;
+
+struct Capability
+{
+  GLenum capability;
+  const char* name;
+};
+
+const Capability capabilities[] = {
+  {GL_DEPTH_TEST, "depth test"},
+  {GL_STENCIL_TEST, "stencil test"},
+  {GL_CULL_FACE, "cull face"},
+  {GL_BLEND, "blend"},
+  {GL_SCISSOR_TEST, "scissor test"},
+};
+
+}
+
+GLState& GLState::Instance()
+{
+  static GLState state;
+  return state;
+}
+
+template <typename T, typename CheckFn>
+bool GLState::Skip(Cached<T>& cached, const T& value, CheckFn&& check)
+{
+  if (cached.known && cached.value == value && (!_validation || check()))
+  {
+    ++_stats.skipped;
+    return true;
+  }
+  cached.value = value;
+  cached.known = true;
+  ++_stats.issued;
+  return false;
+}
+
+bool GLState::Check(const char* what, GLenum query, GLint expected)
+{
+  GLint actual = 0;
+  glGetIntegerv(query, &actual);
+  if (actual == expected)
+    return true;
+  Report(what, expected, actual);
+  return false;
+}
+
+void GLState::Report(const char* what, GLint cached, GLint actual)
+{
+  ++_stats.mismatches;
+  std::cout << "ERROR::GLSTATE::MISMATCH " << what << ": cached " << cached << ", GL has " << actual << std::endl;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+  if (!Skip(_program, program, [&] { return Check("program", GL_CURRENT_PROGRAM, (GLint)program); }))
+    glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+  if (Skip(_vao, vao, [&] { return Check("vertex array", GL_VERTEX_ARRAY_BINDING, (GLint)vao); }))
+    return;
+  glBindVertexArray(vao);
+  // the element array binding is part of the VAO
+  _buffers[ElementArraySlot].known = false;
+}
+
+void GLState::ActiveTexture(GLenum texture)
+{
+  const GLuint unit = texture - GL_TEXTURE0;
+  if (!Skip(_activeUnit, unit, [&] { return Check("active texture", GL_ACTIVE_TEXTURE, (GLint)texture); }))
+    glActiveTexture(texture);
+}
+
+GLState::Cached<GLuint>* GLState::TextureSlot(GLenum target)
+{
+  if (!_activeUnit.known || _activeUnit.value >= MaxUnits)
+    return nullptr;
+  if (target == GL_TEXTURE_2D)
+    return &_textures2D[_activeUnit.value];
+  if (target == GL_TEXTURE_CUBE_MAP)
+    return &_texturesCube[_activeUnit.value];
+  return nullptr;
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+  Cached<GLuint>* slot = TextureSlot(target);
+  if (!slot)
+  {
+    ++_stats.issued;
+    glBindTexture(target, texture);
+    return;
+  }
+  const GLenum binding = target == GL_TEXTURE_2D ? GL_TEXTURE_BINDING_2D : GL_TEXTURE_BINDING_CUBE_MAP;
+  auto check = [&]
+  {
+    return Check("active texture", GL_ACTIVE_TEXTURE, (GLint)(GL_TEXTURE0 + _activeUnit.value))
+      && Check(target == GL_TEXTURE_2D ? "texture 2D" : "cube map", binding, (GLint)texture);
+  };
+  if (!Skip(*slot, texture, check))
+    glBindTexture(target, texture);
+}
+
+GLState::Cached<GLuint>* GLState::BufferSlot(GLenum target)
+{
+  for (size_t i = 0; i < BufferTargets; ++i)
+    if (bufferTargets[i].target == target)
+      return &_buffers[i];
+  return nullptr;
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+  Cached<GLuint>* slot = BufferSlot(target);
+  if (!slot)
+  {
+    ++_stats.issued;
+    glBindBuffer(target, buffer);
+    return;
+  }
+  const BufferTarget& info = bufferTargets[slot - _buffers];
+  if (!Skip(*slot, buffer, [&] { return Check(info.name, info.binding, (GLint)buffer); }))
+    glBindBuffer(target, buffer);
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+  ++_stats.issued;
+  glBindBufferBase(target, index, buffer);
+  if (Cached<GLuint>* slot = BufferSlot(target))
+  {
+    slot->value = buffer;
+    slot->known = true;
+  }
+}
+
+void GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+  ++_stats.issued;
+  glBindBufferRange(target, index, buffer, offset, size);
+  if (Cached<GLuint>* slot = BufferSlot(target))
+  {
+    slot->value = buffer;
+    slot->known = true;
+  }
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+  const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  auto same = [&](Cached<GLuint>& cached, const char* what, GLenum query)
+  {
+    return cached.known && cached.value == framebuffer && (!_validation || Check(what, query, (GLint)framebuffer));
+  };
+  if ((!draw || same(_drawFramebuffer, "draw framebuffer", GL_DRAW_FRAMEBUFFER_BINDING))
+    && (!read || same(_readFramebuffer, "read framebuffer", GL_READ_FRAMEBUFFER_BINDING)))
+  {
+    ++_stats.skipped;
+    return;
+  }
+  ++_stats.issued;
+  glBindFramebuffer(target, framebuffer);
+  if (draw)
+    _drawFramebuffer = {framebuffer, true};
+  if (read)
+    _readFramebuffer = {framebuffer, true};
+}
+
+GLState::Cached<bool>* GLState::CapabilitySlot(GLenum capability)
+{
+  for (size_t i = 0; i < Capabilities; ++i)
+    if (capabilities[i].capability == capability)
+      return &_capabilities[i];
+  return nullptr;
+}
+
+void GLState::SetCapability(GLenum capability, bool enabled)
+{
+  Cached<bool>* slot = CapabilitySlot(capability);
+  auto check = [&]
+  {
+    const bool actual = glIsEnabled(capability) == GL_TRUE;
+    if (actual != enabled)
+      Report(capabilities[slot - _capabilities].name, enabled, actual);
+    return actual == enabled;
+  };
+  if (slot && Skip(*slot, enabled, check))
+    return;
+  if (!slot)
+    ++_stats.issued;
+  if (enabled)
+    glEnable(capability);
+  else
+    glDisable(capability);
+}
+
+void GLState::Enable(GLenum capability)
+{
+  SetCapability(capability, true);
+}
+
+void GLState::Disable(GLenum capability)
+{
+  SetCapability(capability, false);
+}
+
+void GLState::DepthMask(GLboolean flag)
+{
+  auto check = [&]
+  {
+    GLboolean actual = GL_FALSE;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &actual);
+    if (actual != flag)
+      Report("depth mask", flag, actual);
+    return actual == flag;
+  };
+  if (!Skip(_depthMask, flag, check))
+    glDepthMask(flag);
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+  if (!Skip(_depthFunc, func, [&] { return Check("depth func", GL_DEPTH_FUNC, (GLint)func); }))
+    glDepthFunc(func);
+}
+
+void GLState::StencilFunc(GLenum func, GLint ref, GLuint mask)
+{
+  auto check = [&]
+  {
+    return Check("stencil func", GL_STENCIL_FUNC, (GLint)func) && Check("stencil ref", GL_STENCIL_REF, ref)
+      && Check("stencil value mask", GL_STENCIL_VALUE_MASK, (GLint)mask);
+  };
+  if (!Skip(_stencilFunc, StencilFuncState{func, ref, mask}, check))
+    glStencilFunc(func, ref, mask);
+}
+
+void GLState::StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass)
+{
+  auto check = [&]
+  {
+    return Check("stencil fail", GL_STENCIL_FAIL, (GLint)stencilFail) && Check("stencil depth fail", GL_STENCIL_PASS_DEPTH_FAIL, (GLint)depthFail)
+      && Check("stencil depth pass", GL_STENCIL_PASS_DEPTH_PASS, (GLint)depthPass);
+  };
+  if (!Skip(_stencilOp, StencilOpState{stencilFail, depthFail, depthPass}, check))
+    glStencilOp(stencilFail, depthFail, depthPass);
+}
+
+void GLState::StencilMask(GLuint mask)
+{
+  if (!Skip(_stencilMask, mask, [&] { return Check("stencil write mask", GL_STENCIL_WRITEMASK, (GLint)mask); }))
+    glStencilMask(mask);
+}
+
+void GLState::BlendFunc(GLenum source, GLenum destination)
+{
+  auto check = [&]
+  {
+    return Check("blend source", GL_BLEND_SRC_RGB, (GLint)source) && Check("blend destination", GL_BLEND_DST_RGB, (GLint)destination);
+  };
+  if (!Skip(_blendFunc, BlendFuncState{source, destination}, check))
+    glBlendFunc(source, destination);
+}
+
+void GLState::CullFace(GLenum mode)
+{
+  if (!Skip(_cullFace, mode, [&] { return Check("cull face mode", GL_CULL_FACE_MODE, (GLint)mode); }))
+    glCullFace(mode);
+}
+
+void GLState::DeleteTextures(GLsizei count, const GLuint* textures)
+{
+  glDeleteTextures(count, textures);
+  // GL reverts every unit the textures were bound to back to 0
+  for (GLsizei i = 0; i < count; ++i)
+    for (unsigned unit = 0; unit < MaxUnits; ++unit)
+    {
+      if (_textures2D[unit].known && _textures2D[unit].value == textures[i])
+        _textures2D[unit].value = 0;
+      if (_texturesCube[unit].known && _texturesCube[unit].value == textures[i])
+        _texturesCube[unit].value = 0;
+    }
+}
+
+void GLState::DeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+  glDeleteBuffers(count, buffers);
+  for (GLsizei i = 0; i < count; ++i)
+    for (Cached<GLuint>& buffer : _buffers)
+      if (buffer.known && buffer.value == buffers[i])
+        buffer.value = 0;
+  // unbound from VAOs other than the current one too, whatever the cache thought is gone
+  _buffers[ElementArraySlot].known = false;
+}
+
+void GLState::DeleteVertexArrays(GLsizei count, const GLuint* vaos)
+{
+  glDeleteVertexArrays(count, vaos);
+  for (GLsizei i = 0; i < count; ++i)
+    if (_vao.known && _vao.value == vaos[i])
+    {
+      _vao.value = 0;
+      _buffers[ElementArraySlot].known = false;
+    }
+}
+
+void GLState::DeleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+{
+  glDeleteFramebuffers(count, framebuffers);
+  for (GLsizei i = 0; i < count; ++i)
+  {
+    if (_drawFramebuffer.known && _drawFramebuffer.value == framebuffers[i])
+      _drawFramebuffer.value = 0;
+    if (_readFramebuffer.known && _readFramebuffer.value == framebuffers[i])
+      _readFramebuffer.value = 0;
+  }
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+  glDeleteProgram(program);
+  // a current program is only flagged for deletion and stays current
+  if (_program.known && _program.value == program)
+    _program.known = false;
+}
+
+void GLState::Invalidate()
+{
+  const GLStateStats stats = _stats;
+  const bool validation = _validation;
+  *this = GLState();
+  _stats = stats;
+  _validation = validation;
+}
+
+size_t GLState::Validate()
+{
+  const size_t before = _stats.mismatches;
+  auto validate = [&](auto& cached, const char* what, GLenum query)
+  {
+    if (cached.known && !Check(what, query, (GLint)cached.value))
+      cached.known = false;
+  };
+
+  validate(_program, "program", GL_CURRENT_PROGRAM);
+  validate(_vao, "vertex array", GL_VERTEX_ARRAY_BINDING);
+  for (size_t i = 0; i < BufferTargets; ++i)
+    validate(_buffers[i], bufferTargets[i].name, bufferTargets[i].binding);
+  validate(_drawFramebuffer, "draw framebuffer", GL_DRAW_FRAMEBUFFER_BINDING);
+  validate(_readFramebuffer, "read framebuffer", GL_READ_FRAMEBUFFER_BINDING);
+  validate(_depthFunc, "depth func", GL_DEPTH_FUNC);
+  validate(_stencilMask, "stencil write mask", GL_STENCIL_WRITEMASK);
+  validate(_cullFace, "cull face mode", GL_CULL_FACE_MODE);
+  if (_depthMask.known)
+  {
+    GLboolean actual = GL_FALSE;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &actual);
+    if (actual != _depthMask.value)
+    {
+      Report("depth mask", _depthMask.value, actual);
+      _depthMask.known = false;
+    }
+  }
+  for (size_t i = 0; i < Capabilities; ++i)
+  {
+    Cached<bool>& capability = _capabilities[i];
+    const bool actual = glIsEnabled(capabilities[i].capability) == GL_TRUE;
+    if (capability.known && actual != capability.value)
+    {
+      Report(capabilities[i].name, capability.value, actual);
+      capability.known = false;
+    }
+  }
+  if (_stencilFunc.known)
+  {
+    const StencilFuncState& cached = _stencilFunc.value;
+    if (!Check("stencil func", GL_STENCIL_FUNC, (GLint)cached.func) || !Check("stencil ref", GL_STENCIL_REF, cached.ref)
+      || !Check("stencil value mask", GL_STENCIL_VALUE_MASK, (GLint)cached.mask))
+      _stencilFunc.known = false;
+  }
+  if (_stencilOp.known)
+  {
+    const StencilOpState& cached = _stencilOp.value;
+    if (!Check("stencil fail", GL_STENCIL_FAIL, (GLint)cached.stencilFail)
+      || !Check("stencil depth fail", GL_STENCIL_PASS_DEPTH_FAIL, (GLint)cached.depthFail)
+      || !Check("stencil depth pass", GL_STENCIL_PASS_DEPTH_PASS, (GLint)cached.depthPass))
+      _stencilOp.known = false;
+  }
+  if (_blendFunc.known)
+  {
+    const BlendFuncState& cached = _blendFunc.value;
+    if (!Check("blend source", GL_BLEND_SRC_RGB, (GLint)cached.source) || !Check("blend destination", GL_BLEND_DST_RGB, (GLint)cached.destination))
+      _blendFunc.known = false;
+  }
+
+  // texture bindings are per unit: walk the units, then go back to the active one
+  GLint active = GL_TEXTURE0;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  if (_activeUnit.known && !Check("active texture", GL_ACTIVE_TEXTURE, (GLint)(GL_TEXTURE0 + _activeUnit.value)))
+    _activeUnit.known = false;
+  for (unsigned unit = 0; unit < MaxUnits; ++unit)
+  {
+    if (!_textures2D[unit].known && !_texturesCube[unit].known)
+      continue;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    validate(_textures2D[unit], "texture 2D", GL_TEXTURE_BINDING_2D);
+    validate(_texturesCube[unit], "cube map", GL_TEXTURE_BINDING_CUBE_MAP);
+  }
+  glActiveTexture(active);
+  return _stats.mismatches - before;
+}
+
+}
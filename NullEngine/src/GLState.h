@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <glad/glad.h>
+
+namespace NullEngine
+{
+
+struct GLStateStats
+{
+  // calls passed on to GL, and calls dropped because the cache had that state set already
+  size_t issued = 0;
+  size_t skipped = 0;
+  // validation: cached values GL disagreed with
+  size_t mismatches = 0;
+};
+
+// Cache of the binding and fixed-function state the engine sets, GL thread (main context) only.
+// The functions mirror the GL calls they wrap and drop the ones that would set what is set already:
+//  - programs, VAOs, the active unit, 2D/cube map textures per unit, buffers per target (the element
+//    array binding is forgotten on VAO changes, it belongs to the VAO), draw/read framebuffers
+//  - depth test/mask/func, stencil test/func/op/mask, cull face, blend; targets and capabilities
+//    it does not track are passed through
+// Objects must be deleted through it (GL unbinds them and reuses the names). Code that changes state
+// behind it calls Invalidate afterwards.
+class GLState
+{
+public:
+  static GLState& Instance();
+
+  void UseProgram(GLuint program);
+  void BindVertexArray(GLuint vao);
+  void ActiveTexture(GLenum texture);
+  // on the active unit
+  void BindTexture(GLenum target, GLuint texture);
+  void BindBuffer(GLenum target, GLuint buffer);
+  // also bind the buffer to the generic target, like GL does
+  void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+  void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+  void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+  void Enable(GLenum capability);
+  void Disable(GLenum capability);
+  void DepthMask(GLboolean flag);
+  void DepthFunc(GLenum func);
+  void StencilFunc(GLenum func, GLint ref, GLuint mask);
+  void StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass);
+  void StencilMask(GLuint mask);
+  void BlendFunc(GLenum source, GLenum destination);
+  void CullFace(GLenum mode);
+
+  void DeleteTextures(GLsizei count, const GLuint* textures);
+  void DeleteBuffers(GLsizei count, const GLuint* buffers);
+  void DeleteVertexArrays(GLsizei count, const GLuint* vaos);
+  void DeleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+  void DeleteProgram(GLuint program);
+
+  // forgets everything, the next call of each kind is issued
+  void Invalidate();
+
+  // debug: every call about to be dropped first compares the cached value with glGet; a mismatch is
+  // reported and the call issued
+  void SetValidation(bool validation) { _validation = validation; }
+  bool Validation() const { return _validation; }
+  // compares all cached state with glGet, reports and forgets what differs; returns how much did
+  size_t Validate();
+
+  const GLStateStats& Stats() const { return _stats; }
+  void ResetStats() { _stats = GLStateStats(); }
+
+  static constexpr unsigned MaxUnits = 32;
+
+private:
+  template <typename T>
+  struct Cached
+  {
+    T value{};
+    bool known = false;
+  };
+  struct StencilFuncState
+  {
+    GLenum func;
+    GLint ref;
+    GLuint mask;
+    bool operator==(const StencilFuncState& o) const { return func == o.func && ref == o.ref && mask == o.mask; }
+  };
+  struct StencilOpState
+  {
+    GLenum stencilFail;
+    GLenum depthFail;
+    GLenum depthPass;
+    bool operator==(const StencilOpState& o) const { return stencilFail == o.stencilFail && depthFail == o.depthFail && depthPass == o.depthPass; }
+  };
+  struct BlendFuncState
+  {
+    GLenum source;
+    GLenum destination;
+    bool operator==(const BlendFuncState& o) const { return source == o.source && destination == o.destination; }
+  };
+
+  static constexpr size_t BufferTargets = 9;
+  static constexpr size_t Capabilities = 5;
+
+  Cached<GLuint> _program;
+  Cached<GLuint> _vao;
+  // unit index, not GL_TEXTURE0 + index
+  Cached<GLuint> _activeUnit;
+  Cached<GLuint> _textures2D[MaxUnits];
+  Cached<GLuint> _texturesCube[MaxUnits];
+  Cached<GLuint> _buffers[BufferTargets];
+  Cached<GLuint> _drawFramebuffer;
+  Cached<GLuint> _readFramebuffer;
+  Cached<bool> _capabilities[Capabilities];
+  Cached<GLboolean> _depthMask;
+  Cached<GLenum> _depthFunc;
+  Cached<StencilFuncState> _stencilFunc;
+  Cached<StencilOpState> _stencilOp;
+  Cached<GLuint> _stencilMask;
+  Cached<BlendFuncState> _blendFunc;
+  Cached<GLenum> _cullFace;
+  GLStateStats _stats;
+  bool _validation = false;
+
+  GLState() = default;
+  // true if the call can be dropped; otherwise records value as set. check (validation only) compares
+  // the cached value with GL's and reports a mismatch
+  template <typename T, typename Check>
+  bool Skip(Cached<T>& cached, const T& value, Check&& check);
+  // the cache entry of a texture target on the active unit, null if untracked
+  Cached<GLuint>* TextureSlot(GLenum target);
+  Cached<GLuint>* BufferSlot(GLenum target);
+  Cached<bool>* CapabilitySlot(GLenum capability);
+  void SetCapability(GLenum capability, bool enabled);
+  // glGetIntegerv(query) == expected, reports a mismatch
+  bool Check(const char* what, GLenum query, GLint expected);
+  void Report(const char* what, GLint cached, GLint actual);
+};
+
+}
@@ -0,0 +1,851 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "GeometryCodec.h"
+#include "MeshData.h"
+#include "MeshOptimizer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NULLENGINE_SSE2 1
+#endif
+
+// AVX2 is compiled per function and picked at runtime, the rest of the engine stays SSE2
+#if defined(NULLENGINE_SSE2) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define NULLENGINE_AVX2 1
+#define NULLENGINE_AVX2_TARGET
+#elif defined(NULLENGINE_SSE2) && defined(__GNUC__)
+#include <immintrin.h>
+#define NULLENGINE_AVX2 1
+#define NULLENGINE_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace NullEngine
+{
+
+namespace
+{
+
+static_assert(sizeof(Vertex) == 32, "the vertex codec works on 8 32-bit lanes");
+
+constexpr uint8_t VertexStreamTag = 0xA1;
+constexpr uint8_t IndexStreamTag = 0xE1;
+constexpr size_t Lanes = sizeof(Vertex) / 4;
+constexpr size_t Planes = sizeof(Vertex);
+constexpr size_t BlockVertices = GeometryCodec::BlockVertices;
+constexpr size_t BlockHeaderBytes = 8;
+constexpr size_t EdgeFifoSize = 5;     // 3 rotations each, 15 codes + "no edge" in a nibble
+constexpr size_t VertexFifoSize = 14;  // codes 1..14, 0 = next new index, 15 = explicit
+
+enum class Decoder
+{
+  Scalar,
+  Sse2,
+  Avx2
+};
+
+// plane modes: bytes per 16 values
+const size_t PlaneBytes[4] = {0, 4, 8, 16};
+
+uint32_t Zigzag(uint32_t delta) { return (delta << 1) ^ (0u - (delta >> 31)); }
+uint32_t Unzigzag(uint32_t value) { return (value >> 1) ^ (0u - (value & 1)); }
+
+// vertex v of a block is row BitReverse[v] after the unpack transpose
+const uint8_t BitReverse[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+
+bool HasAvx2()
+{
+#if defined(NULLENGINE_AVX2) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  // OSXSAVE + AVX, and the OS saves the ymm registers
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif defined(NULLENGINE_AVX2)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+Decoder BestDecoder()
+{
+  static const Decoder best = HasAvx2() ? Decoder::Avx2 :
+#ifdef NULLENGINE_SSE2
+    Decoder::Sse2;
+#else
+    Decoder::Scalar;
+#endif
+  return best;
+}
+
+// ---------------------------------------------------------------- block layout
+
+// size of a block's planes from its header, the header itself excluded
+size_t BlockDataBytes(uint64_t modes)
+{
+  size_t bytes = 0;
+  for (size_t p = 0; p < Planes; ++p)
+    bytes += PlaneBytes[(modes >> (2 * p)) & 3];
+  return bytes;
+}
+
+void EncodeBlock(const uint8_t (&planes)[Planes][BlockVertices], std::vector<uint8_t>& out)
+{
+  uint64_t modes = 0;
+  for (size_t p = 0; p < Planes; ++p)
+  {
+    uint8_t largest = *std::max_element(planes[p], planes[p] + BlockVertices);
+    uint64_t mode = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+    modes |= mode << (2 * p);
+  }
+  for (size_t i = 0; i < BlockHeaderBytes; ++i)
+    out.push_back((uint8_t)(modes >> (8 * i)));
+
+  for (size_t p = 0; p < Planes; ++p)
+  {
+    const uint8_t* v = planes[p];
+    switch ((modes >> (2 * p)) & 3)
+    {
+    case 1:
+      for (size_t j = 0; j < 4; ++j)
+        out.push_back((uint8_t)(v[4 * j] | (v[4 * j + 1] << 2) | (v[4 * j + 2] << 4) | (v[4 * j + 3] << 6)));
+      break;
+    case 2:
+      for (size_t j = 0; j < 8; ++j)
+        out.push_back((uint8_t)(v[2 * j] | (v[2 * j + 1] << 4)));
+      break;
+    case 3:
+      out.insert(out.end(), v, v + BlockVertices);
+      break;
+    }
+  }
+}
+
+// ---------------------------------------------------------------- scalar decoder
+
+// data: the block's planes, which the caller has bounds checked
+void DecodeBlockScalar(const uint8_t* data, uint64_t modes, uint32_t (&previous)[Lanes], uint8_t* out, size_t count)
+{
+  uint8_t planes[Planes][BlockVertices];
+  for (size_t p = 0; p < Planes; ++p)
+  {
+    uint8_t* v = planes[p];
+    switch ((modes >> (2 * p)) & 3)
+    {
+    case 0:
+      std::memset(v, 0, BlockVertices);
+      break;
+    case 1:
+      for (size_t j = 0; j < BlockVertices; ++j)
+        v[j] = (data[j / 4] >> (2 * (j % 4))) & 3;
+      break;
+    case 2:
+      for (size_t j = 0; j < BlockVertices; ++j)
+        v[j] = (data[j / 2] >> (4 * (j % 2))) & 15;
+      break;
+    case 3:
+      std::memcpy(v, data, BlockVertices);
+      break;
+    }
+    data += PlaneBytes[(modes >> (2 * p)) & 3];
+  }
+
+  for (size_t v = 0; v < count; ++v)
+  {
+    uint32_t lanes[Lanes];
+    for (size_t l = 0; l < Lanes; ++l)
+    {
+      uint32_t z = planes[4 * l][v] | (planes[4 * l + 1][v] << 8) | (planes[4 * l + 2][v] << 16) | ((uint32_t)planes[4 * l + 3][v] << 24);
+      lanes[l] = previous[l] += Unzigzag(z);
+    }
+    std::memcpy(out + v * sizeof(Vertex), lanes, sizeof(Vertex));
+  }
+}
+
+#if defined(NULLENGINE_SSE2) || defined(NULLENGINE_AVX2)
+
+// start of every plane in the block's data
+void PlaneOffsets(uint64_t modes, uint32_t (&offsets)[Planes])
+{
+  uint32_t offset = 0;
+  for (size_t p = 0; p < Planes; ++p)
+  {
+    offsets[p] = offset;
+    offset += (uint32_t)PlaneBytes[(modes >> (2 * p)) & 3];
+  }
+}
+
+// byte masks selecting the expansion of a plane mode: 2-bit, 4-bit, raw (all clear = zero plane)
+alignas(16) const uint8_t ModeMasks[4][3][16] = {
+  {{0}, {0}, {0}},
+  {{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, {0}, {0}},
+  {{0}, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, {0}},
+  {{0}, {0}, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}}};
+
+#endif
+
+// ---------------------------------------------------------------- SSE2 decoder
+
+#ifdef NULLENGINE_SSE2
+
+// One plane as 16 bytes. Branch free: the modes change from plane to plane, so all three
+// expansions are computed and masked. Always reads 16 bytes, the caller pads the stream end.
+__m128i ExpandPlane(const uint8_t* data, unsigned mode)
+{
+  const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+  const __m128i mask2 = _mm_set1_epi8(3);
+  const __m128i mask4 = _mm_set1_epi8(15);
+  // 2-bit: byte j holds values 4j..4j+3; 4-bit: low nibble first
+  __m128i a = _mm_and_si128(x, mask2);
+  __m128i b = _mm_and_si128(_mm_srli_epi16(x, 2), mask2);
+  __m128i c = _mm_and_si128(_mm_srli_epi16(x, 4), mask2);
+  __m128i d = _mm_and_si128(_mm_srli_epi16(x, 6), mask2);
+  __m128i pairs = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+  __m128i nibbles = _mm_unpacklo_epi8(_mm_and_si128(x, mask4), _mm_and_si128(_mm_srli_epi16(x, 4), mask4));
+
+  const __m128i* masks = reinterpret_cast<const __m128i*>(ModeMasks[mode]);
+  return _mm_or_si128(_mm_or_si128(_mm_and_si128(pairs, _mm_load_si128(masks)), _mm_and_si128(nibbles, _mm_load_si128(masks + 1))),
+    _mm_and_si128(x, _mm_load_si128(masks + 2)));
+}
+
+// 16x16 byte transpose, row r of the result is column BitReverse[r] of the input
+void Transpose16(__m128i* x)
+{
+  __m128i t[16];
+  for (int i = 0; i < 8; ++i)
+  {
+    t[i] = _mm_unpacklo_epi8(x[2 * i], x[2 * i + 1]);
+    t[i + 8] = _mm_unpackhi_epi8(x[2 * i], x[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    x[i] = _mm_unpacklo_epi16(t[2 * i], t[2 * i + 1]);
+    x[i + 8] = _mm_unpackhi_epi16(t[2 * i], t[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    t[i] = _mm_unpacklo_epi32(x[2 * i], x[2 * i + 1]);
+    t[i + 8] = _mm_unpackhi_epi32(x[2 * i], x[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    x[i] = _mm_unpacklo_epi64(t[2 * i], t[2 * i + 1]);
+    x[i + 8] = _mm_unpackhi_epi64(t[2 * i], t[2 * i + 1]);
+  }
+}
+
+__m128i Unzigzag(__m128i z)
+{
+  return _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi32(1))));
+}
+
+void DecodeBlockSse2(const uint8_t* data, uint64_t modes, uint32_t (&previous)[Lanes], uint8_t* out, size_t count)
+{
+  uint32_t offsets[Planes];
+  PlaneOffsets(modes, offsets);
+  __m128i planes[Planes];
+  for (size_t p = 0; p < Planes; ++p)
+    planes[p] = ExpandPlane(data + offsets[p], (modes >> (2 * p)) & 3);
+  // bytes 0-15 and 16-31 of the vertices
+  Transpose16(planes);
+  Transpose16(planes + 16);
+
+  alignas(16) uint8_t partial[BlockVertices * sizeof(Vertex)];
+  uint8_t* target = count == BlockVertices ? out : partial;
+  __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous));
+  __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + 4));
+  for (size_t v = 0; v < BlockVertices; ++v)
+  {
+    lo = _mm_add_epi32(lo, Unzigzag(planes[BitReverse[v]]));
+    hi = _mm_add_epi32(hi, Unzigzag(planes[16 + BitReverse[v]]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(target + v * sizeof(Vertex)), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(target + v * sizeof(Vertex) + 16), hi);
+  }
+  // the padding deltas are zero, so the running sums are those of the last real vertex
+  if (target == partial)
+    std::memcpy(out, partial, count * sizeof(Vertex));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(previous), lo);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(previous + 4), hi);
+}
+
+#endif
+
+// ---------------------------------------------------------------- AVX2 decoder
+
+#ifdef NULLENGINE_AVX2
+
+// Same as the SSE2 path with planes p and p + 16 in the two halves of a register: the 256-bit
+// unpacks work per 128-bit half, so one transpose yields whole vertices.
+// Everything is written with AVX intrinsics, mixing in the legacy SSE encoded helpers above
+// would pay for the SSE/AVX state transitions on every call.
+// 16 bytes from each pointer, low and high half
+NULLENGINE_AVX2_TARGET inline __m256i LoadPair(const uint8_t* lo, const uint8_t* hi)
+{
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo))),
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)), 1);
+}
+
+NULLENGINE_AVX2_TARGET void DecodeBlockAvx2(const uint8_t* data, uint64_t modes, uint32_t (&previous)[Lanes], uint8_t* out, size_t count)
+{
+  uint32_t offsets[Planes];
+  PlaneOffsets(modes, offsets);
+
+  const __m256i mask2 = _mm256_set1_epi8(3);
+  const __m256i mask4 = _mm256_set1_epi8(15);
+  __m256i x[16];
+  for (size_t p = 0; p < 16; ++p)
+  {
+    const unsigned modeLo = (modes >> (2 * p)) & 3, modeHi = (modes >> (2 * (p + 16))) & 3;
+    __m256i raw = LoadPair(data + offsets[p], data + offsets[p + 16]);
+    __m256i a = _mm256_and_si256(raw, mask2);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi16(raw, 2), mask2);
+    __m256i c = _mm256_and_si256(_mm256_srli_epi16(raw, 4), mask2);
+    __m256i d = _mm256_and_si256(_mm256_srli_epi16(raw, 6), mask2);
+    __m256i pairs = _mm256_unpacklo_epi16(_mm256_unpacklo_epi8(a, b), _mm256_unpacklo_epi8(c, d));
+    __m256i nibbles = _mm256_unpacklo_epi8(_mm256_and_si256(raw, mask4), _mm256_and_si256(_mm256_srli_epi16(raw, 4), mask4));
+
+    x[p] = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(pairs, LoadPair(ModeMasks[modeLo][0], ModeMasks[modeHi][0])),
+      _mm256_and_si256(nibbles, LoadPair(ModeMasks[modeLo][1], ModeMasks[modeHi][1]))),
+      _mm256_and_si256(raw, LoadPair(ModeMasks[modeLo][2], ModeMasks[modeHi][2])));
+  }
+
+  __m256i t[16];
+  for (int i = 0; i < 8; ++i)
+  {
+    t[i] = _mm256_unpacklo_epi8(x[2 * i], x[2 * i + 1]);
+    t[i + 8] = _mm256_unpackhi_epi8(x[2 * i], x[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    x[i] = _mm256_unpacklo_epi16(t[2 * i], t[2 * i + 1]);
+    x[i + 8] = _mm256_unpackhi_epi16(t[2 * i], t[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    t[i] = _mm256_unpacklo_epi32(x[2 * i], x[2 * i + 1]);
+    t[i + 8] = _mm256_unpackhi_epi32(x[2 * i], x[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    x[i] = _mm256_unpacklo_epi64(t[2 * i], t[2 * i + 1]);
+    x[i + 8] = _mm256_unpackhi_epi64(t[2 * i], t[2 * i + 1]);
+  }
+
+  alignas(32) uint8_t partial[BlockVertices * sizeof(Vertex)];
+  uint8_t* target = count == BlockVertices ? out : partial;
+  const __m256i one = _mm256_set1_epi32(1);
+  __m256i sum = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous));
+  for (size_t v = 0; v < BlockVertices; ++v)
+  {
+    __m256i z = x[BitReverse[v]];
+    __m256i delta = _mm256_xor_si256(_mm256_srli_epi32(z, 1), _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(z, one)));
+    sum = _mm256_add_epi32(sum, delta);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + v * sizeof(Vertex)), sum);
+  }
+  if (target == partial)
+    std::memcpy(out, partial, count * sizeof(Vertex));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(previous), sum);
+}
+
+#endif
+
+bool DecodeVerticesWith(Decoder decoder, const uint8_t* data, size_t size, Vertex* out, size_t count)
+{
+  const uint8_t* end = data + size;
+  if (size < 1 || data[0] != VertexStreamTag)
+    return false;
+  ++data;
+
+  uint32_t previous[Lanes] = {};
+  uint8_t* target = reinterpret_cast<uint8_t*>(out);
+  // the SIMD paths read every plane as 16 bytes; near the end of the stream a block is copied out first
+  uint8_t padded[Planes * BlockVertices + 16];
+  for (size_t first = 0; first < count; first += BlockVertices)
+  {
+    if ((size_t)(end - data) < BlockHeaderBytes)
+      return false;
+    uint64_t modes = 0;
+    for (size_t i = 0; i < BlockHeaderBytes; ++i)
+      modes |= (uint64_t)data[i] << (8 * i);
+    data += BlockHeaderBytes;
+    const size_t bytes = BlockDataBytes(modes);
+    if ((size_t)(end - data) < bytes)
+      return false;
+
+    const uint8_t* planes = data;
+    if ((size_t)(end - data) < Planes * BlockVertices + 16)
+    {
+      std::memcpy(padded, data, bytes);
+      std::memset(padded + bytes, 0, sizeof(padded) - bytes);
+      planes = padded;
+    }
+
+    const size_t n = std::min(BlockVertices, count - first);
+    uint8_t* block = target + first * sizeof(Vertex);
+    switch (decoder)
+    {
+#ifdef NULLENGINE_AVX2
+    case Decoder::Avx2:
+      DecodeBlockAvx2(planes, modes, previous, block, n);
+      break;
+#endif
+#ifdef NULLENGINE_SSE2
+    case Decoder::Sse2:
+      DecodeBlockSse2(planes, modes, previous, block, n);
+      break;
+#endif
+    default:
+      DecodeBlockScalar(planes, modes, previous, block, n);
+      break;
+    }
+    data += bytes;
+  }
+  return data == end;
+}
+
+// ---------------------------------------------------------------- indices
+
+struct IndexState
+{
+  uint32_t edges[EdgeFifoSize][2];
+  size_t edgeHead = 0;
+  uint32_t vertices[VertexFifoSize];
+  size_t vertexHead = 0;
+  uint32_t next = 0;
+  uint32_t last = 0;
+
+  IndexState()
+  {
+    std::memset(edges, 0xff, sizeof(edges));
+    std::memset(vertices, 0xff, sizeof(vertices));
+  }
+
+  // age 0 = most recent
+  const uint32_t* Edge(size_t age) const { return edges[(edgeHead + EdgeFifoSize - 1 - age) % EdgeFifoSize]; }
+  uint32_t VertexAt(size_t age) const { return vertices[(vertexHead + VertexFifoSize - 1 - age) % VertexFifoSize]; }
+
+  void PushEdge(uint32_t a, uint32_t b)
+  {
+    edges[edgeHead][0] = a;
+    edges[edgeHead][1] = b;
+    edgeHead = (edgeHead + 1) % EdgeFifoSize;
+  }
+  void PushVertex(uint32_t v)
+  {
+    vertices[vertexHead] = v;
+    vertexHead = (vertexHead + 1) % VertexFifoSize;
+  }
+};
+
+void WriteVarint(uint32_t value, std::vector<uint8_t>& out)
+{
+  while (value >= 0x80)
+  {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+{
+  value = 0;
+  for (unsigned shift = 0; shift < 35; shift += 7)
+  {
+    if (data == end)
+      return false;
+    uint8_t byte = *data++;
+    value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+// code of one vertex (0 next, 1..14 FIFO, 15 explicit), updating the state the decoder mirrors
+uint8_t EncodeVertex(IndexState& state, uint32_t v, std::vector<uint8_t>& data)
+{
+  uint8_t code;
+  if (v == state.next)
+  {
+    code = 0;
+    ++state.next;
+    state.PushVertex(v);
+  }
+  else
+  {
+    code = 15;
+    for (size_t age = 0; age < VertexFifoSize; ++age)
+    {
+      if (state.VertexAt(age) == v)
+      {
+        code = (uint8_t)(age + 1);
+        break;
+      }
+    }
+    if (code == 15)
+    {
+      WriteVarint(Zigzag(v - state.last), data);
+      state.PushVertex(v);
+    }
+  }
+  state.last = v;
+  return code;
+}
+
+bool DecodeVertex(IndexState& state, uint8_t code, const uint8_t*& data, const uint8_t* end, uint32_t& v)
+{
+  if (code == 0)
+  {
+    v = state.next++;
+    state.PushVertex(v);
+  }
+  else if (code < 15)
+    v = state.VertexAt(code - 1);
+  else
+  {
+    uint32_t delta;
+    if (!ReadVarint(data, end, delta))
+      return false;
+    v = state.last + Unzigzag(delta);
+    state.PushVertex(v);
+  }
+  state.last = v;
+  return true;
+}
+
+// ---------------------------------------------------------------- test data
+
+// height field grid with smooth normals and UVs, optimized like an imported mesh
+MeshData GridMesh(size_t side, uint32_t seed)
+{
+  MeshData mesh;
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> noise(-0.02f, 0.02f);
+  auto height = [](float x, float z) { return 0.5f * std::sin(x * 6.0f) * std::cos(z * 4.0f); };
+  for (size_t j = 0; j < side; ++j)
+  {
+    for (size_t i = 0; i < side; ++i)
+    {
+      float x = (float)i / (side - 1), z = (float)j / (side - 1);
+      Vertex v;
+      v.Position = glm::vec3(x * 10.0f, height(x, z) + noise(random), z * 10.0f);
+      float dx = height(x + 0.001f, z) - height(x - 0.001f, z), dz = height(x, z + 0.001f) - height(x, z - 0.001f);
+      v.Normal = glm::normalize(glm::vec3(-dx / 0.002f, 1.0f, -dz / 0.002f));
+      v.TexCoords = glm::vec2(x, z);
+      mesh.vertices.push_back(v);
+    }
+  }
+  for (size_t j = 0; j + 1 < side; ++j)
+  {
+    for (size_t i = 0; i + 1 < side; ++i)
+    {
+      unsigned a = (unsigned)(j * side + i), b = a + 1, c = a + (unsigned)side, d = c + 1;
+      mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+    }
+  }
+  MeshOptimizer::Optimize(mesh);
+  return mesh;
+}
+
+template<typename F>
+double BestSeconds(unsigned runs, F&& fn)
+{
+  double best = 1e30;
+  for (unsigned r = 0; r < runs; ++r)
+  {
+    auto t = std::chrono::high_resolution_clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t).count());
+  }
+  return best;
+}
+
+} // namespace
+
+void GeometryCodec::EncodeVertices(const Vertex* vertices, size_t count, std::vector<uint8_t>& out)
+{
+  out.clear();
+  out.reserve(1 + (count + BlockVertices - 1) / BlockVertices * (BlockHeaderBytes + Planes * BlockVertices));
+  out.push_back(VertexStreamTag);
+
+  uint32_t previous[Lanes] = {};
+  for (size_t first = 0; first < count; first += BlockVertices)
+  {
+    uint8_t planes[Planes][BlockVertices];
+    for (size_t v = 0; v < BlockVertices; ++v)
+    {
+      // a partial last block repeats the last vertex: zero deltas
+      uint32_t lanes[Lanes];
+      if (first + v < count)
+        std::memcpy(lanes, &vertices[first + v], sizeof(Vertex));
+      else
+        std::memcpy(lanes, previous, sizeof(Vertex));
+      for (size_t l = 0; l < Lanes; ++l)
+      {
+        uint32_t z = Zigzag(lanes[l] - previous[l]);
+        previous[l] = lanes[l];
+        for (size_t b = 0; b < 4; ++b)
+          planes[4 * l + b][v] = (uint8_t)(z >> (8 * b));
+      }
+    }
+    EncodeBlock(planes, out);
+  }
+}
+
+bool GeometryCodec::DecodeVertices(const uint8_t* data, size_t size, Vertex* out, size_t count)
+{
+  return DecodeVerticesWith(BestDecoder(), data, size, out, count);
+}
+
+bool GeometryCodec::EncodeIndices(const uint32_t* indices, size_t count, std::vector<uint8_t>& out)
+{
+  if (count % 3)
+    return false;
+
+  const size_t triangles = count / 3;
+  std::vector<uint8_t> codes;
+  std::vector<uint8_t> data;
+  codes.reserve(triangles);
+  data.reserve(triangles);
+  IndexState state;
+  for (size_t t = 0; t < triangles; ++t)
+  {
+    const uint32_t tri[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+    int edge = -1, rotation = 0;
+    for (size_t age = 0; age < EdgeFifoSize && edge < 0; ++age)
+    {
+      const uint32_t* e = state.Edge(age);
+      for (int r = 0; r < 3; ++r)
+      {
+        if (e[0] == tri[r] && e[1] == tri[(r + 1) % 3])
+        {
+          edge = (int)age;
+          rotation = r;
+          break;
+        }
+      }
+    }
+
+    if (edge >= 0)
+    {
+      // (p, q) is the shared edge, s the new corner
+      const uint32_t p = tri[rotation], q = tri[(rotation + 1) % 3], s = tri[(rotation + 2) % 3];
+      uint8_t code = EncodeVertex(state, s, data);
+      codes.push_back((uint8_t)(((3 * edge + rotation) << 4) | code));
+      state.PushEdge(s, q);
+      state.PushEdge(p, s);
+    }
+    else
+    {
+      // the codes of b and c go into the data stream ahead of their varints
+      const size_t extra = data.size();
+      data.push_back(0);
+      uint8_t a = EncodeVertex(state, tri[0], data);
+      uint8_t b = EncodeVertex(state, tri[1], data);
+      uint8_t c = EncodeVertex(state, tri[2], data);
+      codes.push_back((uint8_t)(0xf0 | a));
+      data[extra] = (uint8_t)((b << 4) | c);
+      state.PushEdge(tri[1], tri[0]);
+      state.PushEdge(tri[2], tri[1]);
+      state.PushEdge(tri[0], tri[2]);
+    }
+  }
+
+  out.clear();
+  out.reserve(1 + codes.size() + data.size());
+  out.push_back(IndexStreamTag);
+  out.insert(out.end(), codes.begin(), codes.end());
+  out.insert(out.end(), data.begin(), data.end());
+  return true;
+}
+
+bool GeometryCodec::DecodeIndices(const uint8_t* data, size_t size, uint32_t* out, size_t count)
+{
+  const size_t triangles = count / 3;
+  if (count % 3 || size < 1 + triangles || data[0] != IndexStreamTag)
+    return false;
+
+  const uint8_t* codes = data + 1;
+  const uint8_t* cursor = codes + triangles;
+  const uint8_t* end = data + size;
+  IndexState state;
+  for (size_t t = 0; t < triangles; ++t, out += 3)
+  {
+    const uint8_t code = codes[t];
+    const unsigned high = code >> 4;
+    if (high < 3 * EdgeFifoSize)
+    {
+      const uint32_t* e = state.Edge(high / 3);
+      const uint32_t p = e[0], q = e[1];
+      uint32_t s;
+      if (!DecodeVertex(state, code & 15, cursor, end, s))
+        return false;
+      // undo the rotation: (p, q, s) started at corner rotation of the original triangle
+      switch (high % 3)
+      {
+      case 0: out[0] = p; out[1] = q; out[2] = s; break;
+      case 1: out[0] = s; out[1] = p; out[2] = q; break;
+      default: out[0] = q; out[1] = s; out[2] = p; break;
+      }
+      state.PushEdge(s, q);
+      state.PushEdge(p, s);
+    }
+    else
+    {
+      if (cursor == end)
+        return false;
+      const uint8_t extra = *cursor++;
+      if (!DecodeVertex(state, code & 15, cursor, end, out[0]) || !DecodeVertex(state, extra >> 4, cursor, end, out[1])
+        || !DecodeVertex(state, extra & 15, cursor, end, out[2]))
+        return false;
+      state.PushEdge(out[1], out[0]);
+      state.PushEdge(out[2], out[1]);
+      state.PushEdge(out[0], out[2]);
+    }
+  }
+  return cursor == end;
+}
+
+const char* GeometryCodec::DecoderName()
+{
+  switch (BestDecoder())
+  {
+  case Decoder::Avx2: return "avx2";
+  case Decoder::Sse2: return "sse2";
+  default: return "scalar";
+  }
+}
+
+bool GeometryCodec::SelfTest()
+{
+  std::vector<Decoder> decoders = {Decoder::Scalar};
+#ifdef NULLENGINE_SSE2
+  decoders.push_back(Decoder::Sse2);
+#endif
+  if (HasAvx2())
+    decoders.push_back(Decoder::Avx2);
+
+  std::mt19937 random(1234);
+  bool ok = true;
+  size_t cases = 0;
+  auto fail = [&](const char* what, size_t n)
+  {
+    std::cout << "ERROR::GEOMETRY_CODEC::Self test failed: " << what << " (" << n << ")" << std::endl;
+    ok = false;
+  };
+
+  auto checkVertices = [&](const std::vector<Vertex>& vertices, const char* what)
+  {
+    ++cases;
+    std::vector<uint8_t> encoded;
+    EncodeVertices(vertices.data(), vertices.size(), encoded);
+    for (Decoder decoder : decoders)
+    {
+      std::vector<Vertex> decoded(vertices.size());
+      if (!DecodeVerticesWith(decoder, encoded.data(), encoded.size(), decoded.data(), decoded.size())
+        || (!vertices.empty() && std::memcmp(decoded.data(), vertices.data(), vertices.size() * sizeof(Vertex)) != 0))
+        fail(what, vertices.size());
+      // truncated and trailing data must be rejected, not read past
+      if (!vertices.empty() && DecodeVerticesWith(decoder, encoded.data(), encoded.size() - 1, decoded.data(), decoded.size()))
+        fail("truncated vertices accepted", vertices.size());
+    }
+  };
+  auto checkIndices = [&](const std::vector<uint32_t>& indices, const char* what)
+  {
+    ++cases;
+    std::vector<uint8_t> encoded;
+    std::vector<uint32_t> decoded(indices.size());
+    if (!EncodeIndices(indices.data(), indices.size(), encoded) || !DecodeIndices(encoded.data(), encoded.size(), decoded.data(), decoded.size())
+      || decoded != indices)
+      fail(what, indices.size());
+    if (!indices.empty() && DecodeIndices(encoded.data(), encoded.size() - 1, decoded.data(), decoded.size()))
+      fail("truncated indices accepted", indices.size());
+  };
+
+  // every block boundary case, random bit patterns include NaNs, infinities and denormals
+  for (size_t n : {0, 1, 2, 15, 16, 17, 31, 32, 33, 1000})
+  {
+    std::vector<Vertex> vertices(n);
+    uint32_t* words = reinterpret_cast<uint32_t*>(vertices.data());
+    for (size_t i = 0; i < n * Lanes; ++i)
+      words[i] = random();
+    checkVertices(vertices, "random vertices");
+    // all planes in each mode: constant, small steps, larger steps
+    for (uint32_t step : {0u, 1u, 7u, 300u})
+    {
+      for (size_t i = 0; i < n * Lanes; ++i)
+        words[i] = (uint32_t)(i / Lanes) * step - (i % 2 ? 5u : 0u);
+      checkVertices(vertices, "stepped vertices");
+    }
+  }
+
+  checkIndices({}, "empty");
+  checkIndices({0, 0, 0}, "degenerate");
+  checkIndices({0xffffffffu, 0, 0x7fffffffu, 0x80000000u, 0xffffffffu, 1}, "extreme indices");
+  for (size_t n : {3, 30, 3000})
+  {
+    std::vector<uint32_t> indices(n);
+    for (auto& index : indices)
+      index = random() % 1000;
+    checkIndices(indices, "random indices");
+  }
+
+  MeshData grid = GridMesh(64, 7);
+  checkVertices(grid.vertices, "grid vertices");
+  checkIndices(grid.indices, "grid indices");
+
+  std::cout << "GEOMETRY_CODEC::SELF_TEST::" << cases << " cases, " << decoders.size() << " decoders: " << (ok ? "passed" : "FAILED") << std::endl;
+  return ok;
+}
+
+GeometryCodecBenchmark GeometryCodec::Benchmark(size_t vertexCount)
+{
+  GeometryCodecBenchmark result;
+  result.decoder = DecoderName();
+  const size_t side = std::max<size_t>(2, (size_t)std::sqrt((double)vertexCount));
+  MeshData mesh = GridMesh(side, 11);
+  result.vertices = mesh.vertices.size();
+  result.indices = mesh.indices.size();
+  result.vertexBytes = mesh.vertices.size() * sizeof(Vertex);
+  result.indexBytes = mesh.indices.size() * sizeof(uint32_t);
+
+  std::vector<uint8_t> vertexData, indexData;
+  std::vector<Vertex> vertices(mesh.vertices.size());
+  std::vector<uint32_t> indices(mesh.indices.size());
+  const double gb = 1e9;
+  result.vertexEncodeGBs = result.vertexBytes / gb / BestSeconds(3, [&]() { EncodeVertices(mesh.vertices.data(), mesh.vertices.size(), vertexData); });
+  result.vertexDecodeGBs = result.vertexBytes / gb / BestSeconds(5, [&]()
+  {
+    DecodeVertices(vertexData.data(), vertexData.size(), vertices.data(), vertices.size());
+  });
+  result.indexEncodeGBs = result.indexBytes / gb / BestSeconds(3, [&]() { EncodeIndices(mesh.indices.data(), mesh.indices.size(), indexData); });
+  result.indexDecodeGBs = result.indexBytes / gb / BestSeconds(5, [&]()
+  {
+    DecodeIndices(indexData.data(), indexData.size(), indices.data(), indices.size());
+  });
+  result.encodedVertexBytes = vertexData.size();
+  result.encodedIndexBytes = indexData.size();
+
+  const bool roundTrip = std::memcmp(vertices.data(), mesh.vertices.data(), result.vertexBytes) == 0 && indices == mesh.indices;
+  std::cout << "GEOMETRY_CODEC::BENCHMARK::" << result.vertices << " vertices, " << result.indices / 3 << " triangles, " << result.decoder
+    << (roundTrip ? "" : " (ROUND TRIP MISMATCH)") << "\n"
+    << "  vertices " << result.VertexRatio() * 100.0 << "% of raw, encode " << result.vertexEncodeGBs << " GB/s, decode "
+    << result.vertexDecodeGBs << " GB/s\n"
+    << "  indices " << result.IndexRatio() * 100.0 << "% of raw (" << (double)result.encodedIndexBytes / (result.indices / 3)
+    << " bytes/triangle), encode " << result.indexEncodeGBs << " GB/s, decode " << result.indexDecodeGBs << " GB/s" << std::endl;
+  return result;
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Vertex.h"
+
+namespace NullEngine
+{
+
+// GeometryCodec::Benchmark result, throughput in GB/s of raw (decoded) data
+struct GeometryCodecBenchmark
+{
+  const char* decoder = "";
+  size_t vertices = 0;
+  size_t indices = 0;
+  size_t vertexBytes = 0;         // raw
+  size_t encodedVertexBytes = 0;
+  size_t indexBytes = 0;          // raw
+  size_t encodedIndexBytes = 0;
+  double vertexEncodeGBs = 0.0;
+  double vertexDecodeGBs = 0.0;
+  double indexEncodeGBs = 0.0;
+  double indexDecodeGBs = 0.0;
+
+  double VertexRatio() const { return vertexBytes ? (double)encodedVertexBytes / vertexBytes : 0.0; }
+  double IndexRatio() const { return indexBytes ? (double)encodedIndexBytes / indexBytes : 0.0; }
+};
+
+// Lossless codec for NullEngine::Vertex streams and triangle lists, used for the .nemesh blobs.
+//
+// Vertices: each of the 8 32-bit lanes is delta coded against the previous vertex (on the bit
+// pattern), zigzag mapped so small differences of either sign have few significant bits, then
+// the 32 bytes of 16 vertices are regrouped into 32 byte planes. Every plane is stored as all
+// zero, 2-bit, 4-bit or raw bytes, chosen by a 2-bit mode per plane in the block header. The
+// decoder transposes the planes back and undoes zigzag/delta with SSE2, or AVX2 where the CPU has it.
+//
+// Indices: one code byte per triangle. The triangle is matched against a FIFO of the last edges
+// (rotation kept in the code, so the output is identical to the input), its remaining vertices are
+// either the next unused index, a hit in a FIFO of recent vertices or an explicit zigzag varint
+// delta. Mesh-optimized lists (MeshOptimizer) take about a byte per triangle.
+class GeometryCodec
+{
+public:
+  static constexpr size_t BlockVertices = 16;
+
+  static void EncodeVertices(const Vertex* vertices, size_t count, std::vector<uint8_t>& out);
+  // count must be the encoded count; false if data is malformed
+  static bool DecodeVertices(const uint8_t* data, size_t size, Vertex* out, size_t count);
+
+  // count must be a multiple of 3
+  static bool EncodeIndices(const uint32_t* indices, size_t count, std::vector<uint8_t>& out);
+  static bool DecodeIndices(const uint8_t* data, size_t size, uint32_t* out, size_t count);
+
+  // "avx2", "sse2" or "scalar"
+  static const char* DecoderName();
+
+  // round trips generated streams (edge cases, random and optimized meshes) through every decoder
+  // path and compares them bit for bit; prints failures
+  static bool SelfTest();
+  // encodes/decodes an optimized grid mesh with about vertexCount vertices; prints the result
+  static GeometryCodecBenchmark Benchmark(size_t vertexCount = 1 << 20);
+};
+
+}
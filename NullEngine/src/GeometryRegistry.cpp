@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cstring>
+#include "GeometryRegistry.h"
+#include "GLState.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+struct MeshBox
+{
+  glm::vec3 lo = glm::vec3(0.0f);
+  glm::vec3 hi = glm::vec3(0.0f);
+};
+
+MeshBox BoxOf(const MeshData& mesh)
+{
+  MeshBox box;
+  if (mesh.vertices.empty())
+    return box;
+  box.lo = box.hi = mesh.vertices[0].Position;
+  for (const Vertex& v : mesh.vertices)
+  {
+    box.lo = glm::min(box.lo, v.Position);
+    box.hi = glm::max(box.hi, v.Position);
+  }
+  return box;
+}
+
+// everything but the positions: equal for copies of a mesh placed somewhere else
+uint64_t ShapeKey(const MeshData& mesh)
+{
+  std::vector<float> attributes;
+  attributes.reserve(mesh.vertices.size() * 5);
+  for (const Vertex& v : mesh.vertices)
+  {
+    attributes.insert(attributes.end(), {v.Normal.x, v.Normal.y, v.Normal.z});
+    attributes.insert(attributes.end(), {v.TexCoords.x, v.TexCoords.y});
+  }
+  uint64_t key = HashBytes(attributes.data(), attributes.size() * sizeof(float), mesh.vertices.size());
+  key = HashBytes(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int), key);
+  key = HashBytes(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod), key);
+  return HashBytes(&mesh.materialIndex, sizeof(mesh.materialIndex), key);
+}
+
+// b is a's geometry moved by b.lo - a.lo; positions within a few float steps, the rest exactly
+bool SameShape(const MeshData& a, const MeshBox& boxA, const MeshData& b, const MeshBox& boxB)
+{
+  if (a.materialIndex != b.materialIndex || a.vertices.size() != b.vertices.size() || a.indices.size() != b.indices.size()
+    || a.lods.size() != b.lods.size())
+    return false;
+  if (!a.indices.empty() && std::memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(unsigned int)) != 0)
+    return false;
+  for (size_t l = 0; l < a.lods.size(); ++l)
+    if (a.lods[l].firstIndex != b.lods[l].firstIndex || a.lods[l].indexCount != b.lods[l].indexCount || a.lods[l].error != b.lods[l].error)
+      return false;
+
+  // the subtraction rounds at the magnitude of the coordinates, not of the mesh
+  const glm::vec3 magnitude = glm::max(glm::max(glm::abs(boxA.lo), glm::abs(boxA.hi)), glm::max(glm::abs(boxB.lo), glm::abs(boxB.hi)));
+  const float tolerance = 1e-6f * std::max(1.0f, std::max(magnitude.x, std::max(magnitude.y, magnitude.z)));
+  const glm::vec3 translation = boxB.lo - boxA.lo;
+  for (size_t i = 0; i < a.vertices.size(); ++i)
+  {
+    const Vertex& va = a.vertices[i];
+    const Vertex& vb = b.vertices[i];
+    if (va.Normal != vb.Normal || va.TexCoords != vb.TexCoords)
+      return false;
+    const glm::vec3 error = glm::abs(vb.Position - va.Position - translation);
+    if (error.x > tolerance || error.y > tolerance || error.z > tolerance)
+      return false;
+  }
+  return true;
+}
+
+uint64_t RegistryKey(uint64_t key, VertexFormat format)
+{
+  return HashBytes(&format, sizeof(format), key);
+}
+
+} // namespace
+
+GeometryRegistry& GeometryRegistry::Instance()
+{
+  static GeometryRegistry registry;
+  return registry;
+}
+
+uint64_t GeometryRegistry::ContentKey(const Vertex* vertices, size_t vertexCount, const unsigned* indices, size_t indexCount,
+  const std::vector<MeshLod>& lods)
+{
+  uint64_t key = HashBytes(vertices, vertexCount * sizeof(Vertex), vertexCount);
+  key = HashBytes(indices, indexCount * sizeof(unsigned), key);
+  key = HashBytes(lods.data(), lods.size() * sizeof(MeshLod), key);
+  return key ? key : 1;
+}
+
+std::vector<MeshInstances> GeometryRegistry::GroupInstances(std::vector<MeshData>& meshes, bool parallel)
+{
+  std::vector<MeshBox> boxes(meshes.size());
+  std::vector<uint64_t> shapes(meshes.size());
+  auto hash = [&](size_t i)
+  {
+    MeshData& mesh = meshes[i];
+    boxes[i] = BoxOf(mesh);
+    shapes[i] = ShapeKey(mesh);
+    mesh.geometryKey = ContentKey(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.lods);
+  };
+  if (parallel)
+    ThreadPool::Instance().ParallelFor(meshes.size(), hash);
+  else
+    for (size_t i = 0; i < meshes.size(); ++i)
+      hash(i);
+
+  // in mesh order, so the first copy is the one uploaded; equal shape keys are only candidates
+  std::vector<MeshInstances> groups;
+  std::unordered_map<uint64_t, std::vector<size_t>> candidates;
+  for (size_t i = 0; i < meshes.size(); ++i)
+  {
+    std::vector<size_t>& sameShape = candidates[shapes[i]];
+    bool placed = false;
+    for (size_t g : sameShape)
+    {
+      const size_t first = groups[g].members[0];
+      if (!SameShape(meshes[first], boxes[first], meshes[i], boxes[i]))
+        continue;
+      groups[g].members.push_back(i);
+      groups[g].translations.push_back(boxes[i].lo - boxes[first].lo);
+      placed = true;
+      break;
+    }
+    if (placed)
+      continue;
+    sameShape.push_back(groups.size());
+    groups.push_back({{i}, {glm::vec3(0.0f)}});
+  }
+  return groups;
+}
+
+std::shared_ptr<const MeshGeometry> GeometryRegistry::Find(uint64_t key, VertexFormat format, size_t vertexCount,
+  size_t indexCount, size_t lodCount)
+{
+  if (!key)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto entry = _entries.find(RegistryKey(key, format));
+  std::shared_ptr<const MeshGeometry> geometry = entry != _entries.end() ? entry->second.geometry.lock() : nullptr;
+  if (geometry && (geometry->vertexCount != vertexCount || geometry->indexCount != indexCount ||
+    geometry->lodCount != lodCount))
+  {
+    ++_collisions;
+    return nullptr;
+  }
+  if (geometry)
+  {
+    ++_hits;
+    _sharedBytes += geometry->vertexBytes + geometry->indexBytes;
+  }
+  return geometry;
+}
+
+std::shared_ptr<const MeshGeometry> GeometryRegistry::Insert(uint64_t key, VertexFormat format, const MeshGeometry& geometry)
+{
+  const uint64_t registryKey = key ? RegistryKey(key, format) : 0;
+  std::shared_ptr<const MeshGeometry> shared(new MeshGeometry(geometry),
+    [registryKey](const MeshGeometry* g) { GeometryRegistry::Instance().Release(registryKey, g); });
+  if (!key)
+    return shared;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  ++_misses;
+  Entry& entry = _entries[registryKey];
+  entry.geometry = shared;
+  entry.object = shared.get();
+  return shared;
+}
+
+void GeometryRegistry::Release(uint64_t key, const MeshGeometry* geometry)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // the key may already belong to a newer upload of the same content
+    auto entry = _entries.find(key);
+    if (key && entry != _entries.end() && entry->second.object == geometry)
+      _entries.erase(entry);
+    _garbage.push_back(geometry->vbo);
+    _garbage.push_back(geometry->ebo);
+    ++_released;
+  }
+  delete geometry;
+}
+
+void GeometryRegistry::CollectGarbage()
+{
+  std::vector<unsigned> garbage;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    garbage.swap(_garbage);
+  }
+  if (!garbage.empty())
+    GLState::Instance().DeleteBuffers((GLsizei)garbage.size(), garbage.data());
+}
+
+void GeometryRegistry::Shutdown()
+{
+  CollectGarbage();
+}
+
+GeometryRegistryStats GeometryRegistry::Stats() const
+{
+  GeometryRegistryStats stats;
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (const auto& entry : _entries)
+    stats.geometries += entry.second.geometry.expired() ? 0 : 1;
+  stats.hits = _hits;
+  stats.misses = _misses;
+  stats.sharedBytes = _sharedBytes;
+  stats.released = _released;
+  stats.collisions = _collisions;
+  return stats;
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Mesh.h"
+#include "MeshData.h"
+
+namespace NullEngine
+{
+
+struct GeometryRegistryStats
+{
+  // shareable geometries alive, lookups that found one and those that uploaded a new one
+  size_t geometries = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+  // vertex + index bytes the hits did not upload
+  size_t sharedBytes = 0;
+  // geometries whose buffers were freed because their last Mesh went away
+  size_t released = 0;
+  // keys found with different vertex/index/LOD counts, uploaded as misses
+  size_t collisions = 0;
+};
+
+// Pending meshes of a model drawn as one Mesh: members[0] is uploaded and drawn once per entry
+// of translations (model space, members[0]'s is zero), the other members are copies of it
+struct MeshInstances
+{
+  std::vector<size_t> members;
+  std::vector<glm::vec3> translations;
+};
+
+// Engine wide owner of mesh vertex/index buffers, shared by every Model:
+//  - keyed on the content of the mesh (vertices, indices, levels of detail) and the vertex format,
+//    so the same geometry in several models, or several times in one, is uploaded once
+//  - entries hold weak references like TextureRegistry; when the last Mesh lets go the buffers
+//    are queued and deleted by CollectGarbage() on the GL thread
+class GeometryRegistry
+{
+public:
+  static GeometryRegistry& Instance();
+
+  // any thread; never 0, which Mesh takes as "not shared"
+  static uint64_t ContentKey(const Vertex* vertices, size_t vertexCount, const unsigned* indices, size_t indexCount,
+    const std::vector<MeshLod>& lods);
+
+  // Any thread. Groups meshes of one material whose geometry only differs by a translation (the
+  // positions compared relative to their minimum, everything else exactly), and sets every
+  // mesh's geometryKey. Meshes without a copy come back as groups of one.
+  static std::vector<MeshInstances> GroupInstances(std::vector<MeshData>& meshes, bool parallel);
+
+  // the geometry uploaded for key in format, null if there is none alive or its counts differ
+  // (a hash collision; the caller's upload then takes the key over through Insert)
+  std::shared_ptr<const MeshGeometry> Find(uint64_t key, VertexFormat format, size_t vertexCount, size_t indexCount,
+    size_t lodCount);
+  // takes over the buffers of a new upload; with key 0 they are only freed when unused, not shared
+  std::shared_ptr<const MeshGeometry> Insert(uint64_t key, VertexFormat format, const MeshGeometry& geometry);
+
+  // GL thread, once per frame: deletes the buffers of released geometry
+  void CollectGarbage();
+  // GL thread, before the context is destroyed
+  void Shutdown();
+
+  GeometryRegistryStats Stats() const;
+
+private:
+  GeometryRegistry() = default;
+
+  struct Entry
+  {
+    std::weak_ptr<const MeshGeometry> geometry;
+    const MeshGeometry* object = nullptr;
+  };
+
+  // shared_ptr deleter, any thread
+  void Release(uint64_t key, const MeshGeometry* geometry);
+
+  mutable std::mutex _mutex;
+  std::unordered_map<uint64_t, Entry> _entries;
+  std::vector<unsigned> _garbage;
+  size_t _hits = 0;
+  size_t _misses = 0;
+  size_t _sharedBytes = 0;
+  size_t _released = 0;
+  size_t _collisions = 0;
+};
+
+}
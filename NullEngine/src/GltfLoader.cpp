@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "GltfLoader.h"
+#include "Json.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+constexpr uint32_t GlbMagic = 0x46546C67;     // "glTF"
+constexpr uint32_t GlbChunkJson = 0x4E4F534A; // "JSON"
+constexpr uint32_t GlbChunkBin = 0x004E4942;  // "BIN\0"
+constexpr int ModeTriangles = 4;
+
+uint32_t ReadU32(const uint8_t* p)
+{
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+size_t ComponentSize(GLenum type)
+{
+  switch (type)
+  {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE: return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT: return 4;
+    default: return 0;
+  }
+}
+
+GLint Components(const std::string& type)
+{
+  if (type == "SCALAR")
+    return 1;
+  if (type == "VEC2")
+    return 2;
+  if (type == "VEC3")
+    return 3;
+  if (type == "VEC4")
+    return 4;
+  // matrices are not used by anything drawn here
+  return 0;
+}
+
+// %XX escapes of relative URIs
+std::string DecodeUri(const std::string& uri)
+{
+  std::string out;
+  out.reserve(uri.size());
+  for (size_t i = 0; i < uri.size(); ++i)
+  {
+    if (uri[i] == '%' && i + 2 < uri.size())
+    {
+      out += (char)std::strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    }
+    else
+      out += uri[i];
+  }
+  return out;
+}
+
+bool Unsupported(const std::string& path, const std::string& what)
+{
+  std::cout << "ERROR::GLTF::" << path << ": " << what << std::endl;
+  return false;
+}
+
+} // namespace
+
+size_t GltfAccessor::ElementSize() const
+{
+  return ComponentSize(componentType) * (size_t)components;
+}
+
+const uint8_t* GltfScene::ViewData(unsigned view) const
+{
+  const GltfBufferView& bufferView = bufferViews[view];
+  return buffers[bufferView.buffer].data + bufferView.offset;
+}
+
+bool GltfLoader::Load(const std::string& path, GltfScene& scene)
+{
+  scene = GltfScene();
+  const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+  auto file = std::make_shared<MappedFile>();
+  if (!file->Open(path))
+    return Unsupported(path, "can't open file");
+
+  // GLB: 12 byte header, JSON chunk, optional BIN chunk; anything else is taken as .gltf text
+  const uint8_t* data = file->Data();
+  const char* json = reinterpret_cast<const char*>(data);
+  size_t jsonSize = file->Size();
+  const uint8_t* bin = nullptr;
+  size_t binSize = 0;
+  if (file->Size() >= 12 && ReadU32(data) == GlbMagic)
+  {
+    if (ReadU32(data + 4) != 2)
+      return Unsupported(path, "GLB version " + std::to_string(ReadU32(data + 4)));
+    size_t length = std::min<size_t>(ReadU32(data + 8), file->Size());
+    size_t offset = 12;
+    json = nullptr;
+    while (offset + 8 <= length)
+    {
+      size_t chunkSize = ReadU32(data + offset);
+      uint32_t chunkType = ReadU32(data + offset + 4);
+      offset += 8;
+      if (chunkSize > length - offset)
+        return Unsupported(path, "truncated GLB chunk");
+      if (chunkType == GlbChunkJson && !json)
+      {
+        json = reinterpret_cast<const char*>(data + offset);
+        jsonSize = chunkSize;
+      }
+      else if (chunkType == GlbChunkBin && !bin)
+      {
+        bin = data + offset;
+        binSize = chunkSize;
+      }
+      // chunks are 4 byte aligned
+      offset += (chunkSize + 3) & ~size_t(3);
+    }
+    if (!json)
+      return Unsupported(path, "GLB without JSON chunk");
+  }
+
+  JsonValue root;
+  std::string error;
+  if (!JsonValue::Parse(json, jsonSize, root, &error))
+    return Unsupported(path, "JSON " + error);
+
+  if (root["extensionsRequired"].Count())
+    return Unsupported(path, "required extension " + root["extensionsRequired"][0].String());
+
+  // buffers
+  for (size_t i = 0; i < root["buffers"].Count(); ++i)
+  {
+    const JsonValue& buffer = root["buffers"][i];
+    GltfBuffer out;
+    size_t byteLength = buffer["byteLength"].Size();
+    if (!buffer.Has("uri"))
+    {
+      if (i != 0 || !bin)
+        return Unsupported(path, "buffer " + std::to_string(i) + " has no data");
+      out.file = file;
+      out.data = bin;
+      out.size = binSize;
+    }
+    else
+    {
+      const std::string& uri = buffer["uri"].String();
+      if (uri.compare(0, 5, "data:") == 0)
+        return Unsupported(path, "data URI buffers");
+      out.file = std::make_shared<MappedFile>();
+      if (!out.file->Open(directory + DecodeUri(uri)))
+        return Unsupported(path, "can't open buffer " + uri);
+      out.data = out.file->Data();
+      out.size = out.file->Size();
+    }
+    if (byteLength > out.size)
+      return Unsupported(path, "buffer " + std::to_string(i) + " shorter than its byteLength");
+    scene.buffers.push_back(out);
+  }
+
+  // buffer views
+  for (const auto& view : root["bufferViews"].Elements())
+  {
+    GltfBufferView out;
+    out.buffer = (unsigned)view["buffer"].Size(~size_t(0));
+    out.offset = view["byteOffset"].Size();
+    out.length = view["byteLength"].Size();
+    out.stride = view["byteStride"].Size();
+    if (out.buffer >= scene.buffers.size() || out.offset > scene.buffers[out.buffer].size
+      || out.length > scene.buffers[out.buffer].size - out.offset)
+      return Unsupported(path, "buffer view out of range");
+    scene.bufferViews.push_back(out);
+  }
+
+  // accessors
+  for (const auto& accessor : root["accessors"].Elements())
+  {
+    GltfAccessor out;
+    if (!accessor.Has("bufferView") || accessor.Has("sparse"))
+      return Unsupported(path, "sparse or zero-filled accessors");
+    out.bufferView = (unsigned)accessor["bufferView"].Size(~size_t(0));
+    out.offset = accessor["byteOffset"].Size();
+    out.count = accessor["count"].Size();
+    out.componentType = (GLenum)accessor["componentType"].Int();
+    out.components = Components(accessor["type"].String());
+    out.normalized = accessor["normalized"].Bool();
+    if (out.bufferView >= scene.bufferViews.size() || out.ElementSize() == 0)
+    {
+      // out of range accessors (and matrices) only matter if a primitive uses them, checked below
+      out.count = 0;
+    }
+    else
+    {
+      const GltfBufferView& view = scene.bufferViews[out.bufferView];
+      size_t stride = view.stride ? view.stride : out.ElementSize();
+      if (out.count && out.offset + (out.count - 1) * stride + out.ElementSize() > view.length)
+        return Unsupported(path, "accessor out of range");
+    }
+    const JsonValue& min = accessor["min"];
+    const JsonValue& max = accessor["max"];
+    if (out.components == 3 && min.Count() == 3 && max.Count() == 3)
+    {
+      out.hasBounds = true;
+      for (int c = 0; c < 3; ++c)
+      {
+        out.min[c] = (float)min[c].Number();
+        out.max[c] = (float)max[c].Number();
+      }
+    }
+    scene.accessors.push_back(out);
+  }
+
+  // images and the base color image of every material
+  for (const auto& image : root["images"].Elements())
+  {
+    GltfImage out;
+    if (image.Has("bufferView"))
+    {
+      out.bufferView = image["bufferView"].Int(-1);
+      if (out.bufferView < 0 || (size_t)out.bufferView >= scene.bufferViews.size())
+        out.bufferView = -1;
+    }
+    else if (image["uri"].String().compare(0, 5, "data:") != 0)
+      out.uri = DecodeUri(image["uri"].String());
+    scene.images.push_back(out);
+  }
+  for (const auto& material : root["materials"].Elements())
+  {
+    int image = -1;
+    const JsonValue& baseColor = material["pbrMetallicRoughness"]["baseColorTexture"];
+    if (baseColor.Has("index"))
+      image = root["textures"][baseColor["index"].Size()]["source"].Int(-1);
+    scene.materialImages.push_back(image >= 0 && (size_t)image < scene.images.size() ? image : -1);
+  }
+
+  // primitives in node order of the default scene (all meshes if there is no scene)
+  const JsonValue& meshes = root["meshes"];
+  auto accessorOk = [&scene](int index, GLint components, bool indices)
+  {
+    if (index < 0 || (size_t)index >= scene.accessors.size())
+      return false;
+    const GltfAccessor& accessor = scene.accessors[index];
+    if (accessor.count == 0 || accessor.components != components)
+      return false;
+    if (indices)
+      return accessor.componentType == GL_UNSIGNED_BYTE || accessor.componentType == GL_UNSIGNED_SHORT || accessor.componentType == GL_UNSIGNED_INT;
+    return accessor.componentType == GL_FLOAT || accessor.normalized;
+  };
+  auto addMesh = [&](size_t index)
+  {
+    for (const auto& primitive : meshes[index]["primitives"].Elements())
+    {
+      if (primitive["mode"].Int(ModeTriangles) != ModeTriangles)
+        return Unsupported(path, "non-triangle primitives");
+      const JsonValue& attributes = primitive["attributes"];
+      GltfPrimitive out;
+      out.position = attributes["POSITION"].Int(-1);
+      out.normal = attributes["NORMAL"].Int(-1);
+      out.texCoord = attributes["TEXCOORD_0"].Int(-1);
+      out.indices = primitive["indices"].Int(-1);
+      out.material = primitive["material"].Int(-1);
+      if (!accessorOk(out.position, 3, false) || scene.accessors[out.position].componentType != GL_FLOAT)
+        return Unsupported(path, "primitive without float positions");
+      if (out.normal >= 0 && !accessorOk(out.normal, 3, false))
+        return Unsupported(path, "unsupported normal accessor");
+      if (out.texCoord >= 0 && !accessorOk(out.texCoord, 2, false))
+        return Unsupported(path, "unsupported texture coordinate accessor");
+      if (out.indices >= 0 && !accessorOk(out.indices, 1, true))
+        return Unsupported(path, "unsupported index accessor");
+      if (out.material >= (int)scene.materialImages.size())
+        out.material = -1;
+      scene.primitives.push_back(out);
+    }
+    return true;
+  };
+
+  const JsonValue& nodes = root["nodes"];
+  const JsonValue& defaultScene = root["scenes"][root["scene"].Size()];
+  if (defaultScene.IsObject())
+  {
+    // iterative walk, a malformed file with cycles stops at the visit limit
+    std::vector<size_t> stack;
+    for (auto it = defaultScene["nodes"].Elements().rbegin(); it != defaultScene["nodes"].Elements().rend(); ++it)
+      stack.push_back(it->Size());
+    size_t visits = 0;
+    while (!stack.empty() && visits++ <= nodes.Count())
+    {
+      const JsonValue& node = nodes[stack.back()];
+      stack.pop_back();
+      if (node.Has("mesh") && node["mesh"].Size() < meshes.Count() && !addMesh(node["mesh"].Size()))
+        return false;
+      const auto& children = node["children"].Elements();
+      for (auto it = children.rbegin(); it != children.rend(); ++it)
+        stack.push_back(it->Size());
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < meshes.Count(); ++i)
+      if (!addMesh(i))
+        return false;
+  }
+
+  return true;
+}
+
+}
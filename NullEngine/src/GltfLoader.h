@@ -0,0 +1,89 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+
+namespace NullEngine
+{
+
+// glTF buffer: the GLB BIN chunk or an external .bin, memory mapped
+struct GltfBuffer
+{
+  std::shared_ptr<MappedFile> file;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+struct GltfBufferView
+{
+  unsigned buffer = 0;
+  size_t offset = 0;
+  size_t length = 0;
+  // 0 = tightly packed
+  size_t stride = 0;
+};
+
+// what glVertexAttribPointer / glDrawElements need, read from the accessor as is
+struct GltfAccessor
+{
+  unsigned bufferView = 0;
+  // relative to the buffer view
+  size_t offset = 0;
+  size_t count = 0;
+  GLenum componentType = GL_FLOAT;
+  GLint components = 1;
+  bool normalized = false;
+  bool hasBounds = false;
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 max = glm::vec3(0.0f);
+
+  size_t ElementSize() const;
+};
+
+// one triangle list; -1 = attribute/indices/material absent
+struct GltfPrimitive
+{
+  int position = -1;
+  int normal = -1;
+  int texCoord = -1;
+  int indices = -1;
+  int material = -1;
+};
+
+// an image is either a range of a buffer view (GLB embedded) or a file next to the .gltf/.glb
+struct GltfImage
+{
+  int bufferView = -1;
+  std::string uri;
+};
+
+struct GltfScene
+{
+  std::vector<GltfBuffer> buffers;
+  std::vector<GltfBufferView> bufferViews;
+  std::vector<GltfAccessor> accessors;
+  // every mesh primitive in node order, like Model::ProcessNode walks an Assimp scene
+  std::vector<GltfPrimitive> primitives;
+  std::vector<GltfImage> images;
+  // base color image per material, -1 = none
+  std::vector<int> materialImages;
+
+  const uint8_t* ViewData(unsigned view) const;
+};
+
+// glTF 2.0 reader for .glb (and .gltf with .bin files) that keeps the binary data in place:
+// buffers are memory mapped and described by offset/stride/component type, so Model can
+// upload buffer views straight into GL buffers and point the vertex attributes at them.
+// Node transforms are ignored, as on the Assimp path. Files this can't draw unchanged
+// (sparse accessors, non-triangle primitives, required extensions) return false so the
+// caller can fall back to Assimp.
+class GltfLoader
+{
+public:
+  static bool Load(const std::string& path, GltfScene& scene);
+};
+
+}
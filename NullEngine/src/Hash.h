@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace NullEngine
+{
+
+// Fast non-cryptographic 64-bit hash used to key caches on file contents.
+// Processes 8 bytes per step (multiply / rotate mixing), good enough to detect changed assets.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+  constexpr uint64_t k0 = 0x9E3779B97F4A7C15ull;
+  constexpr uint64_t k1 = 0xC2B2AE3D27D4EB4Full;
+  constexpr uint64_t k2 = 0x165667B19E3779F9ull;
+
+  auto rotl = [](uint64_t v, int r) { return (v << r) | (v >> (64 - r)); };
+  auto mix = [&](uint64_t h, uint64_t v) { return rotl(h ^ (rotl(v * k1, 31) * k0), 27) * k0 + k2; };
+
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint64_t h = seed ^ (size * k2);
+
+  // four independent lanes so the loop is not one long dependency chain
+  if (size >= 32)
+  {
+    uint64_t lanes[4] = {h + k0 + k1, h + k1, h, h - k0};
+    const uint8_t* end = p + (size & ~size_t(31));
+    for (; p < end; p += 32)
+    {
+      for (int l = 0; l < 4; ++l)
+      {
+        uint64_t v;
+        std::memcpy(&v, p + l * 8, 8);
+        lanes[l] = rotl(lanes[l] + v * k1, 31) * k0;
+      }
+    }
+    h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    for (uint64_t lane : lanes)
+      h = mix(h, lane);
+    size &= 31;
+  }
+
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    h = mix(h, v);
+  }
+
+  uint64_t tail = 0;
+  std::memcpy(&tail, p, size);
+  h = mix(h, tail);
+
+  // final avalanche
+  h ^= h >> 33;
+  h *= k1;
+  h ^= h >> 29;
+  h *= k2;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t HashString(const std::string& s, uint64_t seed = 0)
+{
+  return HashBytes(s.data(), s.size(), seed);
+}
+
+}
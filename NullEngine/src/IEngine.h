@@ -27,4 +27,8 @@ namespace NullEngine {
 extern "C" NULLENGINE_API int LearnOGL();
 extern "C" NULLENGINE_API int LightCasters5_4_main();
 extern "C" NULLENGINE_API int Depth_testing_main();
-extern "C" NULLENGINE_API int Stencil_testing_main();
\ No newline at end of file
+extern "C" NULLENGINE_API int Stencil_testing_main();
+// packs Resources and the shader directories into ../Assets.nepack, which Engine::Main mounts
+extern "C" NULLENGINE_API int BuildAssetPack();
+// nullengine-cook command line (AssetCooker::Main): cooks models and textures under ../Resources ahead of time
+extern "C" NULLENGINE_API int CookAssets(int argc, char** argv);
@@ -0,0 +1,338 @@
+#include <cstdlib>
+#include <cstring>
+#include "Json.h"
+
+namespace NullEngine
+{
+
+// recursive descent over the text, no copies of it besides the strings
+class JsonParser
+{
+public:
+  JsonParser(const char* text, size_t size) : _begin(text), _p(text), _end(text + size) {}
+
+  bool Document(JsonValue& out)
+  {
+    if (!Value(out, 0))
+      return false;
+    SkipSpace();
+    return _p == _end || Fail("trailing characters");
+  }
+
+  std::string Error() const
+  {
+    return "offset " + std::to_string(_errorOffset) + ": " + _error;
+  }
+
+private:
+  static constexpr unsigned MaxDepth = 256;
+
+  const char* _begin;
+  const char* _p;
+  const char* _end;
+  const char* _error = "";
+  size_t _errorOffset = 0;
+
+  bool Fail(const char* reason)
+  {
+    _error = reason;
+    _errorOffset = (size_t)(_p - _begin);
+    return false;
+  }
+
+  void SkipSpace()
+  {
+    while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+      ++_p;
+  }
+
+  bool Literal(const char* word)
+  {
+    size_t length = std::strlen(word);
+    if ((size_t)(_end - _p) < length || std::memcmp(_p, word, length) != 0)
+      return Fail("invalid literal");
+    _p += length;
+    return true;
+  }
+
+  bool Value(JsonValue& out, unsigned depth)
+  {
+    if (depth > MaxDepth)
+      return Fail("nested too deep");
+    SkipSpace();
+    if (_p >= _end)
+      return Fail("unexpected end");
+
+    switch (*_p)
+    {
+      case '{': return Object(out, depth);
+      case '[': return Array(out, depth);
+      case '"':
+        out._type = JsonValue::Type::String;
+        return String(out._string);
+      case 't':
+        out._type = JsonValue::Type::Bool;
+        out._bool = true;
+        return Literal("true");
+      case 'f':
+        out._type = JsonValue::Type::Bool;
+        out._bool = false;
+        return Literal("false");
+      case 'n':
+        out._type = JsonValue::Type::Null;
+        return Literal("null");
+      default:
+        return Number(out);
+    }
+  }
+
+  bool Object(JsonValue& out, unsigned depth)
+  {
+    out._type = JsonValue::Type::Object;
+    ++_p;
+    SkipSpace();
+    if (_p < _end && *_p == '}')
+    {
+      ++_p;
+      return true;
+    }
+    for (;;)
+    {
+      SkipSpace();
+      if (_p >= _end || *_p != '"')
+        return Fail("expected a key");
+      out._members.emplace_back();
+      if (!String(out._members.back().first))
+        return false;
+      SkipSpace();
+      if (_p >= _end || *_p != ':')
+        return Fail("expected ':'");
+      ++_p;
+      if (!Value(out._members.back().second, depth + 1))
+        return false;
+      SkipSpace();
+      if (_p < _end && *_p == ',')
+      {
+        ++_p;
+        continue;
+      }
+      if (_p < _end && *_p == '}')
+      {
+        ++_p;
+        return true;
+      }
+      return Fail("expected ',' or '}'");
+    }
+  }
+
+  bool Array(JsonValue& out, unsigned depth)
+  {
+    out._type = JsonValue::Type::Array;
+    ++_p;
+    SkipSpace();
+    if (_p < _end && *_p == ']')
+    {
+      ++_p;
+      return true;
+    }
+    for (;;)
+    {
+      out._elements.emplace_back();
+      if (!Value(out._elements.back(), depth + 1))
+        return false;
+      SkipSpace();
+      if (_p < _end && *_p == ',')
+      {
+        ++_p;
+        continue;
+      }
+      if (_p < _end && *_p == ']')
+      {
+        ++_p;
+        return true;
+      }
+      return Fail("expected ',' or ']'");
+    }
+  }
+
+  bool Hex4(unsigned& code)
+  {
+    if (_end - _p < 4)
+      return Fail("truncated \\u escape");
+    code = 0;
+    for (int i = 0; i < 4; ++i, ++_p)
+    {
+      char c = *_p;
+      code <<= 4;
+      if (c >= '0' && c <= '9')
+        code |= (unsigned)(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        code |= (unsigned)(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        code |= (unsigned)(c - 'A' + 10);
+      else
+        return Fail("invalid \\u escape");
+    }
+    return true;
+  }
+
+  static void AppendUtf8(std::string& out, unsigned code)
+  {
+    if (code < 0x80)
+      out += (char)code;
+    else if (code < 0x800)
+    {
+      out += (char)(0xC0 | (code >> 6));
+      out += (char)(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+      out += (char)(0xE0 | (code >> 12));
+      out += (char)(0x80 | ((code >> 6) & 0x3F));
+      out += (char)(0x80 | (code & 0x3F));
+    }
+    else
+    {
+      out += (char)(0xF0 | (code >> 18));
+      out += (char)(0x80 | ((code >> 12) & 0x3F));
+      out += (char)(0x80 | ((code >> 6) & 0x3F));
+      out += (char)(0x80 | (code & 0x3F));
+    }
+  }
+
+  bool String(std::string& out)
+  {
+    ++_p;
+    for (;;)
+    {
+      // copy the run up to the next quote or escape in one go
+      const char* run = _p;
+      while (_p < _end && *_p != '"' && *_p != '\\')
+        ++_p;
+      out.append(run, _p);
+      if (_p >= _end)
+        return Fail("unterminated string");
+      if (*_p++ == '"')
+        return true;
+
+      if (_p >= _end)
+        return Fail("unterminated string");
+      char c = *_p++;
+      switch (c)
+      {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+        {
+          unsigned code;
+          if (!Hex4(code))
+            return false;
+          // surrogate pair
+          if (code >= 0xD800 && code < 0xDC00 && _end - _p >= 6 && _p[0] == '\\' && _p[1] == 'u')
+          {
+            _p += 2;
+            unsigned low;
+            if (!Hex4(low))
+              return false;
+            if (low >= 0xDC00 && low < 0xE000)
+              code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          AppendUtf8(out, code);
+          break;
+        }
+        default:
+          return Fail("invalid escape");
+      }
+    }
+  }
+
+  bool Number(JsonValue& out)
+  {
+    const char* start = _p;
+    if (_p < _end && *_p == '-')
+      ++_p;
+    auto digits = [this]()
+    {
+      const char* first = _p;
+      while (_p < _end && *_p >= '0' && *_p <= '9')
+        ++_p;
+      return _p != first;
+    };
+    if (!digits())
+      return Fail("invalid value");
+    if (_p < _end && *_p == '.')
+    {
+      ++_p;
+      if (!digits())
+        return Fail("invalid number");
+    }
+    if (_p < _end && (*_p == 'e' || *_p == 'E'))
+    {
+      ++_p;
+      if (_p < _end && (*_p == '+' || *_p == '-'))
+        ++_p;
+      if (!digits())
+        return Fail("invalid number");
+    }
+
+    // strtod needs a terminated string, the text usually is not
+    char buffer[64];
+    size_t length = (size_t)(_p - start);
+    if (length >= sizeof(buffer))
+    {
+      std::string copy(start, length);
+      out._number = std::strtod(copy.c_str(), nullptr);
+    }
+    else
+    {
+      std::memcpy(buffer, start, length);
+      buffer[length] = '\0';
+      out._number = std::strtod(buffer, nullptr);
+    }
+    out._type = JsonValue::Type::Number;
+    return true;
+  }
+};
+
+bool JsonValue::Parse(const char* text, size_t size, JsonValue& out, std::string* error)
+{
+  out = JsonValue();
+  JsonParser parser(text, size);
+  if (parser.Document(out))
+    return true;
+  if (error)
+    *error = parser.Error();
+  out = JsonValue();
+  return false;
+}
+
+const JsonValue* JsonValue::Find(const char* key) const
+{
+  if (_type != Type::Object)
+    return nullptr;
+  for (const auto& member : _members)
+    if (member.first == key)
+      return &member.second;
+  return nullptr;
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+  static const JsonValue null;
+  const JsonValue* value = Find(key);
+  return value ? *value : null;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+  static const JsonValue null;
+  return _type == Type::Array && index < _elements.size() ? _elements[index] : null;
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NullEngine
+{
+
+// Minimal JSON document (RFC 8259), enough for glTF and the engine's own manifests.
+// Lookups never fail: a missing key or index gives a null value, so chains like
+// json["materials"][0]["name"].String() need no checks in between.
+class JsonValue
+{
+public:
+  enum class Type
+  {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+  };
+
+  // false on a syntax error, error then holds the byte offset and reason
+  static bool Parse(const char* text, size_t size, JsonValue& out, std::string* error = nullptr);
+
+  Type GetType() const { return _type; }
+  bool IsNull() const { return _type == Type::Null; }
+  bool IsNumber() const { return _type == Type::Number; }
+  bool IsString() const { return _type == Type::String; }
+  bool IsArray() const { return _type == Type::Array; }
+  bool IsObject() const { return _type == Type::Object; }
+
+  bool Bool(bool fallback = false) const { return _type == Type::Bool ? _bool : fallback; }
+  double Number(double fallback = 0.0) const { return _type == Type::Number ? _number : fallback; }
+  int Int(int fallback = 0) const { return _type == Type::Number ? (int)_number : fallback; }
+  size_t Size(size_t fallback = 0) const { return _type == Type::Number && _number >= 0.0 ? (size_t)_number : fallback; }
+  const std::string& String() const { return _string; }
+
+  // elements of an array / members of an object, 0 otherwise
+  size_t Count() const { return _type == Type::Object ? _members.size() : _elements.size(); }
+  bool Has(const char* key) const { return Find(key) != nullptr; }
+  const JsonValue* Find(const char* key) const;
+  const JsonValue& operator[](const char* key) const;
+  const JsonValue& operator[](size_t index) const;
+  // a literal 0 would be ambiguous between the two above
+  const JsonValue& operator[](int index) const { return index < 0 ? (*this)[~size_t(0)] : (*this)[(size_t)index]; }
+  const std::vector<JsonValue>& Elements() const { return _elements; }
+  const std::vector<std::pair<std::string, JsonValue>>& Members() const { return _members; }
+
+private:
+  friend class JsonParser;
+
+  Type _type = Type::Null;
+  bool _bool = false;
+  double _number = 0.0;
+  std::string _string;
+  std::vector<JsonValue> _elements;
+  // in document order; objects here are small, a linear search beats hashing
+  std::vector<std::pair<std::string, JsonValue>> _members;
+};
+
+}
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "Ktx2.h"
+#include "MappedFile.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+const uint8_t Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+const char SourceKey[] = "NullEngine.source";
+
+struct Ktx2Header
+{
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+
+struct Ktx2Level
+{
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+// VkFormat values
+enum : uint32_t
+{
+  VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131,
+  VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132,
+  VK_FORMAT_BC3_UNORM_BLOCK = 137,
+  VK_FORMAT_BC3_SRGB_BLOCK = 138,
+  VK_FORMAT_BC5_UNORM_BLOCK = 141,
+  VK_FORMAT_BC7_UNORM_BLOCK = 145,
+  VK_FORMAT_BC7_SRGB_BLOCK = 146
+};
+
+uint32_t ToVkFormat(TextureFormat format, bool srgb)
+{
+  switch (format)
+  {
+    case TextureFormat::BC1: return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case TextureFormat::BC3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case TextureFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case TextureFormat::BC7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default: return 0;
+  }
+}
+
+bool FromVkFormat(uint32_t vkFormat, TextureFormat& format, bool& srgb)
+{
+  switch (vkFormat)
+  {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK: format = TextureFormat::BC1; srgb = false; return true;
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK: format = TextureFormat::BC1; srgb = true; return true;
+    case VK_FORMAT_BC3_UNORM_BLOCK: format = TextureFormat::BC3; srgb = false; return true;
+    case VK_FORMAT_BC3_SRGB_BLOCK: format = TextureFormat::BC3; srgb = true; return true;
+    case VK_FORMAT_BC5_UNORM_BLOCK: format = TextureFormat::BC5; srgb = false; return true;
+    case VK_FORMAT_BC7_UNORM_BLOCK: format = TextureFormat::BC7; srgb = false; return true;
+    case VK_FORMAT_BC7_SRGB_BLOCK: format = TextureFormat::BC7; srgb = true; return true;
+    default: return false;
+  }
+}
+
+// Khronos basic data format descriptor for a 4x4 block format
+std::vector<uint32_t> BuildDfd(TextureFormat format, bool srgb)
+{
+  struct Sample { uint32_t channel, bitOffset, bitLength; };
+  std::vector<Sample> samples;
+  uint32_t colorModel = 0;
+  switch (format)
+  {
+    case TextureFormat::BC1: colorModel = 128; samples = {{0, 0, 64}}; break;
+    case TextureFormat::BC3: colorModel = 130; samples = {{15, 0, 64}, {0, 64, 64}}; break;
+    case TextureFormat::BC5: colorModel = 132; samples = {{0, 0, 64}, {1, 64, 64}}; break;
+    case TextureFormat::BC7: colorModel = 134; samples = {{0, 0, 128}}; break;
+    default: break;
+  }
+
+  const uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+  std::vector<uint32_t> dfd;
+  dfd.push_back(4 + blockSize);                 // dfdTotalSize
+  dfd.push_back(0);                             // vendorId 0 (Khronos), descriptorType 0 (basic)
+  dfd.push_back(2 | (blockSize << 16));         // version 1.3, descriptorBlockSize
+  // colour model, primaries BT709, transfer function (2 = sRGB, 1 = linear), flags 0
+  dfd.push_back(colorModel | (1u << 8) | ((srgb ? 2u : 1u) << 16));
+  dfd.push_back(3 | (3u << 8));                 // 4x4x1x1 texel block (dimension - 1)
+  dfd.push_back((uint32_t)TextureCooker::BlockBytes(format)); // bytesPlane0
+  dfd.push_back(0);
+  for (const auto& s : samples)
+  {
+    dfd.push_back(s.bitOffset | ((s.bitLength - 1) << 16) | (s.channel << 24));
+    dfd.push_back(0);                           // sample position
+    dfd.push_back(0);                           // lower
+    dfd.push_back(0xFFFFFFFFu);                 // upper
+  }
+  return dfd;
+}
+
+uint64_t AlignUp(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+} // namespace
+
+bool Ktx2::Write(const std::string& path, const CompressedTexture& texture, const std::string& sourceKey)
+{
+  const uint32_t levelCount = (uint32_t)texture.levels.size();
+  if (!levelCount)
+    return false;
+
+  std::vector<uint32_t> dfd = BuildDfd(texture.format, texture.srgb);
+
+  // key/value data: length, "key\0value\0", padded to 4
+  std::vector<uint8_t> kvd;
+  {
+    uint32_t length = (uint32_t)(sizeof(SourceKey) + sourceKey.size() + 1);
+    kvd.resize(4);
+    std::memcpy(kvd.data(), &length, 4);
+    kvd.insert(kvd.end(), SourceKey, SourceKey + sizeof(SourceKey));
+    kvd.insert(kvd.end(), sourceKey.begin(), sourceKey.end());
+    kvd.push_back(0);
+    kvd.resize(AlignUp(kvd.size(), 4), 0);
+  }
+
+  Ktx2Header header = {};
+  header.vkFormat = ToVkFormat(texture.format, texture.srgb);
+  header.typeSize = 1;
+  header.pixelWidth = texture.width;
+  header.pixelHeight = texture.height;
+  header.faceCount = 1;
+  header.levelCount = levelCount;
+
+  uint64_t offset = sizeof(Identifier) + sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level);
+  header.dfdByteOffset = (uint32_t)offset;
+  header.dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t));
+  offset += header.dfdByteLength;
+  header.kvdByteOffset = (uint32_t)offset;
+  header.kvdByteLength = (uint32_t)kvd.size();
+  offset += header.kvdByteLength;
+
+  // mip data is stored smallest level first, each level aligned to the block size
+  const uint64_t alignment = TextureCooker::BlockBytes(texture.format);
+  std::vector<Ktx2Level> levelIndex(levelCount);
+  for (uint32_t i = levelCount; i-- > 0;)
+  {
+    offset = AlignUp(offset, alignment);
+    levelIndex[i].byteOffset = offset;
+    levelIndex[i].byteLength = texture.levels[i].size;
+    levelIndex[i].uncompressedByteLength = texture.levels[i].size;
+    offset += texture.levels[i].size;
+  }
+
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      std::cout << "ERROR::KTX2::Cannot write " << tmpPath << std::endl;
+      return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(Identifier), sizeof(Identifier));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(levelIndex.data()), (std::streamsize)(levelIndex.size() * sizeof(Ktx2Level)));
+    out.write(reinterpret_cast<const char*>(dfd.data()), header.dfdByteLength);
+    out.write(reinterpret_cast<const char*>(kvd.data()), (std::streamsize)kvd.size());
+    for (uint32_t i = levelCount; i-- > 0;)
+    {
+      static const char zeros[16] = {};
+      uint64_t cur = (uint64_t)out.tellp();
+      out.write(zeros, (std::streamsize)(levelIndex[i].byteOffset - cur));
+      out.write(reinterpret_cast<const char*>(texture.data.data() + texture.levels[i].offset), (std::streamsize)texture.levels[i].size);
+    }
+
+    if (!out)
+    {
+      std::cout << "ERROR::KTX2::Failed writing " << tmpPath << std::endl;
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    std::cout << "ERROR::KTX2::Cannot replace " << path << ": " << ec.message() << std::endl;
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+bool Ktx2::Read(const std::string& path, CompressedTexture& texture, std::string* sourceKey)
+{
+  if (sourceKey)
+    sourceKey->clear();
+
+  MappedFile file(path);
+  const size_t fixedSize = sizeof(Identifier) + sizeof(Ktx2Header);
+  if (!file.IsOpen() || file.Size() < fixedSize || std::memcmp(file.Data(), Identifier, sizeof(Identifier)) != 0)
+    return false;
+
+  Ktx2Header header;
+  std::memcpy(&header, file.Data() + sizeof(Identifier), sizeof(header));
+
+  TextureFormat format;
+  bool srgb;
+  if (!FromVkFormat(header.vkFormat, format, srgb) || header.supercompressionScheme != 0 ||
+    header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+    header.levelCount == 0 || header.levelCount > 32 || !header.pixelWidth || !header.pixelHeight)
+    return false;
+
+  if (file.Size() < fixedSize + header.levelCount * sizeof(Ktx2Level))
+    return false;
+  std::vector<Ktx2Level> levelIndex(header.levelCount);
+  std::memcpy(levelIndex.data(), file.Data() + fixedSize, levelIndex.size() * sizeof(Ktx2Level));
+
+  if (sourceKey && header.kvdByteLength && (uint64_t)header.kvdByteOffset + header.kvdByteLength <= file.Size())
+  {
+    const uint8_t* kvd = file.Data() + header.kvdByteOffset;
+    const uint8_t* end = kvd + header.kvdByteLength;
+    while (kvd + 4 <= end)
+    {
+      uint32_t length;
+      std::memcpy(&length, kvd, 4);
+      const char* entry = reinterpret_cast<const char*>(kvd + 4);
+      if (length > (uint64_t)(end - kvd - 4))
+        break;
+      size_t keyLength = strnlen(entry, length);
+      if (keyLength < length && std::strcmp(entry, SourceKey) == 0)
+      {
+        const char* value = entry + keyLength + 1;
+        *sourceKey = std::string(value, strnlen(value, length - keyLength - 1));
+        break;
+      }
+      kvd += AlignUp(4 + length, 4);
+    }
+  }
+
+  texture = CompressedTexture();
+  texture.format = format;
+  texture.srgb = srgb;
+  texture.width = header.pixelWidth;
+  texture.height = header.pixelHeight;
+
+  const size_t blockBytes = TextureCooker::BlockBytes(format);
+  uint32_t w = header.pixelWidth, h = header.pixelHeight;
+  for (uint32_t i = 0; i < header.levelCount; ++i)
+  {
+    const Ktx2Level& level = levelIndex[i];
+    size_t expected = (size_t)((w + 3) / 4) * ((h + 3) / 4) * blockBytes;
+    if (level.byteLength != expected || level.byteOffset + level.byteLength > file.Size())
+      return false;
+
+    TextureLevel info;
+    info.width = w;
+    info.height = h;
+    info.offset = texture.data.size();
+    info.size = expected;
+    texture.levels.push_back(info);
+    texture.data.insert(texture.data.end(), file.Data() + level.byteOffset, file.Data() + level.byteOffset + level.byteLength);
+
+    w = std::max(1u, w / 2);
+    h = std::max(1u, h / 2);
+  }
+  return true;
+}
+
+}
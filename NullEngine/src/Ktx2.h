@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include "TextureCooker.h"
+
+namespace NullEngine
+{
+
+// Minimal KTX2 reader/writer for the cooked block compressed textures.
+//
+// Only what TextureCooker produces: 2D, one layer, one face, no supercompression,
+// BC1/BC3/BC5/BC7 with a basic data format descriptor. The cooker stores the identity of
+// the source image in the "NullEngine.source" key/value entry so a stale file can be detected.
+class Ktx2
+{
+public:
+  static std::string CookedPath(const std::string& imagePath) { return imagePath + ".ktx2"; }
+
+  static bool Write(const std::string& path, const CompressedTexture& texture, const std::string& sourceKey);
+  // sourceKey (optional) receives the "NullEngine.source" value, empty if missing
+  static bool Read(const std::string& path, CompressedTexture& texture, std::string* sourceKey = nullptr);
+};
+
+}
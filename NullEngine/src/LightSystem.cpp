@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "GLState.h"
+#include "LightSystem.h"
+
+namespace NullEngine
+{
+
+LightSystem& LightSystem::Instance()
+{
+  static LightSystem lights;
+  return lights;
+}
+
+LightId LightSystem::Add(const Light& light)
+{
+  LightId id;
+  if (!_freeIds.empty())
+  {
+    id = _freeIds.back();
+    _freeIds.pop_back();
+  }
+  else
+  {
+    id = (LightId)_indices.size();
+    _indices.push_back(InvalidLight);
+  }
+  _indices[id] = (uint32_t)_lights.size();
+  _lights.push_back(light);
+  _ids.push_back(id);
+  _dirty = true;
+  return id;
+}
+
+void LightSystem::Remove(LightId id)
+{
+  if (id >= _indices.size() || _indices[id] == InvalidLight)
+    return;
+  // the last light fills the gap
+  const uint32_t index = _indices[id];
+  const LightId moved = _ids.back();
+  _lights[index] = _lights.back();
+  _ids[index] = moved;
+  _indices[moved] = index;
+  _lights.pop_back();
+  _ids.pop_back();
+  _indices[id] = InvalidLight;
+  _freeIds.push_back(id);
+  _dirty = true;
+}
+
+Light* LightSystem::Get(LightId id)
+{
+  if (id >= _indices.size() || _indices[id] == InvalidLight)
+    return nullptr;
+  _dirty = true;
+  return &_lights[_indices[id]];
+}
+
+void LightSystem::Set(LightId id, const Light& light)
+{
+  if (Light* target = Get(id))
+    *target = light;
+}
+
+void LightSystem::Upload()
+{
+  GLState& gl = GLState::Instance();
+  _stats.uploaded = false;
+  _stats.bytes = 0;
+  if (!_buffer)
+    glGenBuffers(1, &_buffer);
+
+  gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, _buffer);
+  if (_lights.size() > _capacity || !_capacity)
+  {
+    // grow in doubling steps, the old contents are rewritten below
+    _capacity = std::max<size_t>(std::max<size_t>(_capacity * 2, 64), _lights.size());
+    glBufferData(GL_SHADER_STORAGE_BUFFER, HeaderSize + _capacity * sizeof(Light), nullptr, GL_DYNAMIC_DRAW);
+    _dirty = true;
+  }
+  if (_dirty)
+  {
+    // invalidating lets the driver hand out fresh memory instead of waiting for last frame's draws
+    const size_t bytes = HeaderSize + _lights.size() * sizeof(Light);
+    auto* data = (unsigned char*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (data)
+    {
+      const uint32_t header[HeaderSize / sizeof(uint32_t)] = {(uint32_t)_lights.size()};
+      std::memcpy(data, header, HeaderSize);
+      if (!_lights.empty())
+        std::memcpy(data + HeaderSize, _lights.data(), _lights.size() * sizeof(Light));
+      if (glUnmapBuffer(GL_SHADER_STORAGE_BUFFER) == GL_TRUE)
+      {
+        _dirty = false;
+        _stats.uploaded = true;
+        _stats.bytes = bytes;
+      }
+    }
+    else
+    {
+      std::cout << "ERROR::LIGHTSYSTEM::Could not map the light buffer (" << bytes << " bytes)" << std::endl;
+    }
+  }
+  // the binding point the shaders read
+  gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding, _buffer);
+
+  _stats.lights = _lights.size();
+  _stats.capacity = _capacity;
+}
+
+void LightSystem::Shutdown()
+{
+  if (_buffer)
+    GLState::Instance().DeleteBuffers(1, &_buffer);
+  _buffer = 0;
+  _capacity = 0;
+  _dirty = true;
+}
+
+}
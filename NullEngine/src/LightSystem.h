@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace NullEngine
+{
+
+enum class LightType : uint32_t
+{
+  Directional,
+  Point,
+  Spot
+};
+
+// A light as the Phong shaders read it: the std430 layout of their Light struct (vec3s padded by the
+// scalar after them, 96 bytes), so the whole array is copied to the buffer as is.
+struct alignas(16) Light
+{
+  // unused by directional lights
+  glm::vec3 position = glm::vec3(0.0f);
+  LightType type = LightType::Point;
+  // unused by point lights
+  glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+  // spot cone: cosines of the angles where the falloff starts and ends
+  float cutOff = 0.9763f;
+  glm::vec3 ambient = glm::vec3(0.0f);
+  float outerCutOff = 0.9537f;
+  glm::vec3 diffuse = glm::vec3(1.0f);
+  // attenuation 1 / (constant + linear * d + quadratic * d^2), point and spot lights
+  float constant = 1.0f;
+  glm::vec3 specular = glm::vec3(1.0f);
+  float linear = 0.09f;
+  float quadratic = 0.032f;
+};
+static_assert(sizeof(Light) == 96, "Light must match the shaders' std430 layout");
+
+using LightId = uint32_t;
+
+struct LightSystemStats
+{
+  size_t lights = 0;
+  // lights the buffer has room for
+  size_t capacity = 0;
+  // last Upload: whether anything was copied and how much
+  bool uploaded = false;
+  size_t bytes = 0;
+};
+
+// The scene's lights, kept in one shader storage buffer the Phong shaders loop over:
+//   layout(std430, binding = LightSystem::Binding) readonly buffer Lights { uint lightCount; Light lights[]; };
+// Lights are added, changed and removed on the CPU side in any number; Upload copies them to the buffer in a
+// single mapped write once per frame, so there are no per-light uniforms. Ids stay valid until removed,
+// the array is kept dense (removal moves the last light into the gap). GL thread only.
+class LightSystem
+{
+public:
+  static LightSystem& Instance();
+
+  static constexpr LightId InvalidLight = ~0u;
+  // shader storage binding point of the buffer
+  static constexpr GLuint Binding = 0;
+
+  LightId Add(const Light& light);
+  void Remove(LightId id);
+  // null if the id was removed; changes through it are uploaded by the next Upload
+  Light* Get(LightId id);
+  void Set(LightId id, const Light& light);
+  size_t Count() const { return _lights.size(); }
+
+  // once per frame before drawing: uploads the lights if anything changed and binds the buffer
+  void Upload();
+  // GL thread, before the context is destroyed
+  void Shutdown();
+
+  const LightSystemStats& Stats() const { return _stats; }
+
+private:
+  LightSystem() = default;
+
+  // the lightCount header, padded to the alignment of the array after it
+  static constexpr size_t HeaderSize = 16;
+
+  std::vector<Light> _lights;
+  // id of each light in _lights, and index in _lights of each id (InvalidLight when free)
+  std::vector<LightId> _ids;
+  std::vector<uint32_t> _indices;
+  std::vector<LightId> _freeIds;
+  GLuint _buffer = 0;
+  size_t _capacity = 0;
+  bool _dirty = true;
+  LightSystemStats _stats;
+};
+
+}
@@ -0,0 +1,189 @@
+#include <cstring>
+#include <vector>
+#include "Lz4.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+constexpr size_t MinMatch = 4;
+// the last match has to start this far before the end, the last bytes are always literals
+constexpr size_t MatchSearchLimit = 12;
+constexpr size_t LastLiterals = 5;
+constexpr size_t MaxOffset = 65535;
+constexpr unsigned HashBits = 14;
+
+uint32_t Read32(const uint8_t* p)
+{
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+  return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+// 15 in the token nibble, then 255s and the remainder
+bool WriteLength(uint8_t*& op, const uint8_t* end, size_t length)
+{
+  for (; length >= 255; length -= 255)
+  {
+    if (op >= end)
+      return false;
+    *op++ = 255;
+  }
+  if (op >= end)
+    return false;
+  *op++ = (uint8_t)length;
+  return true;
+}
+
+bool WriteSequence(uint8_t*& op, const uint8_t* end, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+  if (op >= end)
+    return false;
+  uint8_t* token = op++;
+  *token = (uint8_t)((literalCount >= 15 ? 15 : literalCount) << 4);
+  if (literalCount >= 15 && !WriteLength(op, end, literalCount - 15))
+    return false;
+  if ((size_t)(end - op) < literalCount)
+    return false;
+  if (literalCount)
+    std::memcpy(op, literals, literalCount);
+  op += literalCount;
+
+  // the last sequence has no match
+  if (matchLength == 0)
+    return true;
+  if (end - op < 2)
+    return false;
+  *op++ = (uint8_t)(offset & 0xFF);
+  *op++ = (uint8_t)(offset >> 8);
+  size_t extra = matchLength - MinMatch;
+  *token |= (uint8_t)(extra >= 15 ? 15 : extra);
+  return extra < 15 || WriteLength(op, end, extra - 15);
+}
+
+} // namespace
+
+size_t Lz4::Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+{
+  uint8_t* op = dst;
+  const uint8_t* end = dst + capacity;
+  size_t anchor = 0;
+
+  if (size > MatchSearchLimit)
+  {
+    // positions + 1, 0 = empty
+    std::vector<uint32_t> table(size_t(1) << HashBits, 0);
+    const size_t searchEnd = size - MatchSearchLimit;
+    const size_t matchEnd = size - LastLiterals;
+    size_t ip = 0;
+    while (ip < searchEnd)
+    {
+      uint32_t sequence = Read32(src + ip);
+      uint32_t& slot = table[Hash(sequence)];
+      size_t candidate = slot;
+      slot = (uint32_t)(ip + 1);
+
+      if (candidate == 0 || ip - (candidate - 1) > MaxOffset || Read32(src + candidate - 1) != sequence)
+      {
+        // skip faster through data that does not match
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      size_t ref = candidate - 1;
+      // extend backwards into the pending literals
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+      {
+        --ip;
+        --ref;
+      }
+      size_t length = MinMatch;
+      while (ip + length < matchEnd && src[ref + length] == src[ip + length])
+        ++length;
+
+      if (!WriteSequence(op, end, src + anchor, ip - anchor, ip - ref, length))
+        return 0;
+      ip += length;
+      anchor = ip;
+      if (ip >= 2 && ip < searchEnd)
+        table[Hash(Read32(src + ip - 2))] = (uint32_t)(ip - 2 + 1);
+    }
+  }
+
+  if (!WriteSequence(op, end, src + anchor, size - anchor, 0, 0))
+    return 0;
+  return (size_t)(op - dst);
+}
+
+bool Lz4::Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize)
+{
+  const uint8_t* ip = src;
+  const uint8_t* ipEnd = src + size;
+  uint8_t* op = dst;
+  uint8_t* opEnd = dst + rawSize;
+
+  auto readLength = [&](size_t& length)
+  {
+    uint8_t byte;
+    do
+    {
+      if (ip >= ipEnd)
+        return false;
+      byte = *ip++;
+      length += byte;
+    } while (byte == 255);
+    return true;
+  };
+
+  while (ip < ipEnd)
+  {
+    const uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(literals))
+      return false;
+    if ((size_t)(ipEnd - ip) < literals || (size_t)(opEnd - op) < literals)
+      return false;
+    if (literals)
+      std::memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+
+    // the last sequence ends after its literals
+    if (ip == ipEnd)
+      break;
+
+    if (ipEnd - ip < 2)
+      return false;
+    size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    size_t length = token & 15;
+    if (length == 15 && !readLength(length))
+      return false;
+    length += MinMatch;
+    if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(opEnd - op) < length)
+      return false;
+
+    // overlapping copy when offset < length repeats the pattern, byte by byte
+    const uint8_t* match = op - offset;
+    if (offset >= length)
+    {
+      std::memcpy(op, match, length);
+      op += length;
+    }
+    else
+    {
+      for (size_t i = 0; i < length; ++i)
+        *op++ = match[i];
+    }
+  }
+  return op == opEnd;
+}
+
+}
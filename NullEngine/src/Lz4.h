@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace NullEngine
+{
+
+// LZ4 block format (no frame header), written for the asset pack's 64 KB chunks:
+// greedy single-probe matching on the compress side, a bounds checked decoder that is
+// safe on corrupt input. Blocks are independent, so chunks decompress in parallel.
+class Lz4
+{
+public:
+  // worst case output size for size input bytes (incompressible data grows slightly)
+  static size_t CompressBound(size_t size) { return size + size / 255 + 16; }
+
+  // returns the compressed size, 0 if dst (capacity bytes) is too small
+  static size_t Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+  // decodes exactly rawSize bytes; false if the block is corrupt or does not match rawSize
+  static bool Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize);
+};
+
+}
@@ -0,0 +1,141 @@
+#include <utility>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace NullEngine
+{
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    Close();
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_open, other._open);
+#ifdef _WIN32
+    std::swap(_file, other._file);
+    std::swap(_mapping, other._mapping);
+#else
+    std::swap(_fd, other._fd);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path)
+{
+  Close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  _file = file;
+  _size = (size_t)size.QuadPart;
+  _open = true;
+  if (_size == 0)
+    return true;
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+  {
+    Close();
+    return false;
+  }
+  _mapping = mapping;
+
+  _data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!_data)
+  {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (_data)
+    UnmapViewOfFile(_data);
+  if (_mapping)
+    CloseHandle(_mapping);
+  if (_file)
+    CloseHandle(_file);
+
+  _data = nullptr;
+  _mapping = nullptr;
+  _file = nullptr;
+  _size = 0;
+  _open = false;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path)
+{
+  Close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  _fd = fd;
+  _size = (size_t)st.st_size;
+  _open = true;
+  if (_size == 0)
+    return true;
+
+  void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    Close();
+    return false;
+  }
+  _data = static_cast<const uint8_t*>(data);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (_data)
+    munmap(const_cast<uint8_t*>(_data), _size);
+  if (_fd >= 0)
+    ::close(_fd);
+
+  _data = nullptr;
+  _fd = -1;
+  _size = 0;
+  _open = false;
+}
+
+#endif
+
+}
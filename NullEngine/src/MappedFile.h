@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace NullEngine
+{
+
+// Read-only memory mapped file
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& path) { Open(path); }
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  bool Open(const std::string& path);
+  void Close();
+
+  bool IsOpen() const { return _data != nullptr || _open; }
+  const uint8_t* Data() const { return _data; }
+  size_t Size() const { return _size; }
+
+private:
+  const uint8_t* _data = nullptr;
+  size_t _size = 0;
+  // an empty file is "open" but has no mapping
+  bool _open = false;
+#ifdef _WIN32
+  void* _file = nullptr;
+  void* _mapping = nullptr;
+#else
+  int _fd = -1;
+#endif
+};
+
+}
@@ -1,15 +1,99 @@
+#include <algorithm>
+#include "GeometryRegistry.h"
+#include "GLState.h"
 #include "Mesh.h"
+#include "Uniforms.h"
 
 namespace NullEngine
 {
 
-Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<std::shared_ptr<Texture>>&& textures)
+Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<std::shared_ptr<Texture>>&& textures,
+  vector<MeshLod>&& lods, vector<Meshlet>&& meshlets, VertexFormat format, uint64_t geometryKey)
 {
+  this->_format = format;
   this->_vertices = std::move(vertices);
   this->_indices = std::move(indices);
   this->_textures = std::move(textures);
+  this->_lods = std::move(lods);
+  this->_meshlets = std::move(meshlets);
 
-  SetupMesh();
+  SetupMesh(_vertices.data(), _vertices.size(), _indices.data(), _indices.size(), geometryKey);
+}
+
+Mesh::Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, vector<std::shared_ptr<Texture>>&& textures,
+  vector<MeshLod>&& lods, vector<Meshlet>&& meshlets, VertexFormat format, uint64_t geometryKey)
+{
+  this->_format = format;
+  this->_textures = std::move(textures);
+  this->_lods = std::move(lods);
+  this->_meshlets = std::move(meshlets);
+
+  SetupMesh(vertices, vertexCount, indices, indexCount, geometryKey);
+}
+
+Mesh::Mesh(const MeshBuffers& buffers, vector<std::shared_ptr<Texture>>&& textures)
+{
+  GLState& gl = GLState::Instance();
+  this->_format = VertexFormat::External;
+  this->_textures = std::move(textures);
+
+  MeshLod full;
+  full.indexCount = (uint32_t)buffers.indexCount;
+  _lods.push_back(full);
+
+  _boundsCenter = (buffers.boundsMin + buffers.boundsMax) * 0.5f;
+  _boundsRadius = glm::length(buffers.boundsMax - buffers.boundsMin) * 0.5f;
+  _vertexCount = buffers.vertexCount;
+  _indexCount = buffers.indexCount;
+  _vertexBytes = buffers.vertexBytes;
+  _indexBytes = buffers.indexBytes;
+  _indexType = buffers.indexType;
+  _indexSize = buffers.indexType == GL_UNSIGNED_BYTE ? 1 : buffers.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+  _indexOffset = buffers.indexOffset;
+
+  // the buffers belong to the caller and may be shared between meshes
+  _VBO = 0;
+  _EBO = buffers.indexBuffer;
+  glGenVertexArrays(1, &_VAO);
+  gl.BindVertexArray(_VAO);
+  gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
+
+  const MeshAttribute* attributes[] = {&buffers.position, &buffers.normal, &buffers.texCoords};
+  for (GLuint location = 0; location < 3; ++location)
+  {
+    const MeshAttribute& attribute = *attributes[location];
+    glEnableVertexAttribArray(location);
+    if (attribute.buffer)
+    {
+      gl.BindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+      glVertexAttribPointer(location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, attribute.stride,
+        (void*)attribute.offset);
+    }
+    else
+    {
+      // a constant kept in the VAO: one element read by every vertex (divisor 1, instance 0)
+      gl.BindBuffer(GL_ARRAY_BUFFER, DefaultAttributes());
+      glVertexAttribPointer(location, location == 2 ? 2 : 3, GL_FLOAT, GL_FALSE, 0, (void*)(location == 2 ? 3 * sizeof(float) : 0));
+      glVertexAttribDivisor(location, 1);
+    }
+  }
+
+  gl.BindVertexArray(0);
+  gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned Mesh::DefaultAttributes()
+{
+  // normal (0, 0, 1), texture coordinates (0, 0)
+  static unsigned buffer = 0;
+  if (!buffer)
+  {
+    const float values[5] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    glGenBuffers(1, &buffer);
+    GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(values), values, GL_STATIC_DRAW);
+  }
+  return buffer;
 }
 
 //Mesh::~Mesh()
@@ -21,56 +105,396 @@ Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<std
 
 void Mesh::Draw(Shader& shader)
 {
+  GLState& gl = GLState::Instance();
+  if (_culled)
+    return;
+
+  if (_samplers.size() != _textures.size())
+    NameSamplers();
+  for (unsigned int i = 0; i < _textures.size(); i++)
+  {
+    gl.ActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
+    shader.SetInt(_samplers[i], i);
+    // through Use(), so the residency manager sees the texture is visible
+    _textures[i]->Use();
+  }
+  gl.ActiveTexture(GL_TEXTURE0);
+
+  const bool quantized = _format == VertexFormat::Quantized;
+  if (quantized)
+  {
+    shader.SetVec3(Uniforms::PosOffset, _posOffset);
+    shader.SetVec3(Uniforms::PosScale, _posScale);
+    shader.SetBool(Uniforms::OctNormals, true);
+  }
+
+  // draw mesh
+  const MeshLod& lod = _lods[_lod];
+  gl.BindVertexArray(_VAO);
+  if (_clustered)
+  {
+    if (!_runCounts.empty())
+      glMultiDrawElements(GL_TRIANGLES, _runCounts.data(), _indexType, _runOffsets.data(), (GLsizei)_runCounts.size());
+  }
+  else if (_instances.size() > 1)
+  {
+    glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)lod.indexCount, _indexType, (void*)(_indexOffset + (size_t)lod.firstIndex * _indexSize),
+      (GLsizei)_visibleInstances.size());
+  }
+  else
+  {
+    glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, _indexType, (void*)(_indexOffset + (size_t)lod.firstIndex * _indexSize));
+  }
+  // the VAO stays bound, the next draw's bind is skipped if it is the same
+
+  // back to the float layout for whatever draws with this shader next
+  if (quantized)
+  {
+    shader.SetVec3(Uniforms::PosOffset, glm::vec3(0.0f));
+    shader.SetVec3(Uniforms::PosScale, glm::vec3(1.0f));
+    shader.SetBool(Uniforms::OctNormals, false);
+  }
+}
+
+void Mesh::NameSamplers()
+{
+  _samplers.clear();
   unsigned int diffuseNr = 1;
   unsigned int specularNr = 1;
-  for (unsigned int i = 0; i < _textures.size(); i++)
+  for (const auto& texture : _textures)
   {
-    glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
     // retrieve texture number (the N in diffuse_textureN)
     std::string number;
-    std::string name = _textures[i]->Name();
+    const std::string& name = texture->Name();
     if (name == "texture_diffuse")
       number = std::to_string(diffuseNr++);
     else if (name == "texture_specular")
       number = std::to_string(specularNr++);
+    _samplers.push_back(UniformHandle("material." + name + number));
+  }
+}
+
+void Mesh::Submit(RenderQueue& queue, RenderPass pass, Shader& shader, const glm::mat4& model)
+{
+  if (_culled || (_clustered && _runCounts.empty()))
+    return;
 
-    shader.SetInt(("material." + name + number).c_str(), i);
-    glBindTexture(GL_TEXTURE_2D, _textures[i]->Id());
+  if (_samplers.size() != _textures.size())
+    NameSamplers();
+  DrawItem item;
+  item.shader = &shader;
+  item.vao = _VAO;
+  item.textures = _textures.data();
+  item.samplers = _samplers.data();
+  item.textureCount = (unsigned)_textures.size();
+  item.indexType = _indexType;
+  if (_clustered)
+  {
+    item.runCounts = _runCounts.data();
+    item.runOffsets = _runOffsets.data();
+    item.runs = (GLsizei)_runCounts.size();
+  }
+  else
+  {
+    const MeshLod& lod = _lods[_lod];
+    item.count = (GLsizei)lod.indexCount;
+    item.indexOffset = (void*)(_indexOffset + (size_t)lod.firstIndex * _indexSize);
+    if (_instances.size() > 1)
+      item.instances = (GLsizei)_visibleInstances.size();
   }
-  glActiveTexture(GL_TEXTURE0);
+  item.model = model;
+  item.quantized = _format == VertexFormat::Quantized;
+  item.posOffset = _posOffset;
+  item.posScale = _posScale;
 
-  // draw mesh
-  glBindVertexArray(_VAO);
-  glDrawElements(GL_TRIANGLES, (GLsizei)_indices.size(), GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+  // depth sorted by the center of the first visible copy
+  glm::vec3 center = _boundsCenter;
+  if (_instances.size() > 1 && !_visibleInstances.empty())
+    center += _visibleInstances[0];
+  queue.Push(pass, item, glm::vec3(model * glm::vec4(center, 1.0f)));
 }
 
-void Mesh::SetupMesh()
+void Mesh::Cull(const glm::mat4& model, const CullView& view, ClusterCullStats& stats)
 {
+  _culled = false;
+  _clustered = false;
+  _runCounts.clear();
+  _runOffsets.clear();
+
+  const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  auto outside = [&view](const glm::vec3& center, float radius)
+  {
+    for (const auto& plane : view.planes)
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+        return true;
+    return false;
+  };
+
+  // instances are culled as whole meshes, the visible ones packed to the front of the instance buffer
+  if (_instances.size() > 1)
+  {
+    _visibleInstances.clear();
+    for (const glm::vec3& translation : _instances)
+    {
+      ++stats.meshes;
+      if (view.frustumCulling && outside(glm::vec3(model * glm::vec4(_boundsCenter + translation, 1.0f)), _boundsRadius * scale))
+      {
+        ++stats.meshesRejected;
+        continue;
+      }
+      _visibleInstances.push_back(translation);
+    }
+    _culled = _visibleInstances.empty();
+    if (!_culled)
+    {
+      GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, _visibleInstances.size() * sizeof(glm::vec3), _visibleInstances.data());
+      GLState::Instance().BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    return;
+  }
+
+  ++stats.meshes;
+
+  if (view.frustumCulling && outside(glm::vec3(model * glm::vec4(_boundsCenter, 1.0f)), _boundsRadius * scale))
+  {
+    _culled = true;
+    ++stats.meshesRejected;
+    return;
+  }
+
+  // meshlets cover the full detail level only
+  if (_lod != 0 || _meshlets.empty() || (!view.frustumCulling && !view.coneCulling))
+    return;
+
+  _clustered = true;
+  const glm::mat3 rotation(model);
+  for (const auto& meshlet : _meshlets)
+  {
+    ++stats.meshlets;
+    glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center, 1.0f));
+    float radius = meshlet.radius * scale;
+
+    if (view.frustumCulling && outside(center, radius))
+    {
+      ++stats.frustumRejected;
+      continue;
+    }
+    if (view.coneCulling && meshlet.coneCutoff < 1.0f)
+    {
+      // every triangle faces away if the camera is outside the cone widened by the sphere
+      glm::vec3 axis = glm::normalize(rotation * meshlet.coneAxis);
+      glm::vec3 toCenter = center - view.cameraPosition;
+      if (glm::dot(toCenter, axis) >= meshlet.coneCutoff * glm::length(toCenter) + radius)
+      {
+        ++stats.backfaceRejected;
+        continue;
+      }
+    }
+
+    // merge neighbouring visible meshlets into one draw
+    const char* offset = reinterpret_cast<const char*>(_indexOffset + (size_t)meshlet.firstIndex * _indexSize);
+    GLsizei count = (GLsizei)meshlet.triangleCount * 3;
+    if (!_runCounts.empty() && static_cast<const char*>(_runOffsets.back()) + _runCounts.back() * _indexSize == offset)
+      _runCounts.back() += count;
+    else
+    {
+      _runCounts.push_back(count);
+      _runOffsets.push_back(offset);
+    }
+  }
+}
+
+void Mesh::SelectLod(const glm::mat4& model, const LodView& view)
+{
+  const unsigned count = (unsigned)_lods.size();
+  if (view.forcedLod >= 0)
+  {
+    _lod = std::min((unsigned)view.forcedLod, count - 1);
+    return;
+  }
+
+  // projected diameter of the bounding sphere in pixels, of the nearest instance
+  float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  float radius = _boundsRadius * scale;
+  float pixels = 0.0f;
+  for (size_t i = 0; i < InstanceCount(); ++i)
+  {
+    glm::vec3 translation = _instances.empty() ? glm::vec3(0.0f) : _instances[i];
+    glm::vec3 center = glm::vec3(model * glm::vec4(_boundsCenter + translation, 1.0f));
+    float distance = glm::length(center - view.cameraPosition);
+    if (distance <= radius)
+    {
+      _lod = 0;
+      return;
+    }
+    pixels = std::max(pixels, 2.0f * radius * view.projScale / distance);
+  }
+
+  // coarsest level whose error (relative to the diameter) projects below the limit
+  auto pick = [&](float size)
+  {
+    unsigned lod = 0;
+    for (unsigned i = 1; i < count; ++i)
+      if (_lods[i].error * size <= view.maxPixelError)
+        lod = i;
+    return lod;
+  };
+
+  unsigned desired = pick(pixels);
+  if (desired > _lod)
+    desired = std::max(_lod, pick(pixels * (1.0f + view.hysteresis)));
+  else if (desired < _lod)
+    desired = std::min(_lod, pick(pixels * (1.0f - view.hysteresis)));
+  _lod = desired;
+}
+
+void Mesh::SetInstances(const vector<glm::vec3>& translations)
+{
+  GLState& gl = GLState::Instance();
+  if (_format == VertexFormat::External || translations.empty())
+    return;
+  _instances = translations;
+  _visibleInstances = translations;
+
+  // location 3, one translation per instance; shaders add it to the position before the model matrix
+  if (!_instanceBuffer)
+    glGenBuffers(1, &_instanceBuffer);
+  gl.BindVertexArray(_VAO);
+  gl.BindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, translations.size() * sizeof(glm::vec3), translations.data(), GL_DYNAMIC_DRAW);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+  glVertexAttribDivisor(3, 1);
+  gl.BindVertexArray(0);
+  gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::SetupMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, uint64_t geometryKey)
+{
+  GLState& gl = GLState::Instance();
+  if (_lods.empty())
+  {
+    MeshLod full;
+    full.indexCount = (uint32_t)indexCount;
+    _lods.push_back(full);
+  }
+
+  // bounding sphere around the box
+  if (vertexCount)
+  {
+    glm::vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+    for (size_t i = 1; i < vertexCount; ++i)
+    {
+      lo = glm::min(lo, vertices[i].Position);
+      hi = glm::max(hi, vertices[i].Position);
+    }
+    _boundsCenter = (lo + hi) * 0.5f;
+    _boundsRadius = glm::length(hi - lo) * 0.5f;
+  }
+
+  _vertexCount = vertexCount;
+  _indexCount = indexCount;
+
+  // the same content uploaded before, by this model or another, is drawn from the same buffers
+  GeometryRegistry& registry = GeometryRegistry::Instance();
+  _geometry = registry.Find(geometryKey, _format, vertexCount, indexCount, _lods.size());
+  _sharedGeometry = _geometry != nullptr;
+  if (!_geometry)
+  {
+    MeshGeometry geometry;
+    geometry.vertexCount = vertexCount;
+    geometry.indexCount = indexCount;
+    geometry.lodCount = _lods.size();
+    UploadGeometry(geometry, vertices, vertexCount, indices, indexCount);
+    _geometry = registry.Insert(geometryKey, _format, geometry);
+  }
+  _VBO = _geometry->vbo;
+  _EBO = _geometry->ebo;
+  _indexType = _geometry->indexType;
+  _indexSize = _geometry->indexSize;
+  _posOffset = _geometry->posOffset;
+  _posScale = _geometry->posScale;
+  _quantError = _geometry->quantError;
+  _vertexBytes = _geometry->vertexBytes;
+  _indexBytes = _geometry->indexBytes;
+
   glGenVertexArrays(1, &_VAO);
-  glGenBuffers(1, &_VBO);
-  glGenBuffers(1, &_EBO);
+  gl.BindVertexArray(_VAO);
+  gl.BindBuffer(GL_ARRAY_BUFFER, _VBO);
+  gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
 
-  glBindVertexArray(_VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+  if (_format == VertexFormat::Quantized)
+  {
+    // vertex positions: unorm16 inside the AABB
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, position));
+    // vertex normals: octahedral snorm16
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+    // vertex texture coords: half floats
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, texCoords));
+  }
+  else
+  {
+    // vertex positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+  }
 
-  glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), &_vertices[0], GL_STATIC_DRAW);
+  gl.BindVertexArray(0);
+  gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(unsigned int),
-    &_indices[0], GL_STATIC_DRAW);
+void Mesh::UploadGeometry(MeshGeometry& geometry, const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+  GLState& gl = GLState::Instance();
+  // no VAO is bound here, the indices go in through the copy target
+  glGenBuffers(1, &geometry.vbo);
+  glGenBuffers(1, &geometry.ebo);
+  gl.BindBuffer(GL_ARRAY_BUFFER, geometry.vbo);
+  gl.BindBuffer(GL_COPY_WRITE_BUFFER, geometry.ebo);
 
-  // vertex positions
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-  // vertex normals
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-  // vertex texture coords
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+  if (_format == VertexFormat::Quantized)
+  {
+    vector<QuantizedVertex> quantized;
+    VertexQuantizer::Quantize(vertices, vertexCount, quantized, geometry.posOffset, geometry.posScale);
+    geometry.quantError = VertexQuantizer::Measure(vertices, quantized.data(), vertexCount, geometry.posOffset, geometry.posScale);
+    geometry.vertexBytes = vertexCount * sizeof(QuantizedVertex);
+    glBufferData(GL_ARRAY_BUFFER, geometry.vertexBytes, quantized.data(), GL_STATIC_DRAW);
+
+    // every index of every LOD addresses the same vertex buffer, so the vertex count decides
+    if (vertexCount < 65536)
+    {
+      vector<uint16_t> shortIndices(indices, indices + indexCount);
+      geometry.indexType = GL_UNSIGNED_SHORT;
+      geometry.indexSize = sizeof(uint16_t);
+      geometry.indexBytes = indexCount * geometry.indexSize;
+      glBufferData(GL_COPY_WRITE_BUFFER, geometry.indexBytes, shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+      geometry.indexBytes = indexCount * geometry.indexSize;
+      glBufferData(GL_COPY_WRITE_BUFFER, geometry.indexBytes, indices, GL_STATIC_DRAW);
+    }
+  }
+  else
+  {
+    geometry.vertexBytes = vertexCount * sizeof(Vertex);
+    geometry.indexBytes = indexCount * sizeof(unsigned int);
+    glBufferData(GL_ARRAY_BUFFER, geometry.vertexBytes, vertices, GL_STATIC_DRAW);
+    glBufferData(GL_COPY_WRITE_BUFFER, geometry.indexBytes, indices, GL_STATIC_DRAW);
+  }
 
-  glBindVertexArray(0);
+  gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+  gl.BindBuffer(GL_COPY_WRITE_BUFFER, 0);
 }
 
-}
\ No newline at end of file
+}
@@ -2,8 +2,11 @@
 
 #include <vector>
 #include <memory>
+#include "MeshData.h"
+#include "RenderQueue.h"
 #include "Texture.h"
 #include "Vertex.h"
+#include "VertexQuantizer.h"
 #include "Shader.h"
 
 using std::vector;
@@ -11,6 +14,86 @@ using std::vector;
 namespace NullEngine
 {
 
+// Camera data for screen-space LOD selection
+struct LodView
+{
+  glm::vec3 cameraPosition = glm::vec3(0.0f);
+  // viewport height / (2 tan(fovY / 2)): size at distance 1 -> pixels
+  float projScale = 1.0f;
+  // coarsest level whose simplification error stays below this many pixels
+  float maxPixelError = 1.0f;
+  // relative margin before switching levels, avoids popping back and forth at a boundary
+  float hysteresis = 0.15f;
+  // >= 0 draws that level (clamped per mesh) instead of selecting one
+  int forcedLod = -1;
+};
+
+// GPU vertex layout of a mesh
+enum class VertexFormat
+{
+  // NullEngine::Vertex, 32 bytes, 32-bit indices
+  Float,
+  // QuantizedVertex, 16 bytes, 16-bit indices below 65536 vertices; the vertex shader decodes it
+  // with the posOffset/posScale/octNormals uniforms Draw sets
+  Quantized,
+  // whatever MeshBuffers describes (a glTF file's accessors): float or normalized attributes
+  // the shaders read like Float
+  External
+};
+
+// vertex attribute read in place from a GL buffer, the arguments of glVertexAttribPointer
+struct MeshAttribute
+{
+  // 0 = absent: normals read (0, 0, 1), texture coordinates (0, 0)
+  unsigned buffer = 0;
+  GLint components = 3;
+  GLenum type = GL_FLOAT;
+  bool normalized = false;
+  // 0 = tightly packed
+  GLsizei stride = 0;
+  size_t offset = 0;
+};
+
+// geometry already in GL buffers filled by the caller (GltfLoader buffer views), drawn as is
+struct MeshBuffers
+{
+  MeshAttribute position;
+  MeshAttribute normal;
+  MeshAttribute texCoords;
+  unsigned indexBuffer = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  // byte offset of the first index inside indexBuffer
+  size_t indexOffset = 0;
+  size_t indexCount = 0;
+  size_t vertexCount = 0;
+  // model space box of the positions
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+  // bytes the mesh's attributes/indices take in the shared buffers, for statistics
+  size_t vertexBytes = 0;
+  size_t indexBytes = 0;
+};
+
+// Vertex + index buffers uploaded by Mesh::SetupMesh, shared through GeometryRegistry by every
+// Mesh with the same content
+struct MeshGeometry
+{
+  unsigned vbo = 0;
+  unsigned ebo = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  unsigned indexSize = sizeof(unsigned int);
+  // VertexFormat::Quantized: position = posOffset + unorm * posScale
+  glm::vec3 posOffset = glm::vec3(0.0f);
+  glm::vec3 posScale = glm::vec3(1.0f);
+  QuantizationError quantError;
+  size_t vertexBytes = 0;
+  size_t indexBytes = 0;
+  // what was uploaded, compared on lookups so a key collision is not drawn as this geometry
+  size_t vertexCount = 0;
+  size_t indexCount = 0;
+  size_t lodCount = 0;
+};
+
 class Mesh
 {
 public:
@@ -19,15 +102,97 @@ public:
   vector<unsigned int> _indices;
   vector<std::shared_ptr<Texture>> _textures;
 
-  Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<std::shared_ptr<Texture>>&& textures);
+  // lods: index ranges of the levels of detail inside indices, empty = one level with all of them
+  // meshlets: clusters of the full detail level, empty = culled/drawn as a whole only
+  // geometryKey: GeometryRegistry::ContentKey of the data, reuses the buffers of a mesh with the same one; 0 = always upload
+  Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<std::shared_ptr<Texture>>&& textures,
+    vector<MeshLod>&& lods = {}, vector<Meshlet>&& meshlets = {}, VertexFormat format = VertexFormat::Float, uint64_t geometryKey = 0);
+  // uploads straight from external memory (e.g. a mapped mesh cache), no CPU copy is kept
+  Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, vector<std::shared_ptr<Texture>>&& textures,
+    vector<MeshLod>&& lods = {}, vector<Meshlet>&& meshlets = {}, VertexFormat format = VertexFormat::Float, uint64_t geometryKey = 0);
+  // draws from buffers the caller owns, VertexFormat::External; one level of detail, no meshlets
+  Mesh(const MeshBuffers& buffers, vector<std::shared_ptr<Texture>>&& textures);
   // destructor
   //~Mesh();
   void Draw(Shader& shader);
+  // pushes what Draw would draw as one item; model is the mesh's model matrix. The item points into
+  // the mesh, which must not change before the queue is flushed
+  void Submit(RenderQueue& queue, RenderPass pass, Shader& shader, const glm::mat4& model);
+
+  // picks the level drawn by the following Draw calls; model is the mesh's model matrix
+  void SelectLod(const glm::mat4& model, const LodView& view);
+  unsigned LodCount() const { return (unsigned)_lods.size(); }
+  const MeshLod& Lod(unsigned i) const { return _lods[i]; }
+  unsigned CurrentLod() const { return _lod; }
+
+  // Frustum culls the mesh and, at full detail, its meshlets (frustum + normal cone) for the
+  // following Draw calls. Call after SelectLod.
+  void Cull(const glm::mat4& model, const CullView& view, ClusterCullStats& stats);
+  size_t MeshletCount() const { return _meshlets.size(); }
+
+  // Draws the mesh once per translation (model space, applied before the model matrix) with one
+  // instanced draw; the first is usually zero. Instances are culled and LOD selected as a group,
+  // meshlets are only used for a single instance. Float/Quantized meshes, GL thread.
+  void SetInstances(const vector<glm::vec3>& translations);
+  size_t InstanceCount() const { return _instances.empty() ? 1 : _instances.size(); }
+  // the buffers came from GeometryRegistry, another mesh uploaded them
+  bool SharedGeometry() const { return _sharedGeometry; }
+
+  // model space bounding sphere (of the first instance)
+  const glm::vec3& BoundsCenter() const { return _boundsCenter; }
+  float BoundsRadius() const { return _boundsRadius; }
+
+  VertexFormat Format() const { return _format; }
+  size_t VertexCount() const { return _vertexCount; }
+  // indices of all levels of detail
+  size_t IndexCount() const { return _indexCount; }
+  // bytes of the uploaded vertex/index buffers
+  size_t VertexBytes() const { return _vertexBytes; }
+  size_t IndexBytes() const { return _indexBytes; }
+  // error introduced by VertexFormat::Quantized, zero for Float
+  const QuantizationError& QuantError() const { return _quantError; }
 private:
   //  render data
   unsigned int _VAO, _VBO, _EBO;
+  // sampler uniform of each texture ("material.texture_diffuse1", ...), named on first draw
+  vector<UniformHandle> _samplers;
+  // owner of _VBO/_EBO, null for External meshes
+  std::shared_ptr<const MeshGeometry> _geometry;
+  bool _sharedGeometry = false;
+  // SetInstances: translations, per-instance attribute buffer (location 3) and the instances Cull left visible
+  vector<glm::vec3> _instances;
+  vector<glm::vec3> _visibleInstances;
+  unsigned _instanceBuffer = 0;
+  vector<MeshLod> _lods;
+  unsigned _lod = 0;
+  vector<Meshlet> _meshlets;
+  // result of the last Cull: whole mesh rejected, or the runs of visible meshlets to draw
+  bool _culled = false;
+  bool _clustered = false;
+  vector<GLsizei> _runCounts;
+  vector<const void*> _runOffsets;
+  glm::vec3 _boundsCenter = glm::vec3(0.0f);
+  float _boundsRadius = 0.0f;
+  VertexFormat _format = VertexFormat::Float;
+  GLenum _indexType = GL_UNSIGNED_INT;
+  unsigned _indexSize = sizeof(unsigned int);
+  // byte offset of index 0 inside _EBO
+  size_t _indexOffset = 0;
+  // quantized position = posOffset + unorm * posScale
+  glm::vec3 _posOffset = glm::vec3(0.0f);
+  glm::vec3 _posScale = glm::vec3(1.0f);
+  QuantizationError _quantError;
+  size_t _vertexCount = 0;
+  size_t _indexCount = 0;
+  size_t _vertexBytes = 0;
+  size_t _indexBytes = 0;
 
-  void SetupMesh();
+  void SetupMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, uint64_t geometryKey);
+  // fills a new MeshGeometry's buffers from the CPU data
+  void UploadGeometry(MeshGeometry& geometry, const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+  void NameSamplers();
+  // constant normal/texture coordinates for External meshes without them
+  static unsigned DefaultAttributes();
 };
 
 }
\ No newline at end of file
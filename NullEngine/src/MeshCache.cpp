@@ -0,0 +1,389 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "GeometryCodec.h"
+#include "Hash.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+constexpr char Magic[4] = {'N', 'E', 'M', 'C'};
+
+uint64_t Align16(uint64_t v) { return (v + 15) & ~uint64_t(15); }
+
+class StringTable
+{
+public:
+  uint32_t Add(const std::string& s)
+  {
+    uint32_t offset = (uint32_t)_data.size();
+    _data.insert(_data.end(), s.begin(), s.end());
+    _data.push_back('\0');
+    return offset;
+  }
+  const std::vector<char>& Data() const { return _data; }
+
+private:
+  std::vector<char> _data;
+};
+
+} // namespace
+
+bool MeshCache::HashSource(const std::string& path, FileStamp& stamp, uint64_t& hash)
+{
+  if (!Stamp(path, stamp))
+    return false;
+
+  MappedFile file(path);
+  if (!file.IsOpen())
+    return false;
+  hash = HashBytes(file.Data(), file.Size());
+  return true;
+}
+
+bool MeshCache::Write(const std::string& cachePath, const FileStamp& source, uint64_t sourceHash, unsigned importFlags, unsigned processFlags,
+  const std::vector<FileStamp>& dependencies,
+  const std::vector<MeshData>& meshes,
+  const std::vector<std::vector<MaterialTextureRef>>& materials)
+{
+  StringTable strings;
+
+  // encode every mesh's streams, falling back to raw indices for lists that are not triangles
+  std::vector<std::vector<uint8_t>> vertexData(meshes.size()), indexData(meshes.size());
+  std::vector<uint32_t> indexEncoding(meshes.size(), MeshCacheIndices_Encoded);
+  ThreadPool::Instance().ParallelFor(meshes.size(), [&](size_t i)
+  {
+    const MeshData& mesh = meshes[i];
+    GeometryCodec::EncodeVertices(mesh.vertices.data(), mesh.vertices.size(), vertexData[i]);
+    if (!GeometryCodec::EncodeIndices(mesh.indices.data(), mesh.indices.size(), indexData[i]))
+    {
+      const auto* bytes = reinterpret_cast<const uint8_t*>(mesh.indices.data());
+      indexData[i].assign(bytes, bytes + mesh.indices.size() * sizeof(uint32_t));
+      indexEncoding[i] = MeshCacheIndices_Raw;
+    }
+  });
+
+  std::vector<MeshCacheMesh> meshTable(meshes.size());
+  std::vector<MeshLod> lodTable;
+  std::vector<Meshlet> meshletTable;
+  uint64_t vertexBytes = 0, indexBytes = 0;
+  for (size_t i = 0; i < meshes.size(); ++i)
+  {
+    MeshCacheMesh& entry = meshTable[i];
+    entry.vertexDataOffset = vertexBytes;
+    entry.indexDataOffset = indexBytes;
+    entry.vertexDataSize = vertexData[i].size();
+    entry.indexDataSize = indexData[i].size();
+    entry.vertexCount = (uint32_t)meshes[i].vertices.size();
+    entry.indexCount = (uint32_t)meshes[i].indices.size();
+    entry.materialIndex = meshes[i].materialIndex;
+    entry.firstLod = (uint32_t)lodTable.size();
+    entry.lodCount = (uint32_t)meshes[i].lods.size();
+    entry.indexEncoding = indexEncoding[i];
+    // same sphere around the box as Mesh::SetupMesh
+    glm::vec3 lo(0.0f), hi(0.0f);
+    if (!meshes[i].vertices.empty())
+      lo = hi = meshes[i].vertices[0].Position;
+    for (const Vertex& v : meshes[i].vertices)
+    {
+      lo = glm::min(lo, v.Position);
+      hi = glm::max(hi, v.Position);
+    }
+    const glm::vec3 center = (lo + hi) * 0.5f;
+    entry.boundsCenter[0] = center.x;
+    entry.boundsCenter[1] = center.y;
+    entry.boundsCenter[2] = center.z;
+    entry.boundsRadius = glm::length(hi - lo) * 0.5f;
+    lodTable.insert(lodTable.end(), meshes[i].lods.begin(), meshes[i].lods.end());
+    entry.firstMeshlet = (uint32_t)meshletTable.size();
+    entry.meshletCount = (uint32_t)meshes[i].meshlets.size();
+    meshletTable.insert(meshletTable.end(), meshes[i].meshlets.begin(), meshes[i].meshlets.end());
+    vertexBytes += entry.vertexDataSize;
+    indexBytes += entry.indexDataSize;
+  }
+
+  std::vector<MeshCacheMaterial> materialTable(materials.size());
+  std::vector<MeshCacheTexture> textureTable;
+  for (size_t i = 0; i < materials.size(); ++i)
+  {
+    materialTable[i].firstTexture = (uint32_t)textureTable.size();
+    materialTable[i].textureCount = (uint32_t)materials[i].size();
+    for (const auto& tex : materials[i])
+      textureTable.push_back({strings.Add(tex.type), strings.Add(tex.path)});
+  }
+
+  std::vector<MeshCacheDependency> dependencyTable;
+  for (const auto& dep : dependencies)
+    dependencyTable.push_back({dep.size, dep.mtime, strings.Add(dep.path), 0});
+
+  MeshCacheHeader header = {};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.importFlags = importFlags;
+  header.vertexStride = sizeof(Vertex);
+  header.processFlags = processFlags;
+  header.sourceSize = source.size;
+  header.sourceMtime = source.mtime;
+  header.sourceHash = sourceHash;
+  header.meshCount = (uint32_t)meshTable.size();
+  header.materialCount = (uint32_t)materialTable.size();
+  header.textureCount = (uint32_t)textureTable.size();
+  header.dependencyCount = (uint32_t)dependencyTable.size();
+  header.lodCount = (uint32_t)lodTable.size();
+  header.meshletCount = (uint32_t)meshletTable.size();
+
+  uint64_t offset = Align16(sizeof(MeshCacheHeader));
+  header.meshTableOffset = offset;
+  offset = Align16(offset + meshTable.size() * sizeof(MeshCacheMesh));
+  header.materialTableOffset = offset;
+  offset = Align16(offset + materialTable.size() * sizeof(MeshCacheMaterial));
+  header.textureTableOffset = offset;
+  offset = Align16(offset + textureTable.size() * sizeof(MeshCacheTexture));
+  header.dependencyTableOffset = offset;
+  offset = Align16(offset + dependencyTable.size() * sizeof(MeshCacheDependency));
+  header.lodTableOffset = offset;
+  offset = Align16(offset + lodTable.size() * sizeof(MeshLod));
+  header.meshletTableOffset = offset;
+  offset = Align16(offset + meshletTable.size() * sizeof(Meshlet));
+  header.stringsOffset = offset;
+  header.stringsSize = strings.Data().size();
+  offset = Align16(offset + header.stringsSize);
+  header.vertexBlobOffset = offset;
+  header.vertexBlobSize = vertexBytes;
+  offset = Align16(offset + header.vertexBlobSize);
+  header.indexBlobOffset = offset;
+  header.indexBlobSize = indexBytes;
+
+  // write to a temporary first so a crash never leaves a truncated cache behind
+  std::string tmpPath = cachePath + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      std::cout << "ERROR::MESHCACHE::Cannot write " << tmpPath << std::endl;
+      return false;
+    }
+
+    auto padTo = [&out](uint64_t pos)
+    {
+      static const char zeros[16] = {};
+      uint64_t cur = (uint64_t)out.tellp();
+      if (pos > cur)
+        out.write(zeros, (std::streamsize)(pos - cur));
+    };
+    auto writeTable = [&](uint64_t pos, const void* data, size_t bytes)
+    {
+      padTo(pos);
+      if (bytes)
+        out.write(static_cast<const char*>(data), (std::streamsize)bytes);
+    };
+
+    writeTable(0, &header, sizeof(header));
+    writeTable(header.meshTableOffset, meshTable.data(), meshTable.size() * sizeof(MeshCacheMesh));
+    writeTable(header.materialTableOffset, materialTable.data(), materialTable.size() * sizeof(MeshCacheMaterial));
+    writeTable(header.textureTableOffset, textureTable.data(), textureTable.size() * sizeof(MeshCacheTexture));
+    writeTable(header.dependencyTableOffset, dependencyTable.data(), dependencyTable.size() * sizeof(MeshCacheDependency));
+    writeTable(header.lodTableOffset, lodTable.data(), lodTable.size() * sizeof(MeshLod));
+    writeTable(header.meshletTableOffset, meshletTable.data(), meshletTable.size() * sizeof(Meshlet));
+    writeTable(header.stringsOffset, strings.Data().data(), strings.Data().size());
+
+    padTo(header.vertexBlobOffset);
+    for (const auto& data : vertexData)
+      out.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+    padTo(header.indexBlobOffset);
+    for (const auto& data : indexData)
+      out.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+
+    if (!out)
+    {
+      std::cout << "ERROR::MESHCACHE::Failed writing " << tmpPath << std::endl;
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, cachePath, ec);
+  if (ec)
+  {
+    std::cout << "ERROR::MESHCACHE::Cannot replace " << cachePath << ": " << ec.message() << std::endl;
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+bool MeshCache::Restamp(const std::string& cachePath, const FileStamp& source, uint64_t sourceHash)
+{
+  std::fstream file(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+  MeshCacheHeader header;
+  if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+    || header.version != Version || header.sourceHash != sourceHash)
+    return false;
+
+  std::vector<MeshCacheDependency> deps(header.dependencyCount);
+  std::vector<char> strings(header.stringsSize);
+  file.seekg((std::streamoff)header.dependencyTableOffset);
+  file.read(reinterpret_cast<char*>(deps.data()), (std::streamsize)(deps.size() * sizeof(MeshCacheDependency)));
+  file.seekg((std::streamoff)header.stringsOffset);
+  file.read(strings.data(), (std::streamsize)strings.size());
+  if (!file || (!strings.empty() && strings.back() != '\0'))
+    return false;
+
+  for (auto& dep : deps)
+  {
+    FileStamp stamp;
+    if (dep.pathOffset >= strings.size() || !Stamp(&strings[dep.pathOffset], stamp))
+      return false;
+    dep.size = stamp.size;
+    dep.mtime = stamp.mtime;
+  }
+  header.sourceSize = source.size;
+  header.sourceMtime = source.mtime;
+
+  // header and dependency table only, the tables and blobs stay as they are
+  file.seekp(0);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.seekp((std::streamoff)header.dependencyTableOffset);
+  file.write(reinterpret_cast<const char*>(deps.data()), (std::streamsize)(deps.size() * sizeof(MeshCacheDependency)));
+  return (bool)file;
+}
+
+bool MeshCache::Open(const std::string& cachePath, const FileStamp& source, uint64_t sourceHash, unsigned importFlags, unsigned processFlags)
+{
+  Close();
+  if (!_file.Open(cachePath) || _file.Size() < sizeof(MeshCacheHeader))
+  {
+    Close();
+    return false;
+  }
+
+  const auto* header = reinterpret_cast<const MeshCacheHeader*>(_file.Data());
+  auto fits = [&](uint64_t offset, uint64_t bytes) { return offset <= _file.Size() && bytes <= _file.Size() - offset; };
+
+  bool valid = std::memcmp(header->magic, Magic, sizeof(Magic)) == 0
+    && header->version == Version
+    && header->vertexStride == sizeof(Vertex)
+    && header->importFlags == importFlags
+    && header->processFlags == processFlags
+    && header->sourceSize == source.size
+    && header->sourceMtime == source.mtime
+    && header->sourceHash == sourceHash
+    && fits(header->meshTableOffset, uint64_t(header->meshCount) * sizeof(MeshCacheMesh))
+    && fits(header->materialTableOffset, uint64_t(header->materialCount) * sizeof(MeshCacheMaterial))
+    && fits(header->textureTableOffset, uint64_t(header->textureCount) * sizeof(MeshCacheTexture))
+    && fits(header->dependencyTableOffset, uint64_t(header->dependencyCount) * sizeof(MeshCacheDependency))
+    && fits(header->lodTableOffset, uint64_t(header->lodCount) * sizeof(MeshLod))
+    && fits(header->meshletTableOffset, uint64_t(header->meshletCount) * sizeof(Meshlet))
+    && fits(header->stringsOffset, header->stringsSize)
+    && fits(header->vertexBlobOffset, header->vertexBlobSize)
+    && fits(header->indexBlobOffset, header->indexBlobSize);
+
+  if (!valid)
+  {
+    Close();
+    return false;
+  }
+  _header = header;
+
+  // the string table must be terminated, every file the importer read must be unchanged
+  if (_header->stringsSize && String((uint32_t)_header->stringsSize - 1)[0] != '\0')
+  {
+    Close();
+    return false;
+  }
+  const auto* deps = Table<MeshCacheDependency>(_header->dependencyTableOffset);
+  for (uint32_t i = 0; i < _header->dependencyCount; ++i)
+  {
+    FileStamp stamp;
+    if (deps[i].pathOffset >= _header->stringsSize || !Stamp(String(deps[i].pathOffset), stamp)
+      || stamp.size != deps[i].size || stamp.mtime != deps[i].mtime)
+    {
+      Close();
+      return false;
+    }
+  }
+
+  // mesh and LOD ranges must stay inside the blobs
+  const auto* lods = Table<MeshLod>(_header->lodTableOffset);
+  for (uint32_t i = 0; i < _header->meshCount; ++i)
+  {
+    const MeshCacheMesh& mesh = MeshAt(i);
+    bool inside = mesh.vertexDataOffset <= _header->vertexBlobSize && mesh.vertexDataSize <= _header->vertexBlobSize - mesh.vertexDataOffset
+      && mesh.indexDataOffset <= _header->indexBlobSize && mesh.indexDataSize <= _header->indexBlobSize - mesh.indexDataOffset
+      && (mesh.indexEncoding == MeshCacheIndices_Encoded
+        || (mesh.indexEncoding == MeshCacheIndices_Raw && mesh.indexDataSize == uint64_t(mesh.indexCount) * sizeof(uint32_t)))
+      && uint64_t(mesh.firstLod) + mesh.lodCount <= _header->lodCount
+      && uint64_t(mesh.firstMeshlet) + mesh.meshletCount <= _header->meshletCount;
+    for (uint32_t l = 0; inside && l < mesh.lodCount; ++l)
+    {
+      const MeshLod& lod = lods[mesh.firstLod + l];
+      inside = uint64_t(lod.firstIndex) + lod.indexCount <= mesh.indexCount;
+    }
+    const auto* meshlets = Table<Meshlet>(_header->meshletTableOffset) + (inside ? mesh.firstMeshlet : 0);
+    for (uint32_t m = 0; inside && m < mesh.meshletCount; ++m)
+      inside = uint64_t(meshlets[m].firstIndex) + uint64_t(meshlets[m].triangleCount) * 3 <= mesh.indexCount;
+    if (!inside)
+    {
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MeshCache::DecodeMesh(uint32_t i, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const
+{
+  const MeshCacheMesh& mesh = MeshAt(i);
+  vertices.resize(mesh.vertexCount);
+  indices.resize(mesh.indexCount);
+  const uint8_t* indexData = Table<uint8_t>(_header->indexBlobOffset) + mesh.indexDataOffset;
+  if (!GeometryCodec::DecodeVertices(Table<uint8_t>(_header->vertexBlobOffset) + mesh.vertexDataOffset, (size_t)mesh.vertexDataSize,
+    vertices.data(), vertices.size()))
+    return false;
+  if (mesh.indexEncoding == MeshCacheIndices_Raw)
+  {
+    if (!indices.empty())
+      std::memcpy(indices.data(), indexData, indices.size() * sizeof(uint32_t));
+    return true;
+  }
+  return GeometryCodec::DecodeIndices(indexData, (size_t)mesh.indexDataSize, indices.data(), indices.size());
+}
+
+std::vector<MeshLod> MeshCache::Lods(uint32_t i) const
+{
+  const MeshCacheMesh& mesh = MeshAt(i);
+  const MeshLod* lods = Table<MeshLod>(_header->lodTableOffset) + mesh.firstLod;
+  return std::vector<MeshLod>(lods, lods + mesh.lodCount);
+}
+
+std::vector<Meshlet> MeshCache::Meshlets(uint32_t i) const
+{
+  const MeshCacheMesh& mesh = MeshAt(i);
+  const Meshlet* meshlets = Table<Meshlet>(_header->meshletTableOffset) + mesh.firstMeshlet;
+  return std::vector<Meshlet>(meshlets, meshlets + mesh.meshletCount);
+}
+
+std::vector<MaterialTextureRef> MeshCache::MaterialTextures(uint32_t material) const
+{
+  std::vector<MaterialTextureRef> textures;
+  if (material >= _header->materialCount)
+    return textures;
+
+  const MeshCacheMaterial& entry = Table<MeshCacheMaterial>(_header->materialTableOffset)[material];
+  const auto* table = Table<MeshCacheTexture>(_header->textureTableOffset);
+  for (uint32_t i = 0; i < entry.textureCount && entry.firstTexture + i < _header->textureCount; ++i)
+  {
+    const MeshCacheTexture& tex = table[entry.firstTexture + i];
+    if (tex.typeOffset < _header->stringsSize && tex.pathOffset < _header->stringsSize)
+      textures.push_back({String(tex.typeOffset), String(tex.pathOffset)});
+  }
+  return textures;
+}
+
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FileStamp.h"
+#include "MappedFile.h"
+#include "MeshData.h"
+
+namespace NullEngine
+{
+
+// Binary model cache (<model path>.nemesh) written after the first Assimp import.
+//
+// Layout (little endian, every table/blob 16 byte aligned):
+//   MeshCacheHeader
+//   MeshCacheMesh[meshCount]
+//   MeshCacheMaterial[materialCount]
+//   MeshCacheTexture[textureCount]
+//   MeshCacheDependency[dependencyCount]
+//   MeshLod[lodCount] - index ranges relative to the mesh's first index
+//   Meshlet[meshletCount] - clusters of each mesh's full detail level
+//   string table (zero terminated)
+//   vertex blob - GeometryCodec vertex streams, one per mesh, back to back
+//   index blob  - GeometryCodec index streams (raw uint32[] for lists that are not triangles)
+//
+// The file is memory mapped on load; DecodeMesh expands a mesh's streams, several meshes can be
+// decoded in parallel.
+// It is valid only if the source file (size, mtime, content hash), every file the importer
+// opened (mtl, ...), the import flags and the processing flags match what was recorded.
+
+struct MeshCacheHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t importFlags;
+  uint32_t vertexStride;
+  uint32_t processFlags;  // engine side processing of the imported meshes (ModelLoad_* bits)
+  uint32_t pad;
+
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+
+  uint32_t meshCount;
+  uint32_t materialCount;
+  uint32_t textureCount;
+  uint32_t dependencyCount;
+  uint32_t lodCount;
+  uint32_t meshletCount;
+
+  uint64_t meshTableOffset;
+  uint64_t materialTableOffset;
+  uint64_t textureTableOffset;
+  uint64_t dependencyTableOffset;
+  uint64_t lodTableOffset;
+  uint64_t meshletTableOffset;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+  uint64_t vertexBlobOffset;
+  uint64_t vertexBlobSize;
+  uint64_t indexBlobOffset;
+  uint64_t indexBlobSize;
+};
+
+enum MeshCacheIndexEncoding : uint32_t
+{
+  MeshCacheIndices_Encoded = 0,
+  MeshCacheIndices_Raw = 1
+};
+
+struct MeshCacheMesh
+{
+  // byte ranges of the mesh's streams, relative to the vertex/index blob
+  uint64_t vertexDataOffset;
+  uint64_t indexDataOffset;
+  uint64_t vertexDataSize;
+  uint64_t indexDataSize;
+  uint32_t vertexCount;
+  uint32_t indexCount;   // all levels of detail
+  uint32_t materialIndex;
+  uint32_t firstLod;
+  uint32_t lodCount;
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+  uint32_t indexEncoding;  // MeshCacheIndexEncoding
+  // model space bounding sphere of the vertices, known before the mesh is decoded (streaming priorities)
+  float boundsCenter[3];
+  float boundsRadius;
+};
+
+struct MeshCacheMaterial
+{
+  uint32_t firstTexture;
+  uint32_t textureCount;
+};
+
+struct MeshCacheTexture
+{
+  uint32_t typeOffset;  // "texture_diffuse", ...
+  uint32_t pathOffset;  // path as stored in the material, relative to the model/textures directory
+};
+
+struct MeshCacheDependency
+{
+  uint64_t size;
+  int64_t mtime;
+  uint32_t pathOffset;
+  uint32_t pad;
+};
+
+// Texture reference of a material, used when writing a cache
+struct MaterialTextureRef
+{
+  std::string type;
+  std::string path;
+};
+
+class MeshCache
+{
+public:
+  static constexpr uint32_t Version = 6;
+
+  static std::string CachePath(const std::string& sourcePath) { return sourcePath + ".nemesh"; }
+  // size + mtime of a file, false if it does not exist
+  static bool Stamp(const std::string& path, FileStamp& stamp) { return StampFile(path, stamp); }
+  // size + mtime + content hash of the model source
+  static bool HashSource(const std::string& path, FileStamp& stamp, uint64_t& hash);
+
+  static bool Write(const std::string& cachePath, const FileStamp& source, uint64_t sourceHash, unsigned importFlags, unsigned processFlags,
+    const std::vector<FileStamp>& dependencies,
+    const std::vector<MeshData>& meshes,
+    const std::vector<std::vector<MaterialTextureRef>>& materials);
+
+  // Updates the recorded size/mtime of the source and every dependency to their current values, for files
+  // whose content the caller knows to be unchanged (only touched or copied); false if sourceHash does not match
+  static bool Restamp(const std::string& cachePath, const FileStamp& source, uint64_t sourceHash);
+
+  // Maps the cache and validates it against the source, false = missing or stale
+  bool Open(const std::string& cachePath, const FileStamp& source, uint64_t sourceHash, unsigned importFlags, unsigned processFlags);
+  void Close() { _file.Close(); _header = nullptr; }
+
+  uint32_t MeshCount() const { return _header->meshCount; }
+  const MeshCacheMesh& MeshAt(uint32_t i) const { return Table<MeshCacheMesh>(_header->meshTableOffset)[i]; }
+  // decodes the vertex and index streams of mesh i, false if they are corrupt
+  bool DecodeMesh(uint32_t i, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const;
+  std::vector<MeshLod> Lods(uint32_t i) const;
+  std::vector<Meshlet> Meshlets(uint32_t i) const;
+
+  uint32_t MaterialCount() const { return _header->materialCount; }
+  std::vector<MaterialTextureRef> MaterialTextures(uint32_t material) const;
+
+  const MeshCacheHeader& Header() const { return *_header; }
+
+private:
+  template<typename T>
+  const T* Table(uint64_t offset) const { return reinterpret_cast<const T*>(_file.Data() + offset); }
+  const char* String(uint32_t offset) const { return Table<char>(_header->stringsOffset) + offset; }
+
+  MappedFile _file;
+  const MeshCacheHeader* _header = nullptr;
+};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Meshlet.h"
+#include "Vertex.h"
+
+namespace NullEngine
+{
+
+// Index range of one level of detail inside MeshData::indices (and the mesh's index buffer)
+struct MeshLod
+{
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  // simplification error relative to the mesh extent (bounding sphere diameter), 0 for the full mesh
+  float error = 0.0f;
+};
+
+// CPU side geometry of one mesh, produced by the importers before anything touches GL
+struct MeshData
+{
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  unsigned int materialIndex = 0;
+  // levels of detail, finest first, all sharing the vertices; empty = one level with all indices
+  std::vector<MeshLod> lods;
+  // clusters of the full detail level for culling, empty = drawn as a whole
+  std::vector<Meshlet> meshlets;
+  // content key for GeometryRegistry (GroupInstances sets it), 0 = the mesh's buffers are not shared
+  uint64_t geometryKey = 0;
+};
+
+}
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include "Hash.h"
+#include "MeshOptimizer.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+// ---------------------------------------------------------------- Forsyth scoring
+
+constexpr int CacheSize = 32;
+constexpr float CacheDecayPower = 1.5f;
+constexpr float LastTriScore = 0.75f;
+constexpr float ValenceBoostScale = 2.0f;
+constexpr float ValenceBoostPower = 0.5f;
+
+float VertexScore(int cachePosition, unsigned liveTriangles)
+{
+  // no triangles left to use this vertex
+  if (liveTriangles == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if (cachePosition >= 0)
+  {
+    // the three vertices of the last triangle get a fixed score, so the next triangle
+    // does not simply continue a strip
+    if (cachePosition < 3)
+      score = LastTriScore;
+    else
+      score = std::pow(1.0f - float(cachePosition - 3) / (CacheSize - 3), CacheDecayPower);
+  }
+  // prefer vertices with few triangles left, finishes them off before they are evicted
+  score += ValenceBoostScale * std::pow((float)liveTriangles, -ValenceBoostPower);
+  return score;
+}
+
+struct VertexKeyHash
+{
+  size_t operator()(const Vertex& v) const { return (size_t)HashBytes(&v, sizeof(Vertex)); }
+};
+
+struct VertexKeyEqual
+{
+  bool operator()(const Vertex& a, const Vertex& b) const { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; }
+};
+
+} // namespace
+
+// ---------------------------------------------------------------- analysis
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<unsigned>& indices, size_t vertexCount, unsigned cacheSize)
+{
+  VertexCacheStats stats;
+  if (indices.size() < 3)
+    return stats;
+
+  // FIFO: a vertex is cached if fewer than cacheSize misses happened since it was loaded
+  std::vector<size_t> loadedAt(vertexCount, 0);
+  std::vector<bool> referenced(vertexCount, false);
+  size_t misses = 0, unique = 0;
+  for (unsigned index : indices)
+  {
+    if (index >= vertexCount)
+      continue;
+    if (!referenced[index])
+    {
+      referenced[index] = true;
+      ++unique;
+    }
+    if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize)
+    {
+      ++misses;
+      loadedAt[index] = misses;
+    }
+  }
+
+  stats.acmr = float(misses) / float(indices.size() / 3);
+  stats.atvr = unique ? float(misses) / float(unique) : 0.0f;
+  return stats;
+}
+
+// ---------------------------------------------------------------- steps
+
+void MeshOptimizer::DeduplicateVertices(MeshData& mesh)
+{
+  std::unordered_map<Vertex, unsigned, VertexKeyHash, VertexKeyEqual> unique;
+  unique.reserve(mesh.vertices.size());
+
+  std::vector<unsigned> remap(mesh.vertices.size());
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (size_t i = 0; i < mesh.vertices.size(); ++i)
+  {
+    auto inserted = unique.emplace(mesh.vertices[i], (unsigned)vertices.size());
+    if (inserted.second)
+      vertices.push_back(mesh.vertices[i]);
+    remap[i] = inserted.first->second;
+  }
+
+  if (vertices.size() == mesh.vertices.size())
+    return;
+  for (unsigned& index : mesh.indices)
+    index = remap[index];
+  mesh.vertices.swap(vertices);
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned>& indices, size_t vertexCount)
+{
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount < 2)
+    return;
+
+  // vertex -> triangles adjacency; liveTriangles[v] is the used part of its range
+  std::vector<unsigned> liveTriangles(vertexCount, 0);
+  for (unsigned index : indices)
+    ++liveTriangles[index];
+  std::vector<unsigned> adjacencyOffset(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v)
+    adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+  std::vector<unsigned> adjacency(indices.size());
+  {
+    std::vector<unsigned> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+      for (int k = 0; k < 3; ++k)
+        adjacency[fill[indices[t * 3 + k]]++] = (unsigned)t;
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScore(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+    vertexScore[v] = VertexScore(-1, liveTriangles[v]);
+
+  std::vector<float> triangleScore(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+  size_t best = 0;
+  for (size_t t = 0; t < triangleCount; ++t)
+  {
+    triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    if (triangleScore[t] > triangleScore[best])
+      best = t;
+  }
+
+  std::vector<unsigned> result;
+  result.reserve(indices.size());
+  unsigned cache[CacheSize + 3];
+  int cacheCount = 0;
+  size_t scanCursor = 0;
+
+  for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+  {
+    const unsigned* tri = &indices[best * 3];
+    result.insert(result.end(), tri, tri + 3);
+    emitted[best] = true;
+
+    // remove the triangle from its vertices' live lists
+    for (int k = 0; k < 3; ++k)
+    {
+      unsigned v = tri[k];
+      unsigned* list = &adjacency[adjacencyOffset[v]];
+      unsigned count = liveTriangles[v];
+      for (unsigned i = 0; i < count; ++i)
+      {
+        if (list[i] == best)
+        {
+          list[i] = list[count - 1];
+          break;
+        }
+      }
+      --liveTriangles[v];
+    }
+
+    // LRU update: the triangle's vertices move to the front
+    unsigned newCache[CacheSize + 3];
+    int newCount = 0;
+    for (int k = 0; k < 3; ++k)
+      newCache[newCount++] = tri[k];
+    for (int i = 0; i < cacheCount; ++i)
+    {
+      unsigned v = cache[i];
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        newCache[newCount++] = v;
+    }
+
+    // vertices pushed past the end leave the cache
+    for (int i = CacheSize; i < newCount; ++i)
+    {
+      cachePosition[newCache[i]] = -1;
+      vertexScore[newCache[i]] = VertexScore(-1, liveTriangles[newCache[i]]);
+    }
+    cacheCount = std::min(newCount, CacheSize);
+    for (int i = 0; i < cacheCount; ++i)
+    {
+      cache[i] = newCache[i];
+      cachePosition[cache[i]] = i;
+      vertexScore[cache[i]] = VertexScore(i, liveTriangles[cache[i]]);
+    }
+
+    // rescore the triangles touching the cache and pick the best of them
+    float bestScore = -1.0f;
+    size_t bestTriangle = triangleCount;
+    for (int i = 0; i < cacheCount; ++i)
+    {
+      unsigned v = cache[i];
+      const unsigned* list = &adjacency[adjacencyOffset[v]];
+      for (unsigned j = 0; j < liveTriangles[v]; ++j)
+      {
+        unsigned t = list[j];
+        float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        triangleScore[t] = score;
+        if (score > bestScore)
+        {
+          bestScore = score;
+          bestTriangle = t;
+        }
+      }
+    }
+
+    // nothing connected to the cache, continue with the next unused triangle
+    if (bestTriangle == triangleCount)
+    {
+      while (scanCursor < triangleCount && emitted[scanCursor])
+        ++scanCursor;
+      bestTriangle = scanCursor;
+    }
+    best = bestTriangle;
+  }
+
+  indices.swap(result);
+}
+
+size_t MeshOptimizer::OptimizeOverdraw(std::vector<unsigned>& indices, const std::vector<Vertex>& vertices)
+{
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount < 2)
+    return triangleCount;
+
+  // cluster boundaries where all three vertices of a triangle miss the cache - the stream
+  // restarts there, so reordering clusters costs (almost) nothing in ACMR
+  std::vector<size_t> clusterStart;
+  {
+    std::vector<size_t> loadedAt(vertices.size(), 0);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      int triangleMisses = 0;
+      for (int k = 0; k < 3; ++k)
+      {
+        unsigned v = indices[t * 3 + k];
+        if (loadedAt[v] == 0 || misses - loadedAt[v] >= AnalyzeCacheSize)
+        {
+          ++misses;
+          loadedAt[v] = misses;
+          ++triangleMisses;
+        }
+      }
+      if (t == 0 || triangleMisses == 3)
+        clusterStart.push_back(t);
+    }
+  }
+  clusterStart.push_back(triangleCount);
+  const size_t clusterCount = clusterStart.size() - 1;
+  if (clusterCount < 2)
+    return clusterCount;
+
+  // area weighted centroid and normal of every cluster
+  std::vector<glm::vec3> centroid(clusterCount, glm::vec3(0.0f));
+  std::vector<glm::vec3> normal(clusterCount, glm::vec3(0.0f));
+  std::vector<float> area(clusterCount, 0.0f);
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t)
+    {
+      const glm::vec3& a = vertices[indices[t * 3]].Position;
+      const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+      const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+      glm::vec3 n = glm::cross(b - a, d - a);
+      float twiceArea = glm::length(n);
+      normal[c] += n;
+      centroid[c] += (a + b + d) * (twiceArea / 3.0f);
+      area[c] += twiceArea;
+    }
+    meshCentroid += centroid[c];
+    meshArea += area[c];
+    if (area[c] > 0.0f)
+      centroid[c] /= area[c];
+  }
+  if (meshArea > 0.0f)
+    meshCentroid /= meshArea;
+
+  // clusters facing outwards are likely in front of the rest, draw them first
+  std::vector<float> sortKey(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    float len = glm::length(normal[c]);
+    sortKey[c] = len > 0.0f ? glm::dot(centroid[c] - meshCentroid, normal[c] / len) : 0.0f;
+  }
+  std::vector<size_t> order(clusterCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+  std::vector<unsigned> result;
+  result.reserve(indices.size());
+  for (size_t c : order)
+    result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+  indices.swap(result);
+  return clusterCount;
+}
+
+void MeshOptimizer::OptimizeVertexFetch(MeshData& mesh)
+{
+  const unsigned unused = ~0u;
+  std::vector<unsigned> remap(mesh.vertices.size(), unused);
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (unsigned& index : mesh.indices)
+  {
+    if (remap[index] == unused)
+    {
+      remap[index] = (unsigned)vertices.size();
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+  // vertices no triangle references are dropped
+  mesh.vertices.swap(vertices);
+}
+
+MeshOptimizeStats MeshOptimizer::Optimize(MeshData& mesh)
+{
+  MeshOptimizeStats stats;
+  stats.verticesBefore = mesh.vertices.size();
+  stats.before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+  DeduplicateVertices(mesh);
+  OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+  stats.clusters = OptimizeOverdraw(mesh.indices, mesh.vertices);
+  OptimizeVertexFetch(mesh);
+
+  stats.verticesAfter = mesh.vertices.size();
+  stats.after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+  return stats;
+}
+
+}
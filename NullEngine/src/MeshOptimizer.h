@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include "MeshData.h"
+
+namespace NullEngine
+{
+
+// Post-transform cache efficiency of an index buffer, simulated with a FIFO cache
+struct VertexCacheStats
+{
+  // cache misses per triangle (0.5 is the ideal for a regular grid, 3 the worst)
+  float acmr = 0.0f;
+  // cache misses per referenced vertex (1 is the ideal)
+  float atvr = 0.0f;
+};
+
+struct MeshOptimizeStats
+{
+  VertexCacheStats before;
+  VertexCacheStats after;
+  size_t verticesBefore = 0;
+  size_t verticesAfter = 0;
+  size_t clusters = 0;
+};
+
+// CPU mesh optimization run after import, no GL:
+//  1. exact vertex deduplication
+//  2. triangle reordering for the post-transform vertex cache (Forsyth's linear-speed algorithm)
+//  3. overdraw ordering: the cache optimized stream is cut into clusters where the cache
+//     restarts anyway, clusters facing away from the mesh centre are drawn first
+//  4. vertex buffer reordered by first use for fetch locality
+class MeshOptimizer
+{
+public:
+  // cache size used for the ACMR/ATVR simulation, typical for current GPUs
+  static constexpr unsigned AnalyzeCacheSize = 16;
+
+  // all steps, returns ACMR/ATVR before and after
+  static MeshOptimizeStats Optimize(MeshData& mesh);
+
+  static void DeduplicateVertices(MeshData& mesh);
+  static void OptimizeVertexCache(std::vector<unsigned>& indices, size_t vertexCount);
+  // indices must already be cache optimized, returns the number of clusters
+  static size_t OptimizeOverdraw(std::vector<unsigned>& indices, const std::vector<Vertex>& vertices);
+  static void OptimizeVertexFetch(MeshData& mesh);
+
+  static VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned>& indices, size_t vertexCount, unsigned cacheSize = AnalyzeCacheSize);
+};
+
+}
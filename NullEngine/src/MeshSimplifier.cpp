@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+// symmetric 4x4 error quadric: sum of squared distances to a set of planes
+struct Quadric
+{
+  double a2 = 0, ab = 0, ac = 0, ad = 0;
+  double b2 = 0, bc = 0, bd = 0;
+  double c2 = 0, cd = 0;
+  double d2 = 0;
+
+  static Quadric FromPlane(double a, double b, double c, double d)
+  {
+    Quadric q;
+    q.a2 = a * a; q.ab = a * b; q.ac = a * c; q.ad = a * d;
+    q.b2 = b * b; q.bc = b * c; q.bd = b * d;
+    q.c2 = c * c; q.cd = c * d;
+    q.d2 = d * d;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& o)
+  {
+    a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+    b2 += o.b2; bc += o.bc; bd += o.bd;
+    c2 += o.c2; cd += o.cd;
+    d2 += o.d2;
+    return *this;
+  }
+
+  double Evaluate(const glm::vec3& p) const
+  {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+      + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+      + c2 * z * z + 2 * cd * z
+      + d2;
+    return std::max(e, 0.0);
+  }
+};
+
+struct Collapse
+{
+  unsigned from;
+  unsigned to;
+  double cost;
+};
+
+} // namespace
+
+std::vector<unsigned> MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned>& indices,
+  size_t targetIndexCount, float maxError, float* error)
+{
+  std::vector<unsigned> result(indices);
+  if (error)
+    *error = 0.0f;
+  const size_t vertexCount = vertices.size();
+  if (result.size() <= targetIndexCount || vertexCount == 0)
+    return result;
+
+  // errors are measured relative to the extent of the mesh
+  glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+  for (const auto& v : vertices)
+  {
+    lo = glm::min(lo, v.Position);
+    hi = glm::max(hi, v.Position);
+  }
+  const double extent = std::max((double)glm::length(hi - lo), 1e-12);
+  const double errorLimit = double(maxError) * extent * double(maxError) * extent;
+
+  // plane quadrics of the adjacent triangles
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i + 2 < result.size(); i += 3)
+  {
+    const glm::vec3& p0 = vertices[result[i]].Position;
+    const glm::vec3& p1 = vertices[result[i + 1]].Position;
+    const glm::vec3& p2 = vertices[result[i + 2]].Position;
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float len = glm::length(n);
+    if (len <= 0.0f)
+      continue;
+    n /= len;
+    Quadric q = Quadric::FromPlane(n.x, n.y, n.z, -glm::dot(n, p0));
+    for (int k = 0; k < 3; ++k)
+      quadrics[result[i + k]] += q;
+  }
+
+  // lock vertices on edges that do not have exactly two triangles: open borders, and the
+  // splits where one position has several vertices (UV/normal seams) look the same
+  std::vector<bool> locked(vertexCount, false);
+  {
+    std::vector<std::pair<uint64_t, int>> edges;
+    edges.reserve(result.size());
+    for (size_t i = 0; i + 2 < result.size(); i += 3)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        uint64_t a = result[i + k], b = result[i + (k + 1) % 3];
+        edges.push_back({std::min(a, b) << 32 | std::max(a, b), 1});
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();)
+    {
+      size_t j = i;
+      while (j < edges.size() && edges[j].first == edges[i].first)
+        ++j;
+      if (j - i != 2)
+      {
+        locked[edges[i].first >> 32] = true;
+        locked[edges[i].first & 0xFFFFFFFFu] = true;
+      }
+      i = j;
+    }
+  }
+
+  std::vector<unsigned> remap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+  std::vector<unsigned> adjacencyOffset(vertexCount + 1);
+  std::vector<unsigned> adjacency;
+  std::vector<Collapse> collapses;
+  double reachedError = 0.0;
+
+  while (result.size() > targetIndexCount)
+  {
+    const size_t triangleCount = result.size() / 3;
+
+    // vertex -> triangle adjacency of the current index list
+    std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+    for (unsigned index : result)
+      ++adjacencyOffset[index + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+      adjacencyOffset[v + 1] += adjacencyOffset[v];
+    adjacency.resize(result.size());
+    {
+      std::vector<unsigned> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+      for (size_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k)
+          adjacency[fill[result[t * 3 + k]]++] = (unsigned)t;
+    }
+
+    // cheapest direction of every edge
+    collapses.clear();
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        unsigned a = result[t * 3 + k], b = result[t * 3 + (k + 1) % 3];
+        // each interior edge is seen twice, once per direction - keep one
+        if (a > b)
+          continue;
+        Quadric q = quadrics[a];
+        q += quadrics[b];
+        double costAB = locked[a] ? std::numeric_limits<double>::max() : q.Evaluate(vertices[b].Position);
+        double costBA = locked[b] ? std::numeric_limits<double>::max() : q.Evaluate(vertices[a].Position);
+        if (locked[a] && locked[b])
+          continue;
+        if (costAB <= costBA)
+          collapses.push_back({a, b, costAB});
+        else
+          collapses.push_back({b, a, costBA});
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+    // apply independent collapses, cheapest first
+    for (size_t v = 0; v < vertexCount; ++v)
+      remap[v] = (unsigned)v;
+    std::fill(touched.begin(), touched.end(), false);
+
+    size_t removed = 0;
+    const size_t wantRemoved = (result.size() - targetIndexCount) / 3;
+    for (const Collapse& c : collapses)
+    {
+      if (removed >= wantRemoved || c.cost > errorLimit)
+        break;
+      if (touched[c.from] || touched[c.to])
+        continue;
+
+      // reject collapses that flip a triangle
+      const glm::vec3& target = vertices[c.to].Position;
+      bool flips = false;
+      for (unsigned j = adjacencyOffset[c.from]; j < adjacencyOffset[c.from + 1] && !flips; ++j)
+      {
+        const unsigned* tri = &result[adjacency[j] * 3];
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+          continue;
+        glm::vec3 p[3], q[3];
+        for (int k = 0; k < 3; ++k)
+        {
+          p[k] = vertices[tri[k]].Position;
+          q[k] = tri[k] == c.from ? target : p[k];
+        }
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        flips = glm::dot(before, after) <= 0.0f;
+      }
+      if (flips)
+        continue;
+
+      remap[c.from] = c.to;
+      quadrics[c.to] += quadrics[c.from];
+      // the neighbourhood changes, its other collapses have to wait for the next pass
+      for (unsigned j = adjacencyOffset[c.from]; j < adjacencyOffset[c.from + 1]; ++j)
+      {
+        const unsigned* tri = &result[adjacency[j] * 3];
+        for (int k = 0; k < 3; ++k)
+          touched[tri[k]] = true;
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+          ++removed;
+      }
+      reachedError = std::max(reachedError, c.cost);
+    }
+
+    if (removed == 0)
+      break;
+
+    // rewrite the index list, dropping the triangles that collapsed
+    size_t write = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      unsigned a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+      if (a == b || b == c || a == c)
+        continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+
+  if (error)
+    *error = (float)(std::sqrt(reachedError) / extent);
+  return result;
+}
+
+void MeshSimplifier::BuildLods(MeshData& mesh, unsigned maxLods, float maxError)
+{
+  mesh.lods.clear();
+  MeshLod full;
+  full.indexCount = (uint32_t)mesh.indices.size();
+  mesh.lods.push_back(full);
+
+  std::vector<unsigned> previous(mesh.indices);
+  float previousError = 0.0f;
+  while (mesh.lods.size() < maxLods)
+  {
+    size_t target = previous.size() / 6 * 3;
+    if (target < 3 * 16)
+      break;
+
+    float error = 0.0f;
+    std::vector<unsigned> lod = Simplify(mesh.vertices, previous, target, maxError, &error);
+    // locked borders or the error limit keep it from getting meaningfully smaller
+    if (lod.size() > previous.size() * 9 / 10)
+      break;
+
+    MeshOptimizer::OptimizeVertexCache(lod, mesh.vertices.size());
+
+    MeshLod level;
+    level.firstIndex = (uint32_t)mesh.indices.size();
+    level.indexCount = (uint32_t)lod.size();
+    // simplifying from the previous level, the errors add up
+    level.error = previousError + error;
+    mesh.lods.push_back(level);
+    mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+
+    previousError = level.error;
+    previous.swap(lod);
+  }
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+#include "MeshData.h"
+
+namespace NullEngine
+{
+
+// Quadric error edge collapse simplification (Garland-Heckbert), CPU only.
+// Vertices are never moved or added - a collapse snaps one vertex onto a neighbour - so every
+// level of detail is just another index list over the same vertex buffer.
+// Vertices on open borders and attribute seams (UV/normal splits) are locked to keep the
+// silhouette and avoid cracks between material/UV islands.
+class MeshSimplifier
+{
+public:
+  // Stops when the index count reaches targetIndexCount or the next collapse would exceed
+  // maxError (relative to the mesh extent). error receives the largest error introduced.
+  static std::vector<unsigned> Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned>& indices,
+    size_t targetIndexCount, float maxError, float* error = nullptr);
+
+  // Appends up to maxLods - 1 coarser levels (half the triangles each) to mesh.indices and fills
+  // mesh.lods. Stops early when a level no longer removes enough triangles.
+  static void BuildLods(MeshData& mesh, unsigned maxLods, float maxError = 0.05f);
+};
+
+}
@@ -0,0 +1,30 @@
+#include "MeshStreamer.h"
+
+namespace NullEngine
+{
+
+MeshStreamer& MeshStreamer::Instance()
+{
+  static MeshStreamer streamer;
+  return streamer;
+}
+
+void MeshStreamer::BeginFrame()
+{
+  _uploadedLastFrame = _uploadedThisFrame;
+  _uploadsLastFrame = _uploadsThisFrame;
+  _uploadedThisFrame = 0;
+  _uploadsThisFrame = 0;
+}
+
+bool MeshStreamer::Reserve(size_t bytes)
+{
+  if (_uploadsThisFrame > 0 && _uploadedThisFrame + bytes > _frameBudget)
+    return false;
+  _uploadedThisFrame += bytes;
+  _totalUploaded += bytes;
+  ++_uploadsThisFrame;
+  return true;
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+
+namespace NullEngine
+{
+
+// Per-frame upload budget shared by every streaming model (ModelLoad_Streaming).
+// Model::Stream decodes meshes on the ThreadPool and asks Reserve() before each GL upload,
+// so however many meshes finish decoding in a frame, only about FrameBudget() bytes go to GL.
+class MeshStreamer
+{
+public:
+  static MeshStreamer& Instance();
+
+  // GL thread, once per frame before the models' Stream calls
+  void BeginFrame();
+  // GL thread: false if an upload of bytes no longer fits this frame. The first upload of a
+  // frame always fits, so a mesh bigger than the budget still gets through
+  bool Reserve(size_t bytes);
+
+  void SetFrameBudget(size_t bytes) { _frameBudget = bytes; }
+  size_t FrameBudget() const { return _frameBudget; }
+
+  // decodes in flight plus decoded meshes waiting for budget, per model; bounds the memory held
+  static constexpr size_t MaxPending = 8;
+
+  // statistics
+  size_t UploadedLastFrame() const { return _uploadedLastFrame; }
+  size_t UploadsLastFrame() const { return _uploadsLastFrame; }
+  size_t TotalUploaded() const { return _totalUploaded; }
+
+private:
+  MeshStreamer() = default;
+
+  size_t _frameBudget = 8 * 1024 * 1024;
+  size_t _uploadedThisFrame = 0;
+  size_t _uploadsThisFrame = 0;
+  size_t _uploadedLastFrame = 0;
+  size_t _uploadsLastFrame = 0;
+  size_t _totalUploaded = 0;
+};
+
+}
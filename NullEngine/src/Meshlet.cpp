@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "Meshlet.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+void FinishMeshlet(Meshlet& meshlet, const Vertex* vertices, const unsigned* indices)
+{
+  const unsigned* tri = indices + meshlet.firstIndex;
+  const size_t indexCount = (size_t)meshlet.triangleCount * 3;
+
+  // sphere around the box of the referenced vertices
+  glm::vec3 lo = vertices[tri[0]].Position, hi = lo;
+  for (size_t i = 1; i < indexCount; ++i)
+  {
+    lo = glm::min(lo, vertices[tri[i]].Position);
+    hi = glm::max(hi, vertices[tri[i]].Position);
+  }
+  meshlet.center = (lo + hi) * 0.5f;
+  float radius2 = 0.0f;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    glm::vec3 d = vertices[tri[i]].Position - meshlet.center;
+    radius2 = std::max(radius2, glm::dot(d, d));
+  }
+  meshlet.radius = std::sqrt(radius2);
+
+  // normal cone from the face normals
+  std::vector<glm::vec3> normals;
+  normals.reserve(meshlet.triangleCount);
+  glm::vec3 axis(0.0f);
+  for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+  {
+    const glm::vec3& p0 = vertices[tri[t * 3]].Position;
+    glm::vec3 n = glm::cross(vertices[tri[t * 3 + 1]].Position - p0, vertices[tri[t * 3 + 2]].Position - p0);
+    float len = glm::length(n);
+    if (len <= 0.0f)
+      continue;
+    normals.push_back(n / len);
+    axis += normals.back();
+  }
+
+  meshlet.coneCutoff = 1.0f;
+  float axisLength = glm::length(axis);
+  if (normals.empty() || axisLength <= 0.0f)
+    return;
+  meshlet.coneAxis = axis / axisLength;
+
+  float minDot = 1.0f;
+  for (const auto& n : normals)
+    minDot = std::min(minDot, glm::dot(n, meshlet.coneAxis));
+  // a cone of 90 degrees or wider always has a front facing triangle
+  if (minDot > 0.0f)
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+// ---------------------------------------------------------------- test data
+
+struct TestMesh
+{
+  std::vector<Vertex> vertices;
+  std::vector<unsigned> indices;
+};
+
+// side x side vertices on y = height(x, z), counter-clockwise seen from above
+TestMesh GridMesh(size_t side, float (*height)(float, float))
+{
+  TestMesh mesh;
+  for (size_t j = 0; j < side; ++j)
+  {
+    for (size_t i = 0; i < side; ++i)
+    {
+      Vertex v;
+      v.Position = glm::vec3((float)i, height((float)i, (float)j), (float)j);
+      mesh.vertices.push_back(v);
+    }
+  }
+  for (size_t j = 0; j + 1 < side; ++j)
+  {
+    for (size_t i = 0; i + 1 < side; ++i)
+    {
+      unsigned a = (unsigned)(j * side + i), b = a + 1, c = a + (unsigned)side, d = c + 1;
+      mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+    }
+  }
+  return mesh;
+}
+
+// unit cube, 8 shared corners, outward facing
+TestMesh CubeMesh()
+{
+  TestMesh mesh;
+  for (unsigned i = 0; i < 8; ++i)
+  {
+    Vertex v;
+    v.Position = glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+    mesh.vertices.push_back(v);
+  }
+  mesh.indices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+  return mesh;
+}
+
+} // namespace
+
+std::vector<Meshlet> MeshletBuilder::Build(const Vertex* vertices, size_t vertexCount, const unsigned* indices, size_t indexCount,
+  unsigned maxVertices, unsigned maxTriangles)
+{
+  std::vector<Meshlet> meshlets;
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0)
+    return meshlets;
+
+  // stamp = index of the meshlet that already references the vertex
+  std::vector<uint32_t> stamp(vertexCount, ~0u);
+  Meshlet current;
+  for (size_t t = 0; t < triangleCount; ++t)
+  {
+    const unsigned* tri = indices + t * 3;
+    unsigned newVertices = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+      bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+      if (stamp[tri[k]] != (uint32_t)meshlets.size() && !repeated)
+        ++newVertices;
+    }
+
+    // full - the triangle starts the next meshlet
+    if (current.triangleCount > 0 && (current.vertexCount + newVertices > maxVertices || current.triangleCount + 1 > maxTriangles))
+    {
+      FinishMeshlet(current, vertices, indices);
+      meshlets.push_back(current);
+      current = Meshlet();
+      current.firstIndex = (uint32_t)(t * 3);
+    }
+
+    const uint32_t id = (uint32_t)meshlets.size();
+    for (int k = 0; k < 3; ++k)
+    {
+      if (stamp[tri[k]] != id)
+      {
+        stamp[tri[k]] = id;
+        ++current.vertexCount;
+      }
+    }
+    ++current.triangleCount;
+  }
+  FinishMeshlet(current, vertices, indices);
+  meshlets.push_back(current);
+  return meshlets;
+}
+
+bool MeshletBuilder::Validate(const std::vector<Meshlet>& meshlets, const Vertex* vertices, const unsigned* indices, size_t indexCount,
+  unsigned maxVertices, unsigned maxTriangles)
+{
+  size_t next = 0;
+  for (const auto& meshlet : meshlets)
+  {
+    if (meshlet.firstIndex != next || meshlet.triangleCount == 0 || meshlet.triangleCount > maxTriangles || meshlet.vertexCount > maxVertices)
+      return false;
+    next += (size_t)meshlet.triangleCount * 3;
+    if (next > indexCount)
+      return false;
+
+    const unsigned* tri = indices + meshlet.firstIndex;
+    std::vector<unsigned> unique(tri, tri + meshlet.triangleCount * 3);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    if (unique.size() != meshlet.vertexCount)
+      return false;
+
+    const float slack = 1e-4f * std::max(1.0f, meshlet.radius);
+    for (unsigned v : unique)
+    {
+      if (glm::length(vertices[v].Position - meshlet.center) > meshlet.radius + slack)
+        return false;
+    }
+
+    // every face normal must lie inside the cone
+    if (meshlet.coneCutoff < 1.0f)
+    {
+      float minDot = std::sqrt(std::max(0.0f, 1.0f - meshlet.coneCutoff * meshlet.coneCutoff));
+      for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+      {
+        const glm::vec3& p0 = vertices[tri[t * 3]].Position;
+        glm::vec3 n = glm::cross(vertices[tri[t * 3 + 1]].Position - p0, vertices[tri[t * 3 + 2]].Position - p0);
+        float len = glm::length(n);
+        if (len > 0.0f && glm::dot(n / len, meshlet.coneAxis) < minDot - 1e-3f)
+          return false;
+      }
+    }
+  }
+  return next == indexCount - indexCount % 3;
+}
+
+bool MeshletBuilder::SelfTest()
+{
+  bool ok = true;
+  size_t cases = 0;
+  auto fail = [&](const char* what)
+  {
+    std::cout << "ERROR::MESHLET::Self test failed: " << what << std::endl;
+    ok = false;
+  };
+  auto build = [&](const TestMesh& mesh, const char* what, unsigned maxVertices = MaxVertices, unsigned maxTriangles = MaxTriangles)
+  {
+    ++cases;
+    std::vector<Meshlet> meshlets = Build(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), maxVertices,
+      maxTriangles);
+    if (!Validate(meshlets, mesh.vertices.data(), mesh.indices.data(), mesh.indices.size(), maxVertices, maxTriangles))
+      fail(what);
+    return meshlets;
+  };
+
+  // flat grid: every cone points up and is as tight as it gets, spheres hug the vertices
+  TestMesh flat = GridMesh(33, [](float, float) { return 0.0f; });
+  for (const Meshlet& meshlet : build(flat, "flat grid"))
+  {
+    if (glm::dot(meshlet.coneAxis, glm::vec3(0.0f, 1.0f, 0.0f)) < 0.9999f || meshlet.coneCutoff > 1e-3f)
+      fail("flat grid cone");
+    // the sphere is built around the box, so no vertex is further than the radius and one is at it
+    const unsigned* tri = flat.indices.data() + meshlet.firstIndex;
+    float farthest = 0.0f;
+    for (uint32_t i = 0; i < meshlet.triangleCount * 3; ++i)
+      farthest = std::max(farthest, glm::length(flat.vertices[tri[i]].Position - meshlet.center));
+    if (std::abs(farthest - meshlet.radius) > 1e-4f * std::max(1.0f, meshlet.radius))
+      fail("flat grid sphere");
+  }
+
+  // curved grid: cones widen but still contain every face normal (Validate)
+  build(GridMesh(40, [](float x, float z) { return 2.0f * std::sin(x * 0.3f) * std::cos(z * 0.2f); }), "curved grid");
+
+  // faces pointing every way: no meshlet can be back-face culled
+  TestMesh cube = CubeMesh();
+  std::vector<Meshlet> cubeMeshlets = build(cube, "cube");
+  if (cubeMeshlets.size() != 1 || cubeMeshlets[0].coneCutoff != 1.0f || cubeMeshlets[0].vertexCount != 8)
+    fail("cube cone");
+  // one triangle per meshlet: each cone is exactly its face normal
+  for (const Meshlet& meshlet : build(cube, "cube, one triangle each", 3, 1))
+  {
+    if (meshlet.triangleCount != 1 || meshlet.coneCutoff > 1e-3f)
+      fail("cube single triangle cone");
+  }
+
+  // degenerate: zero area and repeated vertices give no normals, so the cone must stay unbounded
+  TestMesh degenerate;
+  degenerate.vertices.resize(4);
+  for (unsigned i = 0; i < 4; ++i)
+    degenerate.vertices[i].Position = glm::vec3((float)i, 0.0f, 0.0f);
+  degenerate.indices = {0, 1, 2, 1, 2, 3, 0, 0, 0, 3, 3, 1};
+  std::vector<Meshlet> degenerateMeshlets = build(degenerate, "degenerate");
+  if (degenerateMeshlets.size() != 1 || degenerateMeshlets[0].coneCutoff != 1.0f || degenerateMeshlets[0].vertexCount != 4)
+    fail("degenerate cone");
+  // a single point: zero radius
+  TestMesh point = degenerate;
+  point.indices = {2, 2, 2};
+  std::vector<Meshlet> pointMeshlets = build(point, "point");
+  if (pointMeshlets.size() != 1 || pointMeshlets[0].radius != 0.0f || pointMeshlets[0].center != point.vertices[2].Position)
+    fail("point sphere");
+
+  // empty and trailing partial triangles
+  TestMesh empty;
+  if (!build(empty, "empty").empty())
+    fail("empty produced meshlets");
+  TestMesh partial = flat;
+  partial.indices.resize(7);
+  if (build(partial, "partial").size() != 1)
+    fail("partial triangle counted");
+
+  // tight vertex limit: many small meshlets, each within it
+  build(flat, "flat grid, 8 vertices", 8, MaxTriangles);
+
+  std::cout << "MESHLET::SELF_TEST::" << cases << " cases: " << (ok ? "passed" : "FAILED") << std::endl;
+  return ok;
+}
+
+void CullView::Set(const glm::mat4& viewProjection, const glm::vec3& position)
+{
+  cameraPosition = position;
+  // Gribb/Hartmann: rows of the clip matrix combined, glm is column major
+  const glm::mat4& m = viewProjection;
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+  planes[0] = row3 + row0; // left
+  planes[1] = row3 - row0; // right
+  planes[2] = row3 + row1; // bottom
+  planes[3] = row3 - row1; // top
+  planes[4] = row3 + row2; // near
+  planes[5] = row3 - row2; // far
+  for (auto& plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+namespace NullEngine
+{
+
+// Small cluster of a mesh's triangles: a contiguous range of its (full detail) index buffer
+// with bounds for culling whole clusters before they are drawn
+struct Meshlet
+{
+  uint32_t firstIndex = 0;
+  uint32_t triangleCount = 0;
+  uint32_t vertexCount = 0;
+  uint32_t pad = 0;
+  // model space bounding sphere
+  glm::vec3 center = glm::vec3(0.0f);
+  float radius = 0.0f;
+  // normal cone: every triangle normal is within the cone around axis;
+  // cutoff = sin of the cone's half angle, 1 = cannot be back-face culled
+  glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+  float coneCutoff = 1.0f;
+};
+
+class MeshletBuilder
+{
+public:
+  static constexpr unsigned MaxVertices = 64;
+  static constexpr unsigned MaxTriangles = 124;
+
+  // Splits the index list into meshlets in order, so the triangles should already be
+  // ordered for locality (MeshOptimizer) to get tight clusters
+  static std::vector<Meshlet> Build(const Vertex* vertices, size_t vertexCount, const unsigned* indices, size_t indexCount,
+    unsigned maxVertices = MaxVertices, unsigned maxTriangles = MaxTriangles);
+
+  // true if the meshlets cover the index list exactly, respect the limits and their bounds
+  // contain every vertex / normal they reference
+  static bool Validate(const std::vector<Meshlet>& meshlets, const Vertex* vertices, const unsigned* indices, size_t indexCount,
+    unsigned maxVertices = MaxVertices, unsigned maxTriangles = MaxTriangles);
+
+  // builds meshlets for generated meshes (flat and curved grids, a cube, degenerate and empty input, tight
+  // limits) and checks them with Validate plus the expected cones and bounds; prints failures
+  static bool SelfTest();
+};
+
+// Camera data for cluster culling
+struct CullView
+{
+  glm::vec3 cameraPosition = glm::vec3(0.0f);
+  // world space frustum planes (xyz = inward normal, w = distance)
+  glm::vec4 planes[6];
+  bool frustumCulling = true;
+  bool coneCulling = true;
+
+  void Set(const glm::mat4& viewProjection, const glm::vec3& position);
+};
+
+// Cluster culling counters, reset once per frame
+struct ClusterCullStats
+{
+  size_t meshes = 0;
+  size_t meshesRejected = 0;
+  size_t meshlets = 0;
+  size_t frustumRejected = 0;
+  size_t backfaceRejected = 0;
+};
+
+}
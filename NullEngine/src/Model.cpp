@@ -1,74 +1,1192 @@
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+#include <limits>
 #include <iostream>
 #include <set>
 #include <map>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
 //#include <glfw3.h>
+#include "GLState.h"
+#include "GltfLoader.h"
+#include "MeshStreamer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
 #include "Model.h"
+#include "TextureRegistry.h"
+#include "ThreadPool.h"
+#include "Vfs.h"
 
 namespace NullEngine
 {
 
+void Model::TextureMemory(size_t& gpuBytes, size_t& uncompressedBytes) const
+{
+  gpuBytes = uncompressedBytes = 0;
+  std::set<const Texture*> counted;
+  for (const auto& mesh : _meshes)
+  {
+    for (const auto& texture : mesh._textures)
+    {
+      if (texture->State() != TextureState::Ready || !counted.insert(texture.get()).second)
+        continue;
+      gpuBytes += texture->GpuBytes();
+      uncompressedBytes += texture->UncompressedBytes();
+    }
+  }
+}
+
+void Model::SelectLod(const glm::mat4& model, const LodView& view)
+{
+  for (auto& mesh : _meshes)
+    mesh.SelectLod(model, view);
+}
+
+unsigned Model::LodCount() const
+{
+  unsigned count = 0;
+  for (const auto& mesh : _meshes)
+    count = std::max(count, mesh.LodCount());
+  return count;
+}
+
+size_t Model::LodTriangles(unsigned lod) const
+{
+  size_t triangles = 0;
+  for (const auto& mesh : _meshes)
+    triangles += mesh.Lod(std::min(lod, mesh.LodCount() - 1)).indexCount / 3 * mesh.InstanceCount();
+  return triangles;
+}
+
+void Model::Cull(const glm::mat4& model, const CullView& view, ClusterCullStats& stats)
+{
+  for (auto& mesh : _meshes)
+    mesh.Cull(model, view, stats);
+}
+
+size_t Model::SelectedTriangles() const
+{
+  size_t triangles = 0;
+  for (const auto& mesh : _meshes)
+    triangles += mesh.Lod(mesh.CurrentLod()).indexCount / 3 * mesh.InstanceCount();
+  return triangles;
+}
+
 void Model::Draw(Shader& shader)
 {
-  glStencilFunc(GL_ALWAYS, 1, 0xFF);
-  glStencilMask(0xFF);
+  GLState::Instance().StencilFunc(GL_ALWAYS, 1, 0xFF);
+  GLState::Instance().StencilMask(0xFF);
   for (unsigned i = 0; i < _meshes.size(); i++)
     _meshes[i].Draw(shader);
 }
 
 void Model::Highlight(Shader& shader)
 {
-  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-  glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-  glStencilMask(0x00);
-  glDisable(GL_DEPTH_TEST);
+  GLState& gl = GLState::Instance();
+  gl.StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  gl.StencilFunc(GL_NOTEQUAL, 1, 0xFF);
+  gl.StencilMask(0x00);
+  gl.Disable(GL_DEPTH_TEST);
 
   for (unsigned i = 0; i < _meshes.size(); i++)
     _meshes[i].Draw(shader);
 
-  glStencilMask(0xFF);
-  glStencilFunc(GL_ALWAYS, 0, 0xFF);
-  glEnable(GL_DEPTH_TEST);
+  gl.StencilMask(0xFF);
+  gl.StencilFunc(GL_ALWAYS, 0, 0xFF);
+  gl.Enable(GL_DEPTH_TEST);
 }
 
+void Model::Submit(RenderQueue& queue, RenderPass pass, Shader& shader, const glm::mat4& model)
+{
+  for (auto& mesh : _meshes)
+    mesh.Submit(queue, pass, shader, model);
+}
+
+namespace
+{
+
+using Clock = std::chrono::high_resolution_clock;
+
+double MsSince(Clock::time_point t)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// Read-only stream over a file read whole through the Vfs
+class MemoryIOStream : public Assimp::IOStream
+{
+public:
+  explicit MemoryIOStream(std::vector<uint8_t>&& data) : _data(std::move(data)) {}
+
+  size_t Read(void* buffer, size_t size, size_t count) override
+  {
+    if (size == 0)
+      return 0;
+    count = std::min(count, (_data.size() - _position) / size);
+    std::memcpy(buffer, _data.data() + _position, size * count);
+    _position += size * count;
+    return count;
+  }
+
+  size_t Write(const void*, size_t, size_t) override { return 0; }
+
+  aiReturn Seek(size_t offset, aiOrigin origin) override
+  {
+    size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? _position : _data.size();
+    if (base + offset > _data.size())
+      return aiReturn_FAILURE;
+    _position = base + offset;
+    return aiReturn_SUCCESS;
+  }
+
+  size_t Tell() const override { return _position; }
+  size_t FileSize() const override { return _data.size(); }
+  void Flush() override {}
+
+private:
+  std::vector<uint8_t> _data;
+  size_t _position = 0;
+};
+
+// Default IO that remembers every file Assimp opened (the .obj plus its .mtl, ...),
+// so the mesh cache can be invalidated when any of them changes.
+// Reads go through the Vfs (asset pack, io_uring or the thread pool fallback).
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+  bool Exists(const char* file) const override
+  {
+    return Vfs::Instance().Exists(file);
+  }
+
+  Assimp::IOStream* Open(const char* file, const char* mode = "rb") override
+  {
+    Assimp::IOStream* stream = nullptr;
+    std::vector<uint8_t> data;
+    if (mode[0] != 'r')
+      stream = DefaultIOSystem::Open(file, mode);
+    else if (Vfs::Instance().ReadSync(file, data))
+      stream = new MemoryIOStream(std::move(data));
+    if (stream)
+      _opened.emplace_back(file);
+    return stream;
+  }
+
+  const std::vector<std::string>& Opened() const { return _opened; }
+
+private:
+  std::vector<std::string> _opened;
+};
+
+} // namespace
+
 void Model::LoadModel(std::string path)
 {
+  _path = path;
+  Prepare();
+  Upload();
+}
+
+bool Model::Prepare()
+{
+  _loadStats = ModelLoadStats();
+  _optimizeStats.clear();
+  _pendingMeshes.clear();
+  _pendingMaterials.clear();
+  _pendingTextures.clear();
+  _pendingInstances.clear();
+  _pendingGltf = false;
+  _pendingValid = false;
+  _directory = _path.substr(0, _path.find_last_of('/'));
+
+  // glTF binary data is drawn in place, neither the mesh cache nor the CPU passes apply; all of it is GL work
+  if ((_flags & ModelLoad_NativeGltf) && (HasExtension(_path, "glb") || HasExtension(_path, "gltf")))
+  {
+    _pendingGltf = true;
+    return true;
+  }
+
+  if ((_flags & ModelLoad_Streaming) && StartStreaming(_path))
+    return true;
+
+  return PrepareMeshes();
+}
+
+bool Model::PrepareMeshes()
+{
+  auto t = Clock::now();
+  FileStamp source;
+  uint64_t sourceHash = 0;
+  bool useCache = (_flags & ModelLoad_UseCache) && MeshCache::HashSource(_path, source, sourceHash);
+  bool cached = false;
+  if (useCache)
+  {
+    MeshCache cache;
+    if (cache.Open(MeshCache::CachePath(_path), source, sourceHash, ImportFlags, _flags & ProcessFlags))
+    {
+      _loadStats.cacheHit = true;
+      _loadStats.importMs = MsSince(t);
+      DecodeCache(cache);
+      cached = true;
+    }
+  }
+
+  if (!cached)
+  {
+    std::vector<std::string> files;
+    if (!BuildMeshData(_path, _flags, _pendingMeshes, _pendingMaterials, files, _loadStats, _optimizeStats))
+      return false;
+
+    if (useCache)
+    {
+      t = Clock::now();
+      WriteCache(_path, source, sourceHash, _flags, files, _pendingMeshes, _pendingMaterials);
+      _loadStats.cacheWriteMs = MsSince(t);
+    }
+  }
+
+  if (_flags & ModelLoad_Dedup)
+  {
+    t = Clock::now();
+    _pendingInstances = GeometryRegistry::GroupInstances(_pendingMeshes, (_flags & ModelLoad_Parallel) != 0);
+    _loadStats.dedupMs = MsSince(t);
+  }
+
+  _pendingValid = true;
+  // deferred callers look textures up with PrepareTextures once the texture settings are final
+  if (!(_flags & ModelLoad_Deferred))
+    PrepareTextures();
+  return true;
+}
+
+void Model::PrepareTextures()
+{
+  // async textures can be looked up on any thread (the registry reads their content hashes), sync ones need the GL thread
+  if (_pendingValid && (_flags & ModelLoad_AsyncTextures) && _pendingTextures.size() != _pendingMaterials.size())
+    AcquirePendingTextures();
+}
+
+void Model::AcquirePendingTextures()
+{
+  // meshes sharing a material share the lookup
+  auto t = Clock::now();
+  _pendingTextures.assign(_pendingMaterials.size(), {});
+  std::vector<bool> materialLoaded(_pendingMaterials.size(), false);
+  for (const auto& data : _pendingMeshes)
+  {
+    unsigned m = data.materialIndex;
+    if (m >= _pendingMaterials.size() || materialLoaded[m])
+      continue;
+    _pendingTextures[m] = LoadMaterialTextures(_pendingMaterials[m]);
+    materialLoaded[m] = true;
+  }
+  _loadStats.texturesMs += MsSince(t);
+}
+
+void Model::Upload()
+{
+  if (_pendingGltf)
+  {
+    _pendingGltf = false;
+    if (LoadGltf(_path) || !PrepareMeshes())
+      return;
+  }
+  if (!_pendingValid)
+    return;
+  _pendingValid = false;
+
+  if (_pendingTextures.size() != _pendingMaterials.size())
+    AcquirePendingTextures();
+
+  // one mesh per group of copies, drawn once per instance; without ModelLoad_Dedup every mesh is its own group
+  if (_pendingInstances.empty())
+  {
+    _pendingInstances.resize(_pendingMeshes.size());
+    for (size_t i = 0; i < _pendingMeshes.size(); ++i)
+      _pendingInstances[i] = {{i}, {glm::vec3(0.0f)}};
+  }
+
+  // GL upload; on a cache hit the meshes are built from pointers, so the decoded vectors are dropped
+  // after the upload instead of being kept as a CPU copy (the cache can decode them again)
+  auto t = Clock::now();
+  _meshes.reserve(_meshes.size() + _pendingInstances.size());
+  for (const MeshInstances& group : _pendingInstances)
+  {
+    for (size_t member : group.members)
+    {
+      const MeshData& copy = _pendingMeshes[member];
+      _loadStats.vertices += copy.vertices.size();
+      // full detail only, the LOD index lists follow it
+      _loadStats.indices += copy.lods.empty() ? copy.indices.size() : copy.lods[0].indexCount;
+    }
+
+    MeshData& data = _pendingMeshes[group.members[0]];
+    std::vector<std::shared_ptr<Texture>> textures;
+    if (data.materialIndex < _pendingTextures.size())
+      textures = _pendingTextures[data.materialIndex];
+    _loadStats.meshlets += data.meshlets.size();
+    if (_loadStats.cacheHit)
+      _meshes.emplace_back(data.vertices.data(), data.vertices.size(), data.indices.data(), data.indices.size(), std::move(textures),
+        std::move(data.lods), std::move(data.meshlets), MeshFormat(), data.geometryKey);
+    else
+      _meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(textures), std::move(data.lods),
+        std::move(data.meshlets), MeshFormat(), data.geometryKey);
+
+    Mesh& mesh = _meshes.back();
+    AddMemoryStats(mesh);
+    if (group.members.size() > 1)
+    {
+      mesh.SetInstances(group.translations);
+      _loadStats.dedupBytes += (group.members.size() - 1) * (mesh.VertexBytes() + mesh.IndexBytes());
+      _loadStats.drawsSaved += group.members.size() - 1;
+      ++_loadStats.instancedMeshes;
+    }
+    for (size_t member : group.members)
+    {
+      std::vector<Vertex>().swap(_pendingMeshes[member].vertices);
+      std::vector<unsigned int>().swap(_pendingMeshes[member].indices);
+    }
+  }
+  _loadStats.uploadMs = MsSince(t);
+
+  _pendingMeshes.clear();
+  _pendingMaterials.clear();
+  _pendingTextures.clear();
+  _pendingInstances.clear();
+  PrintLoadStats(_path);
+}
+
+bool Model::BuildMeshData(const std::string& path, unsigned flags, std::vector<MeshData>& meshData,
+  std::vector<std::vector<MaterialTextureRef>>& materials, std::vector<std::string>& files, ModelLoadStats& stats,
+  std::vector<MeshOptimizeStats>& optimizeStats)
+{
+  const bool parallel = (flags & ModelLoad_Parallel) != 0;
+  bool imported = (flags & ModelLoad_NativeObj) && HasExtension(path, "obj")
+    ? ImportObj(path, parallel, meshData, materials, files, stats)
+    : ImportAssimp(path, parallel, meshData, materials, files, stats);
+  if (!imported)
+    return false;
+
+  auto forEachMesh = [&](const std::function<void(size_t)>& fn)
+  {
+    if (parallel)
+      ThreadPool::Instance().ParallelFor(meshData.size(), fn);
+    else
+    {
+      for (size_t i = 0; i < meshData.size(); ++i)
+        fn(i);
+    }
+  };
+
+  auto t = Clock::now();
+  if (flags & ModelLoad_Optimize)
+  {
+    optimizeStats.assign(meshData.size(), MeshOptimizeStats());
+    forEachMesh([&](size_t i)
+    {
+      optimizeStats[i] = MeshOptimizer::Optimize(meshData[i]);
+    });
+    stats.optimizeMs = MsSince(t);
+  }
+
+  if (flags & ModelLoad_Lods)
+  {
+    t = Clock::now();
+    forEachMesh([&](size_t i)
+    {
+      MeshSimplifier::BuildLods(meshData[i], MaxLods);
+    });
+    stats.lodMs = MsSince(t);
+  }
+
+  if (flags & ModelLoad_Meshlets)
+  {
+    t = Clock::now();
+    forEachMesh([&](size_t i)
+    {
+      MeshData& data = meshData[i];
+      size_t fullIndexCount = data.lods.empty() ? data.indices.size() : data.lods[0].indexCount;
+      data.meshlets = MeshletBuilder::Build(data.vertices.data(), data.vertices.size(), data.indices.data(), fullIndexCount);
+      // debug builds check every mesh's clusters
+      assert(MeshletBuilder::Validate(data.meshlets, data.vertices.data(), data.indices.data(), fullIndexCount));
+    });
+    stats.meshletMs = MsSince(t);
+  }
+  return true;
+}
+
+bool Model::WriteCache(const std::string& path, const FileStamp& source, uint64_t sourceHash, unsigned flags,
+  const std::vector<std::string>& files, const std::vector<MeshData>& meshData, const std::vector<std::vector<MaterialTextureRef>>& materials)
+{
+  std::vector<FileStamp> dependencies;
+  std::set<std::string> seen = {path};
+  for (const auto& file : files)
+  {
+    FileStamp stamp;
+    if (seen.insert(file).second && MeshCache::Stamp(file, stamp))
+      dependencies.push_back(stamp);
+  }
+  return MeshCache::Write(MeshCache::CachePath(path), source, sourceHash, ImportFlags, flags & ProcessFlags, dependencies, meshData, materials);
+}
+
+bool Model::Cook(const std::string& path, unsigned flags, std::vector<std::string>& files, std::vector<MaterialTextureRef>& textures)
+{
+  FileStamp source;
+  uint64_t sourceHash = 0;
+  if (!MeshCache::HashSource(path, source, sourceHash))
+    return false;
+
+  std::vector<MeshData> meshData;
+  std::vector<std::vector<MaterialTextureRef>> materials;
+  ModelLoadStats stats;
+  std::vector<MeshOptimizeStats> optimizeStats;
+  files.clear();
+  if (!BuildMeshData(path, flags, meshData, materials, files, stats, optimizeStats)
+    || !WriteCache(path, source, sourceHash, flags, files, meshData, materials))
+    return false;
+
+  textures.clear();
+  for (const auto& material : materials)
+    textures.insert(textures.end(), material.begin(), material.end());
+  return true;
+}
+
+bool Model::HasExtension(const std::string& path, const char* extension)
+{
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos)
+    return false;
+  std::string lower = path.substr(dot + 1);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return lower == extension;
+}
+
+bool Model::LoadGltf(const std::string& path)
+{
+  GLState& gl = GLState::Instance();
+  auto t = Clock::now();
+  GltfScene scene;
+  if (!GltfLoader::Load(path, scene))
+  {
+    std::cout << "MODEL::GLTF::" << path << " loaded through Assimp instead" << std::endl;
+    return false;
+  }
+  _loadStats.importMs = MsSince(t);
+
+  // one texture per image, shared by every material using it; glTF's UV origin is the top left
+  // of the image, so images are never flipped
+  t = Clock::now();
+  const bool async = (_flags & ModelLoad_AsyncTextures) != 0;
+  std::vector<std::shared_ptr<Texture>> images(scene.images.size());
+  // created for the images the primitives use, before the upload so their time is not counted there
+  for (const GltfPrimitive& primitive : scene.primitives)
+  {
+    const int index = primitive.material >= 0 ? scene.materialImages[primitive.material] : -1;
+    if (index < 0 || images[index])
+      continue;
+    std::shared_ptr<Texture>& texture = images[index];
+    const GltfImage& image = scene.images[index];
+    if (image.bufferView >= 0)
+    {
+      // decoded straight from the mapped file, which the texture keeps open
+      const GltfBufferView& view = scene.bufferViews[image.bufferView];
+      const GltfBuffer& buffer = scene.buffers[view.buffer];
+      texture = std::make_shared<Texture>("texture_diffuse", buffer.file, (size_t)(buffer.data - buffer.file->Data()) + view.offset, view.length,
+        path + "#image" + std::to_string(index));
+      if (async)
+        texture->LoadAsync();
+      else
+        texture->Load();
+    }
+    else if (!image.uri.empty())
+    {
+      const std::string& directory = _texturesDirectory.empty() ? _directory : _texturesDirectory;
+      texture = TextureRegistry::Instance().Acquire("texture_diffuse", directory + "/" + image.uri, false, async);
+    }
+  }
+  _loadStats.texturesMs = MsSince(t);
+
+  // GL upload: every buffer view a primitive reads becomes one GL buffer, copied from the mapping as is
+  t = Clock::now();
+  std::vector<unsigned> viewBuffers(scene.bufferViews.size(), 0);
+  auto viewBuffer = [&](unsigned view)
+  {
+    if (!viewBuffers[view])
+    {
+      glGenBuffers(1, &viewBuffers[view]);
+      gl.BindBuffer(GL_COPY_WRITE_BUFFER, viewBuffers[view]);
+      glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)scene.bufferViews[view].length, scene.ViewData(view), GL_STATIC_DRAW);
+    }
+    return viewBuffers[view];
+  };
+  auto attribute = [&](int index, MeshAttribute& out)
+  {
+    if (index < 0)
+      return (size_t)0;
+    const GltfAccessor& accessor = scene.accessors[index];
+    out.buffer = viewBuffer(accessor.bufferView);
+    out.components = accessor.components;
+    out.type = accessor.componentType;
+    out.normalized = accessor.normalized;
+    out.stride = (GLsizei)scene.bufferViews[accessor.bufferView].stride;
+    out.offset = accessor.offset;
+    return accessor.count * accessor.ElementSize();
+  };
+
+  _meshes.reserve(_meshes.size() + scene.primitives.size());
+  for (const GltfPrimitive& primitive : scene.primitives)
+  {
+    MeshBuffers buffers;
+    const GltfAccessor& position = scene.accessors[primitive.position];
+    buffers.vertexCount = position.count;
+    buffers.vertexBytes = attribute(primitive.position, buffers.position) + attribute(primitive.normal, buffers.normal)
+      + attribute(primitive.texCoord, buffers.texCoords);
+
+    if (position.hasBounds)
+    {
+      buffers.boundsMin = position.min;
+      buffers.boundsMax = position.max;
+    }
+    else
+    {
+      // min/max are required for positions, but read them from the mapping if a writer left them out
+      const GltfBufferView& view = scene.bufferViews[position.bufferView];
+      const uint8_t* data = scene.ViewData(position.bufferView) + position.offset;
+      const size_t stride = view.stride ? view.stride : position.ElementSize();
+      glm::vec3 p;
+      std::memcpy(&p, data, sizeof(p));
+      buffers.boundsMin = buffers.boundsMax = p;
+      for (size_t i = 1; i < position.count; ++i)
+      {
+        std::memcpy(&p, data + i * stride, sizeof(p));
+        buffers.boundsMin = glm::min(buffers.boundsMin, p);
+        buffers.boundsMax = glm::max(buffers.boundsMax, p);
+      }
+    }
+
+    if (primitive.indices >= 0)
+    {
+      const GltfAccessor& indices = scene.accessors[primitive.indices];
+      buffers.indexBuffer = viewBuffer(indices.bufferView);
+      buffers.indexType = indices.componentType;
+      buffers.indexOffset = indices.offset;
+      buffers.indexCount = indices.count;
+      buffers.indexBytes = indices.count * indices.ElementSize();
+    }
+    else
+    {
+      // non-indexed triangle list: the only buffer built here
+      std::vector<unsigned int> sequence(position.count);
+      for (size_t i = 0; i < sequence.size(); ++i)
+        sequence[i] = (unsigned int)i;
+      glGenBuffers(1, &buffers.indexBuffer);
+      gl.BindBuffer(GL_COPY_WRITE_BUFFER, buffers.indexBuffer);
+      glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(sequence.size() * sizeof(unsigned int)), sequence.data(), GL_STATIC_DRAW);
+      buffers.indexCount = sequence.size();
+      buffers.indexBytes = sequence.size() * sizeof(unsigned int);
+    }
+
+    std::vector<std::shared_ptr<Texture>> textures;
+    if (primitive.material >= 0 && scene.materialImages[primitive.material] >= 0)
+    {
+      if (const std::shared_ptr<Texture>& texture = images[scene.materialImages[primitive.material]])
+        textures.push_back(texture);
+    }
+
+    _loadStats.vertices += buffers.vertexCount;
+    _loadStats.indices += buffers.indexCount;
+    _meshes.emplace_back(buffers, std::move(textures));
+    AddMemoryStats(_meshes.back());
+  }
+  gl.BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  _loadStats.uploadMs = MsSince(t);
+
+  PrintLoadStats(path);
+  return true;
+}
+
+bool Model::ImportAssimp(const std::string& path, bool parallel, std::vector<MeshData>& meshes,
+  std::vector<std::vector<MaterialTextureRef>>& materials, std::vector<std::string>& files, ModelLoadStats& stats)
+{
+  auto t = Clock::now();
   Assimp::Importer importer;
-  const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+  RecordingIOSystem* io = new RecordingIOSystem();
+  importer.SetIOHandler(io); // importer owns it from now on
+  const aiScene* scene = importer.ReadFile(path, ImportFlags);
 
   if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
   {
     std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+    return false;
+  }
+  stats.importMs = MsSince(t);
+
+  // meshes in node order (a mesh referenced by several nodes is drawn several times, as before)
+  std::vector<unsigned> meshOrder;
+  ProcessNode(scene->mRootNode, scene, meshOrder);
+
+  // CPU conversion - every aiMesh writes only into its own preallocated MeshData
+  t = Clock::now();
+  meshes.assign(meshOrder.size(), MeshData());
+  auto convert = [&](size_t i)
+  {
+    ConvertMesh(scene->mMeshes[meshOrder[i]], meshes[i]);
+  };
+  if (parallel)
+  {
+    ThreadPool& pool = ThreadPool::Instance();
+    pool.ParallelFor(meshes.size(), convert);
+    stats.threads = pool.Size() + 1;
+  }
+  else
+  {
+    for (size_t i = 0; i < meshes.size(); ++i)
+      convert(i);
+  }
+
+  materials.assign(scene->mNumMaterials, {});
+  for (unsigned m = 0; m < scene->mNumMaterials; ++m)
+  {
+    // diffuse maps first, then specular maps
+    CollectMaterialTextures(scene->mMaterials[m], aiTextureType_DIFFUSE, "texture_diffuse", materials[m]);
+    CollectMaterialTextures(scene->mMaterials[m], aiTextureType_SPECULAR, "texture_specular", materials[m]);
+  }
+  stats.convertMs = MsSince(t);
+  files = io->Opened();
+  return true;
+}
+
+bool Model::ImportObj(const std::string& path, bool parallel, std::vector<MeshData>& meshes,
+  std::vector<std::vector<MaterialTextureRef>>& materials, std::vector<std::string>& files, ModelLoadStats& stats)
+{
+  // parsing and conversion are one pass, all of it counts as import
+  auto t = Clock::now();
+  ObjScene scene;
+  if (!ObjLoader::Load(path, scene, parallel))
+    return false;
+  stats.importMs = MsSince(t);
+  stats.convertMs = 0.0;
+  stats.threads = parallel ? ThreadPool::Instance().Size() + 1 : 1;
+
+  meshes = std::move(scene.meshes);
+  materials = std::move(scene.materials);
+  files = std::move(scene.files);
+  return true;
+}
+
+ImportBenchmark Model::BenchmarkImport(const std::string& path, unsigned runs)
+{
+  ImportBenchmark result;
+  result.path = path;
+  result.runs = std::max(runs, 1u);
+  result.assimpMs = result.nativeMs = std::numeric_limits<double>::max();
+
+  for (unsigned run = 0; run < result.runs; ++run)
+  {
+    std::vector<MeshData> meshes;
+    std::vector<std::vector<MaterialTextureRef>> materials;
+    std::vector<std::string> files;
+    ModelLoadStats stats;
+
+    auto t = Clock::now();
+    if (ImportAssimp(path, true, meshes, materials, files, stats))
+    {
+      result.assimpMs = std::min(result.assimpMs, MsSince(t));
+      result.assimpMeshes = meshes.size();
+      result.assimpVertices = 0;
+      for (const auto& mesh : meshes)
+        result.assimpVertices += mesh.vertices.size();
+    }
+
+    meshes.clear();
+    t = Clock::now();
+    if (ImportObj(path, true, meshes, materials, files, stats))
+    {
+      result.nativeMs = std::min(result.nativeMs, MsSince(t));
+      result.nativeMeshes = meshes.size();
+      result.nativeVertices = 0;
+      result.triangles = 0;
+      for (const auto& mesh : meshes)
+      {
+        result.nativeVertices += mesh.vertices.size();
+        result.triangles += mesh.indices.size() / 3;
+      }
+    }
+  }
+
+  std::cout << "MODEL::BENCHMARK::" << path << " (best of " << result.runs << ")\n"
+    << "  assimp " << result.assimpMs << " ms, " << result.assimpMeshes << " meshes, " << result.assimpVertices << " vertices\n"
+    << "  native " << result.nativeMs << " ms, " << result.nativeMeshes << " meshes, " << result.nativeVertices << " vertices, "
+    << result.triangles << " triangles\n"
+    << "  speedup " << result.Speedup() << "x" << std::endl;
+  return result;
+}
+
+void Model::DecodeCache(const MeshCache& cache)
+{
+  auto t = Clock::now();
+  _pendingMaterials.resize(cache.MaterialCount());
+  for (uint32_t m = 0; m < cache.MaterialCount(); ++m)
+    _pendingMaterials[m] = cache.MaterialTextures(m);
+
+  // expand the encoded streams on the pool
+  _pendingMeshes.assign(cache.MeshCount(), MeshData());
+  std::vector<char> decoded(cache.MeshCount(), 0);
+  ThreadPool& pool = ThreadPool::Instance();
+  pool.ParallelFor(cache.MeshCount(), [&](size_t i)
+  {
+    MeshData& data = _pendingMeshes[i];
+    decoded[i] = cache.DecodeMesh((uint32_t)i, data.vertices, data.indices);
+    data.materialIndex = cache.MeshAt((uint32_t)i).materialIndex;
+    data.lods = cache.Lods((uint32_t)i);
+    data.meshlets = cache.Meshlets((uint32_t)i);
+  });
+
+  size_t kept = 0;
+  for (size_t i = 0; i < _pendingMeshes.size(); ++i)
+  {
+    if (!decoded[i])
+    {
+      std::cout << "ERROR::MODEL::Corrupt mesh " << i << " in cache" << std::endl;
+      continue;
+    }
+    if (kept != i)
+      _pendingMeshes[kept] = std::move(_pendingMeshes[i]);
+    ++kept;
+  }
+  _pendingMeshes.resize(kept);
+  _loadStats.convertMs = MsSince(t);
+  _loadStats.threads = pool.Size() + 1;
+}
+
+// ---------------------------------------------------------------- streaming
+
+// Streaming state of a ModelLoad_Streaming model. The decode and import jobs hold a reference,
+// so the cache stays mapped until the last of them is done, whatever happens to the Model.
+struct ModelStream
+{
+  enum class State
+  {
+    Registered,
+    Decoding,
+    Decoded,
+    Resident,
+    Failed
+  };
+
+  struct Entry
+  {
+    uint32_t mesh = 0;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    // upload size
+    size_t bytes = 0;
+    float priority = 0.0f;
+    State state = State::Registered;
+    // written by the decode job, read by the GL thread once the state is Decoded
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<std::shared_ptr<Texture>> textures;
+    // ModelLoad_Dedup: GeometryRegistry key, an identical mesh already uploaded is not uploaded again
+    uint64_t geometryKey = 0;
+  };
+
+  std::string path;
+  std::string textureDirectory;
+  bool flipTextures = false;
+  unsigned flags = 0;
+  FileStamp source;
+  uint64_t sourceHash = 0;
+  Clock::time_point start;
+
+  MeshCache cache;
+  bool opened = false;
+  bool done = false;
+  // cache miss: import + cache write on a worker
+  std::future<bool> import;
+
+  // guards the states of entries and the material textures
+  mutable std::mutex mutex;
+  std::vector<Entry> entries;
+  std::vector<std::vector<std::shared_ptr<Texture>>> materialTextures;
+  std::vector<char> materialAcquired;
+};
+
+namespace
+{
+
+// worker: expands one mesh and acquires its material's textures, so they are requested in
+// the same priority order as the geometry
+void DecodeStreamed(const std::shared_ptr<ModelStream>& stream, size_t e,
+  const std::function<std::vector<std::shared_ptr<Texture>>(uint32_t)>& acquire)
+{
+  ModelStream::Entry& entry = stream->entries[e];
+  bool decoded = stream->cache.DecodeMesh(entry.mesh, entry.vertices, entry.indices);
+  if (decoded && (stream->flags & ModelLoad_Dedup))
+    entry.geometryKey = GeometryRegistry::ContentKey(entry.vertices.data(), entry.vertices.size(), entry.indices.data(), entry.indices.size(),
+      stream->cache.Lods(entry.mesh));
+
+  std::vector<std::shared_ptr<Texture>> textures;
+  const uint32_t material = stream->cache.MeshAt(entry.mesh).materialIndex;
+  if (decoded && material < stream->materialTextures.size())
+  {
+    bool acquired;
+    {
+      std::lock_guard<std::mutex> lock(stream->mutex);
+      acquired = stream->materialAcquired[material] != 0;
+      if (acquired)
+        textures = stream->materialTextures[material];
+    }
+    // two meshes of one material may both get here, the registry hands out the same textures
+    if (!acquired)
+    {
+      textures = acquire(material);
+      std::lock_guard<std::mutex> lock(stream->mutex);
+      stream->materialTextures[material] = textures;
+      stream->materialAcquired[material] = 1;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(stream->mutex);
+  entry.textures = std::move(textures);
+  entry.state = decoded ? ModelStream::State::Decoded : ModelStream::State::Failed;
+}
+
+} // namespace
+
+bool Model::StartStreaming(const std::string& path)
+{
+  auto stream = std::make_shared<ModelStream>();
+  stream->start = Clock::now();
+  if (!MeshCache::HashSource(path, stream->source, stream->sourceHash))
+    return false;
+  stream->path = path;
+  stream->textureDirectory = _texturesDirectory.empty() ? _directory : _texturesDirectory;
+  stream->flipTextures = _flippedTextures;
+  stream->flags = _flags;
+  _stream = stream;
+
+  if (stream->cache.Open(MeshCache::CachePath(path), stream->source, stream->sourceHash, ImportFlags, _flags & ProcessFlags))
+  {
+    _loadStats.cacheHit = true;
+    _loadStats.importMs = MsSince(stream->start);
+    RegisterStreamedMeshes();
+    return true;
+  }
+
+  // nothing to register yet: import and write the cache in the background, Stream picks it up
+  std::cout << "MODEL::STREAM::" << path << ": no valid cache, importing in the background" << std::endl;
+  stream->import = ThreadPool::Instance().Submit([stream]()
+  {
+    std::vector<MeshData> meshData;
+    std::vector<std::vector<MaterialTextureRef>> materials;
+    std::vector<std::string> files;
+    ModelLoadStats stats;
+    std::vector<MeshOptimizeStats> optimizeStats;
+    return BuildMeshData(stream->path, stream->flags, meshData, materials, files, stats, optimizeStats)
+      && WriteCache(stream->path, stream->source, stream->sourceHash, stream->flags, files, meshData, materials);
+  });
+  return true;
+}
+
+void Model::RegisterStreamedMeshes()
+{
+  ModelStream& stream = *_stream;
+  const MeshCache& cache = stream.cache;
+  const size_t vertexSize = MeshFormat() == VertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+
+  stream.opened = true;
+  stream.entries.resize(cache.MeshCount());
+  for (uint32_t i = 0; i < cache.MeshCount(); ++i)
+  {
+    const MeshCacheMesh& mesh = cache.MeshAt(i);
+    ModelStream::Entry& entry = stream.entries[i];
+    entry.mesh = i;
+    entry.center = glm::vec3(mesh.boundsCenter[0], mesh.boundsCenter[1], mesh.boundsCenter[2]);
+    entry.radius = mesh.boundsRadius;
+    entry.bytes = mesh.vertexCount * vertexSize + (size_t)mesh.indexCount * sizeof(uint32_t);
+  }
+  stream.materialTextures.resize(cache.MaterialCount());
+  stream.materialAcquired.assign(cache.MaterialCount(), 0);
+  _meshes.reserve(_meshes.size() + cache.MeshCount());
+}
+
+void Model::Stream(const glm::mat4& model, const LodView& view, const CullView& cull)
+{
+  if (!_stream || _stream->done)
     return;
+  ModelStream& stream = *_stream;
+
+  if (!stream.opened)
+  {
+    if (stream.import.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return;
+    if (!stream.import.get()
+      || !stream.cache.Open(MeshCache::CachePath(stream.path), stream.source, stream.sourceHash, ImportFlags, _flags & ProcessFlags))
+    {
+      std::cout << "ERROR::MODEL::STREAM::Import of " << stream.path << " failed" << std::endl;
+      stream.done = true;
+      return;
+    }
+    RegisterStreamedMeshes();
   }
-  _directory = path.substr(0, path.find_last_of('/'));
 
-  ProcessNode(scene->mRootNode, scene);
+  // inside the frustum: projected radius in pixels, everything the camera is inside of first;
+  // outside: after all visible meshes, nearest first
+  const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  std::vector<size_t> order;
+  size_t pending = 0, waiting = 0;
+  {
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    for (size_t e = 0; e < stream.entries.size(); ++e)
+    {
+      ModelStream::Entry& entry = stream.entries[e];
+      if (entry.state == ModelStream::State::Decoding || entry.state == ModelStream::State::Decoded)
+        ++pending;
+      if (entry.state == ModelStream::State::Decoding)
+        ++waiting;
+      if (entry.state != ModelStream::State::Registered && entry.state != ModelStream::State::Decoded)
+        continue;
+
+      const glm::vec3 center = glm::vec3(model * glm::vec4(entry.center, 1.0f));
+      const float radius = entry.radius * scale;
+      const float distance = glm::length(center - view.cameraPosition);
+      bool inside = true;
+      for (const auto& plane : cull.planes)
+        inside = inside && glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+      if (distance <= radius)
+        entry.priority = std::numeric_limits<float>::max();
+      else if (inside)
+        entry.priority = radius * view.projScale / distance;
+      else
+        entry.priority = -distance;
+      order.push_back(e);
+    }
+  }
+
+  if (order.empty() && waiting == 0)
+  {
+    // everything is resident or failed, no job uses the cache any more
+    stream.done = true;
+    stream.cache.Close();
+    std::cout << "MODEL::STREAM::" << stream.path << ": " << _meshes.size() << " meshes resident after " << MsSince(stream.start) << " ms"
+      << std::endl;
+    return;
+  }
+
+  std::sort(order.begin(), order.end(), [&stream](size_t a, size_t b) { return stream.entries[a].priority > stream.entries[b].priority; });
+
+  // Registered and Decoded entries only change on this thread, the snapshot above stays valid
+  MeshStreamer& streamer = MeshStreamer::Instance();
+  bool budgetLeft = true;
+  for (size_t e : order)
+  {
+    ModelStream::Entry& entry = stream.entries[e];
+    if (entry.state == ModelStream::State::Decoded)
+    {
+      if (!budgetLeft)
+        continue;
+      if (!streamer.Reserve(entry.bytes))
+      {
+        // keep going, later entries may still need their decodes started
+        budgetLeft = false;
+        continue;
+      }
+      UploadStreamed(e);
+      --pending;
+    }
+    else if (pending < MeshStreamer::MaxPending)
+    {
+      {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        entry.state = ModelStream::State::Decoding;
+      }
+      ++pending;
+      std::shared_ptr<ModelStream> shared = _stream;
+      const std::string directory = stream.textureDirectory;
+      const bool flip = stream.flipTextures;
+      ThreadPool::Instance().Submit([shared, e, directory, flip]()
+      {
+        DecodeStreamed(shared, e, [&](uint32_t material)
+        {
+          return AcquireTextures(shared->cache.MaterialTextures(material), directory, flip, true);
+        });
+      });
+    }
+  }
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene)
+void Model::UploadStreamed(size_t e)
 {
-  // process all the node's meshes (if any)
-  for (unsigned i = 0; i < node->mNumMeshes; ++i)
+  ModelStream& stream = *_stream;
+  ModelStream::Entry& entry = stream.entries[e];
+  const MeshCacheMesh& mesh = stream.cache.MeshAt(entry.mesh);
+  std::vector<MeshLod> lods = stream.cache.Lods(entry.mesh);
+
+  _loadStats.vertices += mesh.vertexCount;
+  _loadStats.indices += lods.empty() ? mesh.indexCount : lods[0].indexCount;
+  _loadStats.meshlets += mesh.meshletCount;
+  _meshes.emplace_back(entry.vertices.data(), entry.vertices.size(), entry.indices.data(), entry.indices.size(), std::move(entry.textures),
+    std::move(lods), stream.cache.Meshlets(entry.mesh), MeshFormat(), entry.geometryKey);
+  AddMemoryStats(_meshes.back());
+
+  std::vector<Vertex>().swap(entry.vertices);
+  std::vector<uint32_t>().swap(entry.indices);
+  std::lock_guard<std::mutex> lock(stream.mutex);
+  entry.state = ModelStream::State::Resident;
+}
+
+bool Model::Streaming() const
+{
+  return _stream && !_stream->done;
+}
+
+ModelStreamStats Model::StreamStats() const
+{
+  ModelStreamStats stats;
+  if (!_stream)
+    return stats;
+
+  std::lock_guard<std::mutex> lock(_stream->mutex);
+  stats.importing = !_stream->opened && !_stream->done;
+  stats.meshes = _stream->entries.size();
+  for (const auto& entry : _stream->entries)
+  {
+    stats.totalBytes += entry.bytes;
+    switch (entry.state)
+    {
+    case ModelStream::State::Resident:
+      ++stats.resident;
+      stats.residentBytes += entry.bytes;
+      break;
+    case ModelStream::State::Decoding:
+    case ModelStream::State::Decoded:
+      ++stats.pending;
+      break;
+    case ModelStream::State::Failed:
+      ++stats.failed;
+      break;
+    default:
+      break;
+    }
+  }
+  return stats;
+}
+
+VertexFormat Model::MeshFormat() const
+{
+  return (_flags & ModelLoad_Quantize) ? VertexFormat::Quantized : VertexFormat::Float;
+}
+
+void Model::AddMemoryStats(const Mesh& mesh)
+{
+  _loadStats.quantError.Merge(mesh.QuantError());
+  // buffers another mesh uploaded count as saved, not as memory of this model
+  if (mesh.SharedGeometry())
+  {
+    _loadStats.dedupBytes += mesh.VertexBytes() + mesh.IndexBytes();
+    ++_loadStats.sharedMeshes;
+    return;
+  }
+  _loadStats.gpuBytes += mesh.VertexBytes() + mesh.IndexBytes();
+  _loadStats.floatBytes += mesh.VertexCount() * sizeof(Vertex) + mesh.IndexCount() * sizeof(unsigned int);
+}
+
+void Model::PrintLoadStats(const std::string& path) const
+{
+  std::cout << "MODEL::LOAD::" << path << (_loadStats.cacheHit ? " (cache)" : "") << ": " << _meshes.size() << " meshes, "
+    << _loadStats.vertices << " vertices, " << _loadStats.indices / 3 << " triangles\n"
+    << "  " << (_loadStats.cacheHit ? "cache map" : "import   ") << " " << _loadStats.importMs << " ms\n"
+    << "  " << (_loadStats.cacheHit ? "decode   " : "convert  ") << " " << _loadStats.convertMs << " ms (" << _loadStats.threads << " threads)\n";
+  if (_loadStats.optimizeMs > 0.0)
+    std::cout << "  optimize  " << _loadStats.optimizeMs << " ms\n";
+  if (_loadStats.lodMs > 0.0)
+    std::cout << "  lods      " << _loadStats.lodMs << " ms\n";
+  if (_loadStats.meshletMs > 0.0)
+    std::cout << "  meshlets  " << _loadStats.meshletMs << " ms\n";
+  if (_loadStats.meshlets)
+    std::cout << "  " << _loadStats.meshlets << " meshlets\n";
+  if (LodCount() > 1)
   {
-    aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-    _meshes.push_back(ProcessMesh(mesh, scene));
+    std::cout << "  triangles per lod:";
+    for (unsigned lod = 0; lod < LodCount(); ++lod)
+      std::cout << " " << LodTriangles(lod);
+    std::cout << "\n";
   }
+  if (_loadStats.cacheWriteMs > 0.0)
+    std::cout << "  cache out " << _loadStats.cacheWriteMs << " ms\n";
+  std::cout << "  textures  " << _loadStats.texturesMs << " ms\n"
+    << "  upload    " << _loadStats.uploadMs << " ms" << std::endl;
+  if (_flags & ModelLoad_Quantize)
+    PrintQuantizeStats();
+  if (_flags & ModelLoad_Dedup)
+    PrintDedupStats();
+  PrintOptimizeStats();
+}
+
+void Model::PrintDedupStats() const
+{
+  std::cout << "MODEL::DEDUP:: " << _loadStats.dedupBytes / 1024 << " KB not uploaded, " << _loadStats.drawsSaved << " draw calls saved ("
+    << _loadStats.instancedMeshes << " instanced meshes, " << _loadStats.sharedMeshes << " shared with earlier uploads), grouping "
+    << _loadStats.dedupMs << " ms" << std::endl;
+}
+
+void Model::PrintQuantizeStats() const
+{
+  const QuantizationError& e = _loadStats.quantError;
+  std::cout << "MODEL::QUANTIZE:: vertex + index memory " << _loadStats.floatBytes / 1024 << " KB -> " << _loadStats.gpuBytes / 1024 << " KB ("
+    << (_loadStats.floatBytes ? 100.0 * _loadStats.gpuBytes / _loadStats.floatBytes : 0.0) << "%)\n"
+    << "  max error: position " << e.position << " (tolerance " << QuantizationError::PositionTolerance << " of the AABB)"
+    << ", normal " << e.normalDegrees << " deg (" << QuantizationError::NormalToleranceDegrees << ")"
+    << ", uv " << e.texCoord << " (" << QuantizationError::TexCoordTolerance << ")\n"
+    << "  " << (e.WithinTolerance() ? "within tolerance" : "ERROR::MODEL::QUANTIZE::TOLERANCE_EXCEEDED") << std::endl;
+}
+
+void Model::PrintOptimizeStats() const
+{
+  if (_optimizeStats.empty())
+    return;
+
+  std::cout << "MODEL::OPTIMIZE:: ACMR/ATVR before -> after (FIFO " << MeshOptimizer::AnalyzeCacheSize << ")\n";
+  std::cout.precision(3);
+  for (size_t i = 0; i < _optimizeStats.size(); ++i)
+  {
+    const MeshOptimizeStats& s = _optimizeStats[i];
+    std::cout << "  mesh " << i << ": ACMR " << s.before.acmr << " -> " << s.after.acmr
+      << ", ATVR " << s.before.atvr << " -> " << s.after.atvr
+      << ", vertices " << s.verticesBefore << " -> " << s.verticesAfter
+      << ", " << s.clusters << " clusters\n";
+  }
+  std::cout.precision(6);
+  std::cout << std::flush;
+}
+
+void Model::ProcessNode(aiNode* node, const aiScene* scene, std::vector<unsigned>& meshOrder)
+{
+  // process all the node's meshes (if any)
+  for (unsigned i = 0; i < node->mNumMeshes; ++i)
+    meshOrder.push_back(node->mMeshes[i]);
   // then do the same for each of its children
   for (unsigned i = 0; i < node->mNumChildren; ++i)
   {
-    ProcessNode(node->mChildren[i], scene);
+    ProcessNode(node->mChildren[i], scene, meshOrder);
   }
 }
 
-Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
+void Model::ConvertMesh(const aiMesh* mesh, MeshData& out)
 {
-  std::vector<Vertex> vertices;
-  std::vector<unsigned int> indices;
-  std::vector<std::shared_ptr<Texture>> textures;
-
+  // runs on worker threads - no GL, no shared state
+  out.vertices.resize(mesh->mNumVertices);
+  const aiVector3D* texCoords = mesh->mTextureCoords[0];
   for (unsigned i = 0; i < mesh->mNumVertices; i++)
   {
-    Vertex vertex;
+    Vertex& vertex = out.vertices[i];
     // process vertex positions, normals and texture coordinates
     const aiVector3D& meshVec = mesh->mVertices[i];
     vertex.Position = glm::vec3(meshVec.x, meshVec.y, meshVec.z);
@@ -78,68 +1196,55 @@ Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
       const aiVector3D& meshVecN = mesh->mNormals[i];
       vertex.Normal = glm::vec3(meshVecN.x, meshVecN.y, meshVecN.z);
     }
+    else
+      vertex.Normal = glm::vec3(0.0f);
 
-    if (mesh->mTextureCoords[0])
-    {
-      const auto& texCoords = mesh->mTextureCoords[0][i];
-      vertex.TexCoords = glm::vec2(texCoords.x, texCoords.y);
-    }
+    if (texCoords)
+      vertex.TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
     else
       vertex.TexCoords = glm::vec2(0.0f);
-
-    vertices.push_back(vertex);
   }
+
   // process indices
+  size_t indexCount = 0;
+  for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+    indexCount += mesh->mFaces[i].mNumIndices;
+
+  out.indices.resize(indexCount);
+  unsigned* dst = out.indices.data();
   for (unsigned i = 0; i < mesh->mNumFaces; ++i)
   {
     const aiFace& face = mesh->mFaces[i];
-    for (int j = 0; j < face.mNumIndices; ++j)
-      indices.push_back(face.mIndices[j]);
-  }
-  // process material
-  if (mesh->mMaterialIndex >= 0)
-  {
-    const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-    // add diffuse maps
-    textures = LoadMaterialTextures(material, aiTextureType_DIFFUSE, std::string("texture_diffuse"));
-    // add specular maps
-    std::vector<std::shared_ptr<Texture>> specularMaps = LoadMaterialTextures(material, aiTextureType_SPECULAR, std::string("texture_specular"));
-    textures.insert(textures.end(), std::make_move_iterator(specularMaps.begin()), std::make_move_iterator(specularMaps.end()));
+    for (unsigned j = 0; j < face.mNumIndices; ++j)
+      *dst++ = face.mIndices[j];
   }
 
-  return Mesh(std::move(vertices), std::move(indices), std::move(textures));
+  out.materialIndex = mesh->mMaterialIndex;
 }
 
-std::map<std::string, std::shared_ptr<Texture>> loaded_textures;
-
-std::vector<std::shared_ptr<Texture>> Model::LoadMaterialTextures(const aiMaterial* mat, aiTextureType type, const std::string& typeName)
+void Model::CollectMaterialTextures(const aiMaterial* mat, aiTextureType type, const char* typeName, std::vector<MaterialTextureRef>& out)
 {
-  std::vector<std::shared_ptr<Texture>> textures;
   for (unsigned i = 0; i < mat->GetTextureCount(type); ++i)
   {
     aiString aipath;
     mat->GetTexture(type, i, &aipath);
+    out.push_back({typeName, aipath.C_Str()});
+  }
+}
 
-    auto loaded = loaded_textures.find(aipath.C_Str());
-    if (loaded != loaded_textures.end())
-    {
-      textures.push_back(loaded->second);
-    }
-    else
-    {
-      std::string path;
-      if (_texturesDirectory.empty())
-        path = _directory + "/" + aipath.C_Str();
-      else
-        path = _texturesDirectory + "/" + aipath.C_Str();
-      std::shared_ptr<Texture> tex = std::make_shared<Texture>(typeName, path, GL_REPEAT, _flippedTextures);
-      //tex->SetPath(aipath.C_Str());
-      tex->Load();
+std::vector<std::shared_ptr<Texture>> Model::LoadMaterialTextures(const std::vector<MaterialTextureRef>& refs)
+{
+  return AcquireTextures(refs, _texturesDirectory.empty() ? _directory : _texturesDirectory, _flippedTextures,
+    (_flags & ModelLoad_AsyncTextures) != 0);
+}
 
-      textures.push_back(tex);
-      loaded_textures[aipath.C_Str()] = tex;
-    }
-  }
+std::vector<std::shared_ptr<Texture>> Model::AcquireTextures(const std::vector<MaterialTextureRef>& refs, const std::string& directory,
+  bool flip, bool async)
+{
+  std::vector<std::shared_ptr<Texture>> textures;
+  TextureRegistry& registry = TextureRegistry::Instance();
+  for (const auto& ref : refs)
+    textures.push_back(registry.Acquire(ref.type, directory + "/" + ref.path, flip, async));
 
   return textures;
 }
@@ -3,37 +3,247 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include "GeometryRegistry.h"
 #include "Mesh.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 
 namespace NullEngine
 {
 
+// Model loading options, combine with |
+enum ModelLoadFlags : unsigned
+{
+  ModelLoad_None = 0,
+  // convert aiMeshes on the worker pool, GL upload still happens on the calling (GL) thread
+  ModelLoad_Parallel = 1 << 0,
+  // read/write the binary mesh cache (<path>.nemesh) instead of importing with Assimp every run
+  ModelLoad_UseCache = 1 << 1,
+  // decode textures on workers and upload them through TextureStreamer, meshes draw with a placeholder meanwhile
+  ModelLoad_AsyncTextures = 1 << 2,
+  // dedup vertices, reorder triangles for the vertex cache/overdraw and vertices for fetch (MeshOptimizer)
+  ModelLoad_Optimize = 1 << 3,
+  // generate simplified levels of detail per mesh (MeshSimplifier), selected by Model::SelectLod
+  ModelLoad_Lods = 1 << 4,
+  // split every mesh into meshlets (MeshletBuilder) so Model::Cull can reject clusters
+  ModelLoad_Meshlets = 1 << 5,
+  // upload meshes as VertexFormat::Quantized (16 byte vertices, 16-bit indices where they fit);
+  // the cache keeps float vertices, quantization happens at upload
+  ModelLoad_Quantize = 1 << 6,
+  // read .obj files with ObjLoader instead of Assimp (other formats always use Assimp)
+  ModelLoad_NativeObj = 1 << 7,
+  // draw .glb/.gltf buffer views in place (GltfLoader, VertexFormat::External): no cache, optimization,
+  // LODs, meshlets or quantization for these; files it can't handle still go through Assimp
+  ModelLoad_NativeGltf = 1 << 8,
+  // register the meshes of the .nemesh right away (bounds only) and stream their geometry and textures in
+  // over the following frames, see Model::Stream. Always uses the cache and async textures; on a cache miss
+  // the import and cache write run on a worker first. Ignored for glTF files drawn in place
+  ModelLoad_Streaming = 1 << 9,
+  // the constructor only records the settings: Prepare() does the CPU side on any thread (import or cache
+  // decode, async texture lookups), Upload() the GL side on the GL thread
+  ModelLoad_Deferred = 1 << 10,
+  // share the buffers of meshes already uploaded with the same content (GeometryRegistry, across models too)
+  // and draw meshes that are translated copies of one another as one instanced mesh
+  ModelLoad_Dedup = 1 << 11,
+
+  ModelLoad_Default = ModelLoad_Parallel | ModelLoad_UseCache | ModelLoad_AsyncTextures | ModelLoad_Optimize | ModelLoad_Lods
+    | ModelLoad_Meshlets | ModelLoad_NativeObj | ModelLoad_NativeGltf | ModelLoad_Dedup
+};
+
+// Timing breakdown of the last LoadModel call (milliseconds)
+struct ModelLoadStats
+{
+  double importMs = 0.0;
+  double convertMs = 0.0;
+  double optimizeMs = 0.0;
+  double lodMs = 0.0;
+  double meshletMs = 0.0;
+  double texturesMs = 0.0;
+  double uploadMs = 0.0;
+  double cacheWriteMs = 0.0;
+  double dedupMs = 0.0;
+  size_t vertices = 0;
+  size_t indices = 0;
+  size_t meshlets = 0;
+  // uploaded vertex + index buffers, and what the float layout with 32-bit indices takes
+  size_t gpuBytes = 0;
+  size_t floatBytes = 0;
+  // ModelLoad_Dedup: vertex + index bytes not uploaded (instances, and meshes another one had uploaded already),
+  // draw calls the instanced meshes save, meshes drawn instanced and meshes whose buffers were shared
+  size_t dedupBytes = 0;
+  size_t drawsSaved = 0;
+  size_t instancedMeshes = 0;
+  size_t sharedMeshes = 0;
+  // largest error of the quantized meshes
+  QuantizationError quantError;
+  unsigned threads = 1;
+  bool cacheHit = false;
+};
+
+// Streaming progress of a ModelLoad_Streaming model
+struct ModelStreamStats
+{
+  size_t meshes = 0;
+  size_t resident = 0;
+  // decoding, or decoded and waiting for upload budget
+  size_t pending = 0;
+  size_t failed = 0;
+  size_t residentBytes = 0;
+  size_t totalBytes = 0;
+  // no valid cache, importing on a worker
+  bool importing = false;
+
+  float Progress() const { return totalBytes ? (float)residentBytes / totalBytes : 0.0f; }
+};
+
+struct ModelStream;
+
+// Model::BenchmarkImport result: best import + conversion time to MeshData of each path (milliseconds)
+struct ImportBenchmark
+{
+  std::string path;
+  unsigned runs = 0;
+  double assimpMs = 0.0;
+  double nativeMs = 0.0;
+  size_t assimpMeshes = 0;
+  size_t nativeMeshes = 0;
+  // Assimp keeps one vertex per face corner, ObjLoader shares them
+  size_t assimpVertices = 0;
+  size_t nativeVertices = 0;
+  size_t triangles = 0;
+
+  double Speedup() const { return nativeMs > 0.0 ? assimpMs / nativeMs : 0.0; }
+};
+
 class Model
 {
 public:
-  Model(const char* path, const char* texturesPath = nullptr, bool flippedTex = false)
+  Model(const char* path, const char* texturesPath = nullptr, bool flippedTex = false, unsigned flags = ModelLoad_Default)
   {
     _flippedTextures = flippedTex;
+    _flags = flags;
     if (texturesPath)
       _texturesDirectory = texturesPath;
-    LoadModel(path);
+    if (flags & ModelLoad_Deferred)
+      _path = path;
+    else
+      LoadModel(path);
   }
 
+  // ModelLoad_Deferred: any thread, no GL; false if the model can't be imported
+  bool Prepare();
+  // ModelLoad_Deferred, any thread after Prepare: requests the textures with ModelLoad_AsyncTextures, so they
+  // start decoding before Upload (which otherwise does it). Texture::EnableCompression must have been called
+  void PrepareTextures();
+  // ModelLoad_Deferred: GL thread, after Prepare
+  void Upload();
+
   void Draw(Shader& shader);
   void Highlight(Shader& shader);
+  // queues what Draw (RenderPass::Opaque) or Highlight (RenderPass::Highlight) would draw, one item per mesh;
+  // the pass sets the stencil state those set
+  void Submit(RenderQueue& queue, RenderPass pass, Shader& shader, const glm::mat4& model);
+
+  // picks every mesh's level of detail for the following Draw/Highlight/Submit calls
+  void SelectLod(const glm::mat4& model, const LodView& view);
+  // most levels any mesh has
+  unsigned LodCount() const;
+  // triangles of the whole model at a level (meshes with fewer levels use their coarsest)
+  size_t LodTriangles(unsigned lod) const;
+  // triangles at the currently selected levels
+  size_t SelectedTriangles() const;
+
+  // frustum/back-face culls meshes and meshlets for the following Draw/Highlight/Submit calls, after SelectLod
+  void Cull(const glm::mat4& model, const CullView& view, ClusterCullStats& stats);
+
+  // ModelLoad_Streaming, GL thread, once per frame before SelectLod/Cull/Draw: orders the meshes that are
+  // not resident yet by priority (inside the frustum first, then by projected size; the rest by distance),
+  // starts decodes for the first ones and uploads decoded ones within the MeshStreamer budget.
+  // Draw and the other per-mesh calls only ever see resident meshes.
+  void Stream(const glm::mat4& model, const LodView& view, const CullView& cull);
+  // true while meshes are still to be streamed
+  bool Streaming() const;
+  ModelStreamStats StreamStats() const;
+
+  const ModelLoadStats& LoadStats() const { return _loadStats; }
+  // per mesh ACMR/ATVR before and after optimization, empty if loaded from the cache or not optimized
+  const std::vector<MeshOptimizeStats>& OptimizeStats() const { return _optimizeStats; }
+  // video memory of the model's uploaded textures, and the same textures as uncompressed RGBA8
+  void TextureMemory(size_t& gpuBytes, size_t& uncompressedBytes) const;
 
   bool _flippedTextures;
 
+  // times Assimp against ObjLoader on an .obj (CPU work only: parse + convert, no cache, no GL) and prints the result
+  static ImportBenchmark BenchmarkImport(const std::string& path, unsigned runs = 3);
+
+  // offline cooking (AssetCooker): import + processing + .nemesh write as LoadModel does with flags, no GL.
+  // files receives every file the importer read (mtl, ...), textures the texture references of all materials
+  static bool Cook(const std::string& path, unsigned flags, std::vector<std::string>& files, std::vector<MaterialTextureRef>& textures);
+
+  // postprocessing applied by Assimp; part of the mesh cache key
+  static constexpr unsigned ImportFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+  // load flags that change the generated geometry, also part of the cache key
+  static constexpr unsigned ProcessFlags = ModelLoad_Optimize | ModelLoad_Lods | ModelLoad_Meshlets | ModelLoad_NativeObj;
+  // levels of detail per mesh including the full one
+  static constexpr unsigned MaxLods = 4;
+
 private:
   // model data
   std::vector<Mesh> _meshes;
+  std::string _path;
   std::string _directory;
   std::string _texturesDirectory;
+  unsigned _flags = ModelLoad_Default;
+  ModelLoadStats _loadStats;
+  std::vector<MeshOptimizeStats> _optimizeStats;
+  // ModelLoad_Streaming state, shared with the decode/import jobs
+  std::shared_ptr<ModelStream> _stream;
+  // Prepare results waiting for Upload
+  std::vector<MeshData> _pendingMeshes;
+  std::vector<std::vector<MaterialTextureRef>> _pendingMaterials;
+  std::vector<std::vector<std::shared_ptr<Texture>>> _pendingTextures;
+  // ModelLoad_Dedup: pending meshes uploaded as one instanced mesh each, empty = one mesh per pending mesh
+  std::vector<MeshInstances> _pendingInstances;
+  bool _pendingGltf = false;
+  bool _pendingValid = false;
 
   void LoadModel(std::string path);
-  void ProcessNode(aiNode* node, const aiScene* scene);
-  Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene);
-  std::vector<std::shared_ptr<Texture>> LoadMaterialTextures(const aiMaterial* mat, aiTextureType type, const std::string& typeName);
+  static void ProcessNode(aiNode* node, const aiScene* scene, std::vector<unsigned>& meshOrder);
+  // import or cache decode into the pending meshes
+  bool PrepareMeshes();
+  void DecodeCache(const MeshCache& cache);
+  void AcquirePendingTextures();
+  // false if the source can't be read, the model then loads as usual
+  bool StartStreaming(const std::string& path);
+  void RegisterStreamedMeshes();
+  void UploadStreamed(size_t entry);
+  void PrintLoadStats(const std::string& path) const;
+  void PrintOptimizeStats() const;
+  void PrintQuantizeStats() const;
+  void PrintDedupStats() const;
+  VertexFormat MeshFormat() const;
+  void AddMemoryStats(const Mesh& mesh);
+  // case insensitive, extension without the dot
+  static bool HasExtension(const std::string& path, const char* extension);
+  // false if the file needs Assimp (see GltfLoader)
+  bool LoadGltf(const std::string& path);
+  static bool ImportAssimp(const std::string& path, bool parallel, std::vector<MeshData>& meshes,
+    std::vector<std::vector<MaterialTextureRef>>& materials, std::vector<std::string>& files, ModelLoadStats& stats);
+  static bool ImportObj(const std::string& path, bool parallel, std::vector<MeshData>& meshes,
+    std::vector<std::vector<MaterialTextureRef>>& materials, std::vector<std::string>& files, ModelLoadStats& stats);
+  // import + the CPU passes selected by flags, everything before the GL upload
+  static bool BuildMeshData(const std::string& path, unsigned flags, std::vector<MeshData>& meshData,
+    std::vector<std::vector<MaterialTextureRef>>& materials, std::vector<std::string>& files, ModelLoadStats& stats,
+    std::vector<MeshOptimizeStats>& optimizeStats);
+  static bool WriteCache(const std::string& path, const FileStamp& source, uint64_t sourceHash, unsigned flags,
+    const std::vector<std::string>& files, const std::vector<MeshData>& meshData, const std::vector<std::vector<MaterialTextureRef>>& materials);
+  static void ConvertMesh(const aiMesh* mesh, MeshData& out);
+  static void CollectMaterialTextures(const aiMaterial* mat, aiTextureType type, const char* typeName, std::vector<MaterialTextureRef>& out);
+  std::vector<std::shared_ptr<Texture>> LoadMaterialTextures(const std::vector<MaterialTextureRef>& refs);
+  // refs relative to directory; any thread with async
+  static std::vector<std::shared_ptr<Texture>> AcquireTextures(const std::vector<MaterialTextureRef>& refs, const std::string& directory,
+    bool flip, bool async);
 };
 
-}
\ No newline at end of file
+}
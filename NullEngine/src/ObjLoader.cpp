@@ -0,0 +1,645 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include "AssetPack.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+// 0-based indices into the whole file's v/vt/vn lists, -1 = not given
+struct ObjCorner
+{
+  int32_t v = -1;
+  int32_t vt = -1;
+  int32_t vn = -1;
+
+  bool operator==(const ObjCorner& o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+};
+
+struct ObjCornerHash
+{
+  size_t operator()(const ObjCorner& c) const
+  {
+    uint64_t h = (uint64_t)(uint32_t)c.v * 0x9E3779B97F4A7C15ull;
+    h ^= ((uint64_t)(uint32_t)c.vt * 0xC2B2AE3D27D4EB4Full) + (h << 6) + (h >> 2);
+    h ^= ((uint64_t)(uint32_t)c.vn * 0x165667B19E3779F9ull) + (h << 6) + (h >> 2);
+    // the table uses the low bits
+    return (size_t)(h ^ (h >> 29) ^ (h >> 47));
+  }
+};
+
+enum class ObjStatementKind
+{
+  Object,
+  Group,
+  Material
+};
+
+// o/g/usemtl, takes effect from corner onwards (index into the chunk's corners)
+struct ObjStatement
+{
+  ObjStatementKind kind;
+  std::string name;
+  size_t corner;
+};
+
+// what one thread parsed from its part of the file
+struct ObjChunk
+{
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> texCoords;
+  std::vector<glm::vec3> normals;
+  // 3 per triangle
+  std::vector<ObjCorner> corners;
+  std::vector<ObjStatement> statements;
+  std::vector<std::string> libraries;
+  // corners with negative (relative) indices: resolved against this chunk's counts only,
+  // the chunk's base is added once all chunks are counted. Bits: 1 = v, 2 = vt, 4 = vn
+  std::vector<std::pair<size_t, uint8_t>> relative;
+  size_t invalidFaces = 0;
+};
+
+inline bool IsSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// character at p + k, or 0 past the line
+inline char At(const char* p, const char* end, size_t k)
+{
+  return p + k < end ? p[k] : '\0';
+}
+
+inline const char* SkipSpace(const char* p, const char* end)
+{
+  while (p < end && IsSpace(*p))
+    ++p;
+  return p;
+}
+
+inline bool Keyword(const char* p, const char* end, const char* keyword)
+{
+  size_t length = std::strlen(keyword);
+  return (size_t)(end - p) > length && std::memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+}
+
+// rest of the line without surrounding blanks
+std::string RestOfLine(const char* p, const char* end)
+{
+  p = SkipSpace(p, end);
+  while (end > p && IsSpace(end[-1]))
+    --end;
+  return std::string(p, end);
+}
+
+bool ParseInt(const char*& p, const char* end, int64_t& value)
+{
+  const char* s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+  if (s >= end || (unsigned)(*s - '0') > 9)
+    return false;
+  int64_t v = 0;
+  while (s < end && (unsigned)(*s - '0') <= 9)
+    v = v * 10 + (*s++ - '0');
+  value = negative ? -v : v;
+  p = s;
+  return true;
+}
+
+// OBJ index -> 0-based; relative ones are local to the chunk until rebased
+int32_t ResolveIndex(int64_t index, size_t localCount, uint8_t& relative, uint8_t bit)
+{
+  if (index > 0)
+    return (int32_t)(index - 1);
+  if (index < 0)
+  {
+    relative |= bit;
+    return (int32_t)((int64_t)localCount + index);
+  }
+  return -1;
+}
+
+void ParseFace(const char* p, const char* end, ObjChunk& chunk, std::vector<std::pair<ObjCorner, uint8_t>>& face)
+{
+  face.clear();
+  for (;;)
+  {
+    p = SkipSpace(p, end);
+    if (p >= end)
+      break;
+
+    ObjCorner corner;
+    uint8_t relative = 0;
+    int64_t index;
+    if (!ParseInt(p, end, index))
+      break;
+    corner.v = ResolveIndex(index, chunk.positions.size(), relative, 1);
+    if (p < end && *p == '/')
+    {
+      ++p;
+      if (p < end && *p != '/' && ParseInt(p, end, index))
+        corner.vt = ResolveIndex(index, chunk.texCoords.size(), relative, 2);
+      if (p < end && *p == '/')
+      {
+        ++p;
+        if (ParseInt(p, end, index))
+          corner.vn = ResolveIndex(index, chunk.normals.size(), relative, 4);
+      }
+    }
+    while (p < end && !IsSpace(*p))
+      ++p;
+    face.push_back({corner, relative});
+  }
+
+  // points and lines are not drawn
+  if (face.size() < 3)
+  {
+    if (!face.empty())
+      ++chunk.invalidFaces;
+    return;
+  }
+
+  // fan, like aiProcess_Triangulate does for convex polygons
+  for (size_t i = 2; i < face.size(); ++i)
+  {
+    const size_t corners[3] = {0, i - 1, i};
+    for (size_t k : corners)
+    {
+      if (face[k].second)
+        chunk.relative.push_back({chunk.corners.size(), face[k].second});
+      chunk.corners.push_back(face[k].first);
+    }
+  }
+}
+
+void ParseChunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+  std::vector<std::pair<ObjCorner, uint8_t>> face;
+  const char* p = begin;
+  while (p < end)
+  {
+    const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (!lineEnd)
+      lineEnd = end;
+    const char* s = SkipSpace(p, lineEnd);
+
+    if (s < lineEnd)
+    {
+      const char c0 = *s, c1 = At(s, lineEnd, 1);
+      if (c0 == 'v' && IsSpace(c1))
+      {
+        glm::vec3 v(0.0f);
+        const char* q = s + 2;
+        for (int k = 0; k < 3; ++k)
+        {
+          q = SkipSpace(q, lineEnd);
+          if (!ObjLoader::ParseFloat(q, lineEnd, v[k]))
+            break;
+        }
+        chunk.positions.push_back(v);
+      }
+      else if (c0 == 'v' && c1 == 't' && IsSpace(At(s, lineEnd, 2)))
+      {
+        glm::vec2 t(0.0f);
+        const char* q = s + 3;
+        for (int k = 0; k < 2; ++k)
+        {
+          q = SkipSpace(q, lineEnd);
+          if (!ObjLoader::ParseFloat(q, lineEnd, t[k]))
+            break;
+        }
+        // aiProcess_FlipUVs
+        t.y = 1.0f - t.y;
+        chunk.texCoords.push_back(t);
+      }
+      else if (c0 == 'v' && c1 == 'n' && IsSpace(At(s, lineEnd, 2)))
+      {
+        glm::vec3 n(0.0f);
+        const char* q = s + 3;
+        for (int k = 0; k < 3; ++k)
+        {
+          q = SkipSpace(q, lineEnd);
+          if (!ObjLoader::ParseFloat(q, lineEnd, n[k]))
+            break;
+        }
+        chunk.normals.push_back(n);
+      }
+      else if (c0 == 'f' && IsSpace(c1))
+        ParseFace(s + 2, lineEnd, chunk, face);
+      else if (c0 == 'o' && IsSpace(c1))
+        chunk.statements.push_back({ObjStatementKind::Object, RestOfLine(s + 2, lineEnd), chunk.corners.size()});
+      else if (c0 == 'g' && IsSpace(c1))
+        chunk.statements.push_back({ObjStatementKind::Group, RestOfLine(s + 2, lineEnd), chunk.corners.size()});
+      else if (Keyword(s, lineEnd, "usemtl"))
+        chunk.statements.push_back({ObjStatementKind::Material, RestOfLine(s + 6, lineEnd), chunk.corners.size()});
+      else if (Keyword(s, lineEnd, "mtllib"))
+        chunk.libraries.push_back(RestOfLine(s + 6, lineEnd));
+    }
+    p = lineEnd + 1;
+  }
+}
+
+// file name of a map_ statement, after its options (-bm 0.5, -o u v w, -clamp on, ...)
+std::string MapPath(const char* p, const char* end)
+{
+  for (;;)
+  {
+    p = SkipSpace(p, end);
+    if (p >= end || *p != '-')
+      break;
+    while (p < end && !IsSpace(*p))
+      ++p;
+    // option arguments: numbers and on/off
+    for (;;)
+    {
+      const char* q = SkipSpace(p, end);
+      float number;
+      const char* n = q;
+      if (ObjLoader::ParseFloat(n, end, number) && (n == end || IsSpace(*n)))
+        p = n;
+      else if (Keyword(q, end, "on") || Keyword(q, end, "off"))
+        p = q + (q[1] == 'n' ? 2 : 3);
+      else
+        break;
+    }
+  }
+  return RestOfLine(p, end);
+}
+
+struct MtlMaterial
+{
+  std::vector<MaterialTextureRef> diffuse;
+  std::vector<MaterialTextureRef> specular;
+};
+
+// bytes of an .obj/.mtl: from the mounted asset pack, or mapped from disk
+struct SourceFile
+{
+  MappedFile mapped;
+  std::vector<uint8_t> packed;
+  const char* data = nullptr;
+  size_t size = 0;
+
+  bool Open(const std::string& path)
+  {
+    if (AssetPack::Instance().Read(path, packed))
+    {
+      data = reinterpret_cast<const char*>(packed.data());
+      size = packed.size();
+      return true;
+    }
+    if (!mapped.Open(path))
+      return false;
+    data = reinterpret_cast<const char*>(mapped.Data());
+    size = mapped.Size();
+    return true;
+  }
+};
+
+bool ParseMtl(const std::string& path, std::vector<MtlMaterial>& materials, std::unordered_map<std::string, unsigned>& names)
+{
+  SourceFile file;
+  if (!file.Open(path))
+  {
+    std::cout << "ERROR::OBJ::MTL_NOT_FOUND::" << path << std::endl;
+    return false;
+  }
+
+  const char* p = file.data;
+  const char* end = p + file.size;
+  MtlMaterial* current = nullptr;
+  while (p < end)
+  {
+    const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (!lineEnd)
+      lineEnd = end;
+    const char* s = SkipSpace(p, lineEnd);
+
+    if (Keyword(s, lineEnd, "newmtl"))
+    {
+      names[RestOfLine(s + 6, lineEnd)] = (unsigned)materials.size();
+      materials.emplace_back();
+      current = &materials.back();
+    }
+    else if (current && Keyword(s, lineEnd, "map_Kd"))
+      current->diffuse.push_back({"texture_diffuse", MapPath(s + 6, lineEnd)});
+    else if (current && Keyword(s, lineEnd, "map_Ks"))
+      current->specular.push_back({"texture_specular", MapPath(s + 6, lineEnd)});
+    p = lineEnd + 1;
+  }
+  return true;
+}
+
+} // namespace
+
+bool ObjLoader::ParseFloat(const char*& p, const char* end, float& value)
+{
+  static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char* s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+
+  // up to 19 significant digits in an integer, the rest only moves the exponent
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  for (; s < end && (unsigned)(*s - '0') <= 9; ++s)
+  {
+    any = true;
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + (*s - '0');
+      digits += mantissa != 0;
+    }
+    else
+      ++exponent;
+  }
+  if (s < end && *s == '.')
+  {
+    for (++s; s < end && (unsigned)(*s - '0') <= 9; ++s)
+    {
+      any = true;
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + (*s - '0');
+        digits += mantissa != 0;
+        --exponent;
+      }
+    }
+  }
+  if (!any)
+    return false;
+
+  if (s < end && (*s == 'e' || *s == 'E'))
+  {
+    const char* e = s + 1;
+    int64_t power;
+    if (ParseInt(e, end, power))
+    {
+      exponent += (int)std::max<int64_t>(-10000, std::min<int64_t>(10000, power));
+      s = e;
+    }
+  }
+
+  double result = (double)mantissa;
+  if (mantissa != 0)
+  {
+    if (exponent < 0 && exponent >= -22)
+      result /= powers[-exponent];
+    else if (exponent > 0 && exponent <= 22)
+      result *= powers[exponent];
+    else if (exponent != 0)
+      result *= std::pow(10.0, exponent);
+  }
+  value = (float)(negative ? -result : result);
+  p = s;
+  return true;
+}
+
+bool ObjLoader::Load(const std::string& path, ObjScene& scene, bool parallel)
+{
+  scene = ObjScene();
+  SourceFile file;
+  if (!file.Open(path))
+  {
+    std::cout << "ERROR::OBJ::FILE_NOT_FOUND::" << path << std::endl;
+    return false;
+  }
+  scene.files.push_back(path);
+
+  const char* data = file.data;
+  const size_t size = file.size;
+
+  // chunks start right after a newline
+  std::vector<size_t> bounds = {0};
+  for (size_t pos = ChunkSize; pos < size;)
+  {
+    const void* newline = std::memchr(data + pos, '\n', size - pos);
+    if (!newline)
+      break;
+    size_t next = static_cast<const char*>(newline) - data + 1;
+    bounds.push_back(next);
+    pos = next + ChunkSize;
+  }
+  bounds.push_back(size);
+
+  const size_t chunkCount = bounds.size() - 1;
+  std::vector<ObjChunk> chunks(chunkCount);
+  auto forEach = [parallel](size_t count, const std::function<void(size_t)>& fn)
+  {
+    if (parallel)
+      ThreadPool::Instance().ParallelFor(count, fn);
+    else
+      for (size_t i = 0; i < count; ++i)
+        fn(i);
+  };
+  forEach(chunkCount, [&](size_t i)
+  {
+    ParseChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+  });
+
+  // every chunk's vertices follow the previous chunks'
+  std::vector<size_t> positionBase(chunkCount), texCoordBase(chunkCount), normalBase(chunkCount);
+  size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+  for (size_t i = 0; i < chunkCount; ++i)
+  {
+    positionBase[i] = positionCount;
+    texCoordBase[i] = texCoordCount;
+    normalBase[i] = normalCount;
+    positionCount += chunks[i].positions.size();
+    texCoordCount += chunks[i].texCoords.size();
+    normalCount += chunks[i].normals.size();
+    scene.invalidFaces += chunks[i].invalidFaces;
+  }
+
+  std::vector<glm::vec3> positions(positionCount), normals(normalCount);
+  std::vector<glm::vec2> texCoords(texCoordCount);
+  forEach(chunkCount, [&](size_t i)
+  {
+    ObjChunk& chunk = chunks[i];
+    std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i]);
+    std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordBase[i]);
+    std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i]);
+    for (const auto& relative : chunk.relative)
+    {
+      ObjCorner& corner = chunk.corners[relative.first];
+      if (relative.second & 1)
+        corner.v += (int32_t)positionBase[i];
+      if (relative.second & 2)
+        corner.vt += (int32_t)texCoordBase[i];
+      if (relative.second & 4)
+        corner.vn += (int32_t)normalBase[i];
+    }
+    std::vector<glm::vec3>().swap(chunk.positions);
+    std::vector<glm::vec2>().swap(chunk.texCoords);
+    std::vector<glm::vec3>().swap(chunk.normals);
+  });
+
+  // materials of every mtllib, relative to the .obj
+  std::vector<MtlMaterial> mtlMaterials;
+  std::unordered_map<std::string, unsigned> materialNames;
+  const size_t slash = path.find_last_of("/\\");
+  const std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+  for (const auto& chunk : chunks)
+  {
+    for (const auto& library : chunk.libraries)
+    {
+      std::string libraryPath = directory + library;
+      if (std::find(scene.files.begin(), scene.files.end(), libraryPath) != scene.files.end())
+        continue;
+      if (ParseMtl(libraryPath, mtlMaterials, materialNames))
+        scene.files.push_back(libraryPath);
+    }
+  }
+  // faces before any (known) usemtl
+  const unsigned defaultMaterial = (unsigned)mtlMaterials.size();
+  bool defaultUsed = false;
+
+  // one mesh per object/group + material, in order of appearance
+  struct Segment
+  {
+    size_t chunk;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<std::vector<Segment>> segments;
+  std::vector<unsigned> meshMaterials;
+  std::unordered_map<std::string, size_t> meshIndex;
+  std::string object, group;
+  unsigned material = defaultMaterial;
+  auto emit = [&](size_t chunk, size_t begin, size_t end)
+  {
+    if (begin >= end)
+      return;
+    std::string key = object + '\x1f' + group + '\x1f' + std::to_string(material);
+    auto found = meshIndex.find(key);
+    size_t mesh;
+    if (found == meshIndex.end())
+    {
+      mesh = segments.size();
+      meshIndex.emplace(std::move(key), mesh);
+      segments.emplace_back();
+      meshMaterials.push_back(material);
+      defaultUsed |= material == defaultMaterial;
+    }
+    else
+      mesh = found->second;
+    segments[mesh].push_back({chunk, begin, end});
+  };
+  for (size_t c = 0; c < chunkCount; ++c)
+  {
+    size_t begin = 0;
+    for (const auto& statement : chunks[c].statements)
+    {
+      emit(c, begin, statement.corner);
+      begin = statement.corner;
+      if (statement.kind == ObjStatementKind::Object)
+      {
+        object = statement.name;
+        group.clear();
+      }
+      else if (statement.kind == ObjStatementKind::Group)
+        group = statement.name;
+      else
+      {
+        auto known = materialNames.find(statement.name);
+        material = known != materialNames.end() ? known->second : defaultMaterial;
+      }
+    }
+    emit(c, begin, chunks[c].corners.size());
+  }
+
+  scene.materials.resize(mtlMaterials.size() + (defaultUsed ? 1 : 0));
+  for (size_t m = 0; m < mtlMaterials.size(); ++m)
+  {
+    // diffuse maps first, then specular maps, like Model::CollectMaterialTextures
+    auto& refs = scene.materials[m];
+    refs = std::move(mtlMaterials[m].diffuse);
+    refs.insert(refs.end(), mtlMaterials[m].specular.begin(), mtlMaterials[m].specular.end());
+  }
+
+  // shared vertices per mesh
+  scene.meshes.resize(segments.size());
+  std::atomic<size_t> invalid{0};
+  forEach(segments.size(), [&](size_t m)
+  {
+    MeshData& mesh = scene.meshes[m];
+    mesh.materialIndex = meshMaterials[m];
+    size_t cornerCount = 0;
+    for (const auto& segment : segments[m])
+      cornerCount += segment.end - segment.begin;
+
+    // open addressing table of vertex index + 1, at most half full
+    size_t capacity = 16;
+    while (capacity < cornerCount * 2)
+      capacity <<= 1;
+    const size_t mask = capacity - 1;
+    std::vector<uint32_t> slots(capacity, 0);
+    std::vector<ObjCorner> keys;
+    mesh.indices.reserve(cornerCount);
+    size_t invalidTriangles = 0;
+    for (const auto& segment : segments[m])
+    {
+      const ObjCorner* corners = chunks[segment.chunk].corners.data();
+      for (size_t t = segment.begin; t + 2 < segment.end; t += 3)
+      {
+        bool valid = true;
+        for (size_t k = 0; k < 3 && valid; ++k)
+        {
+          const ObjCorner& c = corners[t + k];
+          valid = c.v >= 0 && (size_t)c.v < positionCount && c.vt < (int32_t)texCoordCount && c.vn < (int32_t)normalCount;
+        }
+        if (!valid)
+        {
+          ++invalidTriangles;
+          continue;
+        }
+        for (size_t k = 0; k < 3; ++k)
+        {
+          const ObjCorner& c = corners[t + k];
+          size_t slot = ObjCornerHash()(c) & mask;
+          while (slots[slot] && !(keys[slots[slot] - 1] == c))
+            slot = (slot + 1) & mask;
+          if (!slots[slot])
+          {
+            Vertex vertex;
+            vertex.Position = positions[c.v];
+            vertex.Normal = c.vn >= 0 ? normals[c.vn] : glm::vec3(0.0f);
+            vertex.TexCoords = c.vt >= 0 ? texCoords[c.vt] : glm::vec2(0.0f);
+            mesh.vertices.push_back(vertex);
+            keys.push_back(c);
+            slots[slot] = (uint32_t)mesh.vertices.size();
+          }
+          mesh.indices.push_back(slots[slot] - 1);
+        }
+      }
+    }
+    invalid += invalidTriangles;
+  });
+  scene.invalidFaces += invalid;
+  // groups that only had points/lines or broken faces
+  scene.meshes.erase(std::remove_if(scene.meshes.begin(), scene.meshes.end(), [](const MeshData& mesh) { return mesh.indices.empty(); }),
+    scene.meshes.end());
+
+  if (scene.invalidFaces)
+    std::cout << "ERROR::OBJ::" << path << ": skipped " << scene.invalidFaces << " faces with missing vertices" << std::endl;
+  return true;
+}
+
+}
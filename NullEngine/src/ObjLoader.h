@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "MeshCache.h"
+#include "MeshData.h"
+
+namespace NullEngine
+{
+
+// Result of ObjLoader::Load, the same shape Model builds from an Assimp scene
+struct ObjScene
+{
+  // one mesh per object/group and material, triangulated, UVs flipped like aiProcess_FlipUVs
+  std::vector<MeshData> meshes;
+  // diffuse then specular maps per material (MTL map_Kd / map_Ks), indexed by MeshData::materialIndex
+  std::vector<std::vector<MaterialTextureRef>> materials;
+  // every file read: the .obj first, then its .mtl libraries
+  std::vector<std::string> files;
+  // faces dropped because they referenced missing vertices
+  size_t invalidFaces = 0;
+};
+
+// Wavefront OBJ/MTL loader used by Model for .obj files instead of Assimp:
+//  - the file is memory mapped and cut into ~1 MB chunks at line boundaries, parsed in parallel
+//    (v/vt/vn/f/o/g/usemtl/mtllib; other statements are skipped)
+//  - faces are fan triangulated while parsing, v/vt/vn triples are deduplicated per mesh
+//    so the vertices come out shared, the same as MeshOptimizer's dedup would make them
+class ObjLoader
+{
+public:
+  static constexpr size_t ChunkSize = 1 << 20;
+
+  static bool Load(const std::string& path, ObjScene& scene, bool parallel = true);
+
+  // exposed for checking against strtod: decimal with optional sign, fraction and exponent,
+  // advances p past the number; false if there is none
+  static bool ParseFloat(const char*& p, const char* end, float& value);
+};
+
+}
@@ -0,0 +1,427 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <chrono>
+#include "Hash.h"
+#include "GLState.h"
+#include "Uniforms.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+using Clock = std::chrono::high_resolution_clock;
+
+constexpr uint64_t DepthMax = (1ull << 24) - 1;
+constexpr unsigned Unbound = ~0u;
+
+bool SameSamplers(const UniformHandle* a, unsigned aCount, const UniformHandle* b, unsigned bCount)
+{
+  if (aCount != bCount)
+    return false;
+  if (a == b)
+    return true;
+  if (!a || !b)
+    return false;
+  for (unsigned i = 0; i < aCount; ++i)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
+
+}
+
+// What the submission loop knows is bound. Uniforms are per program; programs are assumed to be in
+// the float vertex layout when a flush starts (Mesh::Draw and Finish leave them that way)
+struct RenderQueue::SubmitState
+{
+  struct Program
+  {
+    const Shader* shader = nullptr;
+    const UniformHandle* samplers = nullptr;
+    unsigned samplerCount = 0;
+    bool samplersSet = false;
+    bool modelSet = false;
+    glm::mat4 model = glm::mat4(1.0f);
+    bool quantized = false;
+    glm::vec3 posOffset = glm::vec3(0.0f);
+    glm::vec3 posScale = glm::vec3(1.0f);
+  };
+
+  std::unordered_map<unsigned, Program> programs;
+  const Shader* shader = nullptr;
+  unsigned vao = Unbound;
+  uint32_t material = Unbound;
+  unsigned activeUnit = Unbound;
+  unsigned cubeMap = Unbound;
+  // GL name bound to GL_TEXTURE_2D of each unit
+  std::vector<unsigned> units;
+};
+
+RenderStateCounts& RenderStateCounts::operator+=(const RenderStateCounts& other)
+{
+  programs += other.programs;
+  materials += other.materials;
+  textureBinds += other.textureBinds;
+  vaos += other.vaos;
+  uniforms += other.uniforms;
+  draws += other.draws;
+  return *this;
+}
+
+RenderQueueStats& RenderQueueStats::operator+=(const RenderQueueStats& other)
+{
+  items += other.items;
+  submitted += other.submitted;
+  pushOrder += other.pushOrder;
+  sortMs += other.sortMs;
+  return *this;
+}
+
+void RenderQueue::Begin(const glm::vec3& cameraPosition, const glm::vec3& cameraForward, float nearPlane, float farPlane)
+{
+  _cameraPosition = cameraPosition;
+  _cameraForward = glm::normalize(cameraForward);
+  _near = nearPlane;
+  _far = farPlane;
+}
+
+void RenderQueue::Push(RenderPass pass, const DrawItem& item, const glm::vec3& center)
+{
+  PassQueue& queue = _passes[(size_t)pass];
+  const uint32_t material = MaterialId(item);
+  const float depth = (glm::dot(center - _cameraPosition, _cameraForward) - _near) / (_far - _near);
+  queue.order.push_back({MakeKey(pass, item.shader->_ID, material, item.vao, depth), (uint32_t)queue.items.size()});
+  queue.items.push_back(item);
+  queue.materials.push_back(material);
+}
+
+uint64_t RenderQueue::MakeKey(RenderPass pass, unsigned program, unsigned material, unsigned vao, float depth)
+{
+  const uint64_t quantizedDepth = (uint64_t)(glm::clamp(depth, 0.0f, 1.0f) * (float)DepthMax);
+  const uint64_t state = ((uint64_t)(program & 0xFFF) << 28) | ((uint64_t)std::min(material, 0xFFFFu) << 12) | (vao & 0xFFF);
+  if (pass == RenderPass::Transparent)
+    return ((DepthMax - quantizedDepth) << 40) | state;
+  return (state << 24) | quantizedDepth;
+}
+
+void RenderQueue::RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+  const size_t n = entries.size();
+  if (n < 2)
+    return;
+
+  // histograms of all eight digits in one pass over the keys
+  size_t counts[8][256] = {};
+  for (const SortEntry& entry : entries)
+    for (int digit = 0; digit < 8; ++digit)
+      ++counts[digit][(entry.key >> (digit * 8)) & 0xFF];
+
+  scratch.resize(n);
+  SortEntry* src = entries.data();
+  SortEntry* dst = scratch.data();
+  for (int digit = 0; digit < 8; ++digit)
+  {
+    size_t* count = counts[digit];
+    const int shift = digit * 8;
+    // the same digit in every key (unused key bits, a single program, ...): nothing would move
+    if (count[(src[0].key >> shift) & 0xFF] == n)
+      continue;
+
+    size_t offset = 0;
+    for (size_t& bucket : counts[digit])
+    {
+      const size_t size = bucket;
+      bucket = offset;
+      offset += size;
+    }
+    for (size_t i = 0; i < n; ++i)
+      dst[count[(src[i].key >> shift) & 0xFF]++] = src[i];
+    std::swap(src, dst);
+  }
+  if (src != entries.data())
+    entries.swap(scratch);
+}
+
+uint32_t RenderQueue::MaterialId(const DrawItem& item)
+{
+  // the texture objects rather than their GL names, which change while textures stream in
+  uint64_t hash = HashBytes(&item.cubeMap, sizeof(item.cubeMap));
+  for (unsigned i = 0; i < item.textureCount; ++i)
+  {
+    const Texture* texture = item.textures[i].get();
+    hash = HashBytes(&texture, sizeof(texture), hash);
+  }
+
+  std::vector<uint32_t>& ids = _materialIds[hash];
+  for (uint32_t id : ids)
+  {
+    const MaterialRef& material = _materials[id];
+    if (material.cubeMap != item.cubeMap || material.textureCount != item.textureCount)
+      continue;
+    bool same = true;
+    for (unsigned i = 0; i < item.textureCount && same; ++i)
+      same = material.textures[i] == item.textures[i];
+    if (same)
+      return id;
+  }
+  const uint32_t id = (uint32_t)_materials.size();
+  _materials.push_back({item.textures, item.textureCount, item.cubeMap});
+  ids.push_back(id);
+  return id;
+}
+
+void RenderQueue::Flush(RenderQueueStats& stats)
+{
+  // what the push order would have needed, counted before the sort reorders it
+  RenderStateCounts pushOrder;
+  if (_sorting)
+  {
+    SubmitState counting;
+    for (size_t pass = 0; pass < (size_t)RenderPass::Count; ++pass)
+      Submit((RenderPass)pass, counting, false, pushOrder);
+    Finish(counting, false, pushOrder);
+
+    const auto start = Clock::now();
+    for (PassQueue& queue : _passes)
+      RadixSort(queue.order, _scratch);
+    stats.sortMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  RenderStateCounts submitted;
+  SubmitState state;
+  for (size_t pass = 0; pass < (size_t)RenderPass::Count; ++pass)
+  {
+    PassQueue& queue = _passes[pass];
+    if (queue.items.empty())
+      continue;
+    stats.items += queue.items.size();
+    BeginPass((RenderPass)pass);
+    Submit((RenderPass)pass, state, true, submitted);
+    EndPass((RenderPass)pass);
+  }
+  Finish(state, true, submitted);
+  GLState::Instance().BindVertexArray(0);
+  GLState::Instance().ActiveTexture(GL_TEXTURE0);
+
+  stats.submitted += submitted;
+  stats.pushOrder += _sorting ? pushOrder : submitted;
+
+  for (PassQueue& queue : _passes)
+  {
+    queue.items.clear();
+    queue.materials.clear();
+    queue.order.clear();
+  }
+  _materialIds.clear();
+  _materials.clear();
+}
+
+void RenderQueue::Submit(RenderPass pass, SubmitState& state, bool execute, RenderStateCounts& counts) const
+{
+  GLState& gl = GLState::Instance();
+  const PassQueue& queue = _passes[(size_t)pass];
+  for (const SortEntry& entry : queue.order)
+  {
+    const DrawItem& item = queue.items[entry.index];
+    const uint32_t material = queue.materials[entry.index];
+
+    if (state.shader != item.shader)
+    {
+      if (execute)
+        item.shader->Use();
+      state.shader = item.shader;
+      ++counts.programs;
+    }
+    SubmitState::Program& program = state.programs[item.shader->_ID];
+    program.shader = item.shader;
+
+    if (state.material != material)
+    {
+      state.material = material;
+      ++counts.materials;
+      // units already holding the texture (shared between materials) are only marked used
+      if (state.units.size() < item.textureCount)
+        state.units.resize(item.textureCount, Unbound);
+      for (unsigned i = 0; i < item.textureCount; ++i)
+      {
+        Texture& texture = *item.textures[i];
+        if (state.units[i] == texture.Id())
+        {
+          if (execute)
+            texture.MarkUsed();
+          continue;
+        }
+        if (execute)
+        {
+          if (state.activeUnit != i)
+            gl.ActiveTexture(GL_TEXTURE0 + i);
+          texture.Use();
+        }
+        state.activeUnit = i;
+        state.units[i] = texture.Id();
+        ++counts.textureBinds;
+      }
+      if (item.cubeMap != DrawItem::NoCubeMap && state.cubeMap != item.cubeMap)
+      {
+        if (execute)
+        {
+          if (state.activeUnit != 0)
+            gl.ActiveTexture(GL_TEXTURE0);
+          gl.BindTexture(GL_TEXTURE_CUBE_MAP, item.cubeMap);
+        }
+        state.activeUnit = 0;
+        state.cubeMap = item.cubeMap;
+        ++counts.textureBinds;
+      }
+    }
+
+    if (!program.samplersSet || !SameSamplers(program.samplers, program.samplerCount, item.samplers, item.textureCount))
+    {
+      for (unsigned i = 0; item.samplers && i < item.textureCount; ++i)
+      {
+        if (execute)
+          item.shader->SetInt(item.samplers[i], i);
+        ++counts.uniforms;
+      }
+      program.samplers = item.samplers;
+      program.samplerCount = item.textureCount;
+      program.samplersSet = true;
+    }
+
+    if (item.hasModel && (!program.modelSet || program.model != item.model))
+    {
+      if (execute)
+        item.shader->SetMat4(Uniforms::Model, item.model);
+      program.model = item.model;
+      program.modelSet = true;
+      ++counts.uniforms;
+    }
+
+    const glm::vec3 posOffset = item.quantized ? item.posOffset : glm::vec3(0.0f);
+    const glm::vec3 posScale = item.quantized ? item.posScale : glm::vec3(1.0f);
+    if (program.posOffset != posOffset)
+    {
+      if (execute)
+        item.shader->SetVec3(Uniforms::PosOffset, posOffset);
+      program.posOffset = posOffset;
+      ++counts.uniforms;
+    }
+    if (program.posScale != posScale)
+    {
+      if (execute)
+        item.shader->SetVec3(Uniforms::PosScale, posScale);
+      program.posScale = posScale;
+      ++counts.uniforms;
+    }
+    if (program.quantized != item.quantized)
+    {
+      if (execute)
+        item.shader->SetBool(Uniforms::OctNormals, item.quantized);
+      program.quantized = item.quantized;
+      ++counts.uniforms;
+    }
+
+    if (state.vao != item.vao)
+    {
+      if (execute)
+        gl.BindVertexArray(item.vao);
+      state.vao = item.vao;
+      ++counts.vaos;
+    }
+
+    ++counts.draws;
+    if (!execute)
+      continue;
+    if (item.runs > 0)
+      glMultiDrawElements(item.mode, item.runCounts, item.indexType, item.runOffsets, item.runs);
+    else if (item.indexType == 0 && item.instances > 1)
+      glDrawArraysInstanced(item.mode, item.first, item.count, item.instances);
+    else if (item.indexType == 0)
+      glDrawArrays(item.mode, item.first, item.count);
+    else if (item.instances > 1)
+      glDrawElementsInstanced(item.mode, item.count, item.indexType, item.indexOffset, item.instances);
+    else
+      glDrawElements(item.mode, item.count, item.indexType, item.indexOffset);
+  }
+}
+
+void RenderQueue::Finish(SubmitState& state, bool execute, RenderStateCounts& counts)
+{
+  for (auto& [id, program] : state.programs)
+  {
+    if (!program.quantized && program.posOffset == glm::vec3(0.0f) && program.posScale == glm::vec3(1.0f))
+      continue;
+    if (execute)
+    {
+      program.shader->Use();
+      program.shader->SetVec3(Uniforms::PosOffset, glm::vec3(0.0f));
+      program.shader->SetVec3(Uniforms::PosScale, glm::vec3(1.0f));
+      program.shader->SetBool(Uniforms::OctNormals, false);
+    }
+    ++counts.programs;
+    counts.uniforms += 3;
+  }
+}
+
+void RenderQueue::BeginPass(RenderPass pass)
+{
+  GLState& gl = GLState::Instance();
+  switch (pass)
+  {
+  case RenderPass::Background:
+    gl.DepthMask(GL_FALSE);
+    gl.StencilMask(0x00);
+    break;
+  case RenderPass::Opaque:
+    gl.StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    gl.StencilFunc(GL_ALWAYS, 1, 0xFF);
+    gl.StencilMask(0xFF);
+    break;
+  case RenderPass::Highlight:
+    gl.StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    gl.StencilFunc(GL_NOTEQUAL, 1, 0xFF);
+    gl.StencilMask(0x00);
+    gl.Disable(GL_DEPTH_TEST);
+    break;
+  case RenderPass::Transparent:
+    gl.Enable(GL_BLEND);
+    gl.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl.DepthMask(GL_FALSE);
+    gl.StencilMask(0x00);
+    break;
+  default:
+    break;
+  }
+}
+
+void RenderQueue::EndPass(RenderPass pass)
+{
+  GLState& gl = GLState::Instance();
+  // the state the rest of the frame draws with
+  switch (pass)
+  {
+  case RenderPass::Background:
+    gl.DepthMask(GL_TRUE);
+    gl.StencilMask(0xFF);
+    break;
+  case RenderPass::Opaque:
+    gl.StencilFunc(GL_ALWAYS, 0, 0xFF);
+    break;
+  case RenderPass::Highlight:
+    gl.StencilMask(0xFF);
+    gl.StencilFunc(GL_ALWAYS, 0, 0xFF);
+    gl.Enable(GL_DEPTH_TEST);
+    break;
+  case RenderPass::Transparent:
+    gl.Disable(GL_BLEND);
+    gl.DepthMask(GL_TRUE);
+    gl.StencilMask(0xFF);
+    break;
+  default:
+    break;
+  }
+}
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Texture.h"
+
+namespace NullEngine
+{
+
+// Passes of a RenderQueue, submitted in this order. Each sets its own depth/stencil/blend state:
+//  - Background: no depth or stencil writes (skybox)
+//  - Opaque: writes stencil 1 where it draws, sorted by state then front to back
+//  - Highlight: only where the stencil is not 1, no depth test (outlines of scaled up models)
+//  - Transparent: alpha blended, no depth writes, back to front
+enum class RenderPass : uint8_t
+{
+  Background,
+  Opaque,
+  Highlight,
+  Transparent,
+  Count
+};
+
+// One draw: the state it needs and its geometry. Pointers must stay valid until RenderQueue::Flush.
+struct DrawItem
+{
+  static constexpr unsigned NoCubeMap = ~0u;
+
+  Shader* shader = nullptr;
+  unsigned vao = 0;
+  // textures bound to units 0.. through Use() (so TextureResidency sees them) and the sampler uniform
+  // pointed at each unit
+  const std::shared_ptr<Texture>* textures = nullptr;
+  const UniformHandle* samplers = nullptr;
+  unsigned textureCount = 0;
+  // GL name bound to unit 0's cube map target (0 unbinds), NoCubeMap = leave it
+  unsigned cubeMap = NoCubeMap;
+
+  // glDrawArrays(mode, first, count) if indexType is 0, glDrawElements(Instanced) otherwise
+  GLenum mode = GL_TRIANGLES;
+  GLenum indexType = 0;
+  GLint first = 0;
+  GLsizei count = 0;
+  const void* indexOffset = nullptr;
+  GLsizei instances = 1;
+  // glMultiDrawElements runs (visible meshlets), used instead of count/indexOffset when runs > 0
+  const GLsizei* runCounts = nullptr;
+  const void* const* runOffsets = nullptr;
+  GLsizei runs = 0;
+
+  // "model" uniform, not set if hasModel is false
+  glm::mat4 model = glm::mat4(1.0f);
+  bool hasModel = true;
+  // VertexFormat::Quantized: posOffset/posScale/octNormals uniforms, the float layout's otherwise
+  bool quantized = false;
+  glm::vec3 posOffset = glm::vec3(0.0f);
+  glm::vec3 posScale = glm::vec3(1.0f);
+};
+
+// GL state set while submitting
+struct RenderStateCounts
+{
+  size_t programs = 0;
+  // texture sets switched, and glBindTexture calls they needed
+  size_t materials = 0;
+  size_t textureBinds = 0;
+  size_t vaos = 0;
+  size_t uniforms = 0;
+  size_t draws = 0;
+
+  size_t Total() const { return programs + textureBinds + vaos + uniforms; }
+  RenderStateCounts& operator+=(const RenderStateCounts& other);
+};
+
+struct RenderQueueStats
+{
+  size_t items = 0;
+  // what was submitted, and what the same items need in the order they were pushed
+  RenderStateCounts submitted;
+  RenderStateCounts pushOrder;
+  double sortMs = 0.0;
+
+  RenderQueueStats& operator+=(const RenderQueueStats& other);
+};
+
+// Collects the draws of a view and submits them sorted by a 64-bit key per pass, so the submission
+// loop only has to change the state that differs from the previous item. Key layout (high to low bits):
+//  - Background/Opaque/Highlight: program 12 | material 16 | VAO 12 | depth 24 (front to back)
+//  - Transparent: inverted depth 24 (back to front) | program 12 | material 16 | VAO 12
+// Program and VAO names are truncated (collisions only cost a state change), materials are numbered
+// per flush by the textures they bind. GL thread.
+class RenderQueue
+{
+public:
+  struct SortEntry
+  {
+    uint64_t key;
+    uint32_t index;
+  };
+
+  // camera of the following pushes; depth in the keys is the distance along forward between the planes
+  void Begin(const glm::vec3& cameraPosition, const glm::vec3& cameraForward, float nearPlane, float farPlane);
+  // center: world position the item is depth sorted by
+  void Push(RenderPass pass, const DrawItem& item, const glm::vec3& center);
+  // sorts each pass (if sorting is on), submits the passes in order and empties the queue;
+  // adds this flush to stats. Leaves the default pass state, no VAO bound and unit 0 active
+  void Flush(RenderQueueStats& stats);
+
+  // off: items are submitted in push order, still without redundant state changes
+  void SetSorting(bool sorting) { _sorting = sorting; }
+  bool Sorting() const { return _sorting; }
+
+  static uint64_t MakeKey(RenderPass pass, unsigned program, unsigned material, unsigned vao, float depth);
+  // stable LSD radix sort on the keys, 8 bits per pass; digits every key shares are skipped
+  static void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+private:
+  struct PassQueue
+  {
+    std::vector<DrawItem> items;
+    // material number of each item
+    std::vector<uint32_t> materials;
+    std::vector<SortEntry> order;
+  };
+  // textures a material number stands for
+  struct MaterialRef
+  {
+    const std::shared_ptr<Texture>* textures;
+    unsigned textureCount;
+    unsigned cubeMap;
+  };
+  struct SubmitState;
+
+  PassQueue _passes[(size_t)RenderPass::Count];
+  std::vector<SortEntry> _scratch;
+  // texture set hash -> material numbers with that hash (compared on lookup), reset every flush
+  std::unordered_map<uint64_t, std::vector<uint32_t>> _materialIds;
+  std::vector<MaterialRef> _materials;
+  glm::vec3 _cameraPosition = glm::vec3(0.0f);
+  glm::vec3 _cameraForward = glm::vec3(0.0f, 0.0f, -1.0f);
+  float _near = 0.1f;
+  float _far = 100.0f;
+  bool _sorting = true;
+
+  uint32_t MaterialId(const DrawItem& item);
+  // walks the items of a pass in order, applying what differs from state; execute = false only counts
+  void Submit(RenderPass pass, SubmitState& state, bool execute, RenderStateCounts& counts) const;
+  // puts the programs the walk left in the quantized layout back to the float one
+  static void Finish(SubmitState& state, bool execute, RenderStateCounts& counts);
+  static void BeginPass(RenderPass pass);
+  static void EndPass(RenderPass pass);
+};
+
+}
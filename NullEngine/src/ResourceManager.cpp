@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <iostream>
+#include "GLState.h"
+#include "ResourceManager.h"
+#include "TextureRegistry.h"
+#include "TextureResidency.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+template <typename T>
+bool Finished(const std::future<T>& future)
+{
+  return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+}
+
+// ---------------------------------------------------------------- resources
+
+void Resource::Request(bool prefetch)
+{
+  if (_state != ResourceState::Declared)
+    return;
+  _onDemand = !prefetch;
+  _state = ResourceState::Loading;
+  ResourceManager::Instance().Started(prefetch);
+  StartLoad();
+}
+
+void TextureResource::StartLoad()
+{
+  // async: the streamer decodes on a worker and Id() is its placeholder until the upload
+  texture = TextureRegistry::Instance().Acquire(_name, _path, _flip, _usage, true);
+  Poll();
+}
+
+void TextureResource::Poll()
+{
+  if (texture->State() == TextureState::Ready)
+    _state = ResourceState::Ready;
+  else if (texture->State() == TextureState::Failed)
+    _state = ResourceState::Failed;
+}
+
+void CubeMapResource::StartLoad()
+{
+  std::shared_ptr<CubeMap> decoding = cubeMap;
+  _decoded = ThreadPool::Instance().Submit([decoding]() { return decoding->Decode(); });
+}
+
+void CubeMapResource::Poll()
+{
+  if (!Finished(_decoded))
+    return;
+  if (!_decoded.get() || !cubeMap->Load())
+  {
+    std::cout << "ERROR::RESOURCE::CUBEMAP_LOAD_FAILED " << _name << std::endl;
+    _state = ResourceState::Failed;
+    return;
+  }
+  TextureResidency::Instance().Track(cubeMap);
+  _state = ResourceState::Ready;
+}
+
+void ModelResource::StartLoad()
+{
+  // texture compression is set by the time anything is drawn, so the texture requests can go along
+  Model* loading = model.get();
+  _prepared = ThreadPool::Instance().Submit([loading]()
+  {
+    if (!loading->Prepare())
+      return false;
+    loading->PrepareTextures();
+    return true;
+  });
+}
+
+void ModelResource::Poll()
+{
+  if (!Finished(_prepared))
+    return;
+  if (!_prepared.get())
+  {
+    std::cout << "ERROR::RESOURCE::MODEL_LOAD_FAILED " << _name << std::endl;
+    _state = ResourceState::Failed;
+    return;
+  }
+  model->Upload();
+  _state = ResourceState::Ready;
+}
+
+ModelResource::~ModelResource()
+{
+  // the worker still uses the model
+  if (_prepared.valid())
+    _prepared.wait();
+}
+
+// ---------------------------------------------------------------- handles
+
+void TextureHandle::Use()
+{
+  if (!_resource)
+    return;
+  _resource->Request();
+  _resource->texture->Use();
+}
+
+std::shared_ptr<Texture> TextureHandle::Get() const
+{
+  return _resource ? _resource->texture : nullptr;
+}
+
+ResourceState TextureHandle::State() const
+{
+  return _resource ? _resource->State() : ResourceState::Failed;
+}
+
+void CubeMapHandle::Use()
+{
+  if (!_resource)
+    return;
+  _resource->Request();
+  if (_resource->State() == ResourceState::Ready)
+    _resource->cubeMap->Use();
+  else
+    GLState::Instance().BindTexture(GL_TEXTURE_CUBE_MAP, ResourceManager::Instance().PlaceholderCubeMap());
+}
+
+unsigned CubeMapHandle::Id()
+{
+  if (!_resource)
+    return 0;
+  _resource->Request();
+  if (_resource->State() != ResourceState::Ready)
+    return ResourceManager::Instance().PlaceholderCubeMap();
+  _resource->cubeMap->MarkUsed();
+  return _resource->cubeMap->Id();
+}
+
+ResourceState CubeMapHandle::State() const
+{
+  return _resource ? _resource->State() : ResourceState::Failed;
+}
+
+Model* ModelHandle::Acquire()
+{
+  if (!_resource)
+    return nullptr;
+  _resource->Request();
+  return _resource->State() == ResourceState::Ready ? _resource->model.get() : nullptr;
+}
+
+const Model* ModelHandle::Resident() const
+{
+  return _resource && _resource->State() == ResourceState::Ready ? _resource->model.get() : nullptr;
+}
+
+ResourceState ModelHandle::State() const
+{
+  return _resource ? _resource->State() : ResourceState::Failed;
+}
+
+// ---------------------------------------------------------------- manager
+
+ResourceManager& ResourceManager::Instance()
+{
+  static ResourceManager manager;
+  return manager;
+}
+
+TextureHandle ResourceManager::DeclareTexture(const std::string& name, const std::string& path, bool flip, TextureUsage usage)
+{
+  TextureHandle handle;
+  handle._resource = std::make_shared<TextureResource>(name, path, flip, usage);
+  std::lock_guard<std::mutex> lock(_mutex);
+  _resources.push_back(handle._resource);
+  return handle;
+}
+
+CubeMapHandle ResourceManager::DeclareCubeMap(const std::string& name, const std::vector<std::string>& faces)
+{
+  CubeMapHandle handle;
+  handle._resource = std::make_shared<CubeMapResource>(name, faces);
+  std::lock_guard<std::mutex> lock(_mutex);
+  _resources.push_back(handle._resource);
+  return handle;
+}
+
+ModelHandle ResourceManager::DeclareModel(const std::string& path, const char* texturesPath, bool flippedTextures, unsigned flags)
+{
+  ModelHandle handle;
+  handle._resource = std::make_shared<ModelResource>(path, texturesPath, flippedTextures, flags);
+  std::lock_guard<std::mutex> lock(_mutex);
+  _resources.push_back(handle._resource);
+  return handle;
+}
+
+void ResourceManager::Prefetch(const TextureHandle& handle)
+{
+  Hint(handle._resource);
+}
+
+void ResourceManager::Prefetch(const CubeMapHandle& handle)
+{
+  Hint(handle._resource);
+}
+
+void ResourceManager::Prefetch(const ModelHandle& handle)
+{
+  Hint(handle._resource);
+}
+
+void ResourceManager::Hint(const std::shared_ptr<Resource>& resource)
+{
+  if (!resource)
+    return;
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (std::find(_prefetch.begin(), _prefetch.end(), resource) == _prefetch.end())
+    _prefetch.push_back(resource);
+}
+
+void ResourceManager::Update(double lastFrameMs)
+{
+  std::vector<std::shared_ptr<Resource>> resources;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    resources = _resources;
+  }
+
+  bool onDemandLoading = false;
+  for (const auto& resource : resources)
+  {
+    if (resource->State() != ResourceState::Loading)
+      continue;
+    resource->Poll();
+    if (resource->State() == ResourceState::Loading && resource->OnDemand())
+      onDemandLoading = true;
+  }
+
+  if (onDemandLoading || lastFrameMs >= IdleFrameMs)
+    return;
+
+  // one prefetch per idle frame, skipping what a first use already loaded
+  std::shared_ptr<Resource> next;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (!_prefetch.empty() && !next)
+    {
+      if (_prefetch.front()->State() == ResourceState::Declared)
+        next = _prefetch.front();
+      _prefetch.erase(_prefetch.begin());
+    }
+  }
+  if (next)
+    next->Request(true);
+}
+
+void ResourceManager::Started(bool prefetch)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  ++(prefetch ? _prefetchLoads : _onDemandLoads);
+}
+
+void ResourceManager::Shutdown()
+{
+  // the handles keep their resources, in flight model loads are waited for when the last one goes
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _resources.clear();
+    _prefetch.clear();
+  }
+  if (_placeholderCube)
+    GLState::Instance().DeleteTextures(1, &_placeholderCube);
+  _placeholderCube = 0;
+}
+
+ResourceStats ResourceManager::Stats() const
+{
+  ResourceStats stats;
+  std::lock_guard<std::mutex> lock(_mutex);
+  stats.declared = _resources.size();
+  for (const auto& resource : _resources)
+  {
+    switch (resource->State())
+    {
+      case ResourceState::Ready: ++stats.ready; break;
+      case ResourceState::Loading: ++stats.loading; break;
+      case ResourceState::Failed: ++stats.failed; break;
+      default: break;
+    }
+  }
+  stats.onDemandLoads = _onDemandLoads;
+  stats.prefetchLoads = _prefetchLoads;
+  return stats;
+}
+
+void ResourceManager::List(std::vector<std::pair<std::string, ResourceState>>& out) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  out.clear();
+  for (const auto& resource : _resources)
+    out.emplace_back(resource->Name(), resource->State());
+}
+
+unsigned ResourceManager::PlaceholderCubeMap()
+{
+  if (_placeholderCube)
+    return _placeholderCube;
+
+  const unsigned char black[4] = {0, 0, 0, 255};
+  glGenTextures(1, &_placeholderCube);
+  GLState::Instance().BindTexture(GL_TEXTURE_CUBE_MAP, _placeholderCube);
+  for (unsigned face = 0; face < 6; ++face)
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  return _placeholderCube;
+}
+
+}
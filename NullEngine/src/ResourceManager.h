@@ -0,0 +1,218 @@
+#pragma once
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Model.h"
+#include "Texture.h"
+
+namespace NullEngine
+{
+
+enum class ResourceState
+{
+  Declared,  // nothing loaded yet
+  Loading,
+  Ready,
+  Failed
+};
+
+class Resource;
+class TextureResource;
+class CubeMapResource;
+class ModelResource;
+
+// Handles to assets declared with ResourceManager. Copies share the resource; a default
+// constructed handle is empty. The first Use/Acquire starts the load, until it is done
+// the handle stands in with a placeholder (or draws nothing, for models).
+
+class TextureHandle
+{
+public:
+  // binds the texture to the active unit, TextureStreamer's 1x1 placeholder until it is uploaded
+  void Use();
+  // the texture, null until the load started
+  std::shared_ptr<Texture> Get() const;
+  ResourceState State() const;
+  explicit operator bool() const { return _resource != nullptr; }
+
+private:
+  friend class ResourceManager;
+  std::shared_ptr<TextureResource> _resource;
+};
+
+class CubeMapHandle
+{
+public:
+  // binds the cube map, a black 1x1 one while the faces decode
+  void Use();
+  // what Use binds, without binding it (for a RenderQueue item); starts the load and marks it used
+  unsigned Id();
+  ResourceState State() const;
+  explicit operator bool() const { return _resource != nullptr; }
+
+private:
+  friend class ResourceManager;
+  std::shared_ptr<CubeMapResource> _resource;
+};
+
+class ModelHandle
+{
+public:
+  // starts the load; the model once it is uploaded, null until then
+  Model* Acquire();
+  // the model if it is uploaded, never starts a load
+  const Model* Resident() const;
+  ResourceState State() const;
+  explicit operator bool() const { return _resource != nullptr; }
+
+private:
+  friend class ResourceManager;
+  std::shared_ptr<ModelResource> _resource;
+};
+
+struct ResourceStats
+{
+  size_t declared = 0;
+  size_t ready = 0;
+  size_t loading = 0;
+  size_t failed = 0;
+  // loads started by a first use, and by an idle-time prefetch hint
+  size_t onDemandLoads = 0;
+  size_t prefetchLoads = 0;
+};
+
+// Assets declared up front and loaded the first time they are used:
+//  - textures go through TextureRegistry + TextureStreamer (decode on workers, budgeted upload)
+//  - cube maps decode their faces on the ThreadPool, Update() uploads them
+//  - models (ModelLoad_Deferred) Prepare on the ThreadPool, Update() uploads them
+// Prefetch() hints load assets early, but only in frames with time to spare and while no
+// on-demand load is running, so they never compete with what the frame actually needs.
+class ResourceManager
+{
+public:
+  static ResourceManager& Instance();
+
+  // any thread; nothing is read until the first use or prefetch
+  TextureHandle DeclareTexture(const std::string& name, const std::string& path, bool flip, TextureUsage usage);
+  CubeMapHandle DeclareCubeMap(const std::string& name, const std::vector<std::string>& faces);
+  // flags as for Model, ModelLoad_Deferred is added
+  ModelHandle DeclareModel(const std::string& path, const char* texturesPath = nullptr, bool flippedTextures = false,
+    unsigned flags = ModelLoad_Default);
+
+  // idle-time load hints, handled in order
+  void Prefetch(const TextureHandle& handle);
+  void Prefetch(const CubeMapHandle& handle);
+  void Prefetch(const ModelHandle& handle);
+
+  // GL thread, once per frame: finishes loads whose worker part is done and, if lastFrameMs
+  // stayed below IdleFrameMs and nothing is loading on demand, starts the next prefetch
+  void Update(double lastFrameMs);
+  // GL thread, before the context is destroyed
+  void Shutdown();
+
+  // a frame this much shorter than 60 Hz counts as idle
+  static constexpr double IdleFrameMs = 12.0;
+
+  ResourceStats Stats() const;
+  // name and state of every declared resource, declaration order
+  void List(std::vector<std::pair<std::string, ResourceState>>& out) const;
+  // black 1x1 cube map, GL thread
+  unsigned PlaceholderCubeMap();
+
+private:
+  friend class Resource;
+  ResourceManager() = default;
+
+  void Hint(const std::shared_ptr<Resource>& resource);
+  void Started(bool prefetch);
+
+  mutable std::mutex _mutex;
+  std::vector<std::shared_ptr<Resource>> _resources;
+  std::vector<std::shared_ptr<Resource>> _prefetch;
+  size_t _onDemandLoads = 0;
+  size_t _prefetchLoads = 0;
+  unsigned _placeholderCube = 0;
+};
+
+// ---------------------------------------------------------------- resources
+
+class Resource
+{
+public:
+  explicit Resource(const std::string& name) : _name(name) {}
+  virtual ~Resource() = default;
+
+  const std::string& Name() const { return _name; }
+  ResourceState State() const { return _state; }
+  // started by a first use rather than a prefetch hint
+  bool OnDemand() const { return _onDemand; }
+  // GL thread; starts the load if it did not start yet
+  void Request(bool prefetch = false);
+  // GL thread, every frame while loading
+  virtual void Poll() {}
+
+protected:
+  virtual void StartLoad() = 0;
+
+  std::string _name;
+  ResourceState _state = ResourceState::Declared;
+  bool _onDemand = false;
+};
+
+class TextureResource : public Resource
+{
+public:
+  TextureResource(const std::string& name, const std::string& path, bool flip, TextureUsage usage)
+    :
+    Resource(name), _path(path), _flip(flip), _usage(usage) {}
+
+  void Poll() override;
+  std::shared_ptr<Texture> texture;
+
+protected:
+  void StartLoad() override;
+
+private:
+  std::string _path;
+  bool _flip;
+  TextureUsage _usage;
+};
+
+class CubeMapResource : public Resource
+{
+public:
+  CubeMapResource(const std::string& name, const std::vector<std::string>& faces)
+    :
+    Resource(name), cubeMap(std::make_shared<CubeMap>(name, faces)) {}
+
+  void Poll() override;
+  std::shared_ptr<CubeMap> cubeMap;
+
+protected:
+  void StartLoad() override;
+
+private:
+  std::future<bool> _decoded;
+};
+
+class ModelResource : public Resource
+{
+public:
+  ModelResource(const std::string& path, const char* texturesPath, bool flippedTextures, unsigned flags)
+    :
+    Resource(path), model(std::make_unique<Model>(path.c_str(), texturesPath, flippedTextures, flags | ModelLoad_Deferred)) {}
+  ~ModelResource() override;
+
+  void Poll() override;
+  std::unique_ptr<Model> model;
+
+protected:
+  void StartLoad() override;
+
+private:
+  std::future<bool> _prepared;
+};
+
+}
@@ -1,49 +1,78 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <glm/glm.hpp>
+#include "GLState.h"
 #include "Shader.h"
+#include "Vfs.h"
 
 namespace NullEngine
 {
 
+namespace
+{
+
+// through the Vfs (asset pack or disk); the stream read below only runs when that failed
+// and throws std::ifstream::failure with the reason
+std::string ReadShaderFile(const char* path)
+{
+    std::string code;
+    if (Vfs::Instance().ReadText(path, code))
+        return code;
+
+    std::ifstream file;
+    // ensure ifstream objects can throw exceptions:
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    file.open(path);
+    std::stringstream stream;
+    // read file's buffer contents into streams
+    stream << file.rdbuf();
+    file.close();
+    return stream.str();
+}
+
+// rewrites value (read back with glGetUniform) to location; false for types it does not handle
+bool UploadUniform(GLint location, GLenum type, const GLfloat* f, const GLint* i)
+{
+    switch (type)
+    {
+    case GL_FLOAT: glUniform1fv(location, 1, f); return true;
+    case GL_FLOAT_VEC2: glUniform2fv(location, 1, f); return true;
+    case GL_FLOAT_VEC3: glUniform3fv(location, 1, f); return true;
+    case GL_FLOAT_VEC4: glUniform4fv(location, 1, f); return true;
+    case GL_FLOAT_MAT3: glUniformMatrix3fv(location, 1, GL_FALSE, f); return true;
+    case GL_FLOAT_MAT4: glUniformMatrix4fv(location, 1, GL_FALSE, f); return true;
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_CUBE:
+        glUniform1iv(location, 1, i);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+UniformUploadStats Shader::_uploadStats;
+
 Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geomShPath)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
     std::string fragmentCode;
     std::string geometryShaderCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    std::ifstream gShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     try
     {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream, gShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-
+        vertexCode = ReadShaderFile(vertexPath);
+        fragmentCode = ReadShaderFile(fragmentPath);
         if (geomShPath)
-        {
-          gShaderFile.open(geomShPath);
-          gShaderStream << gShaderFile.rdbuf();
-          gShaderFile.close();
-
-          geometryShaderCode = gShaderStream.str();
-        }
+            geometryShaderCode = ReadShaderFile(geomShPath);
     }
     catch (std::ifstream::failure e)
     {
@@ -60,75 +89,232 @@ Shader::Shader(const std::string& vertexCode, const std::string& fragmentCode, c
 
 Shader::~Shader()
 {
-    glDeleteProgram(_ID);
+    GLState::Instance().DeleteProgram(_ID);
 }
 
 void Shader::Use() const
 {
-    glUseProgram(_ID);
+    GLState::Instance().UseProgram(_ID);
 }
 
-void Shader::SetBool(const std::string& name, bool value) const
+void Shader::SetBool(UniformHandle uniform, bool value) const
 {
-    glUniform1i(glGetUniformLocation(_ID, name.c_str()), (int)value);
+    SetInt(uniform, (int)value);
 }
 
-void Shader::SetInt(const std::string& name, int value) const
+void Shader::SetInt(UniformHandle uniform, int value) const
 {
-    glUniform1i(glGetUniformLocation(_ID, name.c_str()), value);
+    if (const ShaderUniform* entry = Update(uniform, &value, sizeof(value)))
+        glProgramUniform1i(_ID, entry->location, value);
 }
 
-void Shader::SetFloat(const std::string& name, float value) const
+void Shader::SetFloat(UniformHandle uniform, float value) const
 {
-    glUniform1f(glGetUniformLocation(_ID, name.c_str()), value);
+    if (const ShaderUniform* entry = Update(uniform, &value, sizeof(value)))
+        glProgramUniform1f(_ID, entry->location, value);
 }
 
-void Shader::SetFloat4(const std::string& name, float* value) const
+void Shader::SetFloat4(UniformHandle uniform, float* value) const
 {
-    glUniform4f(glGetUniformLocation(_ID, name.c_str()), value[0], value[1], value[2], value[3]);
+    if (const ShaderUniform* entry = Update(uniform, value, sizeof(float) * 4))
+        glProgramUniform4fv(_ID, entry->location, 1, value);
 }
 
 // ------------------------------------------------------------------------
-void Shader::SetVec2(const std::string& name, const glm::vec2& value) const
+void Shader::SetVec2(UniformHandle uniform, const glm::vec2& value) const
 {
-  glUniform2fv(glGetUniformLocation(_ID, name.c_str()), 1, &value[0]);
+  if (const ShaderUniform* entry = Update(uniform, &value, sizeof(value)))
+    glProgramUniform2fv(_ID, entry->location, 1, &value[0]);
 }
-void Shader::SetVec2(const std::string& name, float x, float y) const
+void Shader::SetVec2(UniformHandle uniform, float x, float y) const
 {
-  glUniform2f(glGetUniformLocation(_ID, name.c_str()), x, y);
+  SetVec2(uniform, glm::vec2(x, y));
 }
 // ------------------------------------------------------------------------
-void Shader::SetVec3(const std::string& name, const glm::vec3& value) const
+void Shader::SetVec3(UniformHandle uniform, const glm::vec3& value) const
 {
-  glUniform3fv(glGetUniformLocation(_ID, name.c_str()), 1, &value[0]);
+  if (const ShaderUniform* entry = Update(uniform, &value, sizeof(value)))
+    glProgramUniform3fv(_ID, entry->location, 1, &value[0]);
 }
-void Shader::SetVec3(const std::string& name, float x, float y, float z) const
+void Shader::SetVec3(UniformHandle uniform, float x, float y, float z) const
 {
-  glUniform3f(glGetUniformLocation(_ID, name.c_str()), x, y, z);
+  SetVec3(uniform, glm::vec3(x, y, z));
 }
 // ------------------------------------------------------------------------
-void Shader::SetVec4(const std::string& name, const glm::vec4& value) const
+void Shader::SetVec4(UniformHandle uniform, const glm::vec4& value) const
 {
-  glUniform4fv(glGetUniformLocation(_ID, name.c_str()), 1, &value[0]);
+  if (const ShaderUniform* entry = Update(uniform, &value, sizeof(value)))
+    glProgramUniform4fv(_ID, entry->location, 1, &value[0]);
 }
-void Shader::SetVec4(const std::string& name, float x, float y, float z, float w) const
+void Shader::SetVec4(UniformHandle uniform, float x, float y, float z, float w) const
 {
-  glUniform4f(glGetUniformLocation(_ID, name.c_str()), x, y, z, w);
+  SetVec4(uniform, glm::vec4(x, y, z, w));
 }
 // ------------------------------------------------------------------------
-void Shader::SetMat2(const std::string& name, const glm::mat2& mat) const
+void Shader::SetMat2(UniformHandle uniform, const glm::mat2& mat) const
 {
-  glUniformMatrix2fv(glGetUniformLocation(_ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+  if (const ShaderUniform* entry = Update(uniform, &mat, sizeof(mat)))
+    glProgramUniformMatrix2fv(_ID, entry->location, 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
-void Shader::SetMat3(const std::string& name, const glm::mat3& mat) const
+void Shader::SetMat3(UniformHandle uniform, const glm::mat3& mat) const
 {
-  glUniformMatrix3fv(glGetUniformLocation(_ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+  if (const ShaderUniform* entry = Update(uniform, &mat, sizeof(mat)))
+    glProgramUniformMatrix3fv(_ID, entry->location, 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
-void Shader::SetMat4(const std::string& name, const glm::mat4& mat) const
+void Shader::SetMat4(UniformHandle uniform, const glm::mat4& mat) const
+{
+  if (const ShaderUniform* entry = Update(uniform, &mat, sizeof(mat)))
+    glProgramUniformMatrix4fv(_ID, entry->location, 1, GL_FALSE, &mat[0][0]);
+}
+
+const ShaderUniform* Shader::Update(UniformHandle uniform, const void* value, size_t size) const
+{
+  auto it = std::lower_bound(_uniforms.begin(), _uniforms.end(), uniform.Hash(),
+    [](const ShaderUniform& entry, uint64_t hash) { return entry.hash < hash; });
+  if (it == _uniforms.end() || it->hash != uniform.Hash() || it->location < 0)
+  {
+    ++_uploadStats.inactive;
+    return nullptr;
+  }
+
+  UniformShadow& shadow = _shadows[it->shadow];
+  if (shadow.size == size && std::memcmp(shadow.value, value, size) == 0)
+  {
+    ++_uploadStats.skipped;
+    return nullptr;
+  }
+  std::memcpy(shadow.value, value, size);
+  shadow.size = (uint8_t)size;
+  ++_uploadStats.issued;
+  return &*it;
+}
+
+GLint Shader::Location(UniformHandle uniform) const
+{
+  auto it = std::lower_bound(_uniforms.begin(), _uniforms.end(), uniform.Hash(),
+    [](const ShaderUniform& entry, uint64_t hash) { return entry.hash < hash; });
+  return it != _uniforms.end() && it->hash == uniform.Hash() ? it->location : -1;
+}
+
+void Shader::ReflectUniforms()
 {
-  glUniformMatrix4fv(glGetUniformLocation(_ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+  _uniforms.clear();
+  _shadows.clear();
+  GLint count = 0;
+  GLint maxLength = 0;
+  glGetProgramiv(_ID, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(_ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::vector<char> buffer(maxLength + 1);
+
+  auto add = [this](const std::string& name, GLint location, GLenum type)
+  {
+    ShaderUniform uniform;
+    uniform.hash = UniformHandle::HashName(name.c_str());
+    uniform.location = location;
+    uniform.type = type;
+    uniform.name = name;
+    _uniforms.push_back(std::move(uniform));
+  };
+
+  for (GLint i = 0; i < count; ++i)
+  {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(_ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+    std::string name(buffer.data(), length);
+    // members of uniform blocks have no location, they are set through the block's buffer
+    const GLint location = glGetUniformLocation(_ID, name.c_str());
+    if (location < 0)
+      continue;
+
+    // arrays are reported once as "name[0]"
+    const bool array = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+    if (!array)
+    {
+      add(name, location, type);
+      continue;
+    }
+    const std::string base = name.substr(0, name.size() - 3);
+    add(base, location, type);
+    add(name, location, type);
+    for (GLint element = 1; element < size; ++element)
+    {
+      const std::string elementName = base + "[" + std::to_string(element) + "]";
+      add(elementName, glGetUniformLocation(_ID, elementName.c_str()), type);
+    }
+  }
+
+  std::sort(_uniforms.begin(), _uniforms.end(), [](const ShaderUniform& a, const ShaderUniform& b) { return a.hash < b.hash; });
+  // one shadow copy per location, whichever name sets it
+  std::unordered_map<GLint, uint32_t> shadows;
+  for (ShaderUniform& uniform : _uniforms)
+  {
+    auto inserted = shadows.emplace(uniform.location, (uint32_t)shadows.size());
+    uniform.shadow = inserted.first->second;
+  }
+  _shadows.assign(shadows.size(), UniformShadow());
+  for (size_t i = 1; i < _uniforms.size(); ++i)
+    if (_uniforms[i].hash == _uniforms[i - 1].hash)
+      std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION " << _uniforms[i - 1].name << " / " << _uniforms[i].name << std::endl;
+}
+
+UniformBenchmark Shader::BenchmarkUniforms(unsigned frames) const
+{
+  using Clock = std::chrono::high_resolution_clock;
+
+  // the current values, so the runs upload what is there already; one entry per location (arrays have
+  // their element 0 under two names)
+  struct Value
+  {
+    const ShaderUniform* uniform;
+    UniformHandle handle;
+    GLfloat f[16];
+    GLint i[16];
+  };
+  std::vector<Value> values;
+  for (const ShaderUniform& uniform : _uniforms)
+  {
+    if (uniform.location < 0)
+      continue;
+    bool duplicate = false;
+    for (const Value& value : values)
+      duplicate |= value.uniform->location == uniform.location;
+    if (duplicate)
+      continue;
+    Value value{&uniform, UniformHandle(uniform.name), {}, {}};
+    glGetUniformfv(_ID, uniform.location, value.f);
+    glGetUniformiv(_ID, uniform.location, value.i);
+    values.push_back(value);
+  }
+
+  UniformBenchmark result;
+  result.uniforms = values.size();
+  result.frames = frames;
+  if (values.empty() || frames == 0)
+    return result;
+  Use();
+
+  auto start = Clock::now();
+  for (unsigned frame = 0; frame < frames; ++frame)
+    for (const Value& value : values)
+    {
+      // the name is built per call like the callers did
+      const std::string name = value.uniform->name;
+      UploadUniform(glGetUniformLocation(_ID, name.c_str()), value.uniform->type, value.f, value.i);
+    }
+  glFinish();
+  result.stringMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+  start = Clock::now();
+  for (unsigned frame = 0; frame < frames; ++frame)
+    for (const Value& value : values)
+      UploadUniform(Location(value.handle), value.uniform->type, value.f, value.i);
+  glFinish();
+  result.handleMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+  return result;
 }
 
 void Shader::InitFromStrings(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geomShCode)
@@ -162,6 +348,10 @@ void Shader::InitFromStrings(const std::string& vertexCode, const std::string& f
     glGetProgramInfoLog(_ID, 512, NULL, infoLog);
     std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
   }
+  else
+  {
+    ReflectUniforms();
+  }
 
   // delete the shaders as they're linked into our program now and no longer necessary
   glDeleteShader(vertex);
@@ -2,11 +2,71 @@
 
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace NullEngine
 {
 
+// Uniform name hashed with FNV-1a. A constexpr handle is hashed at compile time
+// (constexpr UniformHandle model("model")); literals and strings passed to the Set* functions
+// are hashed on the spot, still without a GL query
+class UniformHandle
+{
+public:
+    constexpr UniformHandle(const char* name) : _hash(HashName(name)) {}
+    UniformHandle(const std::string& name) : _hash(HashName(name.c_str())) {}
+
+    constexpr uint64_t Hash() const { return _hash; }
+    constexpr bool operator==(const UniformHandle& other) const { return _hash == other._hash; }
+    constexpr bool operator!=(const UniformHandle& other) const { return _hash != other._hash; }
+
+    static constexpr uint64_t HashName(const char* name)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (; *name; ++name)
+            hash = (hash ^ (uint8_t)*name) * 1099511628211ull;
+        return hash;
+    }
+
+private:
+    uint64_t _hash;
+};
+
+// Active uniform of a linked program; array elements have one entry each ("lights[3].position"),
+// element 0 also under the bare array name like glGetUniformLocation accepts it
+struct ShaderUniform
+{
+    uint64_t hash = 0;
+    GLint location = -1;
+    GLenum type = 0;
+    std::string name;
+    // index of the location's shadow copy, shared by the names of array element 0
+    uint32_t shadow = 0;
+};
+
+// Set* calls since the last ResetUploadStats, over all programs
+struct UniformUploadStats
+{
+    // glProgramUniform* issued, calls skipped because the shadow copy already held the value,
+    // and calls for uniforms the program does not have
+    size_t issued = 0;
+    size_t skipped = 0;
+    size_t inactive = 0;
+};
+
+// Shader::BenchmarkUniforms result, CPU time per frame of setting every active uniform once (milliseconds)
+struct UniformBenchmark
+{
+    size_t uniforms = 0;
+    unsigned frames = 0;
+    // glGetUniformLocation on a std::string per call, as the Set* functions did
+    double stringMs = 0.0;
+    // UniformHandle lookups in the reflected table
+    double handleMs = 0.0;
+};
+
 class Shader
 {
 public:
@@ -22,34 +82,64 @@ public:
     // Use/activate the shader
     void Use() const;
     // utility uniform functions
-    void SetBool(const std::string& name, bool value) const;
-    void SetInt(const std::string& name, int value) const;
-    void SetFloat(const std::string& name, float value) const;
-    void SetFloat4(const std::string& name, float* value) const;
+    void SetBool(UniformHandle uniform, bool value) const;
+    void SetInt(UniformHandle uniform, int value) const;
+    void SetFloat(UniformHandle uniform, float value) const;
+    void SetFloat4(UniformHandle uniform, float* value) const;
 
-    void SetVec2(const std::string& name, const glm::vec2& value) const;
+    void SetVec2(UniformHandle uniform, const glm::vec2& value) const;
 
-    void SetVec2(const std::string& name, float x, float y) const;
+    void SetVec2(UniformHandle uniform, float x, float y) const;
 
-    void SetVec3(const std::string& name, const glm::vec3& value) const;
+    void SetVec3(UniformHandle uniform, const glm::vec3& value) const;
 
-    void SetVec3(const std::string& name, float x, float y, float z) const;
+    void SetVec3(UniformHandle uniform, float x, float y, float z) const;
 
-    void SetVec4(const std::string& name, const glm::vec4& value) const;
+    void SetVec4(UniformHandle uniform, const glm::vec4& value) const;
 
-    void SetVec4(const std::string& name, float x, float y, float z, float w) const;
+    void SetVec4(UniformHandle uniform, float x, float y, float z, float w) const;
 
-    void SetMat2(const std::string& name, const glm::mat2& mat) const;
+    void SetMat2(UniformHandle uniform, const glm::mat2& mat) const;
 
-    void SetMat3(const std::string& name, const glm::mat3& mat) const;
+    void SetMat3(UniformHandle uniform, const glm::mat3& mat) const;
 
-    void SetMat4(const std::string& name, const glm::mat4& mat) const;
+    void SetMat4(UniformHandle uniform, const glm::mat4& mat) const;
+
+    // The Set* functions upload to this program whether it is in use or not, and only if the value
+    // differs from what the last Set* call for the location uploaded
+    static const UniformUploadStats& UploadStats() { return _uploadStats; }
+    static void ResetUploadStats() { _uploadStats = UniformUploadStats(); }
+
+    // location from the table reflected at link time, -1 if the program has no such active uniform
+    // (glUniform* ignores -1 like it did glGetUniformLocation's result)
+    GLint Location(UniformHandle uniform) const;
+    // sorted by hash
+    const std::vector<ShaderUniform>& Uniforms() const { return _uniforms; }
+    // re-uploads the current value of every active uniform frames times through both lookups; binds the program
+    UniformBenchmark BenchmarkUniforms(unsigned frames = 1000) const;
 
 private:
+    // last value uploaded to a location through Set*, size 0 = unknown
+    struct UniformShadow
+    {
+        uint8_t value[sizeof(float) * 16];
+        uint8_t size = 0;
+    };
+
+    std::vector<ShaderUniform> _uniforms;
+    mutable std::vector<UniformShadow> _shadows;
+    static UniformUploadStats _uploadStats;
+
+    // the entry to upload value to, null if the shadow copy holds it already or the uniform is inactive;
+    // updates the shadow copy and the counters
+    const ShaderUniform* Update(UniformHandle uniform, const void* value, size_t size) const;
+
     // Init from std::string
   void InitFromStrings(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geomShCode = "");
     // Compile routine
     unsigned CompileShader(unsigned shaderType, const char* shaderSource);
+    // fills _uniforms after a successful link
+    void ReflectUniforms();
 };
 
 } // namespace NullEngine
\ No newline at end of file
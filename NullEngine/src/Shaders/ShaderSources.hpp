@@ -228,6 +228,8 @@ std::string cmReflectVs = R"(
     layout (location = 0) in vec3 aPos;
     layout (location = 1) in vec3 aNormal;
     layout (location = 2) in vec2 aTexCoord;
+    // instanced meshes (Mesh::SetInstances): model space translation per instance, 0 otherwise
+    layout (location = 3) in vec3 aInstanceOffset;
 
     out vec3 Normal;
     out vec3 Position;
@@ -238,10 +240,24 @@ std::string cmReflectVs = R"(
         mat4 projection;
     };
 
+    // quantized meshes (Mesh VertexFormat::Quantized): AABB relative unorm16 positions, octahedral normals
+    uniform vec3 posOffset = vec3(0.0);
+    uniform vec3 posScale = vec3(1.0);
+    uniform bool octNormals = false;
+
+    vec3 OctDecode(vec2 e)
+    {
+        vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+        if (n.z < 0.0)
+            n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        return normalize(n);
+    }
+
     void main()
     {
-        Normal = mat3(transpose(inverse(model))) * aNormal;
-        Position = vec3(model * vec4(aPos, 1.0));
+        vec3 normal = octNormals ? OctDecode(aNormal.xy) : aNormal;
+        Normal = mat3(transpose(inverse(model))) * normal;
+        Position = vec3(model * vec4(posOffset + aPos * posScale + aInstanceOffset, 1.0));
         gl_Position = projection * view * vec4(Position, 1.0);
     }
   )";
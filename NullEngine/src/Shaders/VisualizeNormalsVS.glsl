@@ -3,6 +3,8 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// instanced meshes (Mesh::SetInstances): model space translation per instance, 0 otherwise
+layout (location = 3) in vec3 aInstanceOffset;
 
 uniform mat4 model;
 
@@ -13,6 +15,19 @@ layout (std140, binding = 0) uniform matrixVP {
 
 uniform vec3 lightPos;
 
+// quantized meshes (Mesh VertexFormat::Quantized): AABB relative unorm16 positions, octahedral normals
+uniform vec3 posOffset = vec3(0.0);
+uniform vec3 posScale = vec3(1.0);
+uniform bool octNormals = false;
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
 out VS_OUT {
     vec3 Normal;
     vec3 FragPos;
@@ -30,8 +45,11 @@ out VS_OUT {
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    //vs_out.Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec3 position = posOffset + aPos * posScale + aInstanceOffset;
+    vec3 normal = octNormals ? OctDecode(aNormal.xy) : aNormal;
+
+    vs_out.FragPos = vec3(model * vec4(position, 1.0));
+    //vs_out.Normal = mat3(transpose(inverse(model))) * normal;
     vs_out.LightPos = lightPos;
     //LightPos = vec3(view * model * vec4(lightPos, 1.0));
     vs_out.TexCoords = aTexCoords;
@@ -41,7 +59,7 @@ void main()
 //    gs_out.LightPos  = vs_out.LightPos;
 //    gs_out.TexCoords = vs_out.TexCoords;
     
-    gl_Position = view * model * vec4(aPos, 1.0); 
+    gl_Position = view * model * vec4(position, 1.0); 
     mat3 normalMatrix = mat3(transpose(inverse(view * model)));
-    vs_out.Normal = normalize(vec3(vec4(normalMatrix * aNormal, 0.0)));
+    vs_out.Normal = normalize(vec3(vec4(normalMatrix * normal, 0.0)));
 } 
\ No newline at end of file
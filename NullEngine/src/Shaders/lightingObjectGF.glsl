@@ -1,5 +1,4 @@
 #version 430 core
-#define NR_POINT_LIGHTS 4
 
 out vec4 FragColor;
 
@@ -22,43 +21,28 @@ in GS_OUT {
 //in vec3 LightPos;
 //in vec2 TexCoords;
 
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
+// LightSystem's buffer, std430 layout of NullEngine::Light
+#define LIGHT_DIRECTIONAL 0u
+#define LIGHT_POINT 1u
+#define LIGHT_SPOT 2u
 
-struct PointLight {
+struct Light {
     vec3 position;
-
+    uint type;
+    vec3 direction;
+    float cutOff;
     vec3 ambient;
+    float outerCutOff;
     vec3 diffuse;
-    vec3 specular;
-
     float constant;
+    vec3 specular;
     float linear;
     float quadratic;
 };
 
-struct SpotLight {
-    vec3  position;
-    vec3  direction;
-    float cutOff;
-    float outerCutOff;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
+layout(std430, binding = 0) readonly buffer Lights {
+    uint lightCount;
+    Light lights[];
 };
 
 struct Material {
@@ -68,39 +52,37 @@ struct Material {
     float shininess;
 };
 
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform DirLight dirLight;
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
-
 uniform Material material;
 uniform vec3 viewPos;
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {
     vec3 norm = normalize(ps_in.Normal);
     vec3 viewDir = normalize(viewPos - ps_in.FragPos);
 
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, ps_in.FragPos, viewDir);
-
-    // for the one lonely lightCube :_)
-    result += CalcPointLight(pointLight, norm, ps_in.FragPos, viewDir);
+    vec3 result = vec3(0.0);
+    for(uint i = 0u; i < lightCount; i++)
+    {
+        if(lights[i].type == LIGHT_DIRECTIONAL)
+            result += CalcDirLight(lights[i], norm, viewDir);
+        else if(lights[i].type == LIGHT_POINT)
+            result += CalcPointLight(lights[i], norm, ps_in.FragPos, viewDir);
+        else if(lights[i].type == LIGHT_SPOT)
+            result += CalcSpotLight(lights[i], norm, ps_in.FragPos, viewDir);
+    }
 
     //vec3 emissive = (1 - diff) * floor(vec3(1.0f) - texture(material.specular, TexCoords).rgb) * texture(material.emissive, TexCoords).rgb;
     //vec3 emissive = vec3(0);
-    result += CalcSpotLight(spotLight, norm, ps_in.FragPos, viewDir);
 
     // resulting lighting
     FragColor = vec4(result, 1.0);
 }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -115,7 +97,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     // calculate diffuse lighting
     vec3 lightDir = normalize(light.position - fragPos);
@@ -132,10 +114,12 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     vec3 specular = (spec * texture(material.specular, ps_in.TexCoords)).rgb * light.specular;
 
-    return (diffuse + specular) ;//* attenuation;
+    vec3 ambient = light.ambient * vec3(texture(material.diffuse, ps_in.TexCoords));
+
+    return (ambient + diffuse + specular) * attenuation;
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     // calculate spotLight influence
     vec3 spLightDir = normalize(light.position - fragPos);
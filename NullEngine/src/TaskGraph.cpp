@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+TaskGraph::TaskId TaskGraph::Add(const std::string& name, TaskThread thread, std::function<void()> job, std::initializer_list<TaskId> dependencies)
+{
+  const TaskId id = _tasks.size();
+  Task task;
+  task.name = name;
+  task.thread = thread;
+  task.job = std::move(job);
+  for (TaskId dependency : dependencies)
+  {
+    if (dependency >= id)
+    {
+      std::cout << "ERROR::TASKGRAPH::" << name << " depends on a task added after it" << std::endl;
+      continue;
+    }
+    task.dependencies.push_back(dependency);
+    _tasks[dependency].dependents.push_back(id);
+  }
+  task.waitingFor = task.dependencies.size();
+  _tasks.push_back(std::move(task));
+  return id;
+}
+
+void TaskGraph::Run()
+{
+  _report = TaskGraphReport();
+  _report.tasks.resize(_tasks.size());
+  for (size_t i = 0; i < _tasks.size(); ++i)
+  {
+    _report.tasks[i].name = _tasks[i].name;
+    _report.tasks[i].thread = _tasks[i].thread;
+  }
+  _done = 0;
+  _mainReady.clear();
+  _start = Clock::now();
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (TaskId id = 0; id < _tasks.size(); ++id)
+      if (_tasks[id].waitingFor == 0)
+        Schedule(id);
+  }
+
+  for (;;)
+  {
+    TaskId next;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _changed.wait(lock, [this]() { return !_mainReady.empty() || _done == _tasks.size(); });
+      if (_mainReady.empty())
+        break;
+      // Add order among the ready ones
+      auto first = std::min_element(_mainReady.begin(), _mainReady.end());
+      next = *first;
+      _mainReady.erase(first);
+    }
+    Execute(next);
+  }
+
+  _report.wallMs = Since(_start);
+  BuildReport();
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+  TaskTiming& timing = _report.tasks[id];
+  timing.startMs = Since(_start);
+  // a throwing task still releases its dependents, startup goes on with whatever it left behind
+  try
+  {
+    _tasks[id].job();
+  }
+  catch (const std::exception& e)
+  {
+    std::cout << "ERROR::TASKGRAPH::" << _tasks[id].name << ": " << e.what() << std::endl;
+  }
+  timing.endMs = Since(_start);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (TaskId dependent : _tasks[id].dependents)
+    if (--_tasks[dependent].waitingFor == 0)
+      Schedule(dependent);
+  ++_done;
+  _changed.notify_all();
+}
+
+void TaskGraph::Schedule(TaskId id)
+{
+  _report.tasks[id].readyMs = Since(_start);
+  if (_tasks[id].thread == TaskThread::Main)
+  {
+    _mainReady.push_back(id);
+    _changed.notify_all();
+  }
+  else
+    ThreadPool::Instance().Submit([this, id]() { Execute(id); });
+}
+
+void TaskGraph::BuildReport()
+{
+  _report.serialMs = 0.0;
+  for (const auto& timing : _report.tasks)
+    _report.serialMs += timing.Ms();
+
+  // walk back from the task that finished last through the dependency that finished last
+  _report.criticalPath.clear();
+  if (_tasks.empty())
+    return;
+  TaskId id = 0;
+  for (TaskId i = 1; i < _tasks.size(); ++i)
+    if (_report.tasks[i].endMs > _report.tasks[id].endMs)
+      id = i;
+  for (;;)
+  {
+    _report.criticalPath.push_back(id);
+    const auto& dependencies = _tasks[id].dependencies;
+    if (dependencies.empty())
+      break;
+    id = *std::max_element(dependencies.begin(), dependencies.end(),
+      [this](TaskId a, TaskId b) { return _report.tasks[a].endMs < _report.tasks[b].endMs; });
+  }
+  std::reverse(_report.criticalPath.begin(), _report.criticalPath.end());
+}
+
+void TaskGraphReport::Print(const char* title) const
+{
+  std::cout << "TASKGRAPH::REPORT::" << title << ": " << tasks.size() << " tasks, wall " << wallMs << " ms, serial " << serialMs << " ms ("
+    << (wallMs > 0.0 ? serialMs / wallMs : 0.0) << "x)\n";
+  char line[256];
+  for (const auto& task : tasks)
+  {
+    // ready -> start is time spent waiting for a thread
+    std::snprintf(line, sizeof(line), "  %-28s %-6s start %8.1f  end %8.1f  %8.1f ms  (waited %.1f)\n", task.name.c_str(),
+      task.thread == TaskThread::Main ? "main" : "worker", task.startMs, task.endMs, task.Ms(), task.startMs - task.readyMs);
+    std::cout << line;
+  }
+  std::cout << "  critical path:";
+  for (size_t i = 0; i < criticalPath.size(); ++i)
+    std::cout << (i ? " -> " : " ") << tasks[criticalPath[i]].name << " (" << tasks[criticalPath[i]].Ms() << " ms)";
+  std::cout << std::endl;
+}
+
+}
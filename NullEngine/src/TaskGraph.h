@@ -0,0 +1,93 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NullEngine
+{
+
+// where a TaskGraph task runs
+enum class TaskThread
+{
+  // ThreadPool, no GL
+  Worker,
+  // the thread calling Run, the one owning the GL context
+  Main
+};
+
+// timing of one task of the last Run, milliseconds since Run started
+struct TaskTiming
+{
+  std::string name;
+  TaskThread thread = TaskThread::Worker;
+  double readyMs = 0.0;  // all dependencies done
+  double startMs = 0.0;
+  double endMs = 0.0;
+
+  double Ms() const { return endMs - startMs; }
+};
+
+// Run result: per task timings (in Add order) and the critical path, the dependency chain that
+// ended last (every link the dependency that finished last), first task first
+struct TaskGraphReport
+{
+  std::vector<TaskTiming> tasks;
+  std::vector<size_t> criticalPath;
+  double wallMs = 0.0;
+  // sum of all task times, what running them one after another would take
+  double serialMs = 0.0;
+
+  void Print(const char* title) const;
+};
+
+// Small dependency graph of one-shot jobs, used for engine startup. Worker tasks go to the
+// ThreadPool as soon as their dependencies are done, Main tasks run on the calling thread in
+// the order they become ready, so independent branches (disk IO + decode on workers, GL uploads
+// on the context thread) overlap.
+class TaskGraph
+{
+public:
+  using TaskId = size_t;
+
+  // dependencies must have been added before
+  TaskId Add(const std::string& name, TaskThread thread, std::function<void()> job, std::initializer_list<TaskId> dependencies = {});
+
+  // runs every task once and returns when all are done
+  void Run();
+  const TaskGraphReport& Report() const { return _report; }
+
+private:
+  struct Task
+  {
+    std::string name;
+    TaskThread thread = TaskThread::Worker;
+    std::function<void()> job;
+    std::vector<TaskId> dependencies;
+    std::vector<TaskId> dependents;
+    size_t waitingFor = 0;
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  double Since(Clock::time_point t) const { return std::chrono::duration<double, std::milli>(Clock::now() - t).count(); }
+  // runs task id on the current thread and releases its dependents
+  void Execute(TaskId id);
+  // with _mutex held: worker tasks go to the pool, main ones to _mainReady
+  void Schedule(TaskId id);
+  void BuildReport();
+
+  std::vector<Task> _tasks;
+  TaskGraphReport _report;
+  Clock::time_point _start;
+
+  std::mutex _mutex;
+  std::condition_variable _changed;
+  std::vector<TaskId> _mainReady;
+  size_t _done = 0;
+};
+
+}
@@ -1,17 +1,33 @@
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <sstream>
 #include "stb/stb_image.h"
+#include "AssetPack.h"
+#include "GLState.h"
+#include "Ktx2.h"
+#include "MeshCache.h"
 #include "Texture.h"
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
+#include "Vfs.h"
+
+// EXT_texture_compression_s3tc, not part of the generated core loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
 namespace NullEngine
 {
 
-bool Texture::Load()
+namespace
 {
-  int nrChannels;
-  stbi_set_flip_vertically_on_load(_flip);
-  unsigned char* data = stbi_load(_path.c_str(), &_width, &_height, &nrChannels, 0);
-  stbi_set_flip_vertically_on_load(false);
 
+GLenum ChannelsToFormat(int nrChannels)
+{
   GLenum format = 0;
   if (nrChannels == 1)
     format = GL_RED;
@@ -19,9 +35,217 @@ bool Texture::Load()
     format = GL_RGB;
   else if (nrChannels == 4)
     format = GL_RGBA;
+  return format;
+}
+
+// The renderer has no sRGB framebuffer, so sRGB data is sampled as UNORM like the
+// uncompressed path does - the cooked mips are still filtered in linear space.
+GLenum CompressedFormat(TextureFormat format)
+{
+  switch (format)
+  {
+    case TextureFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TextureFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TextureFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+  }
+}
+
+// full chain down to 1x1
+unsigned MipLevels(int width, int height)
+{
+  unsigned levels = 1;
+  while ((std::max(width, height) >> levels) > 0)
+    ++levels;
+  return levels;
+}
+
+std::atomic<bool> s_compression{false};
+
+// identity of the source image + cook settings, stored in the .ktx2
+std::string CookKey(const FileStamp& stamp, bool flip, TextureUsage usage)
+{
+  std::ostringstream key;
+  key << stamp.size << ' ' << stamp.mtime << ' ' << (flip ? 1 : 0) << ' ' << (int)usage;
+  return key.str();
+}
+
+// read through the Vfs (asset pack or disk), decoded from memory
+unsigned char* LoadPixels(const std::string& path, int* width, int* height, int* channels)
+{
+  std::vector<uint8_t> bytes;
+  if (!Vfs::Instance().ReadSync(path, bytes))
+    return nullptr;
+  return stbi_load_from_memory(bytes.data(), (int)bytes.size(), width, height, channels, 0);
+}
+
+} // namespace
+
+void TextureImage::Release()
+{
+  stbi_image_free(pixels);
+  pixels = nullptr;
+  compressed.reset();
+}
+
+TextureImage Texture::Decode(const std::string& path, bool flip)
+{
+  TextureImage image;
+  stbi_set_flip_vertically_on_load_thread(flip);
+  image.pixels = LoadPixels(path, &image.width, &image.height, &image.channels);
+  stbi_set_flip_vertically_on_load_thread(false);
+  return image;
+}
+
+TextureImage Texture::Decode(const uint8_t* data, size_t size, bool flip)
+{
+  TextureImage image;
+  stbi_set_flip_vertically_on_load_thread(flip);
+  image.pixels = stbi_load_from_memory(data, (int)size, &image.width, &image.height, &image.channels, 0);
+  stbi_set_flip_vertically_on_load_thread(false);
+  return image;
+}
+
+TextureImage Texture::PrepareImage() const
+{
+  // embedded images are not cooked, the .ktx2 cache is keyed on a file of their own
+  if (_source)
+    return Decode(_source->Data() + _sourceOffset, _sourceSize, _flip);
+  return Prepare(_path, _flip, _usage);
+}
+
+TextureImage Texture::Prepare(const std::string& path, bool flip, TextureUsage usage)
+{
+  FileStamp stamp;
+  // packed images are decoded as they are, the .ktx2 cache lives next to loose files
+  if (!s_compression || AssetPack::Instance().Contains(path) || !MeshCache::Stamp(path, stamp))
+    return Decode(path, flip);
+
+  const std::string key = CookKey(stamp, flip, usage);
+  const std::string cookedPath = Ktx2::CookedPath(path);
+
+  // a cooked chain that matches the image, from nullengine-cook or an earlier run
+  auto compressed = std::make_shared<CompressedTexture>();
+  std::string cookedKey;
+  if (!Ktx2::Read(cookedPath, *compressed, &cookedKey) || cookedKey != key)
+  {
+    TextureImage image = Decode(path, flip);
+    if (!image.pixels)
+      return image;
+
+    if (!TextureCooker::Cook(image.pixels, image.width, image.height, image.channels, usage, *compressed))
+      return image;
+    image.Release();
+    Ktx2::Write(cookedPath, *compressed, key);
+  }
+
+  TextureImage image;
+  image.width = (int)compressed->width;
+  image.height = (int)compressed->height;
+  image.compressed = std::move(compressed);
+  return image;
+}
+
+bool Texture::Cook(const std::string& path, bool flip, TextureUsage usage)
+{
+  FileStamp stamp;
+  if (!MeshCache::Stamp(path, stamp))
+    return false;
+
+  TextureImage image = Decode(path, flip);
+  if (!image.pixels)
+    return false;
+  CompressedTexture compressed;
+  bool cooked = TextureCooker::Cook(image.pixels, image.width, image.height, image.channels, usage, compressed);
+  image.Release();
+  return cooked && Ktx2::Write(Ktx2::CookedPath(path), compressed, CookKey(stamp, flip, usage));
+}
+
+bool Texture::IsCooked(const std::string& path, bool flip, TextureUsage usage)
+{
+  FileStamp stamp;
+  CompressedTexture compressed;
+  std::string cookedKey;
+  return MeshCache::Stamp(path, stamp) && Ktx2::Read(Ktx2::CookedPath(path), compressed, &cookedKey)
+    && cookedKey == CookKey(stamp, flip, usage);
+}
+
+bool Texture::Restamp(const std::string& path, bool flip, TextureUsage usage)
+{
+  FileStamp stamp;
+  CompressedTexture compressed;
+  const std::string cookedPath = Ktx2::CookedPath(path);
+  return MeshCache::Stamp(path, stamp) && Ktx2::Read(cookedPath, compressed) && Ktx2::Write(cookedPath, compressed, CookKey(stamp, flip, usage));
+}
+
+void Texture::EnableCompression(bool enable)
+{
+  if (enable)
+  {
+    // BC5 and BC7 are core in 4.3, BC1/BC3 need S3TC
+    bool s3tc = false;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count && !s3tc; ++i)
+    {
+      const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+      s3tc = name && std::string(name) == "GL_EXT_texture_compression_s3tc";
+    }
+    if (!s3tc)
+    {
+      std::cout << "ERROR::TEXTURE::GL_EXT_texture_compression_s3tc not supported, textures stay uncompressed" << std::endl;
+      enable = false;
+    }
+  }
+  s_compression = enable;
+}
+
+bool Texture::CompressionEnabled()
+{
+  return s_compression;
+}
+
+bool Texture::Load()
+{
+  TextureImage image = PrepareImage();
+  return Load(image);
+}
+
+bool Texture::Load(TextureImage& image)
+{
+  if (image.Valid())
+  {
+    if (image.compressed)
+      UploadCompressed(*image.compressed, false);
+    else
+      Upload(image.pixels, image.width, image.height, image.channels);
+    image.Release();
+
+    return true;
+  }
+  else
+  {
+    std::cout << "Texture failed to load!" << std::endl;
+
+    _state = TextureState::Failed;
+    return false;
+  }
+
+}
+
+bool Texture::LoadAsync()
+{
+  return TextureStreamer::Instance().Request(shared_from_this());
+}
+
+void Texture::Upload(const void* pixels, int width, int height, int channels)
+{
+  const unsigned previous = _glId;
+  GLenum format = ChannelsToFormat(channels);
 
   glGenTextures(1, &_glId);
-  glBindTexture(GL_TEXTURE_2D, _glId);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, _glId);
   // setting the texture filtering & wrapping options
   //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
  // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -32,68 +256,257 @@ bool Texture::Load()
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  if (data)
-  {
-    glTexImage2D(GL_TEXTURE_2D, 0, format, _width, _height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+  // rows of 1 and 3 channel images are not 4 byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(data);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, 0);
+  SetResidentChain(previous, width, height, MipLevels(width, height), format, format, channels == 3 ? 4 : channels, 0);
+  _uncompressedBytes = (size_t)width * height * 4 * 4 / 3;
+  _state = TextureState::Ready;
+  TrackResidency();
+}
 
-    return true;
+void Texture::UploadCompressed(const CompressedTexture& texture, bool fromUnpackBuffer)
+{
+  const unsigned previous = _glId;
+  GLenum format = CompressedFormat(texture.format);
+
+  glGenTextures(1, &_glId);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, _glId);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, _wrapMode);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, _wrapMode);
+  // the cooked chain is complete, so sample it with trilinear filtering
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+
+  for (size_t i = 0; i < texture.levels.size(); ++i)
+  {
+    const TextureLevel& level = texture.levels[i];
+    const void* data = fromUnpackBuffer
+      ? reinterpret_cast<const void*>(level.offset)
+      : static_cast<const void*>(texture.data.data() + level.offset);
+    glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, (GLsizei)level.width, (GLsizei)level.height, 0, (GLsizei)level.size, data);
   }
+
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, 0);
+  SetResidentChain(previous, (int)texture.width, (int)texture.height, (unsigned)texture.levels.size(), format, format, 0,
+    texture.format == TextureFormat::BC1 ? 8 : 16);
+  _uncompressedBytes = texture.UncompressedBytes();
+  _state = TextureState::Ready;
+  TrackResidency();
+}
+
+void Texture::TrackResidency()
+{
+  if (auto self = weak_from_this().lock())
+    TextureResidency::Instance().Track(self);
+}
+
+void Texture::Restore()
+{
+  if (auto self = weak_from_this().lock())
+    _restorePending = TextureStreamer::Instance().Request(self, true);
   else
+    Load();
+}
+
+unsigned TextureBase::Id() const
+{
+  // still loading, or failed before it ever got a texture of its own
+  const TextureState state = _state;
+  if (state == TextureState::Loading || (state == TextureState::Failed && _glId == (unsigned)-1))
+    return TextureStreamer::Instance().Placeholder();
+  return _glId;
+}
+
+void TextureBase::Use()
+{
+  MarkUsed();
+  GLState::Instance().BindTexture(_textureType, Id());
+}
+
+void TextureBase::MarkUsed()
+{
+  _lastUsedFrame = TextureResidency::Instance().Frame();
+}
+
+void TextureBase::SetResidentChain(unsigned previous, int width, int height, unsigned levels, GLenum internalFormat, GLenum pixelFormat,
+  unsigned bytesPerPixel, unsigned blockBytes)
+{
+  // a restore replaces the reduced texture
+  if (_state == TextureState::Ready && previous != (unsigned)-1 && previous != _glId)
+    GLState::Instance().DeleteTextures(1, &previous);
+
+  _width = width;
+  _height = height;
+  _levels = std::max(levels, 1u);
+  _internalFormat = internalFormat;
+  _pixelFormat = pixelFormat;
+  _bytesPerPixel = bytesPerPixel;
+  _blockBytes = blockBytes;
+  _droppedLevels = 0;
+  _restorePending = false;
+  _gpuBytes = ChainBytes(0);
+}
+
+size_t TextureBase::ChainBytes(unsigned firstLevel) const
+{
+  size_t bytes = 0;
+  for (unsigned level = firstLevel; level < _levels; ++level)
   {
-    std::cout << "Texture failed to load!" << std::endl;
+    size_t w = (size_t)std::max(1, _width >> level), h = (size_t)std::max(1, _height >> level);
+    bytes += _blockBytes ? ((w + 3) / 4) * ((h + 3) / 4) * _blockBytes : w * h * _bytesPerPixel;
+  }
+  return bytes * (_textureType == GL_TEXTURE_CUBE_MAP ? 6 : 1);
+}
 
-    stbi_image_free(data);
-    return false;
+size_t TextureBase::DropLevels(unsigned count)
+{
+  GLState& gl = GLState::Instance();
+  if (_state != TextureState::Ready || _droppedLevels + 1 >= _levels)
+    return 0;
+  count = std::min(count, _levels - 1 - _droppedLevels);
+  if (count == 0)
+    return 0;
+
+  const bool cube = _textureType == GL_TEXTURE_CUBE_MAP;
+  const GLsizei faces = cube ? 6 : 1;
+  const unsigned first = _droppedLevels + count;
+  const unsigned levels = _levels - first;
+
+  GLint minFilter = GL_LINEAR, magFilter = GL_LINEAR;
+  gl.BindTexture(_textureType, _glId);
+  glGetTexParameteriv(_textureType, GL_TEXTURE_MIN_FILTER, &minFilter);
+  glGetTexParameteriv(_textureType, GL_TEXTURE_MAG_FILTER, &magFilter);
+
+  unsigned id = 0;
+  glGenTextures(1, &id);
+  gl.BindTexture(_textureType, id);
+  for (unsigned i = 0; i < levels; ++i)
+  {
+    GLsizei w = std::max(1, _width >> (first + i)), h = std::max(1, _height >> (first + i));
+    for (GLsizei f = 0; f < faces; ++f)
+    {
+      GLenum target = cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f : GL_TEXTURE_2D;
+      if (_blockBytes)
+        glCompressedTexImage2D(target, (GLint)i, _internalFormat, w, h, 0, (GLsizei)(((w + 3) / 4) * ((h + 3) / 4) * _blockBytes), nullptr);
+      else
+        glTexImage2D(target, (GLint)i, _internalFormat, w, h, 0, _pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+    }
   }
+  glTexParameteri(_textureType, GL_TEXTURE_WRAP_S, _wrapMode);
+  glTexParameteri(_textureType, GL_TEXTURE_WRAP_T, _wrapMode);
+  if (cube)
+    glTexParameteri(_textureType, GL_TEXTURE_WRAP_R, _wrapMode);
+  glTexParameteri(_textureType, GL_TEXTURE_MIN_FILTER, minFilter);
+  glTexParameteri(_textureType, GL_TEXTURE_MAG_FILTER, magFilter);
+  glTexParameteri(_textureType, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+  gl.BindTexture(_textureType, 0);
 
+  // the remaining levels move up the chain, GPU to GPU
+  for (unsigned i = 0; i < levels; ++i)
+  {
+    GLsizei w = std::max(1, _width >> (first + i)), h = std::max(1, _height >> (first + i));
+    glCopyImageSubData(_glId, _textureType, (GLint)(first - _droppedLevels + i), 0, 0, 0, id, _textureType, (GLint)i, 0, 0, 0, w, h, faces);
+  }
+  gl.DeleteTextures(1, &_glId);
+
+  const size_t before = _gpuBytes;
+  _glId = id;
+  _droppedLevels = first;
+  _gpuBytes = ChainBytes(first);
+  return before - _gpuBytes;
 }
 
-void TextureBase::Use()
+bool CubeMap::Decode()
 {
-  glBindTexture(_textureType, _glId);
+  for (auto& image : _decoded)
+    image.Release();
+  _decoded.assign(_faces.size(), TextureImage());
+  // faces are never flipped, whatever the last decode on this thread used
+  stbi_set_flip_vertically_on_load_thread(false);
+  for (unsigned i = 0; i < _faces.size(); ++i)
+  {
+    TextureImage& image = _decoded[i];
+    image.pixels = LoadPixels(_faces[i], &image.width, &image.height, &image.channels);
+    if (!image.pixels)
+    {
+      std::cout << "Cubemap tex failed to load at path: " << _faces[i] << std::endl;
+      return false;
+    }
+  }
+  return true;
 }
 
 bool CubeMap::Load()
 {
+  GLState& gl = GLState::Instance();
+  if (_decoded.size() != _faces.size())
+    Decode();
+
+  const unsigned previous = _glId;
   glGenTextures(1, &_glId);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, _glId);
+  gl.BindTexture(GL_TEXTURE_CUBE_MAP, _glId);
 
-  int width, height, nrChannels;
-  for (unsigned i = 0; i < _faces.size(); ++i)
+  int width = 0, height = 0, nrChannels = 0;
+  GLenum format = 0;
+  bool loaded = true;
+  for (unsigned i = 0; i < _faces.size() && loaded; ++i)
   {
-    unsigned char* data = stbi_load(_faces[i].c_str(), &width, &height, &nrChannels, 0);
-    GLenum format = 0;
-    if (nrChannels == 1)
-      format = GL_RED;
-    else if (nrChannels == 3)
-      format = GL_RGB;
-    else if (nrChannels == 4)
-      format = GL_RGBA;
-
-    if (data)
+    const TextureImage& image = _decoded[i];
+    loaded = image.pixels != nullptr;
+    if (loaded)
     {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-      stbi_image_free(data);
+      width = image.width;
+      height = image.height;
+      nrChannels = image.channels;
+      format = ChannelsToFormat(nrChannels);
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
     }
-    else
+  }
+  // the faces are read again from disk for a restore
+  for (auto& image : _decoded)
+    image.Release();
+  _decoded.clear();
+
+  if (!loaded)
+  {
+    gl.BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    // a failed restore keeps the reduced cube map
+    if (_state == TextureState::Ready)
     {
-      std::cout << "Cubemap tex failed to load at path: " << _faces[i] << std::endl;
-      stbi_image_free(data);
+      gl.DeleteTextures(1, &_glId);
+      _glId = previous;
+      _restorePending = false;
       return false;
     }
+    gl.DeleteTextures(1, &_glId);
+    _state = TextureState::Failed;
+    return false;
   }
+  // a mip chain, so TextureResidency can drop its top levels
+  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
   // wrapMode for CubeMap should be set to GL_CLAMP_TO_EDGE
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, _wrapMode);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, _wrapMode);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, _wrapMode);
+  gl.BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
+  SetResidentChain(previous, width, height, MipLevels(width, height), format, format, nrChannels == 3 ? 4 : nrChannels, 0);
+  _state = TextureState::Ready;
   return true;
 }
 
+void CubeMap::Restore()
+{
+  // faces are read again from disk, synchronously - cube maps are few
+  Load();
+}
+
 } // namespace NullEngine
\ No newline at end of file
@@ -1,55 +1,171 @@
 #pragma once
+#include <atomic>
+#include <memory>
 #include <string>
 #include <glad/glad.h>
 #include <vector>
+#include "MappedFile.h"
+#include "TextureCooker.h"
 //#include <glfw3.h>
 
 namespace NullEngine
 {
 
+enum class TextureState
+{
+  Unloaded,
+  Loading,  // decoding/uploading in the background, Id() is the streamer's placeholder
+  Ready,
+  Failed
+};
+
 class TextureBase
 {
+  friend class TextureResidency;
 public:
   TextureBase() = default;
   TextureBase(const std::string& name, GLenum internalType, int wrapMode)
     :
     _name(name), _textureType(internalType), _wrapMode(wrapMode) {}
+  virtual ~TextureBase() = default;
   virtual bool Load() = 0;
+  // binds the texture and marks it used this frame (TextureResidency)
   virtual void Use();
+  // marks it used without binding, for callers that know it is still bound
+  void MarkUsed();
 
   // Setters
   void SetName(const std::string& val) { _name = val; }
 
   // Getters
   const std::string& Name() const { return _name; }
-  const unsigned int& Id() const { return _glId; }
+  // GL thread; the streamer's placeholder while the first load is in flight
+  unsigned Id() const;
+  TextureState State() const { return _state; }
+  // video memory of the resident mip chain
+  size_t GpuBytes() const { return _gpuBytes; }
+  // top mip levels TextureResidency dropped, 0 = full resolution
+  unsigned DroppedLevels() const { return _droppedLevels; }
+  uint64_t LastUsedFrame() const { return _lastUsedFrame; }
 
 protected:
+  // brings the dropped levels back, from the disk cache / source image
+  virtual void Restore() = 0;
+  // replaces the GL texture with one that starts count levels further down the chain (GPU copy)
+  size_t DropLevels(unsigned count);
+  // records the layout of a freshly uploaded chain; deletes previous if it was a real texture
+  void SetResidentChain(unsigned previous, int width, int height, unsigned levels, GLenum internalFormat, GLenum pixelFormat,
+    unsigned bytesPerPixel, unsigned blockBytes);
+  size_t ChainBytes(unsigned firstLevel) const;
+
   std::string _name;
+  // GL thread only, the state is also changed on workers (TextureStreamer::Request)
   unsigned int _glId = -1;
   GLenum _textureType;
   GLenum _wrapMode;
+  std::atomic<TextureState> _state{TextureState::Unloaded};
+
+  // layout of the full chain: blockBytes != 0 for 4x4 block compressed formats
+  int _width = -1;
+  int _height = -1;
+  unsigned _levels = 1;
+  GLenum _internalFormat = 0;
+  GLenum _pixelFormat = 0;
+  unsigned _bytesPerPixel = 4;
+  unsigned _blockBytes = 0;
+  size_t _gpuBytes = 0;
+  unsigned _droppedLevels = 0;
+  uint64_t _lastUsedFrame = 0;
+  bool _restorePending = false;
+  bool _tracked = false;
 };
 
-class Texture : public TextureBase
+// Decoded 8-bit image (stb) or a block compressed mip chain (cooked .ktx2), free with Release()
+struct TextureImage
 {
+  unsigned char* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::shared_ptr<CompressedTexture> compressed;
+
+  bool Valid() const { return pixels || compressed; }
+  void Release();
+};
+
+class Texture : public TextureBase, public std::enable_shared_from_this<Texture>
+{
+  friend class TextureStreamer;
+  friend class TextureRegistry;
 public:
   Texture() = default;
   Texture(const std::string& name, const std::string& path, int wrapMode = GL_REPEAT, bool flip = false)
     :
-    TextureBase(name, GL_TEXTURE_2D, wrapMode), _path(path), _flip(flip) {}
+    TextureBase(name, GL_TEXTURE_2D, wrapMode), _path(path), _flip(flip), _usage(TextureCooker::UsageFromName(name)) {}
+  // image file (png, jpg, ...) embedded in a bigger mapped file, e.g. a GLB buffer view:
+  // decoded from memory, path only names it in messages
+  Texture(const std::string& name, std::shared_ptr<const MappedFile> source, size_t offset, size_t size, const std::string& path,
+    int wrapMode = GL_REPEAT)
+    :
+    TextureBase(name, GL_TEXTURE_2D, wrapMode), _usage(TextureCooker::UsageFromName(name)), _path(path), _source(std::move(source)),
+    _sourceOffset(offset), _sourceSize(size) {}
 
   virtual bool Load() override;
+  // GL thread: uploads an image PrepareImage() made, possibly on another thread; releases it
+  bool Load(TextureImage& image);
+  // Decode on a worker thread, upload later from TextureStreamer::Update.
+  // Until then Id() returns the streamer's 1x1 placeholder. The texture must be owned by a shared_ptr.
+  bool LoadAsync();
+
+  // Setters
+  void SetUsage(TextureUsage usage) { _usage = usage; }
+
   // Getters
   const std::string& Path() const { return _path; }
+  TextureUsage Usage() const { return _usage; }
+  // what the full chain would take as uncompressed RGBA8, see GpuBytes() for the resident size
+  size_t UncompressedBytes() const { return _uncompressedBytes; }
+
+  // thread safe, uses stb's thread-local flip setting
+  static TextureImage Decode(const std::string& path, bool flip);
+  static TextureImage Decode(const uint8_t* data, size_t size, bool flip);
+  // thread safe; with compression enabled returns the cooked mip chain from <path>.ktx2,
+  // cooking and writing it first if it is missing or older than the image. Otherwise Decode().
+  static TextureImage Prepare(const std::string& path, bool flip, TextureUsage usage);
+
+  // offline cooking (AssetCooker), no GL and independent of EnableCompression: decode + cook + write <path>.ktx2
+  // keyed on the image's current size/mtime, flip and usage, which is what Prepare() checks
+  static bool Cook(const std::string& path, bool flip, TextureUsage usage);
+  // <path>.ktx2 exists and Prepare() would use it
+  static bool IsCooked(const std::string& path, bool flip, TextureUsage usage);
+  // re-keys an existing <path>.ktx2 to the image's current size/mtime, for images whose content did not change
+  static bool Restamp(const std::string& path, bool flip, TextureUsage usage);
+
+  // GL thread, after the context is created. Off by default or if the driver lacks S3TC.
+  static void EnableCompression(bool enable);
+  static bool CompressionEnabled();
+
+  // Prepare() of the file, or Decode() of the embedded image; thread safe
+  TextureImage PrepareImage() const;
+
+protected:
+  virtual void Restore() override;
 
 private:
+  void TrackResidency();
+  // creates the GL texture from pixels (or an offset into the bound GL_PIXEL_UNPACK_BUFFER)
+  void Upload(const void* pixels, int width, int height, int channels);
+  // same for a compressed chain, with a PBO bound the data is read from offset 0 of it
+  void UploadCompressed(const CompressedTexture& texture, bool fromUnpackBuffer);
+
   bool _flip = false;
-  int _width = -1;
-  int _height = -1;
+  TextureUsage _usage = TextureUsage::Color;
+  size_t _uncompressedBytes = 0;
 
   std::string _path;
-
+  std::shared_ptr<const MappedFile> _source;
+  size_t _sourceOffset = 0;
+  size_t _sourceSize = 0;
 };
 
 class CubeMap : public TextureBase
@@ -58,9 +174,14 @@ public:
   CubeMap() = default;
   CubeMap(const std::string& name, const std::vector<std::string>& faces, int wrapMode = GL_CLAMP_TO_EDGE) : TextureBase(name, GL_TEXTURE_CUBE_MAP, wrapMode), _faces(faces) {}
 
+  // decodes the faces ahead of Load, any thread; Load uploads them, or decodes itself if this was not called
+  bool Decode();
   virtual bool Load() override;
+protected:
+  virtual void Restore() override;
 private:
   std::vector<std::string> _faces;
+  std::vector<TextureImage> _decoded;
 };
 
 struct STexture
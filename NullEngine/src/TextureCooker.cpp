@@ -0,0 +1,571 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "TextureCooker.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NULLENGINE_SSE2 1
+#endif
+
+namespace NullEngine
+{
+
+namespace
+{
+
+// ---------------------------------------------------------------- colour space
+
+struct SrgbTables
+{
+  float toLinear[256];
+  uint8_t toSrgb[4096];
+
+  SrgbTables()
+  {
+    for (int i = 0; i < 256; ++i)
+    {
+      float c = i / 255.0f;
+      toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i < 4096; ++i)
+    {
+      float l = i / 4095.0f;
+      float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      toSrgb[i] = (uint8_t)std::clamp((int)(c * 255.0f + 0.5f), 0, 255);
+    }
+  }
+};
+
+const SrgbTables& Srgb()
+{
+  static SrgbTables tables;
+  return tables;
+}
+
+uint8_t LinearToSrgb(float l)
+{
+  int i = (int)(std::clamp(l, 0.0f, 1.0f) * 4095.0f + 0.5f);
+  return Srgb().toSrgb[i];
+}
+
+// ---------------------------------------------------------------- block helpers
+
+// per channel min/max of 16 RGBA pixels
+void BlockMinMax(const uint8_t* rgba, uint8_t* mn, uint8_t* mx)
+{
+#ifdef NULLENGINE_SSE2
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16));
+  __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 32));
+  __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 48));
+  __m128i lo = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+  __m128i hi = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+  lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+  lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+  hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+  hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+  int l = _mm_cvtsi128_si32(lo);
+  int h = _mm_cvtsi128_si32(hi);
+  std::memcpy(mn, &l, 4);
+  std::memcpy(mx, &h, 4);
+#else
+  for (int ch = 0; ch < 4; ++ch)
+  {
+    mn[ch] = 255;
+    mx[ch] = 0;
+  }
+  for (int i = 0; i < 16; ++i)
+  {
+    for (int ch = 0; ch < 4; ++ch)
+    {
+      mn[ch] = std::min(mn[ch], rgba[i * 4 + ch]);
+      mx[ch] = std::max(mx[ch], rgba[i * 4 + ch]);
+    }
+  }
+#endif
+}
+
+// Endpoints along the principal axis of the block colours (power iteration on the covariance).
+// channels = 3 (RGB) or 4 (RGBA)
+void PrincipalEndpoints(const uint8_t* rgba, int channels, float* e0, float* e1)
+{
+  float mean[4] = {};
+  for (int i = 0; i < 16; ++i)
+    for (int ch = 0; ch < channels; ++ch)
+      mean[ch] += rgba[i * 4 + ch];
+  for (int ch = 0; ch < channels; ++ch)
+    mean[ch] /= 16.0f;
+
+  float cov[4][4] = {};
+  for (int i = 0; i < 16; ++i)
+  {
+    float d[4];
+    for (int ch = 0; ch < channels; ++ch)
+      d[ch] = rgba[i * 4 + ch] - mean[ch];
+    for (int r = 0; r < channels; ++r)
+      for (int c = 0; c < channels; ++c)
+        cov[r][c] += d[r] * d[c];
+  }
+
+  // start from the bounding box diagonal, converges in a handful of steps
+  uint8_t mn[4], mx[4];
+  BlockMinMax(rgba, mn, mx);
+  float axis[4] = {};
+  for (int ch = 0; ch < channels; ++ch)
+    axis[ch] = float(mx[ch] - mn[ch]) + 1e-3f;
+
+  for (int iter = 0; iter < 8; ++iter)
+  {
+    float next[4] = {};
+    for (int r = 0; r < channels; ++r)
+      for (int c = 0; c < channels; ++c)
+        next[r] += cov[r][c] * axis[c];
+
+    float len = 0.0f;
+    for (int ch = 0; ch < channels; ++ch)
+      len = std::max(len, std::fabs(next[ch]));
+    if (len < 1e-6f)
+      break;
+    for (int ch = 0; ch < channels; ++ch)
+      axis[ch] = next[ch] / len;
+  }
+
+  float len2 = 0.0f;
+  for (int ch = 0; ch < channels; ++ch)
+    len2 += axis[ch] * axis[ch];
+  if (len2 < 1e-12f)
+  {
+    for (int ch = 0; ch < channels; ++ch)
+      e0[ch] = e1[ch] = mean[ch];
+    return;
+  }
+
+  float tmin = 1e30f, tmax = -1e30f;
+  for (int i = 0; i < 16; ++i)
+  {
+    float t = 0.0f;
+    for (int ch = 0; ch < channels; ++ch)
+      t += (rgba[i * 4 + ch] - mean[ch]) * axis[ch];
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+
+  for (int ch = 0; ch < channels; ++ch)
+  {
+    e0[ch] = std::clamp(mean[ch] + axis[ch] * tmax / len2, 0.0f, 255.0f);
+    e1[ch] = std::clamp(mean[ch] + axis[ch] * tmin / len2, 0.0f, 255.0f);
+  }
+}
+
+uint16_t To565(const float* c)
+{
+  int r = std::clamp((int)(c[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+  int g = std::clamp((int)(c[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+  int b = std::clamp((int)(c[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void From565(uint16_t v, int* c)
+{
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// 128 bit little endian bit writer for BC7
+struct BitWriter
+{
+  uint8_t* out;
+  unsigned pos = 0;
+
+  void Write(uint32_t value, unsigned bits)
+  {
+    for (unsigned i = 0; i < bits; ++i, ++pos)
+    {
+      if (value & (1u << i))
+        out[pos >> 3] |= (uint8_t)(1u << (pos & 7));
+    }
+  }
+};
+
+// fetch a 4x4 block, clamping at the image border
+void FetchBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t* block)
+{
+  for (uint32_t y = 0; y < 4; ++y)
+  {
+    uint32_t sy = std::min(by * 4 + y, height - 1);
+    for (uint32_t x = 0; x < 4; ++x)
+    {
+      uint32_t sx = std::min(bx * 4 + x, width - 1);
+      std::memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+    }
+  }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------- CompressedTexture
+
+size_t CompressedTexture::UncompressedBytes() const
+{
+  size_t bytes = 0;
+  for (const auto& level : levels)
+    bytes += (size_t)level.width * level.height * 4;
+  return bytes;
+}
+
+// ---------------------------------------------------------------- format selection
+
+TextureUsage TextureCooker::UsageFromName(const std::string& typeName)
+{
+  if (typeName.find("normal") != std::string::npos || typeName.find("height") != std::string::npos)
+    return TextureUsage::Normal;
+  if (typeName.find("specular") != std::string::npos)
+    return TextureUsage::Linear;
+  return TextureUsage::Color;
+}
+
+TextureFormat TextureCooker::ChooseFormat(TextureUsage usage, bool hasAlpha)
+{
+  switch (usage)
+  {
+    case TextureUsage::Normal:
+      return TextureFormat::BC5;
+    case TextureUsage::Linear:
+      return hasAlpha ? TextureFormat::BC3 : TextureFormat::BC1;
+    case TextureUsage::Color:
+    default:
+      return hasAlpha ? TextureFormat::BC7 : TextureFormat::BC1;
+  }
+}
+
+const char* TextureCooker::FormatName(TextureFormat format)
+{
+  switch (format)
+  {
+    case TextureFormat::RGBA8: return "RGBA8";
+    case TextureFormat::BC1: return "BC1";
+    case TextureFormat::BC3: return "BC3";
+    case TextureFormat::BC5: return "BC5";
+    case TextureFormat::BC7: return "BC7";
+  }
+  return "?";
+}
+
+size_t TextureCooker::BlockBytes(TextureFormat format)
+{
+  return format == TextureFormat::BC1 ? 8 : 16;
+}
+
+// ---------------------------------------------------------------- block encoders
+
+void TextureCooker::EncodeBC1(const uint8_t* rgba, uint8_t* out)
+{
+  float e0[4], e1[4];
+  PrincipalEndpoints(rgba, 3, e0, e1);
+
+  uint16_t c0 = To565(e0);
+  uint16_t c1 = To565(e1);
+  if (c0 < c1)
+    std::swap(c0, c1);
+
+  uint32_t indices = 0;
+  if (c0 != c1)
+  {
+    // 4 colour mode (c0 > c1)
+    int palette[4][3];
+    From565(c0, palette[0]);
+    From565(c1, palette[1]);
+    for (int ch = 0; ch < 3; ++ch)
+    {
+      palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+      palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+    }
+
+    for (int i = 0; i < 16; ++i)
+    {
+      const uint8_t* p = rgba + i * 4;
+      int best = 0, bestDist = 1 << 30;
+      for (int k = 0; k < 4; ++k)
+      {
+        int dr = p[0] - palette[k][0], dg = p[1] - palette[k][1], db = p[2] - palette[k][2];
+        int dist = dr * dr + dg * dg + db * db;
+        if (dist < bestDist)
+        {
+          bestDist = dist;
+          best = k;
+        }
+      }
+      indices |= (uint32_t)best << (i * 2);
+    }
+  }
+
+  out[0] = (uint8_t)(c0 & 0xFF);
+  out[1] = (uint8_t)(c0 >> 8);
+  out[2] = (uint8_t)(c1 & 0xFF);
+  out[3] = (uint8_t)(c1 >> 8);
+  std::memcpy(out + 4, &indices, 4);
+}
+
+void TextureCooker::EncodeBC4(const uint8_t* rgba, int channel, uint8_t* out)
+{
+  int mn = 255, mx = 0;
+  for (int i = 0; i < 16; ++i)
+  {
+    mn = std::min(mn, (int)rgba[i * 4 + channel]);
+    mx = std::max(mx, (int)rgba[i * 4 + channel]);
+  }
+
+  // 8 value mode: a0 = max, a1 = min, codes 2..7 interpolate from a0 towards a1
+  out[0] = (uint8_t)mx;
+  out[1] = (uint8_t)mn;
+
+  uint64_t bits = 0;
+  if (mx > mn)
+  {
+    int range = mx - mn;
+    for (int i = 0; i < 16; ++i)
+    {
+      int v = rgba[i * 4 + channel];
+      int step = ((mx - v) * 7 + range / 2) / range; // 0 = max ... 7 = min
+      int code = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+      bits |= (uint64_t)code << (i * 3);
+    }
+  }
+  for (int i = 0; i < 6; ++i)
+    out[2 + i] = (uint8_t)(bits >> (i * 8));
+}
+
+void TextureCooker::EncodeBC3(const uint8_t* rgba, uint8_t* out)
+{
+  EncodeBC4(rgba, 3, out);
+  EncodeBC1(rgba, out + 8);
+}
+
+void TextureCooker::EncodeBC5(const uint8_t* rgba, uint8_t* out)
+{
+  EncodeBC4(rgba, 0, out);
+  EncodeBC4(rgba, 1, out + 8);
+}
+
+void TextureCooker::EncodeBC7(const uint8_t* rgba, uint8_t* out)
+{
+  // mode 6: one subset, RGBA 7.7.7.7 endpoints + unique p-bit, 4 bit indices
+  static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+  float e[2][4];
+  PrincipalEndpoints(rgba, 4, e[0], e[1]);
+
+  int q[2][4];   // 7 bit endpoint values
+  int p[2];      // p-bits
+  int full[2][4]; // resulting 8 bit endpoints
+  for (int k = 0; k < 2; ++k)
+  {
+    float bestErr = 1e30f;
+    for (int pbit = 0; pbit < 2; ++pbit)
+    {
+      float err = 0.0f;
+      int cand[4];
+      for (int ch = 0; ch < 4; ++ch)
+      {
+        cand[ch] = std::clamp((int)std::lround((e[k][ch] - pbit) / 2.0f), 0, 127);
+        float d = (cand[ch] * 2 + pbit) - e[k][ch];
+        err += d * d;
+      }
+      if (err < bestErr)
+      {
+        bestErr = err;
+        p[k] = pbit;
+        std::memcpy(q[k], cand, sizeof(cand));
+      }
+    }
+    for (int ch = 0; ch < 4; ++ch)
+      full[k][ch] = (q[k][ch] << 1) | p[k];
+  }
+
+  int palette[16][4];
+  for (int w = 0; w < 16; ++w)
+    for (int ch = 0; ch < 4; ++ch)
+      palette[w][ch] = ((64 - weights[w]) * full[0][ch] + weights[w] * full[1][ch] + 32) >> 6;
+
+  int indices[16];
+  for (int i = 0; i < 16; ++i)
+  {
+    const uint8_t* px = rgba + i * 4;
+    int best = 0, bestDist = 1 << 30;
+    for (int w = 0; w < 16; ++w)
+    {
+      int dist = 0;
+      for (int ch = 0; ch < 4; ++ch)
+      {
+        int d = px[ch] - palette[w][ch];
+        dist += d * d;
+      }
+      if (dist < bestDist)
+      {
+        bestDist = dist;
+        best = w;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // the anchor (pixel 0) index has an implicit 0 msb - swap the endpoints if needed
+  if (indices[0] & 8)
+  {
+    std::swap(q[0], q[1]);
+    std::swap(p[0], p[1]);
+    for (int& index : indices)
+      index = 15 - index;
+  }
+
+  std::memset(out, 0, 16);
+  BitWriter writer{out};
+  writer.Write(1u << 6, 7); // mode 6
+  for (int ch = 0; ch < 4; ++ch)
+  {
+    writer.Write((uint32_t)q[0][ch], 7);
+    writer.Write((uint32_t)q[1][ch], 7);
+  }
+  writer.Write((uint32_t)p[0], 1);
+  writer.Write((uint32_t)p[1], 1);
+  writer.Write((uint32_t)indices[0], 3);
+  for (int i = 1; i < 16; ++i)
+    writer.Write((uint32_t)indices[i], 4);
+}
+
+// ---------------------------------------------------------------- mips
+
+void TextureCooker::Downsample(const uint8_t* src, uint32_t width, uint32_t height, TextureUsage usage, std::vector<uint8_t>& dst)
+{
+  uint32_t w = std::max(1u, width / 2);
+  uint32_t h = std::max(1u, height / 2);
+  dst.resize((size_t)w * h * 4);
+  const float* toLinear = Srgb().toLinear;
+
+  for (uint32_t y = 0; y < h; ++y)
+  {
+    uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+    for (uint32_t x = 0; x < w; ++x)
+    {
+      uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+      const uint8_t* s[4] = {
+        src + ((size_t)y0 * width + x0) * 4, src + ((size_t)y0 * width + x1) * 4,
+        src + ((size_t)y1 * width + x0) * 4, src + ((size_t)y1 * width + x1) * 4};
+      uint8_t* d = dst.data() + ((size_t)y * w + x) * 4;
+
+      if (usage == TextureUsage::Color)
+      {
+        // average in linear space, not on the gamma encoded values
+        for (int ch = 0; ch < 3; ++ch)
+          d[ch] = LinearToSrgb((toLinear[s[0][ch]] + toLinear[s[1][ch]] + toLinear[s[2][ch]] + toLinear[s[3][ch]]) * 0.25f);
+      }
+      else if (usage == TextureUsage::Normal)
+      {
+        float n[3] = {};
+        for (int k = 0; k < 4; ++k)
+          for (int ch = 0; ch < 3; ++ch)
+            n[ch] += s[k][ch] / 127.5f - 1.0f;
+        float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len < 1e-6f)
+        {
+          n[0] = n[1] = 0.0f;
+          n[2] = len = 1.0f;
+        }
+        for (int ch = 0; ch < 3; ++ch)
+          d[ch] = (uint8_t)std::clamp((int)((n[ch] / len * 0.5f + 0.5f) * 255.0f + 0.5f), 0, 255);
+      }
+      else
+      {
+        for (int ch = 0; ch < 3; ++ch)
+          d[ch] = (uint8_t)((s[0][ch] + s[1][ch] + s[2][ch] + s[3][ch] + 2) / 4);
+      }
+      d[3] = (uint8_t)((s[0][3] + s[1][3] + s[2][3] + s[3][3] + 2) / 4);
+    }
+  }
+}
+
+// ---------------------------------------------------------------- cook
+
+bool TextureCooker::Cook(const unsigned char* pixels, int width, int height, int channels, TextureUsage usage, CompressedTexture& out)
+{
+  bool hasAlpha = false;
+  if (channels == 4)
+  {
+    for (size_t i = 0, n = (size_t)width * height; i < n && !hasAlpha; ++i)
+      hasAlpha = pixels[i * 4 + 3] != 255;
+  }
+  return Cook(pixels, width, height, channels, usage, ChooseFormat(usage, hasAlpha), out);
+}
+
+bool TextureCooker::Cook(const unsigned char* pixels, int width, int height, int channels, TextureUsage usage, TextureFormat format, CompressedTexture& out)
+{
+  if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4 || format == TextureFormat::RGBA8)
+    return false;
+
+  // expand to RGBA8
+  std::vector<uint8_t> level((size_t)width * height * 4);
+  for (size_t i = 0, n = (size_t)width * height; i < n; ++i)
+  {
+    const unsigned char* s = pixels + i * channels;
+    uint8_t* d = level.data() + i * 4;
+    d[0] = s[0];
+    d[1] = channels >= 2 ? s[1] : s[0];
+    d[2] = channels >= 3 ? s[2] : (channels == 1 ? s[0] : 0);
+    d[3] = channels == 4 ? s[3] : 255;
+  }
+
+  out = CompressedTexture();
+  out.format = format;
+  out.srgb = usage == TextureUsage::Color;
+  out.width = (uint32_t)width;
+  out.height = (uint32_t)height;
+
+  const size_t blockBytes = BlockBytes(format);
+  uint32_t w = (uint32_t)width, h = (uint32_t)height;
+  std::vector<uint8_t> next;
+  for (;;)
+  {
+    uint32_t blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+    TextureLevel info;
+    info.width = w;
+    info.height = h;
+    info.offset = out.data.size();
+    info.size = (size_t)blocksX * blocksY * blockBytes;
+    out.levels.push_back(info);
+    out.data.resize(info.offset + info.size);
+
+    uint8_t* dst = out.data.data() + info.offset;
+    const uint8_t* src = level.data();
+    ThreadPool::Instance().ParallelFor(blocksY, [&](size_t by)
+    {
+      uint8_t block[64];
+      for (uint32_t bx = 0; bx < blocksX; ++bx)
+      {
+        FetchBlock(src, w, h, bx, (uint32_t)by, block);
+        uint8_t* o = dst + (by * blocksX + bx) * blockBytes;
+        switch (format)
+        {
+          case TextureFormat::BC1: EncodeBC1(block, o); break;
+          case TextureFormat::BC3: EncodeBC3(block, o); break;
+          case TextureFormat::BC5: EncodeBC5(block, o); break;
+          case TextureFormat::BC7: EncodeBC7(block, o); break;
+          default: break;
+        }
+      }
+    });
+
+    if (w == 1 && h == 1)
+      break;
+    Downsample(level.data(), w, h, usage, next);
+    level.swap(next);
+    w = std::max(1u, w / 2);
+    h = std::max(1u, h / 2);
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NullEngine
+{
+
+enum class TextureFormat : uint32_t
+{
+  RGBA8,
+  BC1,  // RGB, 4 bpp - opaque colour, specular
+  BC3,  // RGBA, 8 bpp - colour with alpha (BC1 colour + BC4 alpha)
+  BC5,  // RG, 8 bpp - tangent space normal maps
+  BC7   // RGBA, 8 bpp - high quality colour (mode 6 only)
+};
+
+// What a texture is used for, decides format and mip filtering
+enum class TextureUsage
+{
+  Color,     // sRGB data, gamma correct mips
+  Linear,    // specular/gloss/masks
+  Normal     // tangent space normal map, renormalized mips
+};
+
+struct TextureLevel
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  size_t offset = 0;
+  size_t size = 0;
+};
+
+// Block compressed image with its full mip chain, level 0 first
+struct CompressedTexture
+{
+  TextureFormat format = TextureFormat::BC1;
+  bool srgb = false;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<TextureLevel> levels;
+  std::vector<uint8_t> data;
+
+  // size of the same mip chain as RGBA8
+  size_t UncompressedBytes() const;
+};
+
+// CPU texture cooker: mip generation + BC1/BC3/BC5/BC7 block encoding.
+// No GL - used by the runtime (cook on first load) and the offline tools alike.
+class TextureCooker
+{
+public:
+  static TextureUsage UsageFromName(const std::string& typeName);
+  static TextureFormat ChooseFormat(TextureUsage usage, bool hasAlpha);
+  static const char* FormatName(TextureFormat format);
+  static size_t BlockBytes(TextureFormat format);
+
+  // pixels: 8 bit, 1-4 channels, rows top to bottom as decoded
+  static bool Cook(const unsigned char* pixels, int width, int height, int channels, TextureUsage usage, TextureFormat format, CompressedTexture& out);
+  static bool Cook(const unsigned char* pixels, int width, int height, int channels, TextureUsage usage, CompressedTexture& out);
+
+  // single 4x4 block encoders, input is 16 RGBA pixels (64 bytes, row major)
+  static void EncodeBC1(const uint8_t* rgba, uint8_t* out);
+  static void EncodeBC3(const uint8_t* rgba, uint8_t* out);
+  static void EncodeBC4(const uint8_t* rgba, int channel, uint8_t* out);
+  static void EncodeBC5(const uint8_t* rgba, uint8_t* out);
+  static void EncodeBC7(const uint8_t* rgba, uint8_t* out);
+
+  // next mip level of an RGBA8 image (2x2 box, odd sizes clamp)
+  static void Downsample(const uint8_t* src, uint32_t width, uint32_t height, TextureUsage usage, std::vector<uint8_t>& dst);
+};
+
+}
@@ -0,0 +1,156 @@
+#include <filesystem>
+#include <sstream>
+#include "GLState.h"
+#include "MeshCache.h"
+#include "TextureRegistry.h"
+#include "TextureStreamer.h"
+
+namespace NullEngine
+{
+
+TextureRegistry& TextureRegistry::Instance()
+{
+  static TextureRegistry registry;
+  return registry;
+}
+
+uint64_t TextureRegistry::ContentHash(const std::string& absolutePath)
+{
+  FileStamp stamp;
+  if (!MeshCache::Stamp(absolutePath, stamp))
+    return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto known = _hashes.find(absolutePath);
+    if (known != _hashes.end() && known->second.size == stamp.size && known->second.mtime == stamp.mtime)
+      return known->second.hash;
+  }
+
+  // hashing reads the whole file, keep it outside the lock
+  uint64_t hash = 0;
+  if (!MeshCache::HashSource(absolutePath, stamp, hash))
+    return 0;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _hashes[absolutePath] = {stamp.size, stamp.mtime, hash};
+  return hash;
+}
+
+std::shared_ptr<Texture> TextureRegistry::Acquire(const std::string& name, const std::string& path, bool flip, TextureUsage usage, bool async,
+  int wrapMode)
+{
+  bool created = false;
+  std::shared_ptr<Texture> texture = Lookup(name, path, flip, usage, wrapMode, created);
+  if (!created)
+    return texture;
+
+  // outside the lock: the streamer may drop its references (and so call Release) while holding its own
+  if (async)
+    TextureStreamer::Instance().RequestLoading(texture);
+  else
+    texture->Load();
+  return texture;
+}
+
+std::shared_ptr<Texture> TextureRegistry::AcquireUnloaded(const std::string& name, const std::string& path, bool flip, TextureUsage usage,
+  int wrapMode)
+{
+  bool created = false;
+  return Lookup(name, path, flip, usage, wrapMode, created);
+}
+
+std::shared_ptr<Texture> TextureRegistry::Lookup(const std::string& name, const std::string& path, bool flip, TextureUsage usage, int wrapMode,
+  bool& created)
+{
+  std::error_code ec;
+  std::filesystem::path absolute = std::filesystem::weakly_canonical(path, ec);
+  if (ec)
+    absolute = std::filesystem::absolute(path, ec).lexically_normal();
+  const std::string absolutePath = absolute.generic_string();
+  const uint64_t hash = ContentHash(absolutePath);
+
+  std::ostringstream keyStream;
+  keyStream << absolutePath << '|' << std::hex << hash << std::dec << '|' << name << '|' << (int)usage << '|' << (flip ? 1 : 0) << '|' << wrapMode;
+  const std::string key = keyStream.str();
+
+  std::shared_ptr<Texture> texture;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry& entry = _entries[key];
+    texture = entry.texture.lock();
+    created = !texture;
+    if (texture)
+    {
+      ++_hits;
+      return texture;
+    }
+
+    ++_misses;
+    texture = std::shared_ptr<Texture>(new Texture(name, path, wrapMode, flip), [key](Texture* t) { TextureRegistry::Instance().Release(key, t); });
+    texture->SetUsage(usage);
+    texture->_state = TextureState::Loading;
+    entry.texture = texture;
+    entry.object = texture.get();
+  }
+  return texture;
+}
+
+void TextureRegistry::Release(const std::string& key, Texture* texture)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // the key may already belong to a newer texture that was loaded after this one expired
+    auto entry = _entries.find(key);
+    if (entry != _entries.end() && entry->second.object == texture)
+      _entries.erase(entry);
+
+    // loading/failed textures still point at the streamer's shared placeholder
+    if (texture->_state == TextureState::Ready)
+    {
+      _garbage.push_back(texture->_glId);
+      ++_released;
+    }
+  }
+  delete texture;
+}
+
+void TextureRegistry::CollectGarbage()
+{
+  std::vector<unsigned> garbage;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    garbage.swap(_garbage);
+  }
+  if (!garbage.empty())
+    GLState::Instance().DeleteTextures((GLsizei)garbage.size(), garbage.data());
+}
+
+void TextureRegistry::Shutdown()
+{
+  CollectGarbage();
+}
+
+TextureRegistryStats TextureRegistry::Stats() const
+{
+  TextureRegistryStats stats;
+  std::vector<std::shared_ptr<Texture>> alive;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.released = _released;
+    alive.reserve(_entries.size());
+    for (const auto& entry : _entries)
+      if (auto texture = entry.second.texture.lock())
+        alive.push_back(std::move(texture));
+  }
+
+  // summed (and the references dropped) outside the lock, dropping the last one calls Release
+  stats.textures = alive.size();
+  for (const auto& texture : alive)
+    stats.residentBytes += texture->GpuBytes();
+  return stats;
+}
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Texture.h"
+
+namespace NullEngine
+{
+
+struct TextureRegistryStats
+{
+  size_t hits = 0;
+  size_t misses = 0;
+  // textures currently alive, and the video memory of the uploaded ones
+  size_t textures = 0;
+  size_t residentBytes = 0;
+  // GL textures freed because their last user went away
+  size_t released = 0;
+};
+
+// Engine wide owner of file textures, shared by every Model and Engine::Main:
+//  - keyed on the absolute path plus the content hash of the file (and name/usage/flip, which
+//    change the GL texture), so equal relative names in different directories stay apart and an
+//    edited file is loaded again
+//  - lookups and inserts are thread safe; entries hold weak references, the returned
+//    shared_ptrs are the refcount. When the last one goes away the GL texture is queued for
+//    deletion and freed by CollectGarbage() on the GL thread.
+class TextureRegistry
+{
+public:
+  static TextureRegistry& Instance();
+
+  // any thread with async set (the texture streams in through TextureStreamer), GL thread otherwise
+  std::shared_ptr<Texture> Acquire(const std::string& name, const std::string& path, bool flip, TextureUsage usage, bool async,
+    int wrapMode = GL_REPEAT);
+  // usage from the name, see TextureCooker::UsageFromName
+  std::shared_ptr<Texture> Acquire(const std::string& name, const std::string& path, bool flip = false, bool async = false)
+  {
+    return Acquire(name, path, flip, TextureCooker::UsageFromName(name), async);
+  }
+
+  // any thread; a texture this call creates is Loading (drawn as the placeholder) but not queued: the caller
+  // decodes it (Texture::PrepareImage) and uploads it (Texture::Load(image)) itself. One acquired earlier
+  // comes back loaded or loading as usual
+  std::shared_ptr<Texture> AcquireUnloaded(const std::string& name, const std::string& path, bool flip, TextureUsage usage,
+    int wrapMode = GL_REPEAT);
+
+  // GL thread, once per frame: deletes the GL textures of released entries
+  void CollectGarbage();
+  // GL thread, before the context is destroyed
+  void Shutdown();
+
+  TextureRegistryStats Stats() const;
+
+private:
+  TextureRegistry() = default;
+
+  struct Entry
+  {
+    std::weak_ptr<Texture> texture;
+    const Texture* object = nullptr;
+  };
+
+  // content hash of a file, only read again when its size/mtime change
+  struct HashedFile
+  {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+  };
+
+  // existing entry or a new texture (created set), published already in Loading so a concurrent hit
+  // draws the placeholder until the creator's load finishes
+  std::shared_ptr<Texture> Lookup(const std::string& name, const std::string& path, bool flip, TextureUsage usage, int wrapMode,
+    bool& created);
+  // shared_ptr deleter, any thread
+  void Release(const std::string& key, Texture* texture);
+  uint64_t ContentHash(const std::string& absolutePath);
+
+  mutable std::mutex _mutex;
+  std::unordered_map<std::string, Entry> _entries;
+  std::unordered_map<std::string, HashedFile> _hashes;
+  std::vector<unsigned> _garbage;
+  size_t _hits = 0;
+  size_t _misses = 0;
+  size_t _released = 0;
+};
+
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include "TextureResidency.h"
+
+namespace NullEngine
+{
+
+TextureResidency& TextureResidency::Instance()
+{
+  static TextureResidency residency;
+  return residency;
+}
+
+void TextureResidency::Track(const std::shared_ptr<TextureBase>& texture)
+{
+  if (!texture || texture->_tracked)
+    return;
+  texture->_tracked = true;
+  texture->_lastUsedFrame = _frame;
+  _textures.push_back(texture);
+}
+
+bool TextureResidency::CanDrop(const TextureBase& texture)
+{
+  const unsigned next = texture._droppedLevels + 1;
+  return texture._state == TextureState::Ready && !texture._restorePending && next < texture._levels
+    && (std::max(texture._width, texture._height) >> next) >= MinResidentSize;
+}
+
+void TextureResidency::Update()
+{
+  ++_frame;
+
+  std::vector<std::shared_ptr<TextureBase>> alive;
+  alive.reserve(_textures.size());
+  size_t write = 0;
+  for (auto& weak : _textures)
+  {
+    if (auto texture = weak.lock())
+    {
+      alive.push_back(std::move(texture));
+      _textures[write++] = std::move(weak);
+    }
+  }
+  _textures.resize(write);
+
+  size_t resident = 0;
+  for (const auto& texture : alive)
+    resident += texture->_gpuBytes;
+
+  // used last frame again: bring the full chain back if it fits
+  unsigned restores = 0;
+  for (const auto& texture : alive)
+  {
+    if (restores >= MaxRestoresPerFrame)
+      break;
+    if (texture->_droppedLevels == 0 || texture->_restorePending || _frame - texture->_lastUsedFrame > 1)
+      continue;
+    size_t extra = texture->ChainBytes(0) - texture->_gpuBytes;
+    if (resident + extra > _budget)
+      continue;
+    texture->Restore();
+    // counted as resident right away, so this frame does not evict for it or restore past the budget
+    resident += extra;
+    ++restores;
+    ++_stats.restores;
+  }
+
+  // over budget: drop levels of the least recently used cold textures
+  if (resident > _budget)
+  {
+    std::vector<TextureBase*> cold;
+    for (const auto& texture : alive)
+      if (_frame - texture->_lastUsedFrame >= ColdFrames && CanDrop(*texture))
+        cold.push_back(texture.get());
+    std::sort(cold.begin(), cold.end(), [](const TextureBase* a, const TextureBase* b) { return a->_lastUsedFrame < b->_lastUsedFrame; });
+
+    unsigned drops = 0;
+    for (TextureBase* texture : cold)
+    {
+      while (resident > _budget && drops < MaxDropsPerFrame && CanDrop(*texture))
+      {
+        size_t freed = texture->DropLevels(1);
+        if (freed == 0)
+          break;
+        resident -= freed;
+        ++drops;
+        ++_stats.levelsDropped;
+        _stats.bytesEvicted += freed;
+      }
+      if (resident <= _budget || drops >= MaxDropsPerFrame)
+        break;
+    }
+  }
+
+  _stats.budget = _budget;
+  _stats.textures = alive.size();
+  _stats.residentBytes = 0;
+  _stats.reduced = 0;
+  _stats.pendingRestores = 0;
+  for (const auto& texture : alive)
+  {
+    _stats.residentBytes += texture->_gpuBytes;
+    _stats.reduced += texture->_droppedLevels ? 1 : 0;
+    _stats.pendingRestores += texture->_restorePending ? 1 : 0;
+  }
+}
+
+}
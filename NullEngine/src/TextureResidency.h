@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Texture.h"
+
+namespace NullEngine
+{
+
+struct TextureResidencyStats
+{
+  size_t budget = 0;
+  size_t residentBytes = 0;
+  size_t textures = 0;
+  // textures currently below full resolution, and those waiting for their levels to come back
+  size_t reduced = 0;
+  size_t pendingRestores = 0;
+  // totals since start
+  size_t levelsDropped = 0;
+  size_t bytesEvicted = 0;
+  size_t restores = 0;
+};
+
+// Keeps the video memory of the tracked textures within a budget:
+//  - TextureBase::Use() (also what Mesh::Draw binds through) stamps the frame a texture was used in
+//  - over budget, the top mip levels of textures unused for ColdFrames are dropped, least
+//    recently used first; the smaller chain is copied on the GPU, nothing is read back
+//  - a reduced texture that is used again gets its full chain back (Restore: the .ktx2 cache or
+//    source image through TextureStreamer, cube maps reload their faces) once it fits the budget
+// GL thread only.
+class TextureResidency
+{
+public:
+  static TextureResidency& Instance();
+
+  // tracking ends when the texture is destroyed; Texture tracks itself on upload when owned by a shared_ptr
+  void Track(const std::shared_ptr<TextureBase>& texture);
+
+  // once per frame after TextureStreamer::Update: starts the next frame, restores and evicts
+  void Update();
+
+  uint64_t Frame() const { return _frame; }
+  void SetBudget(size_t bytes) { _budget = bytes; }
+  size_t Budget() const { return _budget; }
+  const TextureResidencyStats& Stats() const { return _stats; }
+
+  // frames a texture has to be unused before its levels are dropped
+  static constexpr uint64_t ColdFrames = 120;
+  // never drop below this size of the top level
+  static constexpr int MinResidentSize = 64;
+  // spread the GPU copies / reloads over frames
+  static constexpr unsigned MaxDropsPerFrame = 8;
+  static constexpr unsigned MaxRestoresPerFrame = 2;
+
+private:
+  TextureResidency() = default;
+
+  static bool CanDrop(const TextureBase& texture);
+
+  std::vector<std::weak_ptr<TextureBase>> _textures;
+  uint64_t _frame = 1;
+  size_t _budget = 256 * 1024 * 1024;
+  TextureResidencyStats _stats;
+};
+
+}
@@ -0,0 +1,266 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include "GLState.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+TextureStreamer& TextureStreamer::Instance()
+{
+  static TextureStreamer streamer;
+  return streamer;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  // no GL here, the context is usually gone by now - see Shutdown()
+  WaitForDecodes();
+  for (auto& decoded : _decoded)
+    decoded.image.Release();
+}
+
+unsigned TextureStreamer::Placeholder() const
+{
+  assert(_placeholder && "TextureStreamer::Placeholder before the first Update");
+  return _placeholder;
+}
+
+bool TextureStreamer::Request(std::shared_ptr<Texture> texture, bool reload)
+{
+  if (!texture)
+    return false;
+
+  // a texture's GL name is only touched on the GL thread; while Loading, Id() is the placeholder
+  TextureState state = texture->_state;
+  for (;;)
+  {
+    if (state == TextureState::Loading)
+      return false;
+    if (state == TextureState::Ready)
+    {
+      if (!reload)
+        return false;
+      break;
+    }
+    // Unloaded/Failed: whoever switches it to Loading decodes it
+    if (texture->_state.compare_exchange_weak(state, TextureState::Loading))
+    {
+      reload = false;
+      break;
+    }
+  }
+  Queue(std::move(texture), reload);
+  return true;
+}
+
+void TextureStreamer::RequestLoading(std::shared_ptr<Texture> texture)
+{
+  assert(texture && texture->_state == TextureState::Loading);
+  Queue(std::move(texture), false);
+}
+
+void TextureStreamer::Queue(std::shared_ptr<Texture> texture, bool reload)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_inFlight;
+  }
+
+  ThreadPool::Instance().Submit([this, texture, reload]()
+  {
+    TextureImage image = texture->PrepareImage();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _decoded.push_back({texture, image, reload});
+    if (--_inFlight == 0)
+      _decodesDone.notify_all();
+  });
+}
+
+void TextureStreamer::InitGL()
+{
+  if (_glReady)
+    return;
+
+  for (auto& buffer : _ring)
+    glGenBuffers(1, &buffer.id);
+
+  const unsigned char grey[4] = {128, 128, 128, 255};
+  glGenTextures(1, &_placeholder);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, _placeholder);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+  GLState::Instance().BindTexture(GL_TEXTURE_2D, 0);
+  _glReady = true;
+}
+
+bool TextureStreamer::UploadOne(Decoded& decoded, bool wait)
+{
+  GLState& gl = GLState::Instance();
+  PixelBuffer& slot = _ring[_ringNext];
+  if (slot.fence)
+  {
+    GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      return false;
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+  }
+
+  const TextureImage& image = decoded.image;
+  const CompressedTexture* compressed = image.compressed.get();
+  size_t bytes = compressed ? compressed->data.size() : (size_t)image.width * image.height * image.channels;
+  const void* src = compressed ? static_cast<const void*>(compressed->data.data()) : image.pixels;
+
+  gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+  // orphan the previous storage, the driver can hand us fresh memory without a sync
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, nullptr, GL_STREAM_DRAW);
+  void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (dst)
+  {
+    std::memcpy(dst, src, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    // with a PBO bound the "pixels" pointer is an offset into it
+    if (compressed)
+      decoded.texture->UploadCompressed(*compressed, true);
+    else
+      decoded.texture->Upload(nullptr, image.width, image.height, image.channels);
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _ringNext = (_ringNext + 1) % RingSize;
+  }
+  else
+  {
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (compressed)
+      decoded.texture->UploadCompressed(*compressed, false);
+    else
+      decoded.texture->Upload(image.pixels, image.width, image.height, image.channels);
+  }
+
+  decoded.image.Release();
+  _uploadedLastFrame += bytes;
+  _totalUploaded += bytes;
+  return true;
+}
+
+void TextureStreamer::FailOne(Decoded& decoded)
+{
+  // a failed reload keeps the texture it already has
+  if (decoded.reload)
+    decoded.texture->_restorePending = false;
+  else
+    decoded.texture->_state = TextureState::Failed;
+}
+
+void TextureStreamer::Update()
+{
+  InitGL();
+  _uploadedLastFrame = 0;
+
+  // always upload at least one texture per frame, so one bigger than the budget still gets through
+  while (_uploadedLastFrame == 0 || _uploadedLastFrame < _frameBudget)
+  {
+    Decoded decoded;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_decoded.empty())
+        break;
+      decoded = std::move(_decoded.front());
+      _decoded.pop_front();
+    }
+
+    if (!decoded.image.Valid())
+    {
+      std::cout << "Texture failed to load: " << decoded.texture->Path() << std::endl;
+      FailOne(decoded);
+      continue;
+    }
+
+    if (!UploadOne(decoded, false))
+    {
+      // ring still busy on the GPU, try again next frame
+      std::lock_guard<std::mutex> lock(_mutex);
+      _decoded.push_front(std::move(decoded));
+      break;
+    }
+  }
+}
+
+void TextureStreamer::Flush()
+{
+  InitGL();
+  WaitForDecodes();
+
+  for (;;)
+  {
+    Decoded decoded;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_decoded.empty())
+        break;
+      decoded = std::move(_decoded.front());
+      _decoded.pop_front();
+    }
+
+    if (!decoded.image.Valid())
+    {
+      std::cout << "Texture failed to load: " << decoded.texture->Path() << std::endl;
+      FailOne(decoded);
+      continue;
+    }
+
+    while (!UploadOne(decoded, true))
+      ;
+  }
+}
+
+void TextureStreamer::WaitForDecodes()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _decodesDone.wait(lock, [this]() { return _inFlight == 0; });
+}
+
+size_t TextureStreamer::PendingDecodes() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _inFlight;
+}
+
+size_t TextureStreamer::PendingUploads() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _decoded.size();
+}
+
+void TextureStreamer::Shutdown()
+{
+  WaitForDecodes();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& decoded : _decoded)
+      decoded.image.Release();
+    _decoded.clear();
+  }
+
+  if (!_glReady)
+    return;
+
+  for (auto& buffer : _ring)
+  {
+    if (buffer.fence)
+      glDeleteSync(buffer.fence);
+    GLState::Instance().DeleteBuffers(1, &buffer.id);
+    buffer = PixelBuffer();
+  }
+  GLState::Instance().DeleteTextures(1, &_placeholder);
+  _placeholder = 0;
+  _glReady = false;
+}
+
+}
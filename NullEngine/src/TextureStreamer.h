@@ -0,0 +1,91 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "Texture.h"
+
+namespace NullEngine
+{
+
+// Background texture loading:
+//  - stb decode (or reading/cooking the .ktx2, see Texture::Prepare) runs on the ThreadPool
+//  - Update() (GL thread, once per frame) copies decoded images into a ring of pixel buffer
+//    objects and creates the GL textures from them, limited by a per-frame byte budget
+//  - until its upload is done a texture's Id() is a shared 1x1 placeholder, so meshes can
+//    be drawn right away and pick up the real texture on a later frame
+class TextureStreamer
+{
+public:
+  static TextureStreamer& Instance();
+
+  // any thread, no GL; false if the texture is already loading/loaded (one caller wins the switch
+  // to Loading). With reload a loaded texture keeps drawing with its current GL texture until the
+  // new chain replaces it (TextureResidency)
+  bool Request(std::shared_ptr<Texture> texture, bool reload = false);
+  // any thread; queues a texture the caller already switched to Loading itself (TextureRegistry
+  // publishes new entries that way, so other threads never see them unloaded)
+  void RequestLoading(std::shared_ptr<Texture> texture);
+
+  // GL thread, once per frame
+  void Update();
+  // GL thread; uploads everything that is queued, waiting for pending decodes (no budget)
+  void Flush();
+  // GL thread, before the context is destroyed
+  void Shutdown();
+
+  void SetFrameBudget(size_t bytes) { _frameBudget = bytes; }
+  size_t FrameBudget() const { return _frameBudget; }
+
+  // GL thread, created by the first Update/Flush
+  unsigned Placeholder() const;
+
+  // statistics
+  size_t PendingDecodes() const;
+  size_t PendingUploads() const;
+  size_t UploadedLastFrame() const { return _uploadedLastFrame; }
+  size_t TotalUploaded() const { return _totalUploaded; }
+
+private:
+  TextureStreamer() = default;
+  ~TextureStreamer();
+
+  struct Decoded
+  {
+    std::shared_ptr<Texture> texture;
+    TextureImage image;
+    bool reload = false;
+  };
+
+  struct PixelBuffer
+  {
+    unsigned id = 0;
+    GLsync fence = nullptr;
+  };
+
+  static constexpr unsigned RingSize = 3;
+
+  // false if the ring slot is still in use by the GPU (and wait is not set)
+  bool UploadOne(Decoded& decoded, bool wait);
+  void FailOne(Decoded& decoded);
+  void InitGL();
+  // the decode on a worker, state already claimed
+  void Queue(std::shared_ptr<Texture> texture, bool reload);
+  void WaitForDecodes();
+
+  mutable std::mutex _mutex;
+  std::condition_variable _decodesDone;
+  std::deque<Decoded> _decoded;
+  size_t _inFlight = 0;
+
+  PixelBuffer _ring[RingSize];
+  unsigned _ringNext = 0;
+  unsigned _placeholder = 0;
+  bool _glReady = false;
+
+  size_t _frameBudget = 8 * 1024 * 1024;
+  size_t _uploadedLastFrame = 0;
+  size_t _totalUploaded = 0;
+};
+
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <exception>
+#include "ThreadPool.h"
+
+namespace NullEngine
+{
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+  if (threadCount == 0)
+  {
+    unsigned hw = std::thread::hardware_concurrency();
+    threadCount = hw > 1 ? hw - 1 : 1;
+  }
+
+  _workers.reserve(threadCount);
+  for (unsigned i = 0; i < threadCount; ++i)
+    _workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+
+  for (auto& worker : _workers)
+    worker.join();
+}
+
+ThreadPool& ThreadPool::Instance()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::Enqueue(std::function<void()>&& job)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push(std::move(job));
+  }
+  _cv.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cv.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+      if (_stop && _jobs.empty())
+        return;
+
+      job = std::move(_jobs.front());
+      _jobs.pop();
+    }
+    job();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+  if (count == 0)
+    return;
+
+  if (count == 1 || _workers.empty())
+  {
+    for (size_t i = 0; i < count; ++i)
+      fn(i);
+    return;
+  }
+
+  // shared between the caller and the helpers; helpers that start late just find no work left
+  struct State
+  {
+    std::function<void(size_t)> fn;
+    size_t count;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    // first exception thrown by fn (under mutex); the remaining indices are skipped but still counted
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+  };
+
+  auto state = std::make_shared<State>();
+  state->fn = fn;
+  state->count = count;
+
+  auto work = [](State& s)
+  {
+    for (size_t i = s.next++; i < s.count; i = s.next++)
+    {
+      if (!s.failed)
+      {
+        try
+        {
+          s.fn(i);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(s.mutex);
+          if (!s.error)
+            s.error = std::current_exception();
+          s.failed = true;
+        }
+      }
+      if (++s.done == s.count)
+      {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.finished.notify_all();
+      }
+    }
+  };
+
+  size_t helpers = std::min<size_t>(count - 1, _workers.size());
+  for (size_t i = 0; i < helpers; ++i)
+    Enqueue([state, work]() { work(*state); });
+
+  work(*state);
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&]() { return state->done == state->count; });
+  // every helper is done with fn, rethrow on the caller
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+} // namespace NullEngine
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace NullEngine
+{
+
+// Simple fixed-size worker pool used for CPU side asset work (mesh conversion, decoding, ...).
+// Never call GL from a job - there is no context on the worker threads.
+class ThreadPool
+{
+public:
+  // 0 = one worker per hardware thread (minus the calling thread)
+  explicit ThreadPool(unsigned threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Engine wide pool
+  static ThreadPool& Instance();
+
+  // Queue a job, the returned future holds its result
+  template<typename F>
+  auto Submit(F&& job) -> std::future<decltype(job())>
+  {
+    using R = decltype(job());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(job));
+    std::future<R> result = task->get_future();
+    Enqueue([task]() { (*task)(); });
+    return result;
+  }
+
+  // Runs fn(i) for every i in [0, count). The calling thread takes part in the work,
+  // so it is safe to call from inside another job. If fn throws, the indices not started yet are
+  // skipped and the first exception is rethrown here once every thread has left fn.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  unsigned Size() const { return (unsigned)_workers.size(); }
+
+private:
+  void Enqueue(std::function<void()>&& job);
+  void WorkerLoop();
+
+  std::vector<std::thread> _workers;
+  std::queue<std::function<void()>> _jobs;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _stop = false;
+};
+
+} // namespace NullEngine
@@ -0,0 +1,18 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+namespace NullEngine
+{
+
+// Uniforms engine code sets on every draw, hashed at compile time
+namespace Uniforms
+{
+  constexpr UniformHandle Model("model");
+  // VertexFormat::Quantized decode
+  constexpr UniformHandle PosOffset("posOffset");
+  constexpr UniformHandle PosScale("posScale");
+  constexpr UniformHandle OctNormals("octNormals");
+}
+
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include "VertexQuantizer.h"
+
+namespace NullEngine
+{
+
+namespace
+{
+
+float SignNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+int16_t ToSnorm16(float v)
+{
+  return (int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+float FromSnorm16(int16_t v)
+{
+  return std::max(v / 32767.0f, -1.0f);
+}
+
+} // namespace
+
+void QuantizationError::Merge(const QuantizationError& other)
+{
+  position = std::max(position, other.position);
+  normalDegrees = std::max(normalDegrees, other.normalDegrees);
+  texCoord = std::max(texCoord, other.texCoord);
+}
+
+glm::vec2 VertexQuantizer::OctEncode(const glm::vec3& n)
+{
+  float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  if (l1 <= 0.0f)
+    return glm::vec2(0.0f);
+  glm::vec2 p(n.x / l1, n.y / l1);
+  // fold the lower hemisphere over the diagonals
+  if (n.z < 0.0f)
+    p = glm::vec2((1.0f - std::fabs(p.y)) * SignNotZero(p.x), (1.0f - std::fabs(p.x)) * SignNotZero(p.y));
+  return p;
+}
+
+glm::vec3 VertexQuantizer::OctDecode(const glm::vec2& e)
+{
+  glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+  if (n.z < 0.0f)
+  {
+    float x = n.x, y = n.y;
+    n.x = (1.0f - std::fabs(y)) * SignNotZero(x);
+    n.y = (1.0f - std::fabs(x)) * SignNotZero(y);
+  }
+  return glm::normalize(n);
+}
+
+void VertexQuantizer::Quantize(const Vertex* vertices, size_t count, std::vector<QuantizedVertex>& out, glm::vec3& offset, glm::vec3& scale)
+{
+  out.resize(count);
+  offset = glm::vec3(0.0f);
+  scale = glm::vec3(1.0f);
+  if (count == 0)
+    return;
+
+  glm::vec3 lo = vertices[0].Position, hi = lo;
+  for (size_t i = 1; i < count; ++i)
+  {
+    lo = glm::min(lo, vertices[i].Position);
+    hi = glm::max(hi, vertices[i].Position);
+  }
+  offset = lo;
+  scale = hi - lo;
+  // flat axis: any scale works, keep it non-zero for the division
+  for (int a = 0; a < 3; ++a)
+    if (scale[a] <= 0.0f)
+      scale[a] = 1.0f;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const Vertex& v = vertices[i];
+    QuantizedVertex& q = out[i];
+    for (int a = 0; a < 3; ++a)
+      q.position[a] = (uint16_t)std::lround(std::clamp((v.Position[a] - offset[a]) / scale[a], 0.0f, 1.0f) * 65535.0f);
+    q.position[3] = 0;
+
+    glm::vec2 e = OctEncode(v.Normal);
+    q.normal[0] = ToSnorm16(e.x);
+    q.normal[1] = ToSnorm16(e.y);
+
+    q.texCoords[0] = glm::packHalf1x16(v.TexCoords.x);
+    q.texCoords[1] = glm::packHalf1x16(v.TexCoords.y);
+  }
+}
+
+Vertex VertexQuantizer::Dequantize(const QuantizedVertex& q, const glm::vec3& offset, const glm::vec3& scale)
+{
+  Vertex v;
+  for (int a = 0; a < 3; ++a)
+    v.Position[a] = offset[a] + q.position[a] / 65535.0f * scale[a];
+  v.Normal = OctDecode(glm::vec2(FromSnorm16(q.normal[0]), FromSnorm16(q.normal[1])));
+  v.TexCoords = glm::vec2(glm::unpackHalf1x16(q.texCoords[0]), glm::unpackHalf1x16(q.texCoords[1]));
+  return v;
+}
+
+QuantizationError VertexQuantizer::Measure(const Vertex* vertices, const QuantizedVertex* quantized, size_t count, const glm::vec3& offset, const glm::vec3& scale)
+{
+  QuantizationError error;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const Vertex& v = vertices[i];
+    Vertex d = Dequantize(quantized[i], offset, scale);
+
+    for (int a = 0; a < 3; ++a)
+      error.position = std::max(error.position, std::fabs(d.Position[a] - v.Position[a]) / scale[a]);
+
+    float len = glm::length(v.Normal);
+    if (len > 0.0f)
+    {
+      float cosAngle = std::clamp(glm::dot(v.Normal / len, d.Normal), -1.0f, 1.0f);
+      error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosAngle)));
+    }
+
+    for (int a = 0; a < 2; ++a)
+      error.texCoord = std::max(error.texCoord, std::fabs(d.TexCoords[a] - v.TexCoords[a]) / std::max(1.0f, std::fabs(v.TexCoords[a])));
+  }
+  return error;
+}
+
+}
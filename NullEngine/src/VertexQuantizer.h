@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+namespace NullEngine
+{
+
+// 16 byte vertex, half of NullEngine::Vertex:
+//  - position: unorm16 relative to the mesh AABB (shader: posOffset + aPos * posScale)
+//  - normal:   octahedral encoded snorm16 x2 (shader: OctDecode when octNormals is set)
+//  - texcoord: half floats
+struct QuantizedVertex
+{
+  uint16_t position[4];
+  int16_t normal[2];
+  uint16_t texCoords[2];
+};
+static_assert(sizeof(QuantizedVertex) == 16, "QuantizedVertex must stay 16 bytes");
+
+// Largest error quantization introduced in a set of vertices
+struct QuantizationError
+{
+  // tolerances: unorm16 step (half a step is the rounding error), octahedral snorm16, half float
+  static constexpr float PositionTolerance = 1.0f / 65535.0f;  // relative to the AABB extent
+  static constexpr float NormalToleranceDegrees = 0.05f;
+  static constexpr float TexCoordTolerance = 1.0f / 1024.0f;   // relative to max(1, |uv|)
+
+  float position = 0.0f;         // relative to the AABB extent of the axis
+  float normalDegrees = 0.0f;
+  float texCoord = 0.0f;         // relative to max(1, |uv|)
+
+  bool WithinTolerance() const
+  {
+    return position <= PositionTolerance && normalDegrees <= NormalToleranceDegrees && texCoord <= TexCoordTolerance;
+  }
+  void Merge(const QuantizationError& other);
+};
+
+class VertexQuantizer
+{
+public:
+  // offset/scale receive the dequantization transform: position = offset + unorm * scale
+  static void Quantize(const Vertex* vertices, size_t count, std::vector<QuantizedVertex>& out, glm::vec3& offset, glm::vec3& scale);
+  static Vertex Dequantize(const QuantizedVertex& vertex, const glm::vec3& offset, const glm::vec3& scale);
+  static QuantizationError Measure(const Vertex* vertices, const QuantizedVertex* quantized, size_t count, const glm::vec3& offset, const glm::vec3& scale);
+
+  // unit vector <-> [-1, 1]^2, same mapping as OctDecode in the shaders
+  static glm::vec2 OctEncode(const glm::vec3& n);
+  static glm::vec3 OctDecode(const glm::vec2& e);
+};
+
+}
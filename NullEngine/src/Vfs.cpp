@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "AssetPack.h"
+#include "ThreadPool.h"
+#include "Vfs.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace NullEngine
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+double MsSince(Clock::time_point t)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// what Shader/Texture/Model did before the Vfs: a blocking stream read on the calling thread
+bool ReadStream(const std::string& path, std::vector<uint8_t>& out)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return false;
+  out.resize((size_t)file.tellg());
+  file.seekg(0);
+  return file.read(reinterpret_cast<char*>(out.data()), (std::streamsize)out.size()) || out.empty();
+}
+
+// evicts the files from the page cache so the next read goes to the disk; false where not possible
+bool DropPageCache(const std::vector<std::string>& files)
+{
+#ifdef __linux__
+  bool dropped = true;
+  for (const auto& path : files)
+  {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      continue;
+    dropped &= posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+  }
+  return dropped;
+#else
+  (void)files;
+  return false;
+#endif
+}
+
+} // namespace
+
+#ifdef __linux__
+
+// The io_uring instance, set up with the raw syscalls (no liburing dependency)
+struct Vfs::Ring
+{
+  int fd = -1;
+  void* sqRing = nullptr;
+  size_t sqRingSize = 0;
+  void* cqRing = nullptr;
+  size_t cqRingSize = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqesSize = 0;
+
+  unsigned* sqTail = nullptr;
+  unsigned* sqMask = nullptr;
+  unsigned* sqArray = nullptr;
+  unsigned* cqHead = nullptr;
+  unsigned* cqTail = nullptr;
+  unsigned* cqMask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+
+  bool Init(unsigned entries)
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+      return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+      return false;
+    cqRing = single ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+      return false;
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+      return false;
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  ~Ring()
+  {
+    if (sqes && sqes != MAP_FAILED)
+      munmap(sqes, sqesSize);
+    if (cqRing && cqRing != MAP_FAILED && cqRing != sqRing)
+      munmap(cqRing, cqRingSize);
+    if (sqRing && sqRing != MAP_FAILED)
+      munmap(sqRing, sqRingSize);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  // queues a readv, made visible to the kernel by the next Enter
+  void PrepareRead(int file, iovec* iov, uint64_t offset, uint64_t userData)
+  {
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe& sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = file;
+    sqe.addr = reinterpret_cast<uint64_t>(iov);
+    sqe.len = 1;
+    sqe.off = offset;
+    sqe.user_data = userData;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  int Enter(unsigned toSubmit, unsigned minComplete)
+  {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+  }
+};
+
+// one read in the ring
+struct Vfs::Slot
+{
+  Request request;
+  int fd = -1;
+  std::vector<uint8_t> data;
+  size_t done = 0;
+  iovec iov = {};
+};
+
+#else
+
+// no io_uring here, everything runs on the ThreadPool
+struct Vfs::Ring
+{
+};
+
+struct Vfs::Slot
+{
+};
+
+#endif
+
+Vfs& Vfs::Instance()
+{
+  static Vfs vfs;
+  return vfs;
+}
+
+Vfs::Vfs()
+{
+#ifdef __linux__
+  auto ring = std::make_unique<Ring>();
+  if (ring->Init(QueueDepth))
+  {
+    _ring = std::move(ring);
+    _ioThread = std::thread(&Vfs::IoLoop, this);
+  }
+  else
+    std::cout << "VFS::io_uring unavailable (" << std::strerror(errno) << "), reading on the thread pool" << std::endl;
+#endif
+  _stats.backend = _ring ? "io_uring" : "thread pool";
+}
+
+Vfs::~Vfs()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  if (_ioThread.joinable())
+    _ioThread.join();
+}
+
+void Vfs::BeginRead()
+{
+  std::lock_guard<std::mutex> lock(_statsMutex);
+  if (_stats.inFlight++ == 0)
+    _busySince = Clock::now();
+  _stats.maxInFlight = std::max(_stats.maxInFlight, _stats.inFlight);
+}
+
+void Vfs::EndRead(bool ok, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(_statsMutex);
+  ++(ok ? _stats.completed : _stats.failed);
+  _stats.bytesRead += ok ? bytes : 0;
+  if (--_stats.inFlight == 0)
+    _stats.busyMs += MsSince(_busySince);
+}
+
+void Vfs::ReadBlocking(Request& request)
+{
+  BeginRead();
+  std::vector<uint8_t> data;
+  bool ok = ReadStream(request.path, data);
+  EndRead(ok, data.size());
+  if (!ok)
+    data.clear();
+  request.done(ok, data);
+}
+
+void Vfs::Enqueue(std::string path, Completion done, const AssetPackEntry* packEntry)
+{
+  {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    ++_stats.requests;
+  }
+
+  if (packEntry)
+  {
+    // decompression is CPU work, for a worker
+    ThreadPool::Instance().Submit([this, packEntry, done = std::move(done)]()
+    {
+      std::vector<uint8_t> data;
+      bool ok = AssetPack::Instance().Read(*packEntry, data);
+      {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        ++_stats.packReads;
+        ++(ok ? _stats.completed : _stats.failed);
+        _stats.bytesRead += ok ? data.size() : 0;
+      }
+      done(ok, data);
+    });
+    return;
+  }
+
+  if (!_ring)
+  {
+    ThreadPool::Instance().Submit([this, request = Request{std::move(path), std::move(done)}]() mutable { ReadBlocking(request); });
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending.push_back({std::move(path), std::move(done)});
+  }
+  _wake.notify_one();
+}
+
+std::future<VfsFile> Vfs::Read(const std::string& path)
+{
+  auto promise = std::make_shared<std::promise<VfsFile>>();
+  std::future<VfsFile> result = promise->get_future();
+  Enqueue(path, [promise](bool ok, std::vector<uint8_t>& data)
+  {
+    VfsFile file;
+    file.ok = ok;
+    file.data = std::move(data);
+    promise->set_value(std::move(file));
+  }, AssetPack::Instance().Find(path));
+  return result;
+}
+
+void Vfs::Read(const std::string& path, VfsCallback callback)
+{
+  const AssetPackEntry* packEntry = AssetPack::Instance().Find(path);
+  const bool fromRing = _ring && !packEntry;
+  Enqueue(path, [callback = std::move(callback), fromRing](bool ok, std::vector<uint8_t>& data)
+  {
+    if (!fromRing)
+    {
+      callback(ok, data);
+      return;
+    }
+    // off the IO thread, callbacks usually decode/parse
+    ThreadPool::Instance().Submit([callback, ok, data = std::move(data)]() mutable { callback(ok, data); });
+  }, packEntry);
+}
+
+bool Vfs::ReadSync(const std::string& path, std::vector<uint8_t>& out)
+{
+  if (const AssetPackEntry* packEntry = AssetPack::Instance().Find(path))
+  {
+    bool ok = AssetPack::Instance().Read(*packEntry, out);
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    ++_stats.requests;
+    ++_stats.packReads;
+    ++(ok ? _stats.completed : _stats.failed);
+    _stats.bytesRead += ok ? out.size() : 0;
+    return ok;
+  }
+
+  bool ok = false;
+  if (!_ring)
+  {
+    // nothing to batch with, read right here
+    {
+      std::lock_guard<std::mutex> lock(_statsMutex);
+      ++_stats.requests;
+    }
+    Request request{path, [&](bool result, std::vector<uint8_t>& data)
+    {
+      ok = result;
+      out.swap(data);
+    }};
+    ReadBlocking(request);
+    return ok;
+  }
+
+  std::promise<void> finished;
+  Enqueue(path, [&](bool result, std::vector<uint8_t>& data)
+  {
+    ok = result;
+    out.swap(data);
+    finished.set_value();
+  }, nullptr);
+  finished.get_future().wait();
+  return ok;
+}
+
+bool Vfs::ReadText(const std::string& path, std::string& out)
+{
+  std::vector<uint8_t> data;
+  if (!ReadSync(path, data))
+    return false;
+  out.assign(data.begin(), data.end());
+  return true;
+}
+
+bool Vfs::Exists(const std::string& path) const
+{
+  std::error_code error;
+  return AssetPack::Instance().Contains(path) || std::filesystem::is_regular_file(path, error);
+}
+
+VfsStats Vfs::Stats() const
+{
+  VfsStats stats;
+  {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    stats = _stats;
+    if (stats.inFlight)
+      stats.busyMs += MsSince(_busySince);
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  stats.queued = _pending.size();
+  return stats;
+}
+
+void Vfs::IoLoop()
+{
+#ifdef __linux__
+  std::vector<Slot> slots(QueueDepth);
+  std::vector<unsigned> freeSlots;
+  for (unsigned i = QueueDepth; i-- > 0;)
+    freeSlots.push_back(i);
+  unsigned inFlight = 0;
+  unsigned unsubmitted = 0;
+
+  auto finish = [&](unsigned index, bool ok)
+  {
+    Slot& slot = slots[index];
+    if (slot.fd >= 0)
+      close(slot.fd);
+    slot.fd = -1;
+    if (!ok)
+      slot.data.clear();
+    EndRead(ok, slot.data.size());
+    slot.request.done(ok, slot.data);
+    slot.request = Request();
+    slot.data = std::vector<uint8_t>();
+    freeSlots.push_back(index);
+    --inFlight;
+  };
+
+  auto submitRest = [&](unsigned index)
+  {
+    Slot& slot = slots[index];
+    slot.iov.iov_base = slot.data.data() + slot.done;
+    slot.iov.iov_len = slot.data.size() - slot.done;
+    _ring->PrepareRead(slot.fd, &slot.iov, slot.done, index);
+    ++unsubmitted;
+  };
+
+  for (;;)
+  {
+    std::vector<Request> batch;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (inFlight == 0)
+        _wake.wait(lock, [this]() { return _stop || !_pending.empty(); });
+      if (_stop)
+      {
+        // nobody will wait for these anymore
+        for (auto& request : _pending)
+        {
+          std::vector<uint8_t> none;
+          request.done(false, none);
+        }
+        _pending.clear();
+        if (inFlight == 0)
+          break;
+      }
+      while (!_pending.empty() && batch.size() < freeSlots.size())
+      {
+        batch.push_back(std::move(_pending.front()));
+        _pending.pop_front();
+      }
+    }
+
+    // open and size the new files; the reads themselves all go out with one io_uring_enter
+    for (auto& request : batch)
+    {
+      unsigned index = freeSlots.back();
+      freeSlots.pop_back();
+      Slot& slot = slots[index];
+      slot.request = std::move(request);
+      slot.done = 0;
+      ++inFlight;
+      BeginRead();
+
+      struct stat info;
+      slot.fd = open(slot.request.path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (slot.fd < 0 || fstat(slot.fd, &info) != 0 || !S_ISREG(info.st_mode))
+      {
+        finish(index, false);
+        continue;
+      }
+      slot.data.resize((size_t)info.st_size);
+      if (slot.data.empty())
+        finish(index, true);
+      else
+        submitRest(index);
+    }
+
+    if (inFlight == 0)
+      continue;
+
+    int result = _ring->Enter(unsubmitted, 1);
+    {
+      std::lock_guard<std::mutex> lock(_statsMutex);
+      ++_stats.submitCalls;
+    }
+    if (result >= 0)
+      unsubmitted -= std::min((unsigned)result, unsubmitted);
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+      // the ring is unusable, fail what is in it rather than hang
+      std::cout << "ERROR::VFS::io_uring_enter " << std::strerror(errno) << std::endl;
+      for (unsigned i = 0; i < QueueDepth; ++i)
+        if (slots[i].request.done)
+          finish(i, false);
+      unsubmitted = 0;
+      continue;
+    }
+
+    unsigned head = *_ring->cqHead;
+    const unsigned tail = __atomic_load_n(_ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+      const io_uring_cqe& cqe = _ring->cqes[head & *_ring->cqMask];
+      const unsigned index = (unsigned)cqe.user_data;
+      Slot& slot = slots[index];
+      if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+        submitRest(index);
+      else if (cqe.res < 0)
+        finish(index, false);
+      else if (cqe.res == 0)
+      {
+        // the file got shorter since fstat
+        slot.data.resize(slot.done);
+        finish(index, true);
+      }
+      else
+      {
+        slot.done += (size_t)cqe.res;
+        if (slot.done < slot.data.size())
+          submitRest(index);
+        else
+          finish(index, true);
+      }
+    }
+    __atomic_store_n(_ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+#endif
+}
+
+VfsBenchmark Vfs::Benchmark(const std::string& directory)
+{
+  VfsBenchmark result;
+  Vfs& vfs = Instance();
+  result.backend = vfs._ring ? "io_uring" : "thread pool";
+
+  std::vector<std::string> files;
+  std::error_code error;
+  for (std::filesystem::recursive_directory_iterator it(directory, error), end; it != end; it.increment(error))
+  {
+    if (error)
+      break;
+    if (it->is_regular_file(error))
+      files.push_back(it->path().string());
+  }
+
+  // loose files both times, the pack would measure decompression instead
+  result.files = files.size();
+  result.coldCache = DropPageCache(files);
+  auto t = Clock::now();
+  for (const auto& path : files)
+  {
+    std::vector<uint8_t> data;
+    if (ReadStream(path, data))
+      result.bytes += data.size();
+  }
+  result.blockingMs = MsSince(t);
+
+  DropPageCache(files);
+  t = Clock::now();
+  std::vector<std::future<VfsFile>> reads;
+  reads.reserve(files.size());
+  for (const auto& path : files)
+  {
+    auto promise = std::make_shared<std::promise<VfsFile>>();
+    reads.push_back(promise->get_future());
+    vfs.Enqueue(path, [promise](bool ok, std::vector<uint8_t>& data)
+    {
+      VfsFile file;
+      file.ok = ok;
+      file.data = std::move(data);
+      promise->set_value(std::move(file));
+    }, nullptr);
+  }
+  for (auto& read : reads)
+    read.get();
+  result.vfsMs = MsSince(t);
+
+  std::cout << "VFS::BENCHMARK::" << directory << ": " << result.files << " files, " << result.bytes / (1024.0 * 1024.0) << " MB, "
+    << (result.coldCache ? "cold" : "warm") << " cache\n"
+    << "  blocking reads " << result.blockingMs << " ms\n"
+    << "  vfs (" << result.backend << ") " << result.vfsMs << " ms, " << result.Speedup() << "x" << std::endl;
+  return result;
+}
+
+}
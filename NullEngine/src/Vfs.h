@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NullEngine
+{
+
+struct AssetPackEntry;
+
+struct VfsFile
+{
+  bool ok = false;
+  std::vector<uint8_t> data;
+};
+
+// called on a ThreadPool worker with the whole file (data is empty if ok is false)
+using VfsCallback = std::function<void(bool ok, std::vector<uint8_t>& data)>;
+
+struct VfsStats
+{
+  const char* backend = "";
+  // requests waiting for a ring slot, and reads the kernel/workers are working on
+  size_t queued = 0;
+  size_t inFlight = 0;
+  size_t maxInFlight = 0;
+  // totals since start
+  size_t requests = 0;
+  size_t completed = 0;
+  size_t failed = 0;
+  size_t packReads = 0;
+  size_t bytesRead = 0;
+  // io_uring_enter calls, each submits/reaps a batch
+  size_t submitCalls = 0;
+  // time with at least one read in flight, bytesRead / busy time = throughput
+  double busyMs = 0.0;
+
+  double ThroughputMBs() const { return busyMs > 0.0 ? bytesRead / (1024.0 * 1024.0) / (busyMs / 1000.0) : 0.0; }
+};
+
+// Vfs::Benchmark result: the same files read with blocking ifstreams (what the loaders did) and
+// through the Vfs with every request queued up front
+struct VfsBenchmark
+{
+  const char* backend = "";
+  size_t files = 0;
+  size_t bytes = 0;
+  double blockingMs = 0.0;
+  double vfsMs = 0.0;
+  // page cache dropped before each pass (Linux posix_fadvise), warm otherwise
+  bool coldCache = false;
+
+  double Speedup() const { return vfsMs > 0.0 ? blockingMs / vfsMs : 0.0; }
+};
+
+// Whole-file asset reads for every loader (Assimp IO, stb, shaders):
+//  - files in the mounted AssetPack are decompressed from there
+//  - everything else goes through io_uring on Linux: one IO thread keeps up to QueueDepth reads
+//    in the ring and submits/reaps them in batches, so many small reads cost few syscalls
+//  - without io_uring (Windows, old kernels, seccomp) the reads run on the ThreadPool
+// Any thread; completions never wait for the ThreadPool, so ReadSync is safe inside jobs.
+class Vfs
+{
+public:
+  static Vfs& Instance();
+
+  std::future<VfsFile> Read(const std::string& path);
+  void Read(const std::string& path, VfsCallback callback);
+  // blocking, on the calling thread's behalf
+  bool ReadSync(const std::string& path, std::vector<uint8_t>& out);
+  bool ReadText(const std::string& path, std::string& out);
+  // in the pack or on disk
+  bool Exists(const std::string& path) const;
+
+  VfsStats Stats() const;
+  bool UsesIoUring() const { return _ring != nullptr; }
+
+  // reads every file under directory twice, see VfsBenchmark; prints the result
+  static VfsBenchmark Benchmark(const std::string& directory);
+
+  static constexpr unsigned QueueDepth = 64;
+
+private:
+  Vfs();
+  ~Vfs();
+
+  // runs on the IO thread (io_uring) or a worker (fallback); must be cheap
+  using Completion = std::function<void(bool ok, std::vector<uint8_t>& data)>;
+
+  struct Request
+  {
+    std::string path;
+    Completion done;
+  };
+
+  struct Ring;
+  struct Slot;
+
+  // packEntry: the path's entry in the mounted AssetPack, looked up once by the caller; null reads the loose file
+  void Enqueue(std::string path, Completion done, const AssetPackEntry* packEntry);
+  void ReadBlocking(Request& request);
+  void IoLoop();
+  void BeginRead();
+  void EndRead(bool ok, size_t bytes);
+
+  std::unique_ptr<Ring> _ring;
+  std::thread _ioThread;
+  mutable std::mutex _mutex;
+  std::condition_variable _wake;
+  std::deque<Request> _pending;
+  bool _stop = false;
+
+  mutable std::mutex _statsMutex;
+  VfsStats _stats;
+  std::chrono::steady_clock::time_point _busySince;
+};
+
+}